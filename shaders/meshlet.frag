@@ -0,0 +1,14 @@
+// Vertex color under a fixed directional light until materials are bound. Input is VertexOutput of
+// meshlet_common.hlsl, repeated here so the push constants aren't pulled into the fragment stage
+struct FragmentInput {
+    float4 position : SV_Position;
+    [[vk::location(0)]] float3 normal : NORMAL;
+    [[vk::location(1)]] float2 uv : TEXCOORD0;
+    [[vk::location(2)]] float4 color : COLOR0;
+};
+
+float4 main(FragmentInput input) : SV_Target0 {
+    float3 light_direction = normalize(float3(0.3, 1.0, 0.5));
+    float diffuse = max(dot(normalize(input.normal), light_direction), 0.0);
+    return float4(input.color.rgb * (0.15 + 0.85 * diffuse), input.color.a);
+}
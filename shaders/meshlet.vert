@@ -0,0 +1,10 @@
+// Vertex pulling for the compute culling path, the culled index buffer holds scene-wide vertex numbers
+#include "meshlet_common.hlsl"
+
+[[vk::push_constant]] PushConstants push_constants;
+
+// instance_cull.comp puts the instance's number in firstInstance, which SV_InstanceID (InstanceIndex) counts from
+VertexOutput main(uint vertex : SV_VertexID, uint instance_index : SV_InstanceID) {
+    DrawInstance instance = load_instance(push_constants.instances, instance_index);
+    return shade_vertex(vertex, world_position(vertex, instance), instance, load_view(push_constants.view));
+}
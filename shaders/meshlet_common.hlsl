@@ -0,0 +1,310 @@
+// Shared by the meshlet shaders. Everything but the depth pyramid is read through the buffer device addresses in the
+// push constants and the instance, the layouts have to match MeshletPushConstants, MeshletViewData,
+// MeshletDrawInstance and MeshletCullCounters in incandescent_meshlet_renderer.h and Meshlet and PackedVertex in
+// incandescent_loader.h.
+
+#define QUANTIZE_POSITIONS 1 // Has to match QUANTIZE_POSITIONS in incandescent_loader.h
+#if QUANTIZE_POSITIONS
+#define POSITION_SIZE 8
+#else
+#define POSITION_SIZE 12
+#endif
+#define VERTEX_STRIDE (POSITION_SIZE + 12)
+
+#define MAX_MESHLET_VERTICES 64
+#define MAX_MESHLET_TRIANGLES 124
+#define MESHLET_STRIDE 64
+#define DRAW_INSTANCE_STRIDE 144
+#define WORK_ITEM_STRIDE 8
+#define TASK_WORKGROUP_SIZE 32
+#define MAX_WORKGROUPS_PER_DIMENSION 65535
+
+// Words of MeshletCullCounters
+#define COUNTER_WORKGROUPS 0 // x, y and z of the meshlet pass
+#define COUNTER_WORK_ITEMS 3
+#define COUNTER_DRAW_COUNTS 4 // One per bucket
+
+#define INSTANCE_CONE_CULLING 1
+#define INSTANCE_MIRRORED 2
+
+// Each shader declares its own push constant block, the meshlet passes' are these
+struct PushConstants {
+    uint64_t view;
+    uint64_t instances;
+    uint64_t work_items;
+    uint64_t counters;
+    uint occlusion_culling; // Meshlets are tested against the depth pyramid too
+};
+
+struct ViewData {
+    float4x4 view_projection;
+    float4 frustum_planes[5]; // Left, right, bottom, top, near, pointing inwards
+    float3 camera_position;
+    uint2 viewport_size;
+    uint depth_pyramid_mip_count;
+};
+
+struct DrawInstance {
+    float4x4 world;
+    float3 position_offset;
+    float max_scale;
+    float3 position_scale;
+    uint first_meshlet;
+    uint meshlet_count;
+    uint draw_command;
+    uint flags;
+    // The mesh's buffer, biased so the scene-wide vertex and meshlet numbers land in it
+    uint64_t vertices;
+    uint64_t meshlets;
+    uint64_t meshlet_vertices;
+    uint64_t meshlet_triangles;
+};
+
+// Meshlets first_meshlet onwards of one instance, up to as many as a workgroup of the meshlet pass handles
+struct WorkItem {
+    uint instance;
+    uint first_meshlet;
+};
+
+struct Meshlet {
+    float3 center;
+    float radius;
+    float3 cone_apex;
+    float cone_cutoff;
+    float3 cone_axis;
+    uint vertex_offset;
+    uint triangle_offset;
+    uint vertex_count;
+    uint triangle_count;
+};
+
+// Meshlets a task workgroup found visible, one mesh workgroup is launched per entry
+struct TaskPayload {
+    uint instance;
+    uint meshlets[TASK_WORKGROUP_SIZE];
+};
+
+struct VertexOutput {
+    float4 position : SV_Position;
+    [[vk::location(0)]] float3 normal : NORMAL;
+    [[vk::location(1)]] float2 uv : TEXCOORD0;
+    [[vk::location(2)]] float4 color : COLOR0;
+};
+
+float4x4 load_matrix(uint64_t address) {
+    // Eigen stores matrices column by column, float4x4's constructor takes rows
+    return transpose(float4x4(vk::RawBufferLoad<float4>(address, 16),
+                              vk::RawBufferLoad<float4>(address + 16, 16),
+                              vk::RawBufferLoad<float4>(address + 32, 16),
+                              vk::RawBufferLoad<float4>(address + 48, 16)));
+}
+
+ViewData load_view(uint64_t address) {
+    ViewData view;
+    view.view_projection = load_matrix(address);
+    for (uint plane = 0; plane < 5; plane++) {
+        view.frustum_planes[plane] = vk::RawBufferLoad<float4>(address + 64 + plane * 16, 16);
+    }
+    view.camera_position = vk::RawBufferLoad<float4>(address + 144, 16).xyz;
+    uint4 viewport = vk::RawBufferLoad<uint4>(address + 160, 16);
+    view.viewport_size = viewport.xy;
+    view.depth_pyramid_mip_count = viewport.z;
+    return view;
+}
+
+DrawInstance load_instance(uint64_t instances, uint instance_index) {
+    uint64_t address = instances + uint64_t(instance_index) * DRAW_INSTANCE_STRIDE;
+    float4 position_offset = vk::RawBufferLoad<float4>(address + 64, 16);
+    float4 position_scale = vk::RawBufferLoad<float4>(address + 80, 16);
+    uint4 ranges = vk::RawBufferLoad<uint4>(address + 96, 16);
+
+    DrawInstance instance;
+    instance.world = load_matrix(address);
+    instance.position_offset = position_offset.xyz;
+    instance.max_scale = position_offset.w;
+    instance.position_scale = position_scale.xyz;
+    instance.first_meshlet = ranges.x;
+    instance.meshlet_count = ranges.y;
+    instance.draw_command = ranges.z;
+    instance.flags = ranges.w;
+    instance.vertices = vk::RawBufferLoad<uint64_t>(address + 112, 8);
+    instance.meshlets = vk::RawBufferLoad<uint64_t>(address + 120, 8);
+    instance.meshlet_vertices = vk::RawBufferLoad<uint64_t>(address + 128, 8);
+    instance.meshlet_triangles = vk::RawBufferLoad<uint64_t>(address + 136, 8);
+    return instance;
+}
+
+// The meshlet passes are dispatched in rows of at most MAX_WORKGROUPS_PER_DIMENSION workgroups
+uint workgroup_index(uint3 group_id) {
+    return group_id.y * MAX_WORKGROUPS_PER_DIMENSION + group_id.x;
+}
+
+uint load_work_item_count(uint64_t counters) {
+    return vk::RawBufferLoad<uint>(counters + COUNTER_WORK_ITEMS * 4);
+}
+
+WorkItem load_work_item(uint64_t work_items, uint item_index) {
+    uint2 bits = vk::RawBufferLoad<uint2>(work_items + uint64_t(item_index) * WORK_ITEM_STRIDE, 8);
+    WorkItem item;
+    item.instance = bits.x;
+    item.first_meshlet = bits.y;
+    return item;
+}
+
+Meshlet load_meshlet(DrawInstance instance, uint meshlet_index) {
+    uint64_t address = instance.meshlets + uint64_t(meshlet_index) * MESHLET_STRIDE;
+    float4 sphere = vk::RawBufferLoad<float4>(address, 16);
+    float4 cone = vk::RawBufferLoad<float4>(address + 16, 16);
+    float4 axis = vk::RawBufferLoad<float4>(address + 32, 16);
+    uint4 counts = vk::RawBufferLoad<uint4>(address + 48, 16);
+
+    Meshlet meshlet;
+    meshlet.center = sphere.xyz;
+    meshlet.radius = sphere.w;
+    meshlet.cone_apex = cone.xyz;
+    meshlet.cone_cutoff = cone.w;
+    meshlet.cone_axis = axis.xyz;
+    meshlet.vertex_offset = asuint(axis.w);
+    meshlet.triangle_offset = counts.x;
+    meshlet.vertex_count = counts.y;
+    meshlet.triangle_count = counts.z;
+    return meshlet;
+}
+
+// Scene-wide number of one of the meshlet's vertices
+uint load_meshlet_vertex(DrawInstance instance, Meshlet meshlet, uint vertex) {
+    return vk::RawBufferLoad<uint>(instance.meshlet_vertices + uint64_t(meshlet.vertex_offset + vertex) * 4);
+}
+
+// The meshlet's vertex numbers of one triangle
+uint3 load_triangle(DrawInstance instance, Meshlet meshlet, uint triangle) {
+    uint bits = vk::RawBufferLoad<uint>(instance.meshlet_triangles + uint64_t(meshlet.triangle_offset + triangle) * 4);
+    return uint3(bits & 0xFF, (bits >> 8) & 0xFF, (bits >> 16) & 0xFF);
+}
+
+int sign_extend_16(uint bits) {
+    return int(bits << 16) >> 16;
+}
+
+float3 world_position(uint vertex, DrawInstance instance) {
+    uint64_t address = instance.vertices + uint64_t(vertex) * VERTEX_STRIDE;
+#if QUANTIZE_POSITIONS
+    uint2 bits = vk::RawBufferLoad<uint2>(address);
+    float3 snorm = max(float3(sign_extend_16(bits.x), sign_extend_16(bits.x >> 16), sign_extend_16(bits.y)) / 32767.0,
+                       -1.0);
+    float3 position = instance.position_offset + instance.position_scale * snorm;
+#else
+    float3 position = vk::RawBufferLoad<float3>(address);
+#endif
+    return mul(instance.world, float4(position, 1.0)).xyz;
+}
+
+float3 octahedral_decode(float2 encoded) {
+    float3 normal = float3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (normal.z < 0.0) {
+        float2 signs = float2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+        normal.xy = (1.0 - abs(normal.yx)) * signs;
+    }
+    return normalize(normal);
+}
+
+VertexOutput shade_vertex(uint vertex, float3 world, DrawInstance instance, ViewData view) {
+    // Normal, uv and color follow the position
+    uint3 attributes = vk::RawBufferLoad<uint3>(instance.vertices + uint64_t(vertex) * VERTEX_STRIDE + POSITION_SIZE);
+    float2 normal = max(float2(sign_extend_16(attributes.x), sign_extend_16(attributes.x >> 16)) / 32767.0, -1.0);
+
+    VertexOutput output;
+    output.position = mul(view.view_projection, float4(world, 1.0));
+    output.normal = mul((float3x3)instance.world, octahedral_decode(normal));
+    output.uv = f16tof32(uint2(attributes.y & 0xFFFF, attributes.y >> 16));
+    output.color = float4(attributes.z & 0xFF, (attributes.z >> 8) & 0xFF, (attributes.z >> 16) & 0xFF,
+                          attributes.z >> 24) / 255.0;
+    return output;
+}
+
+// World space sphere against the planes, the far one is at infinity
+bool sphere_in_frustum(float3 center, float radius, ViewData view) {
+    for (uint plane = 0; plane < 5; plane++) {
+        if (dot(view.frustum_planes[plane].xyz, center) + view.frustum_planes[plane].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// World space sphere against the depth pyramid, whose mip 0 is half the viewport and holds the farthest depth of each
+// 2x2 pixels. The box around the sphere's projection is tested at the level where it covers at most 2x2 texels, so
+// four loads decide it. Anything the pyramid can't answer for counts as visible: spheres crossing the near plane and
+// boxes reaching the pixels of an odd sized level that the reduction left out
+bool sphere_unoccluded(float3 center, float radius, ViewData view, Texture2D<float> depth_pyramid) {
+    // Reversed depth with the far plane at infinity, clip z is the near plane's distance and w the view distance
+    float4 clip_center = mul(view.view_projection, float4(center, 1.0));
+    if (clip_center.w - radius <= clip_center.z) {
+        return true;
+    }
+    float nearest_depth = clip_center.z / (clip_center.w - radius);
+
+    float2 ndc_min = 1.0;
+    float2 ndc_max = -1.0;
+    for (uint corner = 0; corner < 8; corner++) {
+        float3 offset = float3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius,
+                               (corner & 4) != 0 ? radius : -radius);
+        float4 clip = mul(view.view_projection, float4(center + offset, 1.0));
+        if (clip.w <= clip.z) {
+            return true;
+        }
+        ndc_min = min(ndc_min, clip.xy / clip.w);
+        ndc_max = max(ndc_max, clip.xy / clip.w);
+    }
+
+    // NDC y points down the viewport like pixel rows do
+    float2 viewport = float2(view.viewport_size);
+    uint2 pixel_min = uint2(saturate(ndc_min * 0.5 + 0.5) * viewport);
+    uint2 pixel_max = min(uint2(saturate(ndc_max * 0.5 + 0.5) * viewport), view.viewport_size - 1);
+    pixel_max = max(pixel_max, pixel_min);
+
+    // Texels of level l are 2^(l + 1) pixels across, the first level they are wider than the box's span covers it
+    // with two in each direction
+    uint2 span = pixel_max - pixel_min;
+    uint level = min(firstbithigh(max(max(span.x, span.y), 1)), view.depth_pyramid_mip_count - 1);
+    uint2 texel_min = pixel_min >> (level + 1);
+    uint2 texel_max = pixel_max >> (level + 1);
+    if (any(texel_max >= (view.viewport_size >> (level + 1))) || any(texel_max - texel_min > 1)) {
+        return true;
+    }
+
+    float farthest_depth = min(min(depth_pyramid.Load(int3(texel_min, level)),
+                                   depth_pyramid.Load(int3(texel_max.x, texel_min.y, level))),
+                               min(depth_pyramid.Load(int3(texel_min.x, texel_max.y, level)),
+                                   depth_pyramid.Load(int3(texel_max, level))));
+    return nearest_depth >= farthest_depth;
+}
+
+// The meshlet's bounding sphere against the depth pyramid
+bool meshlet_unoccluded(Meshlet meshlet, DrawInstance instance, ViewData view, Texture2D<float> depth_pyramid) {
+    float3 center = mul(instance.world, float4(meshlet.center, 1.0)).xyz;
+    return sphere_unoccluded(center, meshlet.radius * instance.max_scale, view, depth_pyramid);
+}
+
+// Frustum test of the bounding sphere, then the normal cone test if the instance's transform keeps the cone valid
+bool meshlet_visible(Meshlet meshlet, DrawInstance instance, ViewData view) {
+    float3 center = mul(instance.world, float4(meshlet.center, 1.0)).xyz;
+    if (!sphere_in_frustum(center, meshlet.radius * instance.max_scale, view)) {
+        return false;
+    }
+
+    if ((instance.flags & INSTANCE_CONE_CULLING) != 0 && meshlet.cone_cutoff <= 1.0) {
+        float3 apex = mul(instance.world, float4(meshlet.cone_apex, 1.0)).xyz;
+        float3 axis = normalize(mul((float3x3)instance.world, meshlet.cone_axis));
+        if (dot(normalize(apex - view.camera_position), axis) >= meshlet.cone_cutoff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Counter-clockwise triangles face the camera, mirrored instances wind the other way round
+bool triangle_faces_camera(float3 a, float3 b, float3 c, float3 camera_position, uint flags) {
+    float facing = dot(cross(b - a, c - a), camera_position - a);
+    return (flags & INSTANCE_MIRRORED) != 0 ? facing < 0.0 : facing > 0.0;
+}
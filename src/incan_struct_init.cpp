@@ -6,12 +6,13 @@
 #include <incan_struct_init.h>
 #include <incandescent_types.h>
 
-VkImageSubresourceRange incan_struct_init::image_subresource_range(VkImageAspectFlags aspect_flags) {
-    // Range specifying the entire image
+VkImageSubresourceRange incan_struct_init::image_subresource_range(VkImageAspectFlags aspect_flags,
+                                                                   uint32_t base_mip_level, uint32_t level_count) {
+    // Range specifying the entire image unless a part of the mip chain is asked for
     VkImageSubresourceRange image_subresource_range = {};
     image_subresource_range.aspectMask = aspect_flags;
-    image_subresource_range.baseMipLevel = 0;
-    image_subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+    image_subresource_range.baseMipLevel = base_mip_level;
+    image_subresource_range.levelCount = level_count;
     image_subresource_range.baseArrayLayer = 0;
     image_subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
 
@@ -85,14 +86,15 @@ VkSubmitInfo2 incan_struct_init::submit_info(VkCommandBufferSubmitInfo *command_
     return submit_info;
 }
 
-VkImageCreateInfo incan_struct_init::image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent) {
+VkImageCreateInfo incan_struct_init::image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent,
+                                                       uint32_t mip_levels) {
     VkImageCreateInfo image_create_info = {};
     image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     image_create_info.pNext = nullptr;
     image_create_info.imageType = VK_IMAGE_TYPE_2D;
     image_create_info.format = format;
     image_create_info.extent = extent;
-    image_create_info.mipLevels = 1;
+    image_create_info.mipLevels = mip_levels;
     image_create_info.arrayLayers = 1;
     // Used for MSAA, we will not use it by default
     image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -103,7 +105,8 @@ VkImageCreateInfo incan_struct_init::image_create_info(VkFormat format, VkImageU
     return image_create_info;
 }
 
-VkImageViewCreateInfo incan_struct_init::image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags) {
+VkImageViewCreateInfo incan_struct_init::image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags,
+                                                                uint32_t base_mip_level, uint32_t level_count) {
     // Build an image view for the depth image we will use for rendering
     VkImageViewCreateInfo image_view_create_info = {};
     image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -111,11 +114,23 @@ VkImageViewCreateInfo incan_struct_init::image_view_create_info(VkFormat format,
     image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
     image_view_create_info.image = image;
     image_view_create_info.format = format;
-    image_view_create_info.subresourceRange.baseMipLevel = 0;
-    image_view_create_info.subresourceRange.levelCount = 1;
+    image_view_create_info.subresourceRange.baseMipLevel = base_mip_level;
+    image_view_create_info.subresourceRange.levelCount = level_count;
     image_view_create_info.subresourceRange.baseArrayLayer = 0;
     image_view_create_info.subresourceRange.layerCount = 1;
     image_view_create_info.subresourceRange.aspectMask = aspect_flags;
 
     return image_view_create_info;
-}
\ No newline at end of file
+}
+
+VkBufferCreateInfo incan_struct_init::buffer_create_info(VkDeviceSize size, VkBufferUsageFlags usage_flags) {
+    VkBufferCreateInfo buffer_create_info = {};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.pNext = nullptr;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = usage_flags;
+    // Only the graphics queue family touches our buffers
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    return buffer_create_info;
+}
@@ -10,7 +10,9 @@
  * Contains small functions to simplify making create info structs
  */
 namespace incan_struct_init {
-    VkImageSubresourceRange image_subresource_range(VkImageAspectFlags aspect_flags = 0);
+    // Whole image by default, base_mip_level/level_count narrow it to part of the mip chain
+    VkImageSubresourceRange image_subresource_range(VkImageAspectFlags aspect_flags = 0, uint32_t base_mip_level = 0,
+                                                    uint32_t level_count = VK_REMAINING_MIP_LEVELS);
 
     VkFenceCreateInfo fence_create_info(VkFenceCreateFlags flags = 0);
 
@@ -26,9 +28,13 @@ namespace incan_struct_init {
                               VkSemaphoreSubmitInfo *signal_semaphore_submit_info,
                               VkSemaphoreSubmitInfo *wait_semaphore_submit_info);
 
-    VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent);
+    VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent,
+                                        uint32_t mip_levels = 1);
 
-    VkImageViewCreateInfo image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags);
+    VkImageViewCreateInfo image_view_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags,
+                                                 uint32_t base_mip_level = 0, uint32_t level_count = 1);
+
+    VkBufferCreateInfo buffer_create_info(VkDeviceSize size, VkBufferUsageFlags usage_flags);
 
     bool load_shader_module(const char* file_path, VkDevice device, VkShaderModule* out_shader_module);
 }
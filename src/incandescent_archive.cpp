@@ -0,0 +1,164 @@
+#include <incandescent_archive.h>
+#include <incandescent_geometry_cache.h>
+#include <incandescent_lz4.h>
+
+#include <algorithm>
+#include <array>
+
+namespace {
+    constexpr std::array<char, 8> ARCHIVE_MAGIC = {'I', 'N', 'C', 'A', 'R', 'C', 'H', '\0'};
+    // Bump whenever ArchiveHeader, ArchiveEntry or the way entries are compressed change
+    constexpr uint32_t ARCHIVE_VERSION = 2;
+
+    // Alone in the first page of the file
+    struct ArchiveHeader {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t entry_count;
+        uint64_t toc_offset;
+        uint64_t toc_hash;
+    };
+
+    uint64_t align_up(uint64_t offset, uint64_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // Nothing if the file doesn't start with a valid header or its TOC doesn't match the header's hash
+    std::optional<std::vector<ArchiveEntry>> read_table_of_contents(FileHandle file, uint64_t &end_offset) {
+        std::optional<uint64_t> file_size = incan_file::size(file);
+        ArchiveHeader header;
+        if (!file_size.has_value() ||
+            !incan_file::read_at(file, 0, std::as_writable_bytes(std::span(&header, 1))) ||
+            header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION ||
+            header.toc_offset < ARCHIVE_ALIGNMENT || header.toc_offset > file_size.value() ||
+            header.entry_count > (file_size.value() - header.toc_offset) / sizeof(ArchiveEntry)) {
+            return std::nullopt;
+        }
+
+        std::vector<ArchiveEntry> entries(header.entry_count);
+        std::span<std::byte> toc_bytes = std::as_writable_bytes(std::span(entries));
+        if (!incan_file::read_at(file, header.toc_offset, toc_bytes) ||
+            incan_cache::hash_bytes(toc_bytes) != header.toc_hash) {
+            return std::nullopt;
+        }
+        for (const ArchiveEntry &entry: entries) {
+            if (entry.compression > ArchiveCompression::Lz4 || entry.offset < ARCHIVE_ALIGNMENT ||
+                entry.stored_size > header.toc_offset || entry.offset > header.toc_offset - entry.stored_size) {
+                return std::nullopt;
+            }
+        }
+
+        end_offset = align_up(header.toc_offset + toc_bytes.size(), ARCHIVE_ALIGNMENT);
+        return entries;
+    }
+}
+
+bool Archive::open(const std::filesystem::path &file_path, bool writable) {
+    close();
+
+    if (writable) {
+        std::error_code error;
+        std::filesystem::create_directories(file_path.parent_path(), error);
+    }
+    file = incan_file::open(file_path, writable);
+    if (file == INVALID_FILE_HANDLE) {
+        return false;
+    }
+
+    std::optional<std::vector<ArchiveEntry>> table_of_contents = read_table_of_contents(file, end_offset);
+    if (table_of_contents.has_value()) {
+        entries = std::move(table_of_contents.value());
+        return true;
+    }
+    if (!writable) {
+        close();
+        return false;
+    }
+    // Whatever the file held is written over as entries are appended
+    entries.clear();
+    end_offset = ARCHIVE_ALIGNMENT;
+    return true;
+}
+
+void Archive::close() {
+    incan_file::close(file);
+    file = INVALID_FILE_HANDLE;
+    entries.clear();
+    appended_entries.clear();
+    end_offset = 0;
+}
+
+const ArchiveEntry *Archive::find(uint64_t id) const {
+    auto found = std::ranges::lower_bound(entries, id, {}, &ArchiveEntry::id);
+    return found != entries.end() && found->id == id ? &*found : nullptr;
+}
+
+FileRead Archive::read(const ArchiveEntry &entry, std::byte *destination) const {
+    return {file, entry.offset, entry.stored_size, destination, entry.compression == ArchiveCompression::Lz4,
+            entry.size};
+}
+
+FileRead Archive::read_stored(const ArchiveEntry &entry, std::byte *destination) const {
+    return {file, entry.offset, entry.stored_size, destination, false, entry.stored_size};
+}
+
+std::optional<ArchiveEntry> Archive::append(uint64_t id, const PackedEntry &packed_entry) {
+    ArchiveEntry entry = {};
+    entry.id = id;
+    entry.offset = end_offset;
+    entry.stored_size = packed_entry.stored_bytes.size();
+    entry.size = packed_entry.size;
+    entry.compression = packed_entry.compression;
+    if (!incan_file::write_at(file, entry.offset, packed_entry.stored_bytes)) {
+        return std::nullopt;
+    }
+
+    end_offset = align_up(entry.offset + entry.stored_size, ARCHIVE_ALIGNMENT);
+    appended_entries.push_back(entry);
+    return entry;
+}
+
+bool Archive::commit() {
+    if (appended_entries.empty()) {
+        return true;
+    }
+
+    // In append order, so the last entry appended for an id is the one that stays
+    for (const ArchiveEntry &appended_entry: appended_entries) {
+        auto position = std::ranges::lower_bound(entries, appended_entry.id, {}, &ArchiveEntry::id);
+        if (position != entries.end() && position->id == appended_entry.id) {
+            *position = appended_entry;
+        } else {
+            entries.insert(position, appended_entry);
+        }
+    }
+    appended_entries.clear();
+
+    std::span<const std::byte> toc_bytes = std::as_bytes(std::span(entries));
+    ArchiveHeader header = {};
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.entry_count = static_cast<uint32_t>(entries.size());
+    header.toc_offset = end_offset;
+    header.toc_hash = incan_cache::hash_bytes(toc_bytes);
+
+    // The TOC goes after the last entry, so until the header is written the old one is still there and still valid
+    if (!incan_file::write_at(file, end_offset, toc_bytes) ||
+        !incan_file::write_at(file, 0, std::as_bytes(std::span(&header, 1)))) {
+        return false;
+    }
+    end_offset = align_up(end_offset + toc_bytes.size(), ARCHIVE_ALIGNMENT);
+    return true;
+}
+
+PackedEntry incan_archive::pack_entry(std::span<const std::byte> bytes) {
+    PackedEntry packed_entry = {};
+    packed_entry.size = bytes.size();
+    packed_entry.compression = ArchiveCompression::Lz4;
+    packed_entry.stored_bytes = incan_lz4::compress_tiles(bytes);
+    if (packed_entry.stored_bytes.size() > bytes.size() - bytes.size() / 8) {
+        packed_entry.compression = ArchiveCompression::None;
+        packed_entry.stored_bytes.assign(bytes.begin(), bytes.end());
+    }
+    return packed_entry;
+}
@@ -0,0 +1,80 @@
+#ifndef INCANDESCENT_ARCHIVE_H
+#define INCANDESCENT_ARCHIVE_H
+
+#include <incandescent_file_reader.h>
+
+// Entries start on page boundaries, so no two of them share a page and reads of one never pull in its neighbours
+constexpr uint64_t ARCHIVE_ALIGNMENT = 4096;
+
+enum class ArchiveCompression : uint32_t {
+    None,
+    Lz4 // Tiled, see incan_lz4::compress_tiles
+};
+
+// One entry of the table of contents, written to disk as is
+struct ArchiveEntry {
+    uint64_t id;
+    // From the start of the file, a multiple of ARCHIVE_ALIGNMENT
+    uint64_t offset;
+    // Bytes on disk, and bytes once decompressed
+    uint64_t stored_size;
+    uint64_t size;
+    ArchiveCompression compression;
+    uint32_t reserved;
+};
+static_assert(sizeof(ArchiveEntry) == 40);
+
+// An entry's bytes the way they go on disk
+struct PackedEntry {
+    ArchiveCompression compression;
+    uint64_t size;
+    std::vector<std::byte> stored_bytes;
+};
+
+/*
+ * Many small files packed into one, found through a table of contents (TOC) read once when the archive is opened, so
+ * a scene's thousands of textures take one open instead of one each. Entries are looked up by a 64-bit id (callers
+ * hash whatever names them), each is compressed with tiled LZ4 unless that doesn't pay off and starts on a page
+ * boundary. Tiles can be expanded on the CPU as the entry is read, or read as they are and expanded on the GPU.
+ *
+ * A header page points at the TOC, which comes after the entries. Appended entries go after everything else and the
+ * TOC is written again after them, the header only points at the new TOC once that is written and a hash of the TOC
+ * in the header catches one that didn't make it to disk, so a crash leaves the archive as it was. An entry whose id
+ * is appended again is replaced, its old bytes stay behind as dead space until the archive is deleted.
+ */
+struct Archive {
+    // With writable set the file is created if it is missing, and one that isn't a valid archive is started over
+    bool open(const std::filesystem::path &file_path, bool writable);
+    void close();
+
+    // Only entries committed before open() or since
+    const ArchiveEntry *find(uint64_t id) const;
+
+    // A read of the whole entry into destination, which takes entry.size bytes
+    FileRead read(const ArchiveEntry &entry, std::byte *destination) const;
+
+    // The entry's bytes as they are stored, for decompressing elsewhere. destination takes entry.stored_size bytes
+    FileRead read_stored(const ArchiveEntry &entry, std::byte *destination) const;
+
+    // Not thread safe. The entry can be read right away, it only becomes part of the archive with commit()
+    std::optional<ArchiveEntry> append(uint64_t id, const PackedEntry &packed_entry);
+
+    // Writes the TOC with everything appended so far, nothing to do if nothing was
+    bool commit();
+
+private:
+    FileHandle file = INVALID_FILE_HANDLE;
+    // Sorted by id
+    std::vector<ArchiveEntry> entries;
+    std::vector<ArchiveEntry> appended_entries;
+    // Where the next entry goes
+    uint64_t end_offset = 0;
+};
+
+namespace incan_archive {
+    // Compressed with LZ4 unless that saves less than an eighth. Safe to call from any thread
+    PackedEntry pack_entry(std::span<const std::byte> bytes);
+}
+
+
+#endif //INCANDESCENT_ARCHIVE_H
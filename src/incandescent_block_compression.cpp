@@ -0,0 +1,593 @@
+#include <incandescent_block_compression.h>
+#include <incandescent_jobs.h>
+
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define INCANDESCENT_BC_AVX2
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define INCANDESCENT_AVX2_TARGET
+#else
+#define INCANDESCENT_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+uint32_t incan_bc::block_size(BlockFormat format) {
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+VkFormat incan_bc::vulkan_format(BlockFormat format, bool is_srgb) {
+    switch (format) {
+        case BlockFormat::BC1:
+            return is_srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+        case BlockFormat::BC4:
+            return VK_FORMAT_BC4_UNORM_BLOCK;
+        case BlockFormat::BC5:
+            return VK_FORMAT_BC5_UNORM_BLOCK;
+        case BlockFormat::BC7:
+            return is_srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+size_t incan_bc::level_size(BlockFormat format, uint32_t width, uint32_t height) {
+    size_t blocks_x = (width + 3) / 4;
+    size_t blocks_y = (height + 3) / 4;
+    return blocks_x * blocks_y * block_size(format);
+}
+
+namespace {
+    // The 16 texels of a block split by channel, so eight texels of one channel fill an AVX2 register
+    struct BlockTexels {
+        alignas(32) float channels[4][16];
+    };
+
+    // Decoded colors of a block's palette, split by channel the same way
+    struct BlockPalette {
+        float channels[4][16];
+        uint32_t size;
+    };
+
+    BlockTexels load_texels(const uint8_t *texels, uint32_t first_channel, uint32_t channel_count) {
+        BlockTexels block_texels = {};
+        for (uint32_t texel = 0; texel < 16; texel++) {
+            for (uint32_t channel = 0; channel < channel_count; channel++) {
+                block_texels.channels[channel][texel] = texels[texel * 4 + first_channel + channel];
+            }
+        }
+        return block_texels;
+    }
+
+    /* -------- Closest palette entry per texel -------- */
+    // Ties keep the lower index in both versions, so the AVX2 path writes exactly the blocks the scalar one does
+    float select_indices_scalar(const BlockTexels &texels, uint32_t channel_count, const BlockPalette &palette,
+                                uint8_t *indices) {
+        float total_error = 0.0f;
+        for (uint32_t texel = 0; texel < 16; texel++) {
+            float best_error = FLT_MAX;
+            uint8_t best_index = 0;
+            for (uint32_t entry = 0; entry < palette.size; entry++) {
+                float error = 0.0f;
+                for (uint32_t channel = 0; channel < channel_count; channel++) {
+                    float difference = texels.channels[channel][texel] - palette.channels[channel][entry];
+                    error += difference * difference;
+                }
+                if (error < best_error) {
+                    best_error = error;
+                    best_index = static_cast<uint8_t>(entry);
+                }
+            }
+            indices[texel] = best_index;
+            total_error += best_error;
+        }
+        return total_error;
+    }
+
+#ifdef INCANDESCENT_BC_AVX2
+    INCANDESCENT_AVX2_TARGET
+    float select_indices_avx2(const BlockTexels &texels, uint32_t channel_count, const BlockPalette &palette,
+                              uint8_t *indices) {
+        __m256 total_error = _mm256_setzero_ps();
+        for (uint32_t first_texel = 0; first_texel < 16; first_texel += 8) {
+            __m256 best_error = _mm256_set1_ps(FLT_MAX);
+            __m256i best_index = _mm256_setzero_si256();
+            for (uint32_t entry = 0; entry < palette.size; entry++) {
+                __m256 error = _mm256_setzero_ps();
+                for (uint32_t channel = 0; channel < channel_count; channel++) {
+                    __m256 difference = _mm256_sub_ps(_mm256_load_ps(&texels.channels[channel][first_texel]),
+                                                      _mm256_set1_ps(palette.channels[channel][entry]));
+                    error = _mm256_add_ps(error, _mm256_mul_ps(difference, difference));
+                }
+                __m256 closer = _mm256_cmp_ps(error, best_error, _CMP_LT_OQ);
+                best_error = _mm256_blendv_ps(best_error, error, closer);
+                best_index = _mm256_blendv_epi8(best_index, _mm256_set1_epi32(static_cast<int>(entry)),
+                                                _mm256_castps_si256(closer));
+            }
+            total_error = _mm256_add_ps(total_error, best_error);
+
+            alignas(32) int32_t lane_indices[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lane_indices), best_index);
+            for (uint32_t lane = 0; lane < 8; lane++) {
+                indices[first_texel + lane] = static_cast<uint8_t>(lane_indices[lane]);
+            }
+        }
+
+        alignas(32) float lane_errors[8];
+        _mm256_store_ps(lane_errors, total_error);
+        float error_sum = 0.0f;
+        for (float lane_error: lane_errors) {
+            error_sum += lane_error;
+        }
+        return error_sum;
+    }
+#endif
+
+    bool detect_avx2() {
+#ifdef INCANDESCENT_BC_AVX2
+#if defined(_MSC_VER) && !defined(__clang__)
+        // AVX2 needs the CPU flag and the OS saving the YMM registers
+        int cpu_info[4];
+        __cpuid(cpu_info, 1);
+        bool os_saves_ymm = (cpu_info[2] & (1 << 27)) && (cpu_info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+        __cpuidex(cpu_info, 7, 0);
+        return os_saves_ymm && (cpu_info[1] & (1 << 5));
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+#else
+        return false;
+#endif
+    }
+
+    float select_indices(const BlockTexels &texels, uint32_t channel_count, const BlockPalette &palette,
+                         uint8_t *indices) {
+#ifdef INCANDESCENT_BC_AVX2
+        if (incan_bc::avx2_enabled()) {
+            return select_indices_avx2(texels, channel_count, palette, indices);
+        }
+#endif
+        return select_indices_scalar(texels, channel_count, palette, indices);
+    }
+
+    /* -------- Endpoint fitting -------- */
+    // Endpoints at the extremes of the texels projected onto their principal axis, found by power iteration
+    template<int Channels>
+    void principal_endpoints(const BlockTexels &texels, Eigen::Vector<float, Channels> &endpoint0,
+                             Eigen::Vector<float, Channels> &endpoint1) {
+        using Vector = Eigen::Vector<float, Channels>;
+        Vector mean = Vector::Zero();
+        for (uint32_t texel = 0; texel < 16; texel++) {
+            for (int channel = 0; channel < Channels; channel++) {
+                mean[channel] += texels.channels[channel][texel];
+            }
+        }
+        mean /= 16.0f;
+
+        Eigen::Matrix<float, Channels, Channels> covariance = Eigen::Matrix<float, Channels, Channels>::Zero();
+        for (uint32_t texel = 0; texel < 16; texel++) {
+            Vector offset;
+            for (int channel = 0; channel < Channels; channel++) {
+                offset[channel] = texels.channels[channel][texel] - mean[channel];
+            }
+            covariance += offset * offset.transpose();
+        }
+
+        Vector axis = Vector::Ones();
+        for (int iteration = 0; iteration < 8; iteration++) {
+            Vector next_axis = covariance * axis;
+            float length = next_axis.norm();
+            if (length < 1e-6f) {
+                break;
+            }
+            axis = next_axis / length;
+        }
+        axis.normalize();
+
+        float minimum = FLT_MAX;
+        float maximum = -FLT_MAX;
+        for (uint32_t texel = 0; texel < 16; texel++) {
+            Vector offset;
+            for (int channel = 0; channel < Channels; channel++) {
+                offset[channel] = texels.channels[channel][texel] - mean[channel];
+            }
+            float projection = offset.dot(axis);
+            minimum = std::min(minimum, projection);
+            maximum = std::max(maximum, projection);
+        }
+        endpoint0 = (mean + axis * maximum).cwiseMax(0.0f).cwiseMin(255.0f);
+        endpoint1 = (mean + axis * minimum).cwiseMax(0.0f).cwiseMin(255.0f);
+    }
+
+    // Least squares endpoints for fixed indices, weights are how far along from endpoint0 to endpoint1 each index is.
+    // Returns false when every texel picked the same weight and there is nothing to solve
+    template<int Channels>
+    bool refine_endpoints(const BlockTexels &texels, const uint8_t *indices, const float *weights,
+                          Eigen::Vector<float, Channels> &endpoint0, Eigen::Vector<float, Channels> &endpoint1) {
+        float alpha_alpha = 0.0f;
+        float alpha_beta = 0.0f;
+        float beta_beta = 0.0f;
+        Eigen::Vector<float, Channels> alpha_texel = Eigen::Vector<float, Channels>::Zero();
+        Eigen::Vector<float, Channels> beta_texel = Eigen::Vector<float, Channels>::Zero();
+        for (uint32_t texel = 0; texel < 16; texel++) {
+            float beta = weights[indices[texel]];
+            float alpha = 1.0f - beta;
+            alpha_alpha += alpha * alpha;
+            alpha_beta += alpha * beta;
+            beta_beta += beta * beta;
+            for (int channel = 0; channel < Channels; channel++) {
+                alpha_texel[channel] += alpha * texels.channels[channel][texel];
+                beta_texel[channel] += beta * texels.channels[channel][texel];
+            }
+        }
+
+        float determinant = alpha_alpha * beta_beta - alpha_beta * alpha_beta;
+        if (std::abs(determinant) < 1e-6f) {
+            return false;
+        }
+        endpoint0 = ((alpha_texel * beta_beta - beta_texel * alpha_beta) / determinant).cwiseMax(0.0f)
+                .cwiseMin(255.0f);
+        endpoint1 = ((beta_texel * alpha_alpha - alpha_texel * alpha_beta) / determinant).cwiseMax(0.0f)
+                .cwiseMin(255.0f);
+        return true;
+    }
+
+    bool is_solid_block(const BlockTexels &texels, uint32_t channel_count) {
+        for (uint32_t channel = 0; channel < channel_count; channel++) {
+            for (uint32_t texel = 1; texel < 16; texel++) {
+                if (texels.channels[channel][texel] != texels.channels[channel][0]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Packs values into a block least significant bit first, the order every BC format uses
+    struct BlockBitWriter {
+        std::byte *block;
+        uint32_t position = 0;
+
+        void write(uint32_t value, uint32_t bit_count) {
+            for (uint32_t bit = 0; bit < bit_count; bit++) {
+                if ((value >> bit) & 1) {
+                    block[position >> 3] |= std::byte(1 << (position & 7));
+                }
+                position++;
+            }
+        }
+    };
+
+    /* -------- BC1 -------- */
+    uint16_t quantize_565(const Eigen::Vector3f &color) {
+        auto red = static_cast<uint32_t>(std::lround(color.x() * 31.0f / 255.0f));
+        auto green = static_cast<uint32_t>(std::lround(color.y() * 63.0f / 255.0f));
+        auto blue = static_cast<uint32_t>(std::lround(color.z() * 31.0f / 255.0f));
+        return static_cast<uint16_t>((red << 11) | (green << 5) | blue);
+    }
+
+    Eigen::Vector3f expand_565(uint16_t color) {
+        uint32_t red = (color >> 11) & 31;
+        uint32_t green = (color >> 5) & 63;
+        uint32_t blue = color & 31;
+        return {static_cast<float>((red << 3) | (red >> 2)), static_cast<float>((green << 2) | (green >> 4)),
+                static_cast<float>((blue << 3) | (blue >> 2))};
+    }
+
+    struct Bc1Candidate {
+        uint16_t color0;
+        uint16_t color1;
+        uint8_t indices[16];
+        float error;
+    };
+
+    // Four color mode needs color0 > color1, endpoints that quantize to the same color become a solid block
+    Bc1Candidate evaluate_bc1(const BlockTexels &texels, const Eigen::Vector3f &endpoint0,
+                              const Eigen::Vector3f &endpoint1) {
+        Bc1Candidate candidate = {};
+        candidate.color0 = quantize_565(endpoint0);
+        candidate.color1 = quantize_565(endpoint1);
+        if (candidate.color0 < candidate.color1) {
+            std::swap(candidate.color0, candidate.color1);
+        }
+
+        Eigen::Vector3f color0 = expand_565(candidate.color0);
+        Eigen::Vector3f color1 = expand_565(candidate.color1);
+        std::array<Eigen::Vector3f, 4> colors = {color0, color1, (2.0f * color0 + color1) / 3.0f,
+                                                 (color0 + 2.0f * color1) / 3.0f};
+        BlockPalette palette = {};
+        palette.size = candidate.color0 == candidate.color1 ? 1 : 4;
+        for (uint32_t entry = 0; entry < 4; entry++) {
+            for (uint32_t channel = 0; channel < 3; channel++) {
+                palette.channels[channel][entry] = colors[entry][channel];
+            }
+        }
+        candidate.error = select_indices(texels, 3, palette, candidate.indices);
+        return candidate;
+    }
+}
+
+bool incan_bc::avx2_enabled() {
+    static const bool enabled = detect_avx2();
+    return enabled;
+}
+
+void incan_bc::encode_bc1_block(const uint8_t *texels, std::byte *block) {
+    BlockTexels block_texels = load_texels(texels, 0, 3);
+
+    Eigen::Vector3f endpoint0, endpoint1;
+    principal_endpoints<3>(block_texels, endpoint0, endpoint1);
+    Bc1Candidate best = evaluate_bc1(block_texels, endpoint0, endpoint1);
+
+    // Palette order is color0, color1, then the two thirds between them
+    if (best.color0 != best.color1) {
+        constexpr float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+        Eigen::Vector3f refined0 = expand_565(best.color0);
+        Eigen::Vector3f refined1 = expand_565(best.color1);
+        if (refine_endpoints<3>(block_texels, best.indices, weights, refined0, refined1)) {
+            Bc1Candidate refined = evaluate_bc1(block_texels, refined0, refined1);
+            if (refined.error < best.error) {
+                best = refined;
+            }
+        }
+    }
+
+    memset(block, 0, 8);
+    BlockBitWriter writer = {block};
+    writer.write(best.color0, 16);
+    writer.write(best.color1, 16);
+    for (uint8_t index: best.indices) {
+        writer.write(index, 2);
+    }
+}
+
+void incan_bc::encode_bc4_block(const uint8_t *texels, uint32_t channel, std::byte *block) {
+    BlockTexels block_texels = load_texels(texels, channel, 1);
+
+    float minimum = 255.0f;
+    float maximum = 0.0f;
+    for (float value: block_texels.channels[0]) {
+        minimum = std::min(minimum, value);
+        maximum = std::max(maximum, value);
+    }
+
+    // Eight value mode (red0 > red1): the endpoints, then six steps between them. A flat block stores the value twice
+    // and every index points at it
+    uint8_t indices[16] = {};
+    auto red0 = static_cast<uint8_t>(maximum);
+    auto red1 = static_cast<uint8_t>(minimum);
+    if (red0 != red1) {
+        BlockPalette palette = {};
+        palette.size = 8;
+        palette.channels[0][0] = red0;
+        palette.channels[0][1] = red1;
+        for (uint32_t entry = 2; entry < 8; entry++) {
+            palette.channels[0][entry] = (static_cast<float>(8 - entry) * red0 +
+                                          static_cast<float>(entry - 1) * red1) / 7.0f;
+        }
+        select_indices(block_texels, 1, palette, indices);
+    }
+
+    memset(block, 0, 8);
+    BlockBitWriter writer = {block};
+    writer.write(red0, 8);
+    writer.write(red1, 8);
+    for (uint8_t index: indices) {
+        writer.write(index, 3);
+    }
+}
+
+void incan_bc::encode_bc5_block(const uint8_t *texels, std::byte *block) {
+    encode_bc4_block(texels, 0, block);
+    encode_bc4_block(texels, 1, block + 8);
+}
+
+namespace {
+    /* -------- BC7 mode 6 -------- */
+    constexpr uint32_t BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    struct Bc7Candidate {
+        // 7-bit endpoint values and the p-bit shared by each endpoint's channels
+        uint8_t endpoint0[4];
+        uint8_t endpoint1[4];
+        uint8_t p_bit0;
+        uint8_t p_bit1;
+        uint8_t indices[16];
+        float error;
+    };
+
+    // 7 bits plus the p-bit as the lowest bit, rounded to the closest value that p-bit can reach
+    uint8_t quantize_bc7_channel(float value, uint32_t p_bit) {
+        long quantized = std::lround((value - static_cast<float>(p_bit)) / 2.0f);
+        return static_cast<uint8_t>(std::clamp(quantized, 0l, 127l));
+    }
+
+    Bc7Candidate evaluate_bc7(const BlockTexels &texels, const Eigen::Vector4f &endpoint0,
+                              const Eigen::Vector4f &endpoint1, uint32_t p_bit0, uint32_t p_bit1) {
+        Bc7Candidate candidate = {};
+        candidate.p_bit0 = static_cast<uint8_t>(p_bit0);
+        candidate.p_bit1 = static_cast<uint8_t>(p_bit1);
+
+        BlockPalette palette = {};
+        palette.size = 16;
+        for (uint32_t channel = 0; channel < 4; channel++) {
+            candidate.endpoint0[channel] = quantize_bc7_channel(endpoint0[channel], p_bit0);
+            candidate.endpoint1[channel] = quantize_bc7_channel(endpoint1[channel], p_bit1);
+            uint32_t value0 = (candidate.endpoint0[channel] << 1) | p_bit0;
+            uint32_t value1 = (candidate.endpoint1[channel] << 1) | p_bit1;
+            for (uint32_t entry = 0; entry < 16; entry++) {
+                uint32_t weight = BC7_WEIGHTS[entry];
+                palette.channels[channel][entry] = static_cast<float>(((64 - weight) * value0 + weight * value1 +
+                                                                       32) >> 6);
+            }
+        }
+        candidate.error = select_indices(texels, 4, palette, candidate.indices);
+        return candidate;
+    }
+
+    Bc7Candidate best_bc7_p_bits(const BlockTexels &texels, const Eigen::Vector4f &endpoint0,
+                                 const Eigen::Vector4f &endpoint1) {
+        Bc7Candidate best = {};
+        best.error = FLT_MAX;
+        for (uint32_t p_bits = 0; p_bits < 4; p_bits++) {
+            Bc7Candidate candidate = evaluate_bc7(texels, endpoint0, endpoint1, p_bits & 1, p_bits >> 1);
+            if (candidate.error < best.error) {
+                best = candidate;
+            }
+        }
+        return best;
+    }
+}
+
+void incan_bc::encode_bc7_block(const uint8_t *texels, std::byte *block) {
+    BlockTexels block_texels = load_texels(texels, 0, 4);
+
+    Eigen::Vector4f endpoint0, endpoint1;
+    principal_endpoints<4>(block_texels, endpoint0, endpoint1);
+    Bc7Candidate best = best_bc7_p_bits(block_texels, endpoint0, endpoint1);
+
+    if (!is_solid_block(block_texels, 4)) {
+        float weights[16];
+        for (uint32_t entry = 0; entry < 16; entry++) {
+            weights[entry] = static_cast<float>(BC7_WEIGHTS[entry]) / 64.0f;
+        }
+        if (refine_endpoints<4>(block_texels, best.indices, weights, endpoint0, endpoint1)) {
+            Bc7Candidate refined = best_bc7_p_bits(block_texels, endpoint0, endpoint1);
+            if (refined.error < best.error) {
+                best = refined;
+            }
+        }
+    }
+
+    // The anchor (first) index drops its top bit, so it has to be below 8. Swapping the endpoints mirrors the indices
+    if (best.indices[0] & 8) {
+        std::swap(best.endpoint0, best.endpoint1);
+        std::swap(best.p_bit0, best.p_bit1);
+        for (uint8_t &index: best.indices) {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    memset(block, 0, 16);
+    BlockBitWriter writer = {block};
+    writer.write(1 << 6, 7);
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        writer.write(best.endpoint0[channel], 7);
+        writer.write(best.endpoint1[channel], 7);
+    }
+    writer.write(best.p_bit0, 1);
+    writer.write(best.p_bit1, 1);
+    writer.write(best.indices[0], 3);
+    for (uint32_t texel = 1; texel < 16; texel++) {
+        writer.write(best.indices[texel], 4);
+    }
+}
+
+void incan_bc::encode_level(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height,
+                            std::byte *output, size_t max_threads) {
+    uint32_t blocks_x = (width + 3) / 4;
+    uint32_t blocks_y = (height + 3) / 4;
+    uint32_t bytes_per_block = block_size(format);
+
+    incan_util::parallel_for(blocks_y, [&](size_t block_y) {
+        uint8_t texels[16 * 4];
+        for (uint32_t block_x = 0; block_x < blocks_x; block_x++) {
+            for (uint32_t row = 0; row < 4; row++) {
+                uint32_t y = std::min<uint32_t>(static_cast<uint32_t>(block_y) * 4 + row, height - 1);
+                for (uint32_t column = 0; column < 4; column++) {
+                    uint32_t x = std::min(block_x * 4 + column, width - 1);
+                    memcpy(&texels[(row * 4 + column) * 4], &rgba[(static_cast<size_t>(y) * width + x) * 4], 4);
+                }
+            }
+
+            std::byte *block = output + (block_y * blocks_x + block_x) * bytes_per_block;
+            switch (format) {
+                case BlockFormat::BC1:
+                    encode_bc1_block(texels, block);
+                    break;
+                case BlockFormat::BC4:
+                    encode_bc4_block(texels, 0, block);
+                    break;
+                case BlockFormat::BC5:
+                    encode_bc5_block(texels, block);
+                    break;
+                case BlockFormat::BC7:
+                    encode_bc7_block(texels, block);
+                    break;
+            }
+        }
+    }, max_threads);
+}
+
+namespace {
+    float srgb_to_linear(uint8_t value) {
+        static const std::array<float, 256> table = []() {
+            std::array<float, 256> values = {};
+            for (uint32_t i = 0; i < 256; i++) {
+                float color = static_cast<float>(i) / 255.0f;
+                values[i] = color <= 0.04045f ? color / 12.92f : std::pow((color + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table[value];
+    }
+
+    uint8_t linear_to_srgb(float value) {
+        float color = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        return static_cast<uint8_t>(std::clamp(std::lround(color * 255.0f), 0l, 255l));
+    }
+}
+
+std::vector<std::vector<uint8_t>> incan_bc::build_mip_chain(const uint8_t *rgba, uint32_t width, uint32_t height,
+                                                            bool is_srgb) {
+    std::vector<std::vector<uint8_t>> levels;
+    levels.emplace_back(rgba, rgba + static_cast<size_t>(width) * height * 4);
+
+    while (width > 1 || height > 1) {
+        uint32_t next_width = std::max(width / 2, 1u);
+        uint32_t next_height = std::max(height / 2, 1u);
+        const std::vector<uint8_t> &source = levels.back();
+        std::vector<uint8_t> level(static_cast<size_t>(next_width) * next_height * 4);
+
+        // Odd sizes drop the last row or column, the same as a linear blit
+        for (uint32_t y = 0; y < next_height; y++) {
+            uint32_t y0 = std::min(y * 2, height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, height - 1);
+            for (uint32_t x = 0; x < next_width; x++) {
+                uint32_t x0 = std::min(x * 2, width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, width - 1);
+                const uint8_t *texels[4] = {
+                    &source[(static_cast<size_t>(y0) * width + x0) * 4],
+                    &source[(static_cast<size_t>(y0) * width + x1) * 4],
+                    &source[(static_cast<size_t>(y1) * width + x0) * 4],
+                    &source[(static_cast<size_t>(y1) * width + x1) * 4]
+                };
+                uint8_t *destination = &level[(static_cast<size_t>(y) * next_width + x) * 4];
+                for (uint32_t channel = 0; channel < 4; channel++) {
+                    if (is_srgb && channel < 3) {
+                        float sum = 0.0f;
+                        for (const uint8_t *texel: texels) {
+                            sum += srgb_to_linear(texel[channel]);
+                        }
+                        destination[channel] = linear_to_srgb(sum / 4.0f);
+                    } else {
+                        uint32_t sum = 0;
+                        for (const uint8_t *texel: texels) {
+                            sum += texel[channel];
+                        }
+                        destination[channel] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        levels.push_back(std::move(level));
+        width = next_width;
+        height = next_height;
+    }
+    return levels;
+}
@@ -0,0 +1,50 @@
+#ifndef INCANDESCENT_BLOCK_COMPRESSION_H
+#define INCANDESCENT_BLOCK_COMPRESSION_H
+
+#include <incandescent_types.h>
+
+// Block compressed formats the encoder writes, all of them 4x4 texel blocks
+enum class BlockFormat : uint32_t {
+    BC1, // RGB, 565 endpoints and 2-bit indices, 8 bytes
+    BC4, // One channel, 8-bit endpoints and 3-bit indices, 8 bytes
+    BC5, // Red and green as two BC4 blocks, 16 bytes
+    BC7 // RGBA, mode 6 (one subset, 7-bit endpoints with p-bits, 4-bit indices), 16 bytes
+};
+
+/*
+ * CPU block compression. Endpoints come from the block's principal axis and are refined once by least squares, BC1
+ * and BC7 also try every endpoint quantization they can (565 rounding, BC7 p-bits). The hot loop is the search for
+ * the closest palette entry of each texel, which runs eight texels at a time with AVX2 when the CPU has it and falls
+ * back to a scalar loop otherwise; both give the same blocks.
+ */
+namespace incan_bc {
+    // Bytes per 4x4 block
+    uint32_t block_size(BlockFormat format);
+
+    // BC4 and BC5 have no sRGB variants, is_srgb is ignored for them
+    VkFormat vulkan_format(BlockFormat format, bool is_srgb);
+
+    size_t level_size(BlockFormat format, uint32_t width, uint32_t height);
+
+    // Checked once, the same answer for the life of the process
+    bool avx2_enabled();
+
+    // texels are 16 RGBA8 texels of one block, row by row
+    void encode_bc1_block(const uint8_t *texels, std::byte *block);
+    void encode_bc4_block(const uint8_t *texels, uint32_t channel, std::byte *block);
+    void encode_bc5_block(const uint8_t *texels, std::byte *block);
+    void encode_bc7_block(const uint8_t *texels, std::byte *block);
+
+    // Encodes a whole RGBA8 level into level_size(format, width, height) bytes. Blocks hanging over the right or
+    // bottom edge repeat the edge texels. Rows of blocks are spread over up to max_threads threads
+    void encode_level(BlockFormat format, const uint8_t *rgba, uint32_t width, uint32_t height, std::byte *output,
+                      size_t max_threads = 1);
+
+    // Box filtered mip chain of an RGBA8 image down to 1x1, mip 0 (a copy of rgba) first. sRGB color is averaged in
+    // linear space, alpha and linear images as stored
+    std::vector<std::vector<uint8_t>> build_mip_chain(const uint8_t *rgba, uint32_t width, uint32_t height,
+                                                      bool is_srgb);
+}
+
+
+#endif //INCANDESCENT_BLOCK_COMPRESSION_H
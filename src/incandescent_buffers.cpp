@@ -0,0 +1,86 @@
+#include <incandescent_buffers.h>
+#include <incan_struct_init.h>
+#include <volk.h>
+
+AllocatedBuffer incan_util::create_buffer(VmaAllocator allocator, size_t size, VkBufferUsageFlags usage_flags,
+                                          VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags) {
+    VkBufferCreateInfo buffer_create_info = incan_struct_init::buffer_create_info(size, usage_flags);
+
+    VmaAllocationCreateInfo allocation_create_info = {};
+    allocation_create_info.usage = memory_usage;
+    allocation_create_info.flags = allocation_flags;
+
+    AllocatedBuffer new_buffer;
+    VK_CHECK(vmaCreateBuffer(allocator, &buffer_create_info, &allocation_create_info, &new_buffer.buffer,
+        &new_buffer.allocation, &new_buffer.allocation_info));
+    new_buffer.size = size;
+    new_buffer.usage_flags = usage_flags;
+
+    return new_buffer;
+}
+
+void incan_util::destroy_buffer(VmaAllocator allocator, const AllocatedBuffer &buffer) {
+    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+}
+
+VkDeviceAddress incan_util::get_buffer_device_address(VkDevice device, VkBuffer buffer) {
+    VkBufferDeviceAddressInfo device_address_info = {};
+    device_address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+    device_address_info.pNext = nullptr;
+    device_address_info.buffer = buffer;
+
+    return vkGetBufferDeviceAddress(device, &device_address_info);
+}
+
+void FrameLinearAllocator::initialize(VkDevice device, VmaAllocator allocator, MemoryTelemetry &memory_telemetry,
+                                      VkDeviceSize buffer_capacity, const VkPhysicalDeviceLimits &limits) {
+    capacity = buffer_capacity;
+    head = 0;
+    min_alignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+
+    // Sequential write + mapped keeps the buffer mapped for its whole life, VMA will pick BAR memory if it exists
+    buffer = incan_util::create_buffer(allocator, capacity,
+                                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                       VMA_MEMORY_USAGE_AUTO,
+                                       VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                       VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    memory_telemetry.track(buffer.allocation, AllocationCategory::Buffer);
+
+    base_device_address = incan_util::get_buffer_device_address(device, buffer.buffer);
+}
+
+std::optional<LinearAllocation> FrameLinearAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    // Alignments are powers of two, so rounding up is a mask
+    VkDeviceSize used_alignment = std::max(alignment, min_alignment);
+    VkDeviceSize offset = (head + used_alignment - 1) & ~(used_alignment - 1);
+
+    if (offset + size > capacity) {
+        return std::nullopt;
+    }
+    head = offset + size;
+
+    LinearAllocation allocation = {};
+    allocation.buffer = buffer.buffer;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.mapped = static_cast<std::byte *>(buffer.allocation_info.pMappedData) + offset;
+    allocation.device_address = base_device_address + offset;
+
+    return allocation;
+}
+
+void FrameLinearAllocator::flush(VmaAllocator allocator) {
+    if (head > 0) {
+        vmaFlushAllocation(allocator, buffer.allocation, 0, head);
+    }
+}
+
+void FrameLinearAllocator::reset() {
+    head = 0;
+}
+
+void FrameLinearAllocator::destroy(VmaAllocator allocator, MemoryTelemetry &memory_telemetry) {
+    memory_telemetry.untrack(buffer.allocation);
+    incan_util::destroy_buffer(allocator, buffer);
+}
@@ -0,0 +1,73 @@
+#ifndef INCANDESCENT_BUFFERS_H
+#define INCANDESCENT_BUFFERS_H
+
+#include <incandescent_types.h>
+#include <incandescent_memory.h>
+#include <cstring>
+
+// Struct to hold data for a buffer
+struct AllocatedBuffer {
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    VmaAllocationInfo allocation_info;
+    // Kept so the buffer can be recreated when the defragmenter moves it
+    VkDeviceSize size;
+    VkBufferUsageFlags usage_flags;
+};
+
+namespace incan_util {
+    AllocatedBuffer create_buffer(VmaAllocator allocator, size_t size, VkBufferUsageFlags usage_flags,
+                                  VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags = 0);
+
+    void destroy_buffer(VmaAllocator allocator, const AllocatedBuffer &buffer);
+
+    VkDeviceAddress get_buffer_device_address(VkDevice device, VkBuffer buffer);
+}
+
+// A sub-range handed out by FrameLinearAllocator, valid until the owning frame is reused
+struct LinearAllocation {
+    VkBuffer buffer;
+    VkDeviceSize offset; // Use as the dynamic offset when binding
+    VkDeviceSize size;
+    void *mapped; // Write the data here, no map/unmap needed
+    VkDeviceAddress device_address; // For shaders reading through buffer device address
+};
+
+/*
+ * Bump allocator over one persistently mapped, host-visible buffer. Each FrameData owns one and resets it once the
+ * frame's render fence has been waited on, so per-frame uniform and dynamic data never allocates or maps.
+ */
+struct FrameLinearAllocator {
+    AllocatedBuffer buffer;
+    VkDeviceAddress base_device_address;
+    VkDeviceSize capacity;
+    VkDeviceSize head;
+    // Max of minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment
+    VkDeviceSize min_alignment;
+
+    void initialize(VkDevice device, VmaAllocator allocator, MemoryTelemetry &memory_telemetry,
+                    VkDeviceSize buffer_capacity, const VkPhysicalDeviceLimits &limits);
+
+    // Returns an aligned sub-range, or nothing if the frame has run out of space
+    std::optional<LinearAllocation> allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    // Allocates and copies a single value in one go
+    template<typename T>
+    std::optional<LinearAllocation> push(const T &data) {
+        std::optional<LinearAllocation> allocation = allocate(sizeof(T));
+        if (allocation.has_value()) {
+            memcpy(allocation->mapped, &data, sizeof(T));
+        }
+        return allocation;
+    }
+
+    // Makes this frame's writes visible to the GPU, no-op on host-coherent memory
+    void flush(VmaAllocator allocator);
+
+    void reset();
+
+    void destroy(VmaAllocator allocator, MemoryTelemetry &memory_telemetry);
+};
+
+
+#endif //INCANDESCENT_BUFFERS_H
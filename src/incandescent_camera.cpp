@@ -0,0 +1,54 @@
+#include <incandescent_camera.h>
+
+Eigen::Vector3f Camera::forward() const {
+    return {-std::sin(yaw) * std::cos(pitch), std::sin(pitch), -std::cos(yaw) * std::cos(pitch)};
+}
+
+Eigen::Matrix4f Camera::view_matrix() const {
+    Eigen::Matrix3f rotation = (Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitY()) *
+                                Eigen::AngleAxisf(pitch, Eigen::Vector3f::UnitX())).toRotationMatrix();
+
+    // Inverse of the camera's rigid transform
+    Eigen::Matrix4f view = Eigen::Matrix4f::Identity();
+    view.topLeftCorner<3, 3>() = rotation.transpose();
+    view.topRightCorner<3, 1>() = -rotation.transpose() * position;
+    return view;
+}
+
+Eigen::Matrix4f Camera::projection_matrix(float aspect_ratio) const {
+    float focal_length = 1.0f / std::tan(vertical_fov * 0.5f);
+
+    // clip z = near and clip w = -view z, so depth is near / distance
+    Eigen::Matrix4f projection = Eigen::Matrix4f::Zero();
+    projection(0, 0) = focal_length / aspect_ratio;
+    projection(1, 1) = -focal_length;
+    projection(2, 3) = near_plane;
+    projection(3, 2) = -1.0f;
+    return projection;
+}
+
+std::array<Eigen::Vector4f, 5> Camera::frustum_planes(float aspect_ratio) const {
+    Eigen::Matrix4f view_projection = projection_matrix(aspect_ratio) * view_matrix();
+
+    // Gribb and Hartmann, -w <= x, y <= w and z <= w. The far plane (z >= 0) is at infinity and has nothing to test
+    Eigen::RowVector4f w_row = view_projection.row(3);
+    std::array<Eigen::Vector4f, 5> planes = {
+        (w_row + view_projection.row(0)).transpose(),
+        (w_row - view_projection.row(0)).transpose(),
+        (w_row + view_projection.row(1)).transpose(),
+        (w_row - view_projection.row(1)).transpose(),
+        (w_row - view_projection.row(2)).transpose(),
+    };
+    for (Eigen::Vector4f &plane: planes) {
+        plane /= plane.head<3>().norm();
+    }
+    return planes;
+}
+
+void Camera::frame_sphere(const Eigen::Vector3f &center, float radius) {
+    radius = std::max(radius, 1e-3f);
+    float distance = radius / std::sin(vertical_fov * 0.5f);
+    position = center - forward() * distance;
+    // Reversed Z keeps precision far away, so the near plane can sit close without losing much
+    near_plane = std::max(radius * 0.01f, 1e-4f);
+}
@@ -0,0 +1,34 @@
+#ifndef INCANDESCENT_CAMERA_H
+#define INCANDESCENT_CAMERA_H
+
+#include <incandescent_types.h>
+
+/*
+ * Right handed, Y up, looking down -Z at zero yaw and pitch. The projection is reversed Z with the far plane at
+ * infinity: depth is 1 on the near plane and falls towards 0 with distance, which spreads float precision evenly over
+ * the view and makes the farthest depth the smallest one. Clip space Y is flipped for Vulkan's downward Y.
+ */
+struct Camera {
+    Eigen::Vector3f position = Eigen::Vector3f(0.0f, 0.0f, 5.0f);
+    // Radians, yaw turns around +Y and a positive pitch looks up
+    float yaw = 0.0f;
+    float pitch = 0.0f;
+    float vertical_fov = 1.2217305f; // 70 degrees
+    float near_plane = 0.1f;
+
+    Eigen::Vector3f forward() const;
+
+    Eigen::Matrix4f view_matrix() const;
+
+    Eigen::Matrix4f projection_matrix(float aspect_ratio) const;
+
+    // Left, right, bottom, top and near planes of projection * view in world space, normalized with the normals
+    // pointing inwards, so a sphere is outside if dot(plane.xyz, center) + plane.w < -radius for any of them
+    std::array<Eigen::Vector4f, 5> frustum_planes(float aspect_ratio) const;
+
+    // Keeps the direction and backs off from the sphere's center until the sphere fits the view vertically
+    void frame_sphere(const Eigen::Vector3f &center, float radius);
+};
+
+
+#endif //INCANDESCENT_CAMERA_H
@@ -0,0 +1,131 @@
+#include <incandescent_decompression.h>
+#include <incandescent_images.h>
+#include <incandescent_lz4.h>
+#include <volk.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+    // Shared memory lz4_decompress.comp declares: the tile plus five uint arrays of BATCH_SEQUENCES and three uints
+    constexpr uint32_t DECOMPRESS_SHARED_MEMORY = LZ4_TILE_SIZE + (5 * 32 + 3) * sizeof(uint32_t);
+}
+
+void GpuDecompressor::initialize(VkDevice vulkan_device, VkPhysicalDevice gpu, DescriptorLayoutCache &layout_cache,
+                                 ResourceManager &resource_manager, bool device_supports_int64) {
+    device = vulkan_device;
+    resources = &resource_manager;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(gpu, &properties);
+    max_workgroup_count = properties.limits.maxComputeWorkGroupCount[0];
+    // The spec only guarantees 16 KiB of shared memory, which is exactly one tile
+    if (!device_supports_int64 || properties.limits.maxComputeSharedMemorySize < DECOMPRESS_SHARED_MEMORY) {
+        fmt::print("Device can't decompress on the GPU, decompressing assets on the CPU\n");
+        return;
+    }
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(Lz4DecompressPushConstants);
+
+    VkPipelineLayout pipeline_layout = layout_cache.get_pipeline_layout(device, {}, {&push_constant_range, 1});
+
+    VkShaderModule decompress_shader;
+    if (!incan_util::load_shader_module("shaders/lz4_decompress.comp.spv", device, &decompress_shader)) {
+        fmt::print("Error when building LZ4 decompression shader, decompressing assets on the CPU\n");
+        return;
+    }
+
+    VkPipelineShaderStageCreateInfo shader_stage_create_info = {};
+    shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stage_create_info.pNext = nullptr;
+    shader_stage_create_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shader_stage_create_info.module = decompress_shader;
+    shader_stage_create_info.pName = "main";
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+    compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    compute_pipeline_create_info.pNext = nullptr;
+    compute_pipeline_create_info.layout = pipeline_layout;
+    compute_pipeline_create_info.stage = shader_stage_create_info;
+
+    VkPipeline compute_pipeline;
+    VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr,
+        &compute_pipeline));
+    pipeline = resources->add_pipeline(compute_pipeline, pipeline_layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+    vkDestroyShaderModule(device, decompress_shader, nullptr);
+    enabled = true;
+}
+
+void GpuDecompressor::record(VkCommandBuffer command_buffer, VkDeviceAddress source, VkDeviceAddress destination,
+                             VkDeviceSize size) const {
+    const PipelineHotData &decompress = resources->pipelines.hot(pipeline);
+    vkCmdBindPipeline(command_buffer, decompress.bind_point, decompress.pipeline);
+
+    Lz4DecompressPushConstants push_constants = {};
+    push_constants.source = source;
+    push_constants.destination = destination;
+    push_constants.size = static_cast<uint32_t>(size);
+
+    // Streams with more tiles than one dispatch can launch go in several
+    auto tile_count = static_cast<uint32_t>(incan_lz4::tile_count(size));
+    for (uint32_t first_tile = 0; first_tile < tile_count; first_tile += max_workgroup_count) {
+        push_constants.first_tile = first_tile;
+        vkCmdPushConstants(command_buffer, decompress.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(Lz4DecompressPushConstants), &push_constants);
+        vkCmdDispatch(command_buffer, std::min(tile_count - first_tile, max_workgroup_count), 1, 1);
+    }
+}
+
+void GpuDecompressor::destroy() {
+    // The pipeline layout belongs to the layout cache
+    if (enabled) {
+        resources->destroy_pipeline(pipeline);
+    }
+}
+
+StagedEntry incan_decompression::stage_entry(const GpuDecompressor &decompressor, const Archive &archive,
+                                             const ArchiveEntry &entry, UploadBatch &upload_batch) {
+    StagedEntry staged_entry = {};
+    // The shader counts the decompressed bytes in 32 bits
+    bool gpu_decompression = decompressor.enabled && entry.compression == ArchiveCompression::Lz4 &&
+                             entry.size <= std::numeric_limits<uint32_t>::max();
+    if (!gpu_decompression) {
+        staged_entry.staging_offset = upload_batch.reserve(entry.size);
+        staged_entry.source = UploadSource::Staging;
+        staged_entry.offset = staged_entry.staging_offset;
+        upload_batch.allocate_staging();
+        staged_entry.read = archive.read(entry, upload_batch.staging_data(staged_entry.staging_offset));
+        return staged_entry;
+    }
+
+    staged_entry.staging_offset = upload_batch.reserve(entry.stored_size);
+    staged_entry.source = UploadSource::Decompressed;
+    staged_entry.offset = upload_batch.decompress(decompressor, staged_entry.staging_offset, entry.size);
+    upload_batch.allocate_staging();
+    staged_entry.read = archive.read_stored(entry, upload_batch.staging_data(staged_entry.staging_offset));
+    return staged_entry;
+}
+
+std::vector<std::byte> incan_decompression::entry_header(const StagedEntry &staged_entry, const ArchiveEntry &entry,
+                                                         const UploadBatch &upload_batch) {
+    const std::byte *staging = upload_batch.staging_data(staged_entry.staging_offset);
+    size_t header_size = std::min<size_t>(entry.size, LZ4_TILE_SIZE);
+    if (header_size == 0) {
+        return {};
+    }
+    if (staged_entry.source == UploadSource::Staging) {
+        return {staging, staging + header_size};
+    }
+
+    // Only the first tile is expanded here, the GPU is trusted with the rest once the table checks out
+    std::span<const std::byte> stream(staging, entry.stored_size);
+    std::vector<std::byte> header(header_size);
+    if (!incan_lz4::tiles_valid(stream, entry.size) || !incan_lz4::decompress_tile(stream, 0, header)) {
+        return {};
+    }
+    return header;
+}
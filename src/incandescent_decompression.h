@@ -0,0 +1,67 @@
+#ifndef INCANDESCENT_DECOMPRESSION_H
+#define INCANDESCENT_DECOMPRESSION_H
+
+#include <incandescent_types.h>
+#include <incandescent_archive.h>
+#include <incandescent_descriptors.h>
+#include <incandescent_resources.h>
+#include <incandescent_upload.h>
+
+// Must match PushConstants in lz4_decompress.comp
+struct Lz4DecompressPushConstants {
+    VkDeviceAddress source;
+    VkDeviceAddress destination;
+    uint32_t size;
+    uint32_t first_tile;
+};
+
+/*
+ * Expands tiled LZ4 streams (incan_lz4::compress_tiles) on the GPU with lz4_decompress.comp, one workgroup per tile,
+ * so compressed assets cross the bus as they are stored and no CPU core spends the load decompressing them. The shader
+ * reads and writes through buffer addresses and keeps a whole tile in shared memory, a device without 64-bit shader
+ * integers or with too little shared memory leaves enabled false and its callers decompress on the CPU.
+ */
+struct GpuDecompressor {
+    PipelineHandle pipeline;
+    bool enabled = false;
+
+    void initialize(VkDevice vulkan_device, VkPhysicalDevice gpu, DescriptorLayoutCache &layout_cache,
+                    ResourceManager &resource_manager, bool device_supports_int64);
+
+    // Expands the stream at source into size bytes at destination, both 4 byte aligned. The last word is written
+    // whole, so destination takes size rounded up to 4 bytes. No barriers, the caller orders what comes around it
+    void record(VkCommandBuffer command_buffer, VkDeviceAddress source, VkDeviceAddress destination,
+                VkDeviceSize size) const;
+
+    void destroy();
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    ResourceManager *resources = nullptr;
+    uint32_t max_workgroup_count = 0;
+};
+
+// An archive entry on its way into an UploadBatch's staging buffer, LZ4 entries go as they are stored when the GPU
+// decompresses them
+struct StagedEntry {
+    // Still has to be submitted, and the batch recorded only once it is complete
+    FileRead read;
+    VkDeviceSize staging_offset;
+    // Where the entry's decompressed bytes are once the batch is recorded
+    UploadSource source;
+    VkDeviceSize offset;
+};
+
+namespace incan_decompression {
+    // Reserves the entry in upload_batch and allocates the batch's staging, so it has to be the batch's only one
+    StagedEntry stage_entry(const GpuDecompressor &decompressor, const Archive &archive, const ArchiveEntry &entry,
+                            UploadBatch &upload_batch);
+
+    // Once the read is complete: up to the first LZ4_TILE_SIZE bytes of the decompressed entry, enough to read a
+    // header from. Empty if the entry is malformed
+    std::vector<std::byte> entry_header(const StagedEntry &staged_entry, const ArchiveEntry &entry,
+                                        const UploadBatch &upload_batch);
+}
+
+
+#endif //INCANDESCENT_DECOMPRESSION_H
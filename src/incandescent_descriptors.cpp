@@ -5,12 +5,15 @@
 #include <incandescent_types.h>
 #include <incandescent_descriptors.h>
 #include <volk.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 
-void DescriptorLayoutBuilder::add_binding(uint32_t binding, VkDescriptorType type) {
+void DescriptorLayoutBuilder::add_binding(uint32_t binding, VkDescriptorType type, uint32_t descriptor_count) {
     VkDescriptorSetLayoutBinding new_binding = {};
     new_binding.binding = binding;
-    new_binding.descriptorCount = 1;
+    new_binding.descriptorCount = descriptor_count;
     new_binding.descriptorType = type;
 
     bindings.push_back(new_binding);
@@ -20,18 +23,25 @@ void DescriptorLayoutBuilder::clear() {
     bindings.clear();
 }
 
-VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderStageFlags shader_stages, void *pNext,
-                                                     VkDescriptorSetLayoutCreateFlags flags) {
+std::vector<VkDescriptorSetLayoutBinding> DescriptorLayoutBuilder::staged_bindings(
+    VkShaderStageFlags shader_stages) const {
     // Add stage flags for each binding
-    for (auto &binding: bindings) {
+    std::vector<VkDescriptorSetLayoutBinding> staged = bindings;
+    for (auto &binding: staged) {
         binding.stageFlags |= shader_stages;
     }
+    return staged;
+}
+
+VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderStageFlags shader_stages, void *pNext,
+                                                     VkDescriptorSetLayoutCreateFlags flags) {
+    std::vector<VkDescriptorSetLayoutBinding> layout_bindings = staged_bindings(shader_stages);
 
     VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
     descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptor_set_layout_create_info.pNext = pNext;
-    descriptor_set_layout_create_info.pBindings = bindings.data();
-    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    descriptor_set_layout_create_info.pBindings = layout_bindings.data();
+    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(layout_bindings.size());
     descriptor_set_layout_create_info.flags = flags;
 
     VkDescriptorSetLayout set;
@@ -40,12 +50,570 @@ VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderSt
     return set;
 }
 
-void DescriptorAllocator::initialize_pool(VkDevice device, uint32_t max_sets,
-                                          std::span<PoolSizeRatio> pool_size_ratios) {
+VkDescriptorSetLayout DescriptorLayoutBuilder::build(DescriptorLayoutCache &layout_cache, VkDevice device,
+                                                     VkShaderStageFlags shader_stages,
+                                                     VkDescriptorSetLayoutCreateFlags flags,
+                                                     std::span<const VkDescriptorBindingFlags> binding_flags) {
+    return layout_cache.get_descriptor_set_layout(device, staged_bindings(shader_stages), flags, binding_flags);
+}
+
+void DescriptorWriter::write_image(uint32_t binding, VkImageView image_view, VkSampler sampler,
+                                   VkImageLayout layout, VkDescriptorType type, uint32_t array_element) {
+    VkDescriptorImageInfo descriptor_image_info = {};
+    descriptor_image_info.sampler = sampler;
+    descriptor_image_info.imageView = image_view;
+    descriptor_image_info.imageLayout = layout;
+
+    size_t offset = packed_data.size();
+    packed_data.resize(offset + sizeof(VkDescriptorImageInfo));
+    memcpy(packed_data.data() + offset, &descriptor_image_info, sizeof(VkDescriptorImageInfo));
+
+    entries.push_back(WriteEntry{
+        .binding = binding, .array_element = array_element, .type = type, .offset = offset
+    });
+}
+
+void DescriptorWriter::write_buffer(uint32_t binding, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset,
+                                    VkDescriptorType type) {
+    VkDescriptorBufferInfo descriptor_buffer_info = {};
+    descriptor_buffer_info.buffer = buffer;
+    descriptor_buffer_info.offset = offset;
+    descriptor_buffer_info.range = size;
+
+    size_t data_offset = packed_data.size();
+    packed_data.resize(data_offset + sizeof(VkDescriptorBufferInfo));
+    memcpy(packed_data.data() + data_offset, &descriptor_buffer_info, sizeof(VkDescriptorBufferInfo));
+
+    entries.push_back(WriteEntry{.binding = binding, .array_element = 0, .type = type, .offset = data_offset});
+}
+
+void DescriptorWriter::clear() {
+    entries.clear();
+    packed_data.clear();
+}
+
+// Buffer descriptor types read VkDescriptorBufferInfo, everything this writer handles otherwise is an image
+static bool is_buffer_descriptor(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+           type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+std::vector<VkDescriptorUpdateTemplateEntry> DescriptorWriter::template_entries() const {
+    std::vector<VkDescriptorUpdateTemplateEntry> template_entries;
+    template_entries.reserve(entries.size());
+    for (const WriteEntry &entry: entries) {
+        VkDescriptorUpdateTemplateEntry template_entry = {};
+        template_entry.dstBinding = entry.binding;
+        template_entry.dstArrayElement = entry.array_element;
+        template_entry.descriptorCount = 1;
+        template_entry.descriptorType = entry.type;
+        template_entry.offset = entry.offset;
+        template_entry.stride = is_buffer_descriptor(entry.type)
+                                    ? sizeof(VkDescriptorBufferInfo)
+                                    : sizeof(VkDescriptorImageInfo);
+        template_entries.push_back(template_entry);
+    }
+    return template_entries;
+}
+
+void DescriptorWriter::update_set(VkDevice device, VkDescriptorSet set) const {
+    std::vector<VkWriteDescriptorSet> writes;
+    writes.reserve(entries.size());
+    for (const WriteEntry &entry: entries) {
+        VkWriteDescriptorSet write_descriptor_set = {};
+        write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write_descriptor_set.pNext = nullptr;
+        write_descriptor_set.dstBinding = entry.binding;
+        write_descriptor_set.dstSet = set;
+        write_descriptor_set.dstArrayElement = entry.array_element;
+        write_descriptor_set.descriptorCount = 1;
+        write_descriptor_set.descriptorType = entry.type;
+        if (is_buffer_descriptor(entry.type)) {
+            write_descriptor_set.pBufferInfo = reinterpret_cast<const VkDescriptorBufferInfo *>(
+                packed_data.data() + entry.offset);
+        } else {
+            write_descriptor_set.pImageInfo = reinterpret_cast<const VkDescriptorImageInfo *>(
+                packed_data.data() + entry.offset);
+        }
+        writes.push_back(write_descriptor_set);
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void DescriptorWriter::update_set(VkDevice device, VkDescriptorSet set,
+                                  VkDescriptorUpdateTemplate update_template) const {
+    vkUpdateDescriptorSetWithTemplate(device, set, update_template, packed_data.data());
+}
+
+void DescriptorWriter::update_set(VkDevice device, DescriptorBufferAllocator &descriptor_buffer,
+                                  VkDeviceSize set_offset, VkDescriptorSetLayout layout) const {
+    std::byte *set_data = descriptor_buffer.mapped_data(set_offset);
+
+    for (const WriteEntry &entry: entries) {
+        VkDeviceSize binding_offset;
+        vkGetDescriptorSetLayoutBindingOffsetEXT(device, layout, entry.binding, &binding_offset);
+
+        VkDescriptorGetInfoEXT descriptor_get_info = {};
+        descriptor_get_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+        descriptor_get_info.pNext = nullptr;
+        descriptor_get_info.type = entry.type;
+
+        // Buffers are described by address here rather than by handle
+        VkDescriptorAddressInfoEXT descriptor_address_info = {};
+        const auto *image_info = reinterpret_cast<const VkDescriptorImageInfo *>(packed_data.data() + entry.offset);
+        if (is_buffer_descriptor(entry.type)) {
+            const auto *buffer_info = reinterpret_cast<const VkDescriptorBufferInfo *>(
+                packed_data.data() + entry.offset);
+            descriptor_address_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_ADDRESS_INFO_EXT;
+            descriptor_address_info.pNext = nullptr;
+            descriptor_address_info.address = incan_util::get_buffer_device_address(device, buffer_info->buffer) +
+                                              buffer_info->offset;
+            descriptor_address_info.range = buffer_info->range;
+            descriptor_address_info.format = VK_FORMAT_UNDEFINED;
+
+            if (entry.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                descriptor_get_info.data.pUniformBuffer = &descriptor_address_info;
+            } else {
+                descriptor_get_info.data.pStorageBuffer = &descriptor_address_info;
+            }
+        } else if (entry.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) {
+            descriptor_get_info.data.pStorageImage = image_info;
+        } else if (entry.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE) {
+            descriptor_get_info.data.pSampledImage = image_info;
+        } else if (entry.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+            descriptor_get_info.data.pCombinedImageSampler = image_info;
+        } else if (entry.type == VK_DESCRIPTOR_TYPE_SAMPLER) {
+            descriptor_get_info.data.pSampler = &image_info->sampler;
+        }
+
+        // Array elements are packed back to back within the binding
+        size_t descriptor_size = descriptor_buffer.descriptor_size(entry.type);
+        vkGetDescriptorEXT(device, &descriptor_get_info, descriptor_size,
+                           set_data + binding_offset + entry.array_element * descriptor_size);
+    }
+}
+
+void DescriptorBufferAllocator::initialize(VkDevice device, VmaAllocator allocator,
+                                           MemoryTelemetry &memory_telemetry, VkDeviceSize buffer_capacity,
+                                           const VkPhysicalDeviceDescriptorBufferPropertiesEXT &
+                                           descriptor_buffer_properties) {
+    properties = descriptor_buffer_properties;
+    properties.pNext = nullptr;
+    capacity = buffer_capacity;
+    head = 0;
+    requested = 0;
+
+    // Host written every frame, same memory setup as the frame linear allocator
+    buffer = incan_util::create_buffer(allocator, capacity,
+                                       VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+                                       VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+                                       VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                       VMA_MEMORY_USAGE_AUTO,
+                                       VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                       VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    memory_telemetry.track(buffer.allocation, AllocationCategory::Buffer);
+
+    base_device_address = incan_util::get_buffer_device_address(device, buffer.buffer);
+}
+
+std::optional<VkDeviceSize> DescriptorBufferAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout) {
+    VkDeviceSize layout_size;
+    vkGetDescriptorSetLayoutSizeEXT(device, layout, &layout_size);
+
+    // Set offsets must respect descriptorBufferOffsetAlignment (always a power of two)
+    VkDeviceSize alignment = properties.descriptorBufferOffsetAlignment;
+    VkDeviceSize offset = (std::max(head, requested) + alignment - 1) & ~(alignment - 1);
+    requested = offset + layout_size;
+
+    // The buffer is already bound and referenced by this frame's commands, it can only grow once the frame retires
+    if (requested > capacity) {
+        return std::nullopt;
+    }
+    head = requested;
+
+    return offset;
+}
+
+size_t DescriptorBufferAllocator::descriptor_size(VkDescriptorType type) const {
+    switch (type) {
+        case VK_DESCRIPTOR_TYPE_SAMPLER:
+            return properties.samplerDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+            return properties.combinedImageSamplerDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+            return properties.sampledImageDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+            return properties.storageImageDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+            return properties.uniformBufferDescriptorSize;
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+            return properties.storageBufferDescriptorSize;
+        default:
+            return 0;
+    }
+}
+
+std::byte *DescriptorBufferAllocator::mapped_data(VkDeviceSize set_offset) const {
+    return static_cast<std::byte *>(buffer.allocation_info.pMappedData) + set_offset;
+}
+
+void DescriptorBufferAllocator::flush(VmaAllocator allocator) {
+    if (head > 0) {
+        vmaFlushAllocation(allocator, buffer.allocation, 0, head);
+    }
+}
+
+void DescriptorBufferAllocator::clear_descriptors(VkDevice device, VmaAllocator allocator,
+                                                  MemoryTelemetry &memory_telemetry) {
+    if (requested > capacity) {
+        VkDeviceSize grown_capacity = std::max(capacity * 2, requested);
+        fmt::print("Descriptor buffer out of space ({} of {} bytes requested), growing to {} bytes\n", requested,
+                   capacity, grown_capacity);
+
+        destroy(allocator, memory_telemetry);
+        initialize(device, allocator, memory_telemetry, grown_capacity, properties);
+    }
+    head = 0;
+    requested = 0;
+}
+
+void DescriptorBufferAllocator::bind(VkCommandBuffer command_buffer) {
+    VkDescriptorBufferBindingInfoEXT binding_info = {};
+    binding_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+    binding_info.pNext = nullptr;
+    binding_info.address = base_device_address;
+    binding_info.usage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+                         VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+
+    vkCmdBindDescriptorBuffersEXT(command_buffer, 1, &binding_info);
+}
+
+void DescriptorBufferAllocator::set_offset(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point,
+                                           VkPipelineLayout pipeline_layout, uint32_t set_index,
+                                           VkDeviceSize offset) {
+    // Index 0 refers to the single buffer bound in bind()
+    uint32_t buffer_index = 0;
+    vkCmdSetDescriptorBufferOffsetsEXT(command_buffer, bind_point, pipeline_layout, set_index, 1, &buffer_index,
+                                       &offset);
+}
+
+void DescriptorBufferAllocator::destroy(VmaAllocator allocator, MemoryTelemetry &memory_telemetry) {
+    memory_telemetry.untrack(buffer.allocation);
+    incan_util::destroy_buffer(allocator, buffer);
+}
+
+bool DescriptorLayoutCache::DescriptorSetLayoutKey::operator==(const DescriptorSetLayoutKey &other) const {
+    if (flags != other.flags || bindings.size() != other.bindings.size() || binding_flags != other.binding_flags) {
+        return false;
+    }
+    for (size_t i = 0; i < bindings.size(); i++) {
+        if (bindings[i].binding != other.bindings[i].binding ||
+            bindings[i].descriptorType != other.bindings[i].descriptorType ||
+            bindings[i].descriptorCount != other.bindings[i].descriptorCount ||
+            bindings[i].stageFlags != other.bindings[i].stageFlags) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t DescriptorLayoutCache::DescriptorSetLayoutKeyHash::operator()(const DescriptorSetLayoutKey &key) const {
+    size_t seed = std::hash<uint32_t>{}(key.flags);
+    for (const VkDescriptorSetLayoutBinding &binding: key.bindings) {
+        // Binding index, type and count fit in one 64 bit word
+        size_t packed = static_cast<size_t>(binding.binding) |
+                        static_cast<size_t>(binding.descriptorType) << 16 |
+                        static_cast<size_t>(binding.descriptorCount) << 32;
+        incan_util::hash_combine(seed, packed);
+        incan_util::hash_combine(seed, binding.stageFlags);
+    }
+    for (VkDescriptorBindingFlags binding_flags: key.binding_flags) {
+        incan_util::hash_combine(seed, binding_flags);
+    }
+    return seed;
+}
+
+bool DescriptorLayoutCache::PipelineLayoutKey::operator==(const PipelineLayoutKey &other) const {
+    if (set_layouts != other.set_layouts || push_constant_ranges.size() != other.push_constant_ranges.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < push_constant_ranges.size(); i++) {
+        if (push_constant_ranges[i].stageFlags != other.push_constant_ranges[i].stageFlags ||
+            push_constant_ranges[i].offset != other.push_constant_ranges[i].offset ||
+            push_constant_ranges[i].size != other.push_constant_ranges[i].size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t DescriptorLayoutCache::PipelineLayoutKeyHash::operator()(const PipelineLayoutKey &key) const {
+    size_t seed = key.set_layouts.size();
+    for (VkDescriptorSetLayout set_layout: key.set_layouts) {
+        incan_util::hash_combine(seed, std::hash<VkDescriptorSetLayout>{}(set_layout));
+    }
+    for (const VkPushConstantRange &range: key.push_constant_ranges) {
+        incan_util::hash_combine(seed, range.stageFlags);
+        incan_util::hash_combine(seed, static_cast<size_t>(range.offset) << 32 | range.size);
+    }
+    return seed;
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::get_descriptor_set_layout(
+    VkDevice device, std::span<const VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags,
+    std::span<const VkDescriptorBindingFlags> binding_flags) {
+    // Flags are per binding, and immutable samplers aren't part of the key, layouts using them can't share a handle
+    if (!binding_flags.empty() && binding_flags.size() != bindings.size()) {
+        throw std::runtime_error("Descriptor binding flags don't match the bindings!");
+    }
+    for (const VkDescriptorSetLayoutBinding &binding: bindings) {
+        if (binding.pImmutableSamplers != nullptr) {
+            throw std::runtime_error("Cached descriptor set layouts can't have immutable samplers!");
+        }
+    }
+
+    DescriptorSetLayoutKey key;
+    key.bindings.assign(bindings.begin(), bindings.end());
+    key.binding_flags.assign(binding_flags.begin(), binding_flags.end());
+    key.flags = flags;
+
+    // Sort by binding index so the same bindings added in a different order still match
+    std::vector<uint32_t> order(key.bindings.size());
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&key](uint32_t a, uint32_t b) {
+        return key.bindings[a].binding < key.bindings[b].binding;
+    });
+    DescriptorSetLayoutKey sorted_key;
+    sorted_key.flags = flags;
+    for (uint32_t index: order) {
+        sorted_key.bindings.push_back(key.bindings[index]);
+        if (!key.binding_flags.empty()) {
+            sorted_key.binding_flags.push_back(key.binding_flags[index]);
+        }
+    }
+
+    std::lock_guard lock(cache_mutex);
+    auto cached = descriptor_set_layouts.find(sorted_key);
+    if (cached != descriptor_set_layouts.end()) {
+        return cached->second;
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_create_info = {};
+    binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_create_info.pNext = nullptr;
+    binding_flags_create_info.bindingCount = static_cast<uint32_t>(sorted_key.binding_flags.size());
+    binding_flags_create_info.pBindingFlags = sorted_key.binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.pNext = sorted_key.binding_flags.empty() ? nullptr : &binding_flags_create_info;
+    descriptor_set_layout_create_info.pBindings = sorted_key.bindings.data();
+    descriptor_set_layout_create_info.bindingCount = static_cast<uint32_t>(sorted_key.bindings.size());
+    descriptor_set_layout_create_info.flags = flags;
+
+    VkDescriptorSetLayout set_layout;
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &set_layout));
+
+    descriptor_set_layouts.emplace(std::move(sorted_key), set_layout);
+    return set_layout;
+}
+
+VkPipelineLayout DescriptorLayoutCache::get_pipeline_layout(VkDevice device,
+                                                            std::span<const VkDescriptorSetLayout> set_layouts,
+                                                            std::span<const VkPushConstantRange> push_constant_ranges) {
+    PipelineLayoutKey key;
+    key.set_layouts.assign(set_layouts.begin(), set_layouts.end());
+    key.push_constant_ranges.assign(push_constant_ranges.begin(), push_constant_ranges.end());
+
+    std::lock_guard lock(cache_mutex);
+    auto cached = pipeline_layouts.find(key);
+    if (cached != pipeline_layouts.end()) {
+        return cached->second;
+    }
+
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.pNext = nullptr;
+    pipeline_layout_create_info.pSetLayouts = key.set_layouts.data();
+    pipeline_layout_create_info.setLayoutCount = static_cast<uint32_t>(key.set_layouts.size());
+    pipeline_layout_create_info.pPushConstantRanges = key.push_constant_ranges.data();
+    pipeline_layout_create_info.pushConstantRangeCount = static_cast<uint32_t>(key.push_constant_ranges.size());
+
+    VkPipelineLayout pipeline_layout;
+    VK_CHECK(vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout));
+
+    pipeline_layouts.emplace(std::move(key), pipeline_layout);
+    return pipeline_layout;
+}
+
+bool DescriptorLayoutCache::UpdateTemplateKey::operator==(const UpdateTemplateKey &other) const {
+    if (set_layout != other.set_layout || entries.size() != other.entries.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].dstBinding != other.entries[i].dstBinding ||
+            entries[i].dstArrayElement != other.entries[i].dstArrayElement ||
+            entries[i].descriptorType != other.entries[i].descriptorType ||
+            entries[i].offset != other.entries[i].offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t DescriptorLayoutCache::UpdateTemplateKeyHash::operator()(const UpdateTemplateKey &key) const {
+    size_t seed = std::hash<VkDescriptorSetLayout>{}(key.set_layout);
+    for (const VkDescriptorUpdateTemplateEntry &entry: key.entries) {
+        incan_util::hash_combine(seed, static_cast<size_t>(entry.dstBinding) << 32 | entry.descriptorType);
+        incan_util::hash_combine(seed, entry.dstArrayElement);
+        incan_util::hash_combine(seed, entry.offset);
+    }
+    return seed;
+}
+
+VkDescriptorUpdateTemplate DescriptorLayoutCache::get_update_template(VkDevice device,
+                                                                      VkDescriptorSetLayout set_layout,
+                                                                      const DescriptorWriter &writer) {
+    UpdateTemplateKey key;
+    key.set_layout = set_layout;
+    key.entries = writer.template_entries();
+
+    std::lock_guard lock(cache_mutex);
+    auto cached = update_templates.find(key);
+    if (cached != update_templates.end()) {
+        return cached->second;
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo update_template_create_info = {};
+    update_template_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    update_template_create_info.pNext = nullptr;
+    update_template_create_info.descriptorUpdateEntryCount = static_cast<uint32_t>(key.entries.size());
+    update_template_create_info.pDescriptorUpdateEntries = key.entries.data();
+    update_template_create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    update_template_create_info.descriptorSetLayout = set_layout;
+
+    VkDescriptorUpdateTemplate update_template;
+    VK_CHECK(vkCreateDescriptorUpdateTemplate(device, &update_template_create_info, nullptr, &update_template));
+
+    update_templates.emplace(std::move(key), update_template);
+    return update_template;
+}
+
+void DescriptorLayoutCache::destroy(VkDevice device) {
+    std::lock_guard lock(cache_mutex);
+    // Templates and pipeline layouts reference the set layouts, so they go first
+    for (auto &[key, update_template]: update_templates) {
+        vkDestroyDescriptorUpdateTemplate(device, update_template, nullptr);
+    }
+    update_templates.clear();
+    for (auto &[key, pipeline_layout]: pipeline_layouts) {
+        vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    }
+    pipeline_layouts.clear();
+    for (auto &[key, set_layout]: descriptor_set_layouts) {
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    }
+    descriptor_set_layouts.clear();
+}
+
+// Each new pool gets this many times the sets of the last one, up to the cap
+constexpr float DESCRIPTOR_POOL_GROWTH_FACTOR = 1.5f;
+constexpr uint32_t MAX_SETS_PER_DESCRIPTOR_POOL = 4092;
+
+void DescriptorAllocator::initialize_pools(VkDevice device, uint32_t initial_sets,
+                                           std::span<PoolSizeRatio> pool_size_ratios) {
+    ratios.assign(pool_size_ratios.begin(), pool_size_ratios.end());
+
+    VkDescriptorPool new_pool = create_pool(device, initial_sets, ratios);
+    sets_per_pool = std::min(static_cast<uint32_t>(initial_sets * DESCRIPTOR_POOL_GROWTH_FACTOR),
+                             MAX_SETS_PER_DESCRIPTOR_POOL);
+
+    ready_pools.push_back(new_pool);
+}
+
+void DescriptorAllocator::clear_pools(VkDevice device) {
+    for (VkDescriptorPool pool: ready_pools) {
+        vkResetDescriptorPool(device, pool, 0);
+    }
+    for (VkDescriptorPool pool: full_pools) {
+        vkResetDescriptorPool(device, pool, 0);
+        ready_pools.push_back(pool);
+    }
+    full_pools.clear();
+}
+
+void DescriptorAllocator::destroy_pools(VkDevice device) {
+    for (VkDescriptorPool pool: ready_pools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    ready_pools.clear();
+    for (VkDescriptorPool pool: full_pools) {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+    full_pools.clear();
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout, void *pNext) {
+    VkDescriptorPool pool = get_pool(device);
+
+    VkDescriptorSetAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.pNext = pNext;
+    allocate_info.descriptorPool = pool;
+    allocate_info.descriptorSetCount = 1;
+    allocate_info.pSetLayouts = &layout;
+
+    VkDescriptorSet descriptor_set;
+    VkResult result = vkAllocateDescriptorSets(device, &allocate_info, &descriptor_set);
+
+    // Pool is exhausted, retire it and retry once from a fresh (larger) pool
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        full_pools.push_back(pool);
+
+        pool = get_pool(device);
+        allocate_info.descriptorPool = pool;
+
+        // Pools are sized from the ratios, a set needing more of a type than a whole pool holds never fits
+        result = vkAllocateDescriptorSets(device, &allocate_info, &descriptor_set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            fmt::print("Descriptor set doesn't fit in a fresh pool, its layout needs more than the pool ratios give\n");
+            ready_pools.push_back(pool);
+            return VK_NULL_HANDLE;
+        }
+        VK_CHECK(result);
+    } else {
+        VK_CHECK(result);
+    }
+
+    // Keep allocating from the pool until it fills up
+    ready_pools.push_back(pool);
+    return descriptor_set;
+}
+
+VkDescriptorPool DescriptorAllocator::get_pool(VkDevice device) {
+    // Reuse a ready pool if there is one, otherwise grow
+    if (!ready_pools.empty()) {
+        VkDescriptorPool pool = ready_pools.back();
+        ready_pools.pop_back();
+        return pool;
+    }
+
+    VkDescriptorPool new_pool = create_pool(device, sets_per_pool, ratios);
+    sets_per_pool = std::min(static_cast<uint32_t>(sets_per_pool * DESCRIPTOR_POOL_GROWTH_FACTOR),
+                             MAX_SETS_PER_DESCRIPTOR_POOL);
+
+    return new_pool;
+}
+
+VkDescriptorPool DescriptorAllocator::create_pool(VkDevice device, uint32_t set_count,
+                                                  std::span<PoolSizeRatio> pool_size_ratios) {
     std::vector<VkDescriptorPoolSize> pool_sizes;
     for (PoolSizeRatio pool_size_ratio: pool_size_ratios) {
         pool_sizes.push_back(VkDescriptorPoolSize{
-            .type = pool_size_ratio.type, .descriptorCount = static_cast<uint32_t>(pool_size_ratio.ratio * max_sets)
+            .type = pool_size_ratio.type, .descriptorCount = static_cast<uint32_t>(pool_size_ratio.ratio * set_count)
         });
     }
 
@@ -53,22 +621,90 @@ void DescriptorAllocator::initialize_pool(VkDevice device, uint32_t max_sets,
     pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_create_info.pNext = nullptr;
     pool_create_info.flags = 0;
-    pool_create_info.maxSets = max_sets;
+    pool_create_info.maxSets = set_count;
     pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
     pool_create_info.pPoolSizes = pool_sizes.data();
 
-    vkCreateDescriptorPool(device, &pool_create_info, nullptr, &pool);
+    VkDescriptorPool new_pool;
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_create_info, nullptr, &new_pool));
+
+    return new_pool;
 }
 
-void DescriptorAllocator::clear_descriptors(VkDevice device) {
-    vkResetDescriptorPool(device, pool, 0);
+std::optional<uint32_t> DescriptorIndexAllocator::allocate() {
+    if (!free_indices.empty()) {
+        uint32_t index = free_indices.back();
+        free_indices.pop_back();
+        return index;
+    }
+    if (next_index >= capacity) {
+        return std::nullopt;
+    }
+    return next_index++;
 }
 
-void DescriptorAllocator::destroy_pool(VkDevice device) {
-    vkDestroyDescriptorPool(device, pool, nullptr);
+void DescriptorIndexAllocator::release(uint32_t index) {
+    free_indices.push_back(index);
 }
 
-VkDescriptorSet DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLayout layout) {
+// Desired sizes of the bindless arrays before clamping to device limits
+constexpr uint32_t BINDLESS_MAX_SAMPLED_IMAGES = 16384;
+constexpr uint32_t BINDLESS_MAX_STORAGE_IMAGES = 1024;
+constexpr uint32_t BINDLESS_MAX_SAMPLERS = 256;
+constexpr uint32_t BINDLESS_MAX_STORAGE_BUFFERS = 4096;
+
+void BindlessDescriptorHeap::initialize(VkDevice device, DescriptorLayoutCache &layout_cache,
+                                        const VkPhysicalDeviceVulkan12Properties &properties12) {
+    index_allocators[BINDLESS_SAMPLED_IMAGE_BINDING].capacity = std::min(
+        {BINDLESS_MAX_SAMPLED_IMAGES, properties12.maxDescriptorSetUpdateAfterBindSampledImages,
+         properties12.maxPerStageDescriptorUpdateAfterBindSampledImages});
+    index_allocators[BINDLESS_STORAGE_IMAGE_BINDING].capacity = std::min(
+        {BINDLESS_MAX_STORAGE_IMAGES, properties12.maxDescriptorSetUpdateAfterBindStorageImages,
+         properties12.maxPerStageDescriptorUpdateAfterBindStorageImages});
+    index_allocators[BINDLESS_SAMPLER_BINDING].capacity = std::min(
+        {BINDLESS_MAX_SAMPLERS, properties12.maxDescriptorSetUpdateAfterBindSamplers,
+         properties12.maxPerStageDescriptorUpdateAfterBindSamplers});
+    index_allocators[BINDLESS_STORAGE_BUFFER_BINDING].capacity = std::min(
+        {BINDLESS_MAX_STORAGE_BUFFERS, properties12.maxDescriptorSetUpdateAfterBindStorageBuffers,
+         properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+    constexpr VkDescriptorType binding_types[BINDLESS_BINDING_COUNT] = {
+        VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        VK_DESCRIPTOR_TYPE_SAMPLER,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+    };
+
+    // Pool that can hold exactly the one bindless set
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        pool_sizes.push_back(VkDescriptorPoolSize{
+            .type = binding_types[i], .descriptorCount = index_allocators[i].capacity
+        });
+    }
+
+    VkDescriptorPoolCreateInfo pool_create_info = {};
+    pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_create_info.pNext = nullptr;
+    pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_create_info.maxSets = 1;
+    pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_create_info.pPoolSizes = pool_sizes.data();
+
+    VK_CHECK(vkCreateDescriptorPool(device, &pool_create_info, nullptr, &pool));
+
+    // Every binding can be updated while bound and left partially unwritten
+    DescriptorLayoutBuilder layout_builder;
+    std::array<VkDescriptorBindingFlags, BINDLESS_BINDING_COUNT> binding_flags;
+    for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+        layout_builder.add_binding(i, binding_types[i], index_allocators[i].capacity);
+        binding_flags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                           VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+    }
+
+    layout = layout_builder.build(layout_cache, device, VK_SHADER_STAGE_ALL,
+                                  VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, binding_flags);
+
     VkDescriptorSetAllocateInfo allocate_info = {};
     allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocate_info.pNext = nullptr;
@@ -76,8 +712,43 @@ VkDescriptorSet DescriptorAllocator::allocate(VkDevice device, VkDescriptorSetLa
     allocate_info.descriptorSetCount = 1;
     allocate_info.pSetLayouts = &layout;
 
-    VkDescriptorSet descriptor_set;
-    VK_CHECK(vkAllocateDescriptorSets(device, &allocate_info, &descriptor_set));
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocate_info, &set));
+}
 
-    return descriptor_set;
+std::optional<uint32_t> BindlessDescriptorHeap::register_storage_image(VkDevice device, VkImageView image_view) {
+    std::optional<uint32_t> index = index_allocators[BINDLESS_STORAGE_IMAGE_BINDING].allocate();
+    if (!index.has_value()) {
+        return index;
+    }
+
+    VkDescriptorImageInfo descriptor_image_info = {};
+    descriptor_image_info.imageView = image_view;
+    descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet write_descriptor_set = {};
+    write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write_descriptor_set.pNext = nullptr;
+    write_descriptor_set.dstSet = set;
+    write_descriptor_set.dstBinding = BINDLESS_STORAGE_IMAGE_BINDING;
+    write_descriptor_set.dstArrayElement = index.value();
+    write_descriptor_set.descriptorCount = 1;
+    write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write_descriptor_set.pImageInfo = &descriptor_image_info;
+
+    vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+
+    return index;
+}
+
+void BindlessDescriptorHeap::release(BindlessBinding binding, uint32_t index) {
+    index_allocators[binding].release(index);
+}
+
+void BindlessDescriptorHeap::bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point,
+                                  VkPipelineLayout pipeline_layout) {
+    vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout, 0, 1, &set, 0, nullptr);
+}
+
+void BindlessDescriptorHeap::destroy(VkDevice device) {
+    vkDestroyDescriptorPool(device, pool, nullptr);
 }
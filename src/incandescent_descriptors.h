@@ -8,29 +8,250 @@
 #include <vector>
 #include <vulkan/vulkan_core.h>
 #include <incandescent_types.h>
+#include <incandescent_buffers.h>
+#include <mutex>
+#include <unordered_map>
+
+/*
+ * VK_EXT_descriptor_buffer backend. Sets are sub-ranges of one persistently mapped buffer: allocating a set is a bump
+ * of the head by the layout's size, writing a descriptor is vkGetDescriptorEXT straight into mapped memory and binding
+ * is just an offset change. Only the engine's background dispatch goes through it, the renderers, the MipGenerator and
+ * the texture streamer always allocate pool sets from a DescriptorAllocator.
+ */
+struct DescriptorBufferAllocator {
+    AllocatedBuffer buffer;
+    VkDeviceAddress base_device_address;
+    VkDeviceSize capacity;
+    VkDeviceSize head;
+    // Bytes the frame asked for, above capacity when an allocation didn't fit
+    VkDeviceSize requested;
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT properties;
+
+    void initialize(VkDevice device, VmaAllocator allocator, MemoryTelemetry &memory_telemetry,
+                    VkDeviceSize buffer_capacity,
+                    const VkPhysicalDeviceDescriptorBufferPropertiesEXT &descriptor_buffer_properties);
+
+    // Reserves room for one set of the given layout and returns its offset into the buffer. Nothing when the buffer is
+    // full, the caller skips that pass and the buffer grows the next time the frame is cleared
+    std::optional<VkDeviceSize> allocate(VkDevice device, VkDescriptorSetLayout layout);
+
+    // Size of one descriptor of this type as written by vkGetDescriptorEXT
+    size_t descriptor_size(VkDescriptorType type) const;
+
+    // Pointer to where a set's descriptors live
+    std::byte *mapped_data(VkDeviceSize set_offset) const;
+
+    // Makes written descriptors visible to the GPU, no-op on host-coherent memory
+    void flush(VmaAllocator allocator);
+
+    // Only once the GPU is done with the frame, reallocates a larger buffer if the last frame ran out of space
+    void clear_descriptors(VkDevice device, VmaAllocator allocator, MemoryTelemetry &memory_telemetry);
+
+    // Binds the buffer for the whole command buffer, sets are then selected with set_offset
+    void bind(VkCommandBuffer command_buffer);
+
+    void set_offset(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout,
+                    uint32_t set_index, VkDeviceSize offset);
+
+    void destroy(VmaAllocator allocator, MemoryTelemetry &memory_telemetry);
+};
+
+/*
+ * Collects image and buffer writes for one set. Descriptor infos are packed back to back in a single byte array, which
+ * is both what the VkWriteDescriptorSet path points into and the exact struct a matching VkDescriptorUpdateTemplate
+ * reads, so with a template the whole set is updated by one vkUpdateDescriptorSetWithTemplate call.
+ */
+struct DescriptorWriter {
+    // array_element picks the slot when the binding is an array
+    void write_image(uint32_t binding, VkImageView image_view, VkSampler sampler, VkImageLayout layout,
+                     VkDescriptorType type, uint32_t array_element = 0);
+
+    void write_buffer(uint32_t binding, VkBuffer buffer, VkDeviceSize size, VkDeviceSize offset,
+                      VkDescriptorType type);
+
+    void clear();
+
+    // Entries describing where each write lives in the packed data, used to build update templates
+    std::vector<VkDescriptorUpdateTemplateEntry> template_entries() const;
+
+    // Generic path, builds one VkWriteDescriptorSet per write
+    void update_set(VkDevice device, VkDescriptorSet set) const;
+
+    // Template path, the template must have been built from a writer with the same sequence of writes
+    void update_set(VkDevice device, VkDescriptorSet set, VkDescriptorUpdateTemplate update_template) const;
+
+    // Descriptor buffer path, each write becomes a vkGetDescriptorEXT into the set's mapped range. Buffers must have
+    // been created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+    void update_set(VkDevice device, DescriptorBufferAllocator &descriptor_buffer, VkDeviceSize set_offset,
+                    VkDescriptorSetLayout layout) const;
+
+private:
+    struct WriteEntry {
+        uint32_t binding;
+        uint32_t array_element;
+        VkDescriptorType type;
+        size_t offset;
+    };
+
+    std::vector<WriteEntry> entries;
+    std::vector<std::byte> packed_data;
+};
+
+/*
+ * Returns an existing VkDescriptorSetLayout/VkPipelineLayout when an identical one has already been requested. The key
+ * is the full structure (bindings, stages, flags, set layouts, push constants), so equal requests share one handle and
+ * pipelines built from them stay layout compatible, which keeps bound sets valid across pipeline switches.
+ */
+struct DescriptorLayoutCache {
+    // binding_flags is empty or one per binding. Throws for bindings with immutable samplers, which the key can't hold
+    VkDescriptorSetLayout get_descriptor_set_layout(VkDevice device,
+                                                    std::span<const VkDescriptorSetLayoutBinding> bindings,
+                                                    VkDescriptorSetLayoutCreateFlags flags = 0,
+                                                    std::span<const VkDescriptorBindingFlags> binding_flags = {});
+
+    VkPipelineLayout get_pipeline_layout(VkDevice device, std::span<const VkDescriptorSetLayout> set_layouts,
+                                         std::span<const VkPushConstantRange> push_constant_ranges = {});
+
+    // Update template for a known layout and write sequence, shared by every set of that layout
+    VkDescriptorUpdateTemplate get_update_template(VkDevice device, VkDescriptorSetLayout set_layout,
+                                                   const DescriptorWriter &writer);
+
+    // Destroys every cached layout and template, handles returned by the cache must not be destroyed by callers
+    void destroy(VkDevice device);
+
+private:
+    struct DescriptorSetLayoutKey {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> binding_flags;
+        VkDescriptorSetLayoutCreateFlags flags;
+
+        bool operator==(const DescriptorSetLayoutKey &other) const;
+    };
+
+    struct DescriptorSetLayoutKeyHash {
+        size_t operator()(const DescriptorSetLayoutKey &key) const;
+    };
+
+    struct PipelineLayoutKey {
+        std::vector<VkDescriptorSetLayout> set_layouts;
+        std::vector<VkPushConstantRange> push_constant_ranges;
+
+        bool operator==(const PipelineLayoutKey &other) const;
+    };
+
+    struct PipelineLayoutKeyHash {
+        size_t operator()(const PipelineLayoutKey &key) const;
+    };
+
+    struct UpdateTemplateKey {
+        VkDescriptorSetLayout set_layout;
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
+
+        bool operator==(const UpdateTemplateKey &other) const;
+    };
+
+    struct UpdateTemplateKeyHash {
+        size_t operator()(const UpdateTemplateKey &key) const;
+    };
+
+    std::mutex cache_mutex;
+    std::unordered_map<DescriptorSetLayoutKey, VkDescriptorSetLayout, DescriptorSetLayoutKeyHash>
+    descriptor_set_layouts;
+    std::unordered_map<PipelineLayoutKey, VkPipelineLayout, PipelineLayoutKeyHash> pipeline_layouts;
+    std::unordered_map<UpdateTemplateKey, VkDescriptorUpdateTemplate, UpdateTemplateKeyHash> update_templates;
+};
 
 struct DescriptorLayoutBuilder {
     std::vector<VkDescriptorSetLayoutBinding> bindings;
 
-    void add_binding(uint32_t binding, VkDescriptorType type);
+    void add_binding(uint32_t binding, VkDescriptorType type, uint32_t descriptor_count = 1);
 
     void clear();
 
+    // Stage flags are applied to a copy of the bindings, so the builder can be reused with different stages
     VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shader_stages, void *pNext = nullptr,
                                 VkDescriptorSetLayoutCreateFlags flags = 0);
+
+    // Same as above but goes through the cache, binding flags replace the pNext chain so they can be hashed
+    VkDescriptorSetLayout build(DescriptorLayoutCache &layout_cache, VkDevice device,
+                                VkShaderStageFlags shader_stages, VkDescriptorSetLayoutCreateFlags flags = 0,
+                                std::span<const VkDescriptorBindingFlags> binding_flags = {});
+
+private:
+    std::vector<VkDescriptorSetLayoutBinding> staged_bindings(VkShaderStageFlags shader_stages) const;
 };
 
+/*
+ * Pool-of-pools allocator. When the current pool runs out it is moved to the full list and allocation retries from a
+ * new pool with more sets than the last, so running out of sets never fails and stays amortized O(1). Clearing resets
+ * every pool and makes them all ready again instead of destroying them.
+ */
 struct DescriptorAllocator {
     struct PoolSizeRatio {
         VkDescriptorType type;
         float ratio;
     };
 
+    void initialize_pools(VkDevice device, uint32_t initial_sets, std::span<PoolSizeRatio> pool_size_ratios);
+    void clear_pools(VkDevice device);
+    void destroy_pools(VkDevice device);
+    // VK_NULL_HANDLE when the set needs more of a descriptor type than the ratios put in a whole pool
+    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout, void *pNext = nullptr);
+
+private:
+    VkDescriptorPool get_pool(VkDevice device);
+    VkDescriptorPool create_pool(VkDevice device, uint32_t set_count, std::span<PoolSizeRatio> pool_size_ratios);
+
+    std::vector<PoolSizeRatio> ratios;
+    std::vector<VkDescriptorPool> full_pools;
+    std::vector<VkDescriptorPool> ready_pools;
+    uint32_t sets_per_pool;
+};
+
+// Binding slots of the bindless descriptor set, shaders declare unbounded arrays at these bindings in set 0
+enum BindlessBinding : uint32_t {
+    BINDLESS_SAMPLED_IMAGE_BINDING = 0,
+    BINDLESS_STORAGE_IMAGE_BINDING = 1,
+    BINDLESS_SAMPLER_BINDING = 2,
+    BINDLESS_STORAGE_BUFFER_BINDING = 3,
+    BINDLESS_BINDING_COUNT = 4
+};
+
+// Hands out array slots for one bindless binding, released slots are reused first
+struct DescriptorIndexAllocator {
+    uint32_t capacity = 0;
+    uint32_t next_index = 0;
+    std::vector<uint32_t> free_indices;
+
+    std::optional<uint32_t> allocate();
+
+    void release(uint32_t index);
+};
+
+/*
+ * One large UPDATE_AFTER_BIND, partially bound descriptor set with an array per resource type. It is bound once per
+ * command buffer and resources are picked in the shader by the indices passed through push constants. Only storage
+ * images are registered so far (the draw image the background dispatch writes), the other arrays are laid out but
+ * left unwritten.
+ */
+struct BindlessDescriptorHeap {
     VkDescriptorPool pool;
-    void initialize_pool(VkDevice device, uint32_t max_sets, std::span<PoolSizeRatio> pool_size_ratios);
-    void clear_descriptors(VkDevice device);
-    void destroy_pool(VkDevice device);
-    VkDescriptorSet allocate(VkDevice device, VkDescriptorSetLayout layout);
+    VkDescriptorSetLayout layout;
+    VkDescriptorSet set;
+    std::array<DescriptorIndexAllocator, BINDLESS_BINDING_COUNT> index_allocators;
+
+    // Capacities are clamped to the device's update-after-bind limits, the layout is owned by the cache
+    void initialize(VkDevice device, DescriptorLayoutCache &layout_cache,
+                    const VkPhysicalDeviceVulkan12Properties &properties12);
+
+    std::optional<uint32_t> register_storage_image(VkDevice device, VkImageView image_view);
+
+    // The slot may still be read by frames in flight, so only release after they have retired
+    void release(BindlessBinding binding, uint32_t index);
+
+    void bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout pipeline_layout);
+
+    void destroy(VkDevice device);
 };
 
 class incandescent_descriptors {
@@ -4,6 +4,7 @@
 #include <incandescent_types.h>
 #include <incandescent_engine.h>
 #include <incandescent_images.h>
+#include <incandescent_jobs.h>
 #include <incan_struct_init.h>
 
 #define SDL_MAIN_HANDLED
@@ -22,6 +23,7 @@
 #include <iostream>
 #include <queue>
 #include <chrono>
+#include <cstring>
 #include <thread>
 
 #ifdef __APPLE__
@@ -33,6 +35,12 @@
 constexpr bool use_validation_layers = true;
 constexpr bool use_api_dump = false;
 constexpr bool use_log_file = true;
+constexpr bool use_bindless = true; // Only takes effect if the device supports the descriptor indexing features
+// Opt in, only the background dispatch has a descriptor buffer path, every other pass keeps its pool sets. Takes effect
+// if the device supports VK_EXT_descriptor_buffer and bindless isn't picked
+constexpr bool use_descriptor_buffer = false;
+constexpr bool use_defragmentation = true;
+constexpr bool use_mesh_shaders = true; // Only takes effect if the device supports VK_EXT_mesh_shader
 
 IncandescentEngine *loaded_engine = nullptr;
 
@@ -106,6 +114,13 @@ void IncandescentEngine::initialize() {
         log_file.close();
     }
 
+    initialize_frame_allocators();
+    if (use_log_file) {
+        log_file.open("./src/initialization_log_file.txt", std::ios_base::app);
+        log_file << "Frame allocators initialized\n";
+        log_file.close();
+    }
+
     initialize_descriptors();
     if (use_log_file) {
         log_file.open("./src/initialization_log_file.txt", std::ios_base::app);
@@ -120,6 +135,35 @@ void IncandescentEngine::initialize() {
         log_file.close();
     }
 
+    if (!scene_path.empty()) {
+        std::optional<LoadedScene> scene = incan_loader::load_scene(*this, scene_path);
+        if (scene.has_value()) {
+            loaded_scenes.push_back(std::move(scene.value()));
+        }
+        if (use_log_file) {
+            log_file.open("./src/initialization_log_file.txt", std::ios_base::app);
+            log_file << "Scene " << scene_path << (scene.has_value() ? " loaded\n" : " failed to load\n");
+            log_file.close();
+        }
+    }
+
+    // Start with every instance of the loaded scenes in view
+    Eigen::AlignedBox3f scene_box;
+    for (const LoadedScene &scene: loaded_scenes) {
+        for (const MeshInstance &instance: scene.instances) {
+            const MeshAsset &mesh = scene.meshes[instance.mesh];
+            Eigen::AlignedBox3f mesh_box(mesh.position_offset - mesh.position_scale,
+                                         mesh.position_offset + mesh.position_scale);
+            for (int corner = 0; corner < 8; corner++) {
+                Eigen::Vector3f mesh_corner = mesh_box.corner(static_cast<Eigen::AlignedBox3f::CornerType>(corner));
+                scene_box.extend((instance.world_transform * mesh_corner.homogeneous()).head<3>());
+            }
+        }
+    }
+    if (!scene_box.isEmpty()) {
+        camera.frame_sphere(scene_box.center(), 0.5f * scene_box.diagonal().norm());
+    }
+
     // Set success check bool to true
     is_initialized = true;
 }
@@ -215,6 +259,7 @@ void IncandescentEngine::initialize_vulkan() {
 
     // Assign handle
     selected_gpu = physical_device;
+    vkGetPhysicalDeviceProperties(selected_gpu, &gpu_properties);
 
     // https://vulkan-tutorial.com/Drawing_a_triangle/Setup/Physical_devices_and_queue_families
     // https://github.com/zeux/volk?tab=readme-ov-file#optimizing-device-calls
@@ -304,6 +349,48 @@ void IncandescentEngine::initialize_vulkan() {
     synchronization2_features.synchronization2 = 1;
     synchronization2_features.pNext = &dynamic_rendering_feature;
 
+    // Query which Vulkan 1.2 features and limits the device has, optional features are only enabled if present
+    VkPhysicalDeviceVulkan12Features supported_features12 = {};
+    supported_features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    supported_features12.pNext = nullptr;
+
+    VkPhysicalDeviceFeatures2 supported_features = {};
+    supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported_features.pNext = &supported_features12;
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+
+    gpu_properties11 = {};
+    gpu_properties11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_PROPERTIES;
+    gpu_properties11.pNext = nullptr;
+
+    gpu_properties12 = {};
+    gpu_properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    gpu_properties12.pNext = &gpu_properties11;
+
+    VkPhysicalDeviceProperties2 supported_properties = {};
+    supported_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    supported_properties.pNext = &gpu_properties12;
+    vkGetPhysicalDeviceProperties2(physical_device, &supported_properties);
+
+    // Bindless needs runtime sized, partially bound arrays that can be updated while bound
+    bindless_supported = supported_features12.runtimeDescriptorArray &&
+                         supported_features12.descriptorBindingPartiallyBound &&
+                         supported_features12.descriptorBindingUpdateUnusedWhilePending &&
+                         supported_features12.descriptorBindingSampledImageUpdateAfterBind &&
+                         supported_features12.descriptorBindingStorageImageUpdateAfterBind &&
+                         supported_features12.descriptorBindingStorageBufferUpdateAfterBind &&
+                         supported_features12.shaderSampledImageArrayNonUniformIndexing;
+
+    // The single pass mip downsampler shuffles across quads in compute and writes storage images of any format
+    single_pass_mips_supported =
+            (gpu_properties11.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) &&
+            (gpu_properties11.subgroupSupportedOperations & VK_SUBGROUP_FEATURE_SHUFFLE_BIT) &&
+            gpu_properties11.subgroupSize >= 4 &&
+            supported_features.features.shaderStorageImageWriteWithoutFormat;
+
+    // Desktop GPUs all have BC, without it (most mobile and Apple silicon) textures are uploaded uncompressed
+    texture_compression_supported = supported_features.features.textureCompressionBC;
+
     // Enable some Vulkan 1.2 features
     VkPhysicalDeviceVulkan12Features features12 = {};
     features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
@@ -315,6 +402,8 @@ void IncandescentEngine::initialize_vulkan() {
     VkPhysicalDeviceFeatures2 device_features = {};
     device_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
     device_features.pNext = &features12;
+    device_features.features.shaderStorageImageWriteWithoutFormat = single_pass_mips_supported;
+    device_features.features.textureCompressionBC = texture_compression_supported;
 
     // Must manually add Vulkan 1.3 features for MoltenVK compatibility (still not on version 1.3)
     std::vector<const char *> device_extension_names = {
@@ -329,6 +418,118 @@ void IncandescentEngine::initialize_vulkan() {
     // device_extension_names.push_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
     // device_extension_names.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
 
+    // Get the extensions the selected device supports so optional ones can be enabled only when present
+    uint32_t available_extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &available_extension_count, nullptr);
+    std::vector<VkExtensionProperties> available_extensions(available_extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &available_extension_count,
+                                         available_extensions.data());
+
+    auto device_supports_extension = [&available_extensions](const char *extension_name) {
+        for (const auto &extension: available_extensions) {
+            if (strcmp(extension.extensionName, extension_name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Memory budget lets VMA report real per-heap usage/budget instead of estimates
+    memory_budget_supported = device_supports_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memory_budget_supported) {
+        device_extension_names.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    // Descriptor buffers need the extension, the feature bit and its properties for descriptor sizes/alignment
+    VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {};
+    descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+    descriptor_buffer_features.pNext = nullptr;
+
+    gpu_descriptor_buffer_properties = {};
+    gpu_descriptor_buffer_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+    gpu_descriptor_buffer_properties.pNext = nullptr;
+
+    if (device_supports_extension(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+        supported_features.pNext = &descriptor_buffer_features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+
+        supported_properties.pNext = &gpu_descriptor_buffer_properties;
+        vkGetPhysicalDeviceProperties2(physical_device, &supported_properties);
+
+        descriptor_buffer_supported = descriptor_buffer_features.descriptorBuffer;
+    }
+
+    // Pick the descriptor backend, bindless first, then descriptor buffers when asked for, then plain descriptor sets
+    if (use_bindless && bindless_supported) {
+        descriptor_backend = DescriptorBackend::Bindless;
+    } else if (use_descriptor_buffer && descriptor_buffer_supported) {
+        descriptor_backend = DescriptorBackend::DescriptorBuffer;
+    } else {
+        descriptor_backend = DescriptorBackend::DescriptorSets;
+    }
+
+    if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+        device_extension_names.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+
+        // Only the descriptor buffer feature itself, capture/replay and push descriptors are not used
+        descriptor_buffer_features = {};
+        descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+        descriptor_buffer_features.descriptorBuffer = VK_TRUE;
+        descriptor_buffer_features.pNext = device_features.pNext;
+        device_features.pNext = &descriptor_buffer_features;
+    }
+
+    if (descriptor_backend == DescriptorBackend::Bindless) {
+        features12.runtimeDescriptorArray = VK_TRUE;
+        features12.descriptorBindingPartiallyBound = VK_TRUE;
+        features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+        features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        features12.shaderStorageImageArrayNonUniformIndexing =
+                supported_features12.shaderStorageImageArrayNonUniformIndexing;
+        features12.shaderStorageBufferArrayNonUniformIndexing =
+                supported_features12.shaderStorageBufferArrayNonUniformIndexing;
+    }
+
+    // The meshlet shaders load 64-bit buffer addresses, without 64-bit integers nothing is drawn
+    shader_int64_supported = supported_features.features.shaderInt64;
+    device_features.features.shaderInt64 = shader_int64_supported;
+
+    // Without mesh shaders the culled instances are drawn indirect, a bucket of draws per call that each find their
+    // instance through firstInstance. Reading the bucket's count on the GPU saves walking its empty draws
+    multi_draw_indirect_supported = supported_features.features.multiDrawIndirect &&
+                                    supported_features.features.drawIndirectFirstInstance;
+    draw_indirect_count_supported = supported_features12.drawIndirectCount;
+    device_features.features.multiDrawIndirect = multi_draw_indirect_supported;
+    device_features.features.drawIndirectFirstInstance = multi_draw_indirect_supported;
+    features12.drawIndirectCount = draw_indirect_count_supported;
+
+    // Task and mesh shaders let meshlets be culled and drawn in one pass, otherwise culling runs in compute
+    VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features = {};
+    mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    mesh_shader_features.pNext = nullptr;
+
+    if (use_mesh_shaders && device_supports_extension(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        supported_features.pNext = &mesh_shader_features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+
+        mesh_shaders_supported = mesh_shader_features.taskShader && mesh_shader_features.meshShader;
+    }
+
+    if (mesh_shaders_supported) {
+        device_extension_names.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+
+        // Multiview, primitive shading rate and the queries stay off
+        mesh_shader_features = {};
+        mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        mesh_shader_features.taskShader = VK_TRUE;
+        mesh_shader_features.meshShader = VK_TRUE;
+        mesh_shader_features.pNext = device_features.pNext;
+        device_features.pNext = &mesh_shader_features;
+    }
+
     // Make the creation information struct
     VkDeviceCreateInfo device_create_info = {};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -372,15 +573,28 @@ void IncandescentEngine::initialize_vulkan() {
     vma_vulkan_functions.vkMapMemory = vkMapMemory;
     vma_vulkan_functions.vkUnmapMemory = vkUnmapMemory;
     vma_vulkan_functions.vkCmdCopyBuffer = vkCmdCopyBuffer;
+    // Needed by VMA to query VK_EXT_memory_budget
+    vma_vulkan_functions.vkGetPhysicalDeviceMemoryProperties2KHR = vkGetPhysicalDeviceMemoryProperties2KHR;
 
     VmaAllocatorCreateInfo allocator_create_info = {};
     allocator_create_info.physicalDevice = physical_device;
     allocator_create_info.device = device;
     allocator_create_info.instance = instance;
     allocator_create_info.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT; // Lets us use GPU pointers
+    if (memory_budget_supported) {
+        allocator_create_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
     allocator_create_info.pVulkanFunctions = &vma_vulkan_functions;
 
     vmaCreateAllocator(&allocator_create_info, &allocator);
+
+    // Start tracking heap budgets and allocation categories
+    memory_telemetry.initialize(allocator, memory_budget_supported);
+    defragmenter.initialize(allocator, DEFRAGMENTATION_BYTES_PER_FRAME, DEFRAGMENTATION_MOVES_PER_FRAME);
+    resources.initialize(device, allocator, memory_telemetry);
+    file_reader.initialize(FILE_READ_WORKERS, FILE_READ_QUEUE_DEPTH);
+    residency.initialize(allocator, memory_telemetry, resources, file_reader, gpu_decompressor,
+                         RESIDENCY_BUDGET_FRACTION, RESIDENCY_UPLOAD_BYTES_PER_FRAME);
 }
 
 
@@ -525,31 +739,37 @@ void IncandescentEngine::initialize_swapchain(int width, int height) {
 
     VkExtent3D draw_image_extent = {WIDTH, HEIGHT, 1};
 
-    // Hardcode draw format to 32-bit float
-    draw_image.image_format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    draw_image.image_extent = draw_image_extent;
-
     VkImageUsageFlags draw_image_usage_flags = {};
     // Read/write, usage_storage allows us to use compute shaders, color so we can do graphics
     draw_image_usage_flags = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
                              VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    VkImageCreateInfo image_create_info = incan_struct_init::image_create_info(
-        draw_image.image_format, draw_image_usage_flags, draw_image_extent);
-
-    VmaAllocationCreateInfo image_allocation_create_info = {};
-    image_allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY; // Tells VMA to put image into VRAM
-    image_allocation_create_info.requiredFlags = static_cast<VkMemoryPropertyFlags>(
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT); // This guarantees fastest memory access
-
-    // Allocate and create the image
-    vmaCreateImage(allocator, &image_create_info, &image_allocation_create_info, &draw_image.image,
-                   &draw_image.allocation, nullptr);
+    // Hardcode draw format to 16-bit float, the image is redrawn from scratch every frame so a move copies nothing
+    draw_image = resources.create_image(VK_FORMAT_R16G16B16A16_SFLOAT, draw_image_usage_flags, draw_image_extent,
+                                        VK_IMAGE_LAYOUT_UNDEFINED, AllocationCategory::RenderTarget);
+
+    // Depth is cleared at the start of the geometry pass, so it doesn't need copying either. It is sampled to build
+    // the depth pyramid occlusion culling tests against, half its size and rebuilt every frame
+    depth_image = resources.create_image(DEPTH_FORMAT,
+                                         VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                         draw_image_extent, VK_IMAGE_LAYOUT_UNDEFINED,
+                                         AllocationCategory::RenderTarget);
+    recreate_depth_pyramid();
+}
 
-    VkImageViewCreateInfo image_view_create_info = incan_struct_init::image_view_create_info(
-        draw_image.image_format, draw_image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+void IncandescentEngine::recreate_depth_pyramid() {
+    if (resources.images.contains(depth_pyramid)) {
+        resources.destroy_image(depth_pyramid);
+    }
 
-    VK_CHECK(vkCreateImageView(device, &image_view_create_info, nullptr, &draw_image.image_view));
+    // Half the depth buffer's size, rounded down, with every mip down to 1x1
+    VkExtent3D depth_extent = resources.images.cold(depth_image).image_extent;
+    VkExtent3D depth_pyramid_extent = {std::max(depth_extent.width / 2, 1u), std::max(depth_extent.height / 2, 1u), 1};
+    depth_pyramid = resources.create_image(VK_FORMAT_R32_SFLOAT,
+                                           VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                           depth_pyramid_extent, VK_IMAGE_LAYOUT_UNDEFINED,
+                                           AllocationCategory::RenderTarget,
+                                           incan_util::mip_level_count(depth_pyramid_extent));
 }
 
 void IncandescentEngine::initialize_commands() {
@@ -562,18 +782,33 @@ void IncandescentEngine::initialize_commands() {
     command_pool_create_info.queueFamilyIndex = graphics_queue_family_index;
 
     // Create command pool and command buffer for each frame
-    for (auto &[command_pool, main_command_buffer, swapchain_semaphore, render_semaphore, render_fence]: frames) {
-        VK_CHECK(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool));
+    for (FrameData &frame: frames) {
+        VK_CHECK(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &frame.command_pool));
 
         // Allocate command buffer
         VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
         command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         command_buffer_allocate_info.pNext = nullptr;
-        command_buffer_allocate_info.commandPool = command_pool;
+        command_buffer_allocate_info.commandPool = frame.command_pool;
         command_buffer_allocate_info.commandBufferCount = 1;
         command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // Can be submitted directly
-        VK_CHECK(vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &main_command_buffer));
+        VK_CHECK(vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &frame.main_command_buffer));
     }
+
+    // Separate pool for immediate submits so they never touch a frame's command buffer
+    VK_CHECK(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &immediate_command_pool));
+
+    VkCommandBufferAllocateInfo immediate_allocate_info = {};
+    immediate_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    immediate_allocate_info.pNext = nullptr;
+    immediate_allocate_info.commandPool = immediate_command_pool;
+    immediate_allocate_info.commandBufferCount = 1;
+    immediate_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    VK_CHECK(vkAllocateCommandBuffers(device, &immediate_allocate_info, &immediate_command_buffer));
+
+    // One texture per worker decoding plus a few more whose uploads are still on the GPU
+    texture_streamer.initialize(device, graphics_queue, graphics_queue_family_index,
+                                incan_util::worker_thread_count() + 2, texture_compression_supported);
 }
 
 void IncandescentEngine::initialize_sync_structures() {
@@ -585,10 +820,26 @@ void IncandescentEngine::initialize_sync_structures() {
     VkSemaphoreCreateInfo semaphore_create_info = incan_struct_init::semaphore_create_info();
 
     // Create fence and semaphores for each frame
-    for (auto &[command_pool, main_command_buffer, swapchain_semaphore, render_semaphore, render_fence]: frames) {
-        VK_CHECK(vkCreateFence(device, &fence_create_info, nullptr, &render_fence));
-        VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &swapchain_semaphore));
-        VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &render_semaphore));
+    for (FrameData &frame: frames) {
+        VK_CHECK(vkCreateFence(device, &fence_create_info, nullptr, &frame.render_fence));
+        VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &frame.swapchain_semaphore));
+        VK_CHECK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &frame.render_semaphore));
+    }
+
+    // Unsignaled, immediate_submit resets it after every wait
+    VkFenceCreateInfo immediate_fence_create_info = incan_struct_init::fence_create_info();
+    VK_CHECK(vkCreateFence(device, &immediate_fence_create_info, nullptr, &immediate_fence));
+}
+
+void IncandescentEngine::initialize_frame_allocators() {
+    // One persistently mapped bump allocator per frame in flight, so uniform uploads never wait on the GPU
+    for (FrameData &frame: frames) {
+        frame.linear_allocator.initialize(device, allocator, memory_telemetry, FRAME_LINEAR_ALLOCATOR_SIZE,
+                                          gpu_properties.limits);
+        if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+            frame.frame_descriptor_buffer.initialize(device, allocator, memory_telemetry,
+                                                     FRAME_DESCRIPTOR_BUFFER_SIZE, gpu_descriptor_buffer_properties);
+        }
     }
 }
 
@@ -599,25 +850,54 @@ void IncandescentEngine::cleanup() {
             // Wait until the GPU completes all outstanding queue operations
             vkDeviceWaitIdle(device);
 
-            for (auto &[command_pool, main_command_buffer, swapchain_semaphore,
-                     render_semaphore, render_fence]: frames) {
+            for (FrameData &frame: frames) {
                 // Destroy command pool and buffers
-                vkDestroyCommandPool(device, command_pool, nullptr);
+                vkDestroyCommandPool(device, frame.command_pool, nullptr);
 
                 // Destroy sync objects
-                vkDestroySemaphore(device, swapchain_semaphore, nullptr);
-                vkDestroySemaphore(device, render_semaphore, nullptr);
-                vkDestroyFence(device, render_fence, nullptr);
+                vkDestroySemaphore(device, frame.swapchain_semaphore, nullptr);
+                vkDestroySemaphore(device, frame.render_semaphore, nullptr);
+                vkDestroyFence(device, frame.render_fence, nullptr);
+
+                // Destroy per-frame allocators
+                frame.linear_allocator.destroy(allocator, memory_telemetry);
+                frame.frame_descriptors.destroy_pools(device);
+                if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+                    frame.frame_descriptor_buffer.destroy(allocator, memory_telemetry);
+                }
+            }
+
+            vkDestroyCommandPool(device, immediate_command_pool, nullptr);
+            vkDestroyFence(device, immediate_fence, nullptr);
+            texture_streamer.destroy();
+
+            // The device is idle, so an unfinished pass can be committed right away
+            if (defragmenter.pass_active) {
+                retire_defragmentation_pass();
             }
+            defragmenter.destroy();
         }
         // Flush global objects
         // vkDestroyShaderModule();
-        vkDestroyImageView(device, draw_image.image_view, nullptr);
-        vmaDestroyImage(allocator, draw_image.image, draw_image.allocation);
-        vkDestroyPipelineLayout(device, gradient_pipeline_layout, nullptr);
-        vkDestroyPipeline(device, gradient_pipeline, nullptr);
-        global_descriptor_allocator.destroy_pool(device);
-        vkDestroyDescriptorSetLayout(device, draw_image_descriptor_set_layout, nullptr);
+        residency.destroy();
+        file_reader.destroy();
+        for (LoadedScene &scene: loaded_scenes) {
+            scene.destroy(resources);
+        }
+        resources.destroy_image(draw_image);
+        resources.destroy_image(depth_image);
+        resources.destroy_image(depth_pyramid);
+        resources.destroy_pipeline(gradient_pipeline);
+        mip_generator.destroy();
+        gpu_decompressor.destroy();
+        meshlet_renderer.destroy();
+        pipeline_cache.destroy();
+        resources.destroy();
+        global_descriptor_allocator.destroy_pools(device);
+        if (descriptor_backend == DescriptorBackend::Bindless) {
+            bindless_heap.destroy(device);
+        }
+        layout_cache.destroy(device);
         destroy_swapchain(); // swapchain
         vkDestroySurfaceKHR(instance, surface, nullptr); // surface
         vmaDestroyAllocator(allocator);
@@ -640,54 +920,93 @@ void IncandescentEngine::destroy_swapchain() {
 }
 
 void IncandescentEngine::initialize_descriptors() {
-    // Create a descriptor pool to hold 10 sets with 1 image each
+    // Start with pools of 10 sets with 1 image each, the allocator grows if more are needed
     std::vector<DescriptorAllocator::PoolSizeRatio> pool_size_ratios = {{VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1}};
 
-    global_descriptor_allocator.initialize_pool(device, 10, pool_size_ratios);
+    global_descriptor_allocator.initialize_pools(device, 10, pool_size_ratios);
 
     // Create descriptor set layout for compute draw
     DescriptorLayoutBuilder descriptor_layout_builder;
     descriptor_layout_builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-    draw_image_descriptor_set_layout = descriptor_layout_builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+    // Layouts used with descriptor buffers have to say so at creation
+    VkDescriptorSetLayoutCreateFlags draw_image_layout_flags =
+            descriptor_backend == DescriptorBackend::DescriptorBuffer
+                ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT
+                : 0;
+    draw_image_descriptor_set_layout = descriptor_layout_builder.build(layout_cache, device,
+                                                                       VK_SHADER_STAGE_COMPUTE_BIT,
+                                                                       draw_image_layout_flags);
+
+    // Template matching the single storage image write the gradient pass makes every frame
+    if (descriptor_backend == DescriptorBackend::DescriptorSets) {
+        DescriptorWriter draw_image_writer;
+        draw_image_writer.write_image(0, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        draw_image_update_template = layout_cache.get_update_template(device, draw_image_descriptor_set_layout,
+                                                                      draw_image_writer);
+    }
 
-    // Allocate descriptor set for the draw image
-    draw_image_descriptor_set = global_descriptor_allocator.allocate(device, draw_image_descriptor_set_layout);
+    // Per-frame allocators for transient sets, reset wholesale once the frame's fence has been waited on
+    std::vector<DescriptorAllocator::PoolSizeRatio> frame_pool_size_ratios = {
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4},
+    };
 
-    VkDescriptorImageInfo descriptor_image_info = {};
-    descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    descriptor_image_info.imageView = draw_image.image_view;
+    for (FrameData &frame: frames) {
+        frame.frame_descriptors.initialize_pools(device, 1000, frame_pool_size_ratios);
+    }
 
-    VkWriteDescriptorSet draw_image_write_descriptor_set = {};
-    draw_image_write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    draw_image_write_descriptor_set.pNext = nullptr;
-    draw_image_write_descriptor_set.dstBinding = 0;
-    draw_image_write_descriptor_set.dstSet = draw_image_descriptor_set;
-    draw_image_write_descriptor_set.descriptorCount = 1;
-    draw_image_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-    draw_image_write_descriptor_set.pImageInfo = &descriptor_image_info;
+    // Bindless heap, the draw image is registered once and referenced by index from then on
+    if (descriptor_backend == DescriptorBackend::Bindless) {
+        bindless_heap.initialize(device, layout_cache, gpu_properties12);
 
-    vkUpdateDescriptorSets(device, 1, &draw_image_write_descriptor_set, 0, nullptr);
+        ImageHotData &draw_image_data = resources.images.hot(draw_image);
+        std::optional<uint32_t> draw_image_index = bindless_heap.register_storage_image(device,
+                                                                                       draw_image_data.image_view);
+        if (!draw_image_index.has_value()) {
+            throw std::runtime_error("Bindless heap has no room for the draw image!");
+        }
+        draw_image_data.bindless_storage_index = draw_image_index.value();
+    }
 }
 
 
 void IncandescentEngine::initialize_pipelines() {
+    pipeline_cache.initialize(device, resources);
     initialize_background_pipelines();
+    mip_generator.initialize(device, selected_gpu, layout_cache, resources, single_pass_mips_supported);
+    gpu_decompressor.initialize(device, selected_gpu, layout_cache, resources, shader_int64_supported);
+    meshlet_renderer.initialize(device, layout_cache, pipeline_cache, resources, mip_generator, mesh_shaders_supported,
+                                shader_int64_supported, multi_draw_indirect_supported, draw_indirect_count_supported,
+                                resources.images.cold(draw_image).image_format, DEPTH_FORMAT);
 }
 
 
 void IncandescentEngine::initialize_background_pipelines() {
-    // Compute pipeline
-    VkPipelineLayoutCreateInfo compute_layout_create_info = {};
-    compute_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    compute_layout_create_info.pNext = nullptr;
-    compute_layout_create_info.pSetLayouts = &draw_image_descriptor_set_layout;
-    compute_layout_create_info.setLayoutCount = 1;
-
-    VK_CHECK(vkCreatePipelineLayout(device, &compute_layout_create_info, nullptr, &gradient_pipeline_layout));
+    // Compute pipeline layout comes from the cache so passes with the same sets share it
+    VkPipelineLayout gradient_pipeline_layout;
+    if (descriptor_backend == DescriptorBackend::Bindless) {
+        // The bindless variant uses the heap layout and gets the draw image index through a push constant
+        VkPushConstantRange push_constant_range = {};
+        push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(GradientPushConstants);
+
+        gradient_pipeline_layout = layout_cache.get_pipeline_layout(device, {&bindless_heap.layout, 1},
+                                                                    {&push_constant_range, 1});
+    } else {
+        gradient_pipeline_layout = layout_cache.get_pipeline_layout(device, {&draw_image_descriptor_set_layout, 1});
+    }
 
     // Load shader
+    const char *compute_draw_shader_path = descriptor_backend == DescriptorBackend::Bindless
+                                               ? "shaders/gradient_bindless.comp.spv"
+                                               : "shaders/gradient.comp.spv";
     VkShaderModule compute_draw_shader;
-    if (!incan_util::load_shader_module("shaders/gradient.comp.spv", device, &compute_draw_shader)) {
+    if (!incan_util::load_shader_module(compute_draw_shader_path, device, &compute_draw_shader)) {
         fmt::print("Error when building compute shader\n");
     }
 
@@ -703,11 +1022,17 @@ void IncandescentEngine::initialize_background_pipelines() {
     compute_pipeline_create_info.pNext = nullptr;
     compute_pipeline_create_info.layout = gradient_pipeline_layout;
     compute_pipeline_create_info.stage = shader_stage_create_info;
+    if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+        compute_pipeline_create_info.flags |= VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+    }
     // compute_pipeline_create_info.basePipelineIndex = 0;
 
+    VkPipeline compute_pipeline;
     VK_CHECK(
-        vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr, &gradient_pipeline))
+        vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr, &compute_pipeline))
     ;
+    gradient_pipeline = resources.add_pipeline(compute_pipeline, gradient_pipeline_layout,
+                                               VK_PIPELINE_BIND_POINT_COMPUTE);
 
     vkDestroyShaderModule(device, compute_draw_shader, nullptr);
 }
@@ -718,6 +1043,16 @@ void IncandescentEngine::draw() {
     VK_CHECK(vkWaitForFences(device, 1, &get_current_frame().render_fence, true, 1000000000));
     VK_CHECK(vkResetFences(device, 1, &get_current_frame().render_fence)); // Reset the fence after use
 
+    // Refresh heap usage/budget for this frame
+    memory_telemetry.update(frame_number);
+
+    // The GPU is done with everything this frame allocated last time around
+    get_current_frame().linear_allocator.reset();
+    get_current_frame().frame_descriptors.clear_pools(device);
+    if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+        get_current_frame().frame_descriptor_buffer.clear_descriptors(device, allocator, memory_telemetry);
+    }
+
     // Request image from swapchain, swapchain semaphore signals when image is acquired
     uint32_t swapchain_image_index;
     VK_CHECK(vkAcquireNextImageKHR(device, swapchain, 1000000000, get_current_frame().swapchain_semaphore,
@@ -735,21 +1070,47 @@ void IncandescentEngine::draw() {
             incan_struct_init::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
     // Set the extent of the current image to the window size
-    draw_extent.width = draw_image.image_extent.width;
-    draw_extent.height = draw_image.image_extent.height;
+    const ImageColdData &draw_image_info = resources.images.cold(draw_image);
+    draw_extent.width = draw_image_info.image_extent.width;
+    draw_extent.height = draw_image_info.image_extent.height;
 
     // Start writing to the command buffer
     VK_CHECK(vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info));
 
+    // Uploads and evictions go first, so this frame draws with what is resident now. What a defragmentation pass may
+    // still be moving isn't destroyed until the pass is over
+    residency.update(command_buffer, loaded_scenes, camera, draw_extent, static_cast<uint64_t>(frame_number),
+                     !defragmenter.pass_active);
+
+    // Moves are recorded ahead of any rendering, so the rest of the frame already uses the moved resources
+    if (use_defragmentation) {
+        defragment_memory(command_buffer);
+    }
+
+    // Looked up after defragmentation, which may have just swapped the image
+    VkImage draw_vk_image = resources.images.hot(draw_image).image;
+
     // Transition the draw image into the general layout so we can write into it, the initial layout doesn't matter
     // as we are overwriting it.
-    incan_util::transition_image_graphics_to_graphics(command_buffer, draw_image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+    incan_util::transition_image_graphics_to_graphics(command_buffer, draw_vk_image, VK_IMAGE_LAYOUT_UNDEFINED,
                                                       VK_IMAGE_LAYOUT_GENERAL);
+    // The bindless heap is bound once for the whole command buffer, passes only push indices
+    if (descriptor_backend == DescriptorBackend::Bindless) {
+        bindless_heap.bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                           resources.pipelines.hot(gradient_pipeline).layout);
+    }
+    // Likewise the frame's descriptor buffer, passes then only change offsets
+    if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+        get_current_frame().frame_descriptor_buffer.bind(command_buffer);
+    }
+
     // Call draw command
     draw_background(command_buffer);
+    draw_geometry(command_buffer);
 
     // Transition draw image to transfer source
-    incan_util::transition_image_graphics_to_graphics(command_buffer, draw_image.image, VK_IMAGE_LAYOUT_GENERAL,
+    incan_util::transition_image_graphics_to_graphics(command_buffer, draw_vk_image,
+                                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
     // Transition swapchain image to transfer destination
     incan_util::transition_image_graphics_to_graphics(command_buffer, swapchain_images[swapchain_image_index],
@@ -757,7 +1118,7 @@ void IncandescentEngine::draw() {
                                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
     // Copy draw image to swapchain
-    incan_util::copy_image_to_image(command_buffer, draw_image.image, swapchain_images[swapchain_image_index],
+    incan_util::copy_image_to_image(command_buffer, draw_vk_image, swapchain_images[swapchain_image_index],
                                     draw_extent, swapchain_extent);
 
     // Set swapchain image layout to present
@@ -768,6 +1129,12 @@ void IncandescentEngine::draw() {
     // Finalize command buffer
     VK_CHECK(vkEndCommandBuffer(command_buffer));
 
+    // Make this frame's uniform/dynamic writes visible before submitting
+    get_current_frame().linear_allocator.flush(allocator);
+    if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+        get_current_frame().frame_descriptor_buffer.flush(allocator);
+    }
+
     // Prepare the queue submission
     VkCommandBufferSubmitInfo command_buffer_submit_info =
             incan_struct_init::command_buffer_submit_info(command_buffer);
@@ -812,16 +1179,296 @@ void IncandescentEngine::draw_background(VkCommandBuffer command_buffer) {
     VkImageSubresourceRange clear_color_range = incan_struct_init::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
 
     // Bind the gradient draw compute pipeline
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, gradient_pipeline);
+    const PipelineHotData &gradient = resources.pipelines.hot(gradient_pipeline);
+    VkPipelineLayout gradient_pipeline_layout = gradient.layout;
+    vkCmdBindPipeline(command_buffer, gradient.bind_point, gradient.pipeline);
+
+    const ImageHotData &draw_image_data = resources.images.hot(draw_image);
+
+    if (descriptor_backend == DescriptorBackend::Bindless) {
+        // Heap is already bound, just tell the shader which storage image to write
+        GradientPushConstants push_constants = {};
+        push_constants.draw_image_index = draw_image_data.bindless_storage_index;
+        vkCmdPushConstants(command_buffer, gradient_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(GradientPushConstants), &push_constants);
+    } else if (descriptor_backend == DescriptorBackend::DescriptorBuffer) {
+        // Descriptor goes straight into this frame's mapped descriptor buffer, binding is an offset change
+        DescriptorBufferAllocator &descriptor_buffer = get_current_frame().frame_descriptor_buffer;
+        std::optional<VkDeviceSize> set_offset = descriptor_buffer.allocate(device, draw_image_descriptor_set_layout);
+        if (!set_offset) {
+            // Out of space, skip the background this frame, the buffer grows before it is reused
+            return;
+        }
+
+        DescriptorWriter descriptor_writer;
+        descriptor_writer.write_image(0, draw_image_data.image_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        descriptor_writer.update_set(device, descriptor_buffer, *set_offset, draw_image_descriptor_set_layout);
+
+        descriptor_buffer.set_offset(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, gradient_pipeline_layout, 0,
+                                     *set_offset);
+    } else {
+        // Transient set for this frame, freed in bulk when the frame's descriptor pools are reset
+        VkDescriptorSet draw_image_descriptor_set =
+                get_current_frame().frame_descriptors.allocate(device, draw_image_descriptor_set_layout);
+        if (draw_image_descriptor_set == VK_NULL_HANDLE) {
+            return;
+        }
+
+        // Layout is known up front, so the set is filled through its cached update template in one call
+        DescriptorWriter descriptor_writer;
+        descriptor_writer.write_image(0, draw_image_data.image_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        descriptor_writer.update_set(device, draw_image_descriptor_set, draw_image_update_template);
 
-    // Bind descriptor set containing draw image for the compute pipeline
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, gradient_pipeline_layout, 0, 1,
-                            &draw_image_descriptor_set, 0, nullptr);
+        // Bind descriptor set containing draw image for the compute pipeline
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, gradient_pipeline_layout, 0, 1,
+                                &draw_image_descriptor_set, 0, nullptr);
+    }
 
     // Dispatch pipeline, must match our compute shader workgroup size
     vkCmdDispatch(command_buffer, std::ceil(draw_extent.width / 16.0), std::ceil(draw_extent.height / 16.0), 1);
 }
 
+void IncandescentEngine::draw_geometry(VkCommandBuffer command_buffer) {
+    // The background was written in compute, depth starts over every frame
+    incan_util::transition_image(command_buffer, resources.images.hot(draw_image).image, VK_IMAGE_LAYOUT_GENERAL,
+                                 VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                 VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                 VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                                 VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+    incan_util::transition_image_graphics_to_graphics(command_buffer, resources.images.hot(depth_image).image,
+                                                      VK_IMAGE_LAYOUT_UNDEFINED,
+                                                      VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+    // The culling pass's set comes from the frame's pools, which also works alongside the other backends
+    meshlet_renderer.draw(command_buffer, loaded_scenes, camera, draw_extent, draw_image, depth_image, depth_pyramid,
+                          get_current_frame().linear_allocator, get_current_frame().frame_descriptors);
+}
+
+void IncandescentEngine::immediate_submit(std::function<void(VkCommandBuffer command_buffer)> &&function) {
+    VK_CHECK(vkResetCommandBuffer(immediate_command_buffer, 0));
+
+    VkCommandBufferBeginInfo command_buffer_begin_info =
+            incan_struct_init::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(immediate_command_buffer, &command_buffer_begin_info));
+
+    function(immediate_command_buffer);
+
+    VK_CHECK(vkEndCommandBuffer(immediate_command_buffer));
+
+    VkCommandBufferSubmitInfo command_buffer_submit_info =
+            incan_struct_init::command_buffer_submit_info(immediate_command_buffer);
+    VkSubmitInfo2 submit_info = incan_struct_init::submit_info(&command_buffer_submit_info, nullptr, nullptr);
+
+    // Uploads can be big, so wait without a timeout
+    VK_CHECK(vkQueueSubmit2KHR(graphics_queue, 1, &submit_info, immediate_fence));
+    VK_CHECK(vkWaitForFences(device, 1, &immediate_fence, true, UINT64_MAX));
+    VK_CHECK(vkResetFences(device, 1, &immediate_fence));
+}
+
+void IncandescentEngine::defragment_memory(VkCommandBuffer command_buffer) {
+    // A pass can only be committed once the frame holding its copies, and any frame still using the old
+    // resources, has retired
+    if (defragmenter.pass_active) {
+        if (static_cast<uint64_t>(frame_number) < defragmenter.pass_frame + FRAME_OVERLAP) {
+            return;
+        }
+        retire_defragmentation_pass();
+    }
+
+    // Checking walks every memory block, so it is only done every so often
+    if (!defragmenter.is_running()) {
+        if (frame_number % DEFRAGMENTATION_CHECK_INTERVAL != 0 ||
+            !defragmenter.is_fragmented(DEFRAGMENTATION_UNUSED_THRESHOLD)) {
+            return;
+        }
+        defragmenter.begin();
+    }
+
+    std::span<VmaDefragmentationMove> moves = defragmenter.begin_pass(frame_number);
+    if (moves.empty()) {
+        return;
+    }
+
+    // Everything earlier frames wrote has to land before it is copied out
+    VkMemoryBarrier2 memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    memory_barrier.pNext = nullptr;
+    memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memory_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+    memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &memory_barrier;
+
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+
+    for (VmaDefragmentationMove &move: moves) {
+        bool moved = false;
+
+        auto movable_image = resources.image_allocations.find(move.srcAllocation);
+        auto movable_buffer = resources.buffer_allocations.find(move.srcAllocation);
+        if (movable_image != resources.image_allocations.end()) {
+            moved = move_image(command_buffer, movable_image->second, move);
+        } else if (movable_buffer != resources.buffer_allocations.end()) {
+            moved = move_buffer(command_buffer, movable_buffer->second, move);
+        }
+
+        // Anything the engine can't recreate (persistently mapped per-frame buffers, descriptor buffers) stays put
+        if (!moved) {
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+        }
+    }
+
+    // The copies have to finish before the rest of the frame reads the moved resources
+    memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+}
+
+bool IncandescentEngine::move_image(VkCommandBuffer command_buffer, ImageHandle image,
+                                    const VmaDefragmentationMove &move) {
+    ImageHotData &image_data = resources.images.hot(image);
+    const ImageColdData &image_info = resources.images.cold(image);
+
+    bool copy_contents = image_info.resting_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageUsageFlags transfer_usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (copy_contents && (image_info.usage_flags & transfer_usage) != transfer_usage) {
+        return false;
+    }
+
+    // Same image, bound to the destination memory
+    VkImageCreateInfo image_create_info = incan_struct_init::image_create_info(
+        image_info.image_format, image_info.usage_flags, image_info.image_extent, image_info.mip_levels);
+
+    VkImage new_image;
+    VK_CHECK(vkCreateImage(device, &image_create_info, nullptr, &new_image));
+    VK_CHECK(vmaBindImageMemory(allocator, move.dstTmpAllocation, new_image));
+
+    VkImageViewCreateInfo image_view_create_info = incan_struct_init::image_view_create_info(
+        image_info.image_format, new_image, incan_util::image_aspect_flags(image_info.image_format), 0,
+        image_info.mip_levels);
+
+    VkImageView new_image_view;
+    VK_CHECK(vkCreateImageView(device, &image_view_create_info, nullptr, &new_image_view));
+
+    // The frame in flight may still read the old bindless slot, so the moved image gets a new one
+    bool has_bindless_slot = image_data.bindless_storage_index != NO_BINDLESS_INDEX;
+    uint32_t new_bindless_index = NO_BINDLESS_INDEX;
+    if (has_bindless_slot) {
+        std::optional<uint32_t> bindless_index = bindless_heap.register_storage_image(device, new_image_view);
+        if (!bindless_index.has_value()) {
+            vkDestroyImageView(device, new_image_view, nullptr);
+            vkDestroyImage(device, new_image, nullptr);
+            return false;
+        }
+        new_bindless_index = bindless_index.value();
+    }
+
+    if (copy_contents) {
+        incan_util::transition_image(command_buffer, image_data.image, image_info.resting_layout,
+                                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                     VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+                                     VK_ACCESS_2_TRANSFER_READ_BIT);
+        incan_util::transition_image(command_buffer, new_image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_NONE,
+                                     VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COPY_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+        incan_util::copy_image_contents(command_buffer, image_data.image, new_image, image_info.image_extent,
+                                        image_info.mip_levels);
+
+        incan_util::transition_image(command_buffer, new_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     image_info.resting_layout, VK_PIPELINE_STAGE_2_COPY_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                     VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+    }
+
+    // Swap the handle over to the new image, the old Vulkan handles live until the pass retires
+    defragmentation_retired_handles.image_handles.push_back(image_data.image);
+    defragmentation_retired_handles.image_view_handles.push_back(image_data.image_view);
+    image_data.image = new_image;
+    image_data.image_view = new_image_view;
+
+    if (has_bindless_slot) {
+        defragmentation_retired_handles.bindless_storage_image_indices.push_back(image_data.bindless_storage_index);
+        image_data.bindless_storage_index = new_bindless_index;
+    }
+
+    return true;
+}
+
+bool IncandescentEngine::move_buffer(VkCommandBuffer command_buffer, BufferHandle buffer,
+                                     const VmaDefragmentationMove &move) {
+    BufferHotData &buffer_data = resources.buffers.hot(buffer);
+    const BufferColdData &buffer_info = resources.buffers.cold(buffer);
+
+    VkBufferUsageFlags transfer_usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if ((buffer_info.usage_flags & transfer_usage) != transfer_usage) {
+        return false;
+    }
+
+    VkBufferCreateInfo buffer_create_info = incan_struct_init::buffer_create_info(buffer_info.size,
+                                                                                  buffer_info.usage_flags);
+
+    VkBuffer new_buffer;
+    VK_CHECK(vkCreateBuffer(device, &buffer_create_info, nullptr, &new_buffer));
+    VK_CHECK(vmaBindBufferMemory(allocator, move.dstTmpAllocation, new_buffer));
+
+    VkBufferCopy copy_region = {};
+    copy_region.srcOffset = 0;
+    copy_region.dstOffset = 0;
+    copy_region.size = buffer_info.size;
+    vkCmdCopyBuffer(command_buffer, buffer_data.buffer, new_buffer, 1, &copy_region);
+
+    // Swap the handle over, anything that copied the device address out of the pool has to fetch it again
+    defragmentation_retired_handles.buffer_handles.push_back(buffer_data.buffer);
+    buffer_data.buffer = new_buffer;
+    if (buffer_info.usage_flags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        buffer_data.device_address = incan_util::get_buffer_device_address(device, new_buffer);
+    }
+    defragmentation_moved_buffers.push_back(buffer);
+
+    return true;
+}
+
+void IncandescentEngine::retire_defragmentation_pass() {
+    for (VkImageView image_view: defragmentation_retired_handles.image_view_handles) {
+        vkDestroyImageView(device, image_view, nullptr);
+    }
+    // Only the handles go, the memory now belongs to the moved resources
+    for (VkImage image: defragmentation_retired_handles.image_handles) {
+        resources.release_mip_views(image);
+        vkDestroyImage(device, image, nullptr);
+    }
+    for (VkBuffer buffer: defragmentation_retired_handles.buffer_handles) {
+        vkDestroyBuffer(device, buffer, nullptr);
+    }
+    for (uint32_t index: defragmentation_retired_handles.bindless_storage_image_indices) {
+        bindless_heap.release(BINDLESS_STORAGE_IMAGE_BINDING, index);
+    }
+    defragmentation_retired_handles = {};
+
+    defragmenter.end_pass();
+
+    // Allocation info (memory, offset, mapped pointer) only points at the new place once the pass is committed.
+    // A buffer destroyed since it was moved has nothing left to refresh
+    for (BufferHandle buffer: defragmentation_moved_buffers) {
+        if (resources.buffers.contains(buffer)) {
+            BufferColdData &buffer_info = resources.buffers.cold(buffer);
+            vmaGetAllocationInfo(allocator, buffer_info.allocation, &buffer_info.allocation_info);
+        }
+    }
+    defragmentation_moved_buffers.clear();
+}
 
 void IncandescentEngine::run() {
     SDL_Event event;
@@ -841,6 +1488,13 @@ void IncandescentEngine::run() {
 
             if (event.type == SDL_KEYDOWN) {
                 fmt::print("keylog: {}\n", event.key.keysym.sym);
+
+                // Dump a memory snapshot on demand
+                if (event.key.keysym.sym == SDLK_F2) {
+                    if (memory_telemetry.write_json_snapshot("./src/memory_snapshot.json")) {
+                        fmt::print("Memory snapshot written to ./src/memory_snapshot.json\n");
+                    }
+                }
             }
 
 
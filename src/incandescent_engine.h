@@ -7,12 +7,25 @@
 
 #include <incandescent_types.h>
 #include <incandescent_descriptors.h>
+#include <incandescent_memory.h>
+#include <incandescent_buffers.h>
+#include <incandescent_resources.h>
+#include <incandescent_pipelines.h>
+#include <incandescent_mipmaps.h>
+#include <incandescent_loader.h>
+#include <incandescent_texture_streamer.h>
+#include <incandescent_meshlet_renderer.h>
+#include <incandescent_residency.h>
+#include <incandescent_camera.h>
+#include <incandescent_file_reader.h>
+#include <incandescent_decompression.h>
 
 // Create object handle/deletion struct
 struct DeleteHandles {
     std::vector<VkImage> image_handles;
     std::vector<VkImageView> image_view_handles;
     std::vector<VkBuffer> buffer_handles;
+    std::vector<uint32_t> bindless_storage_image_indices;
 };
 
 // Create frame data struct
@@ -25,32 +38,106 @@ struct FrameData {
     VkSemaphore swapchain_semaphore; // Lets the render commands wait on the swapchain image request
     VkSemaphore render_semaphore; // Controls presenting the image once the draw is finished
     VkFence render_fence; // Lets us wait for the draw commands for the frame to be finished
+    // Uniform/dynamic data for this frame, reset once render_fence has been waited on
+    FrameLinearAllocator linear_allocator;
+    // Transient descriptor sets for this frame, reset at the same point as linear_allocator
+    DescriptorAllocator frame_descriptors;
+    // Same role as frame_descriptors when the descriptor buffer backend is active
+    DescriptorBufferAllocator frame_descriptor_buffer;
 };
 
-// Struct to hold data for an image
-struct AllocatedImage {
-    VkImage image;
-    VkImageView image_view;
-    VmaAllocation allocation;
-    VkExtent3D image_extent;
-    VkFormat image_format;
+// Push constants of the bindless gradient compute shader
+struct GradientPushConstants {
+    uint32_t draw_image_index;
 };
 
 constexpr unsigned int FRAME_OVERLAP = 2;
+constexpr VkDeviceSize FRAME_LINEAR_ALLOCATOR_SIZE = 4 * 1024 * 1024;
+constexpr VkDeviceSize FRAME_DESCRIPTOR_BUFFER_SIZE = 256 * 1024;
+// Reversed Z only needs a float depth buffer, no stencil
+constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+// Defragmentation budget per frame, and how often (in frames) fragmentation is checked while no run is active
+constexpr VkDeviceSize DEFRAGMENTATION_BYTES_PER_FRAME = 16 * 1024 * 1024;
+constexpr uint32_t DEFRAGMENTATION_MOVES_PER_FRAME = 32;
+constexpr uint32_t DEFRAGMENTATION_CHECK_INTERVAL = 300;
+// Share of allocated device memory blocks that has to be free space before a run starts
+constexpr float DEFRAGMENTATION_UNUSED_THRESHOLD = 0.25f;
+// Share of the device local heaps' budget the loaded scenes' meshes and textures may take, and how much of them is
+// streamed in per frame
+constexpr float RESIDENCY_BUDGET_FRACTION = 0.5f;
+constexpr VkDeviceSize RESIDENCY_UPLOAD_BYTES_PER_FRAME = 32 * 1024 * 1024;
+// Threads reading when io_uring isn't there, and reads io_uring keeps in flight
+constexpr uint32_t FILE_READ_WORKERS = 4;
+constexpr uint32_t FILE_READ_QUEUE_DEPTH = 256;
+
+// How shaders get their resources, picked from device capabilities in initialize_vulkan
+enum class DescriptorBackend {
+    DescriptorSets, // Sets from the per-frame DescriptorAllocator
+    Bindless, // One update-after-bind heap indexed through push constants
+    DescriptorBuffer // VK_EXT_descriptor_buffer for the background dispatch, opt in through use_descriptor_buffer
+};
 
 class IncandescentEngine {
 public:
-    // Descriptor allocator and set
+    // Descriptor allocator for long-lived sets and the draw image set layout
     DescriptorAllocator global_descriptor_allocator;
-    VkDescriptorSet draw_image_descriptor_set;
+    // Owns every descriptor set layout and pipeline layout
+    DescriptorLayoutCache layout_cache;
+    // Owns every graphics pipeline, passes asking for the same state get the same one
+    GraphicsPipelineCache pipeline_cache;
     VkDescriptorSetLayout draw_image_descriptor_set_layout;
+    VkDescriptorUpdateTemplate draw_image_update_template;
+
+    // Bindless descriptor heap, used instead of per-pipeline sets when the device supports it
+    BindlessDescriptorHeap bindless_heap;
+    bool bindless_supported = false;
+    bool descriptor_buffer_supported = false;
+    DescriptorBackend descriptor_backend = DescriptorBackend::DescriptorSets;
+
+    // Every long-lived image, buffer, pipeline and sampler, everything else refers to them by handle
+    ResourceManager resources;
 
     // Pipelines
-    VkPipeline gradient_pipeline;
-    VkPipelineLayout gradient_pipeline_layout;
+    PipelineHandle gradient_pipeline;
+
+    // Mip chain generation for uploaded textures and render targets
+    MipGenerator mip_generator;
+    bool single_pass_mips_supported = false;
+
+    // Meshlet culling and drawing of the loaded scenes, with mesh shaders if the device has them
+    MeshletRenderer meshlet_renderer;
+    bool mesh_shaders_supported = false;
+    bool shader_int64_supported = false;
+    bool multi_draw_indirect_supported = false;
+    bool draw_indirect_count_supported = false;
+    Camera camera;
+
+    // Decodes scene textures on worker threads and uploads them as they finish
+    TextureStreamer texture_streamer;
+    // Reads the texture archives for the streamer and the residency manager
+    AsyncFileReader file_reader;
+    // Expands what they read on the GPU when the device can
+    GpuDecompressor gpu_decompressor;
+    bool texture_compression_supported = false;
+
+    // glTF or OBJ file loaded at startup, nothing is loaded if empty
+    std::filesystem::path scene_path;
+    std::vector<LoadedScene> loaded_scenes;
+    // Streams the loaded scenes' meshes and texture mips in and out as the camera moves
+    ResidencyManager residency;
+    // Binary geometry cache files, one per imported source file
+    std::filesystem::path geometry_cache_directory = "./cache";
 
     // Memory allocator
     VmaAllocator allocator;
+    MemoryTelemetry memory_telemetry;
+    bool memory_budget_supported = false;
+
+    // Background defragmentation, only resources owned by the ResourceManager are moved, everything else is ignored
+    MemoryDefragmenter defragmenter;
+    // Old Vulkan handles of the current pass, destroyed once the frame that copied out of them has retired
+    DeleteHandles defragmentation_retired_handles;
+    std::vector<BufferHandle> defragmentation_moved_buffers;
 
     // Frame information
     FrameData frames[FRAME_OVERLAP];
@@ -70,6 +157,10 @@ public:
     VkInstance instance;
     VkDebugUtilsMessengerEXT debug_messenger;
     VkPhysicalDevice selected_gpu;
+    VkPhysicalDeviceProperties gpu_properties;
+    VkPhysicalDeviceVulkan11Properties gpu_properties11;
+    VkPhysicalDeviceVulkan12Properties gpu_properties12;
+    VkPhysicalDeviceDescriptorBufferPropertiesEXT gpu_descriptor_buffer_properties;
     VkDevice device;
     VkSurfaceKHR surface;
 
@@ -85,8 +176,16 @@ public:
     VkQueue graphics_queue;
     uint32_t graphics_queue_family_index;
 
+    // One-off submits outside the frame loop (uploads), immediate_submit waits on the fence before returning
+    VkCommandPool immediate_command_pool;
+    VkCommandBuffer immediate_command_buffer;
+    VkFence immediate_fence;
+
     // Draw resources
-    AllocatedImage draw_image;
+    ImageHandle draw_image;
+    ImageHandle depth_image;
+    // Min reduction of depth_image (Hi-Z) the MeshletRenderer builds and occlusion culls against every frame
+    ImageHandle depth_pyramid;
     VkExtent2D draw_extent;
 
     // Forward declaration reduces compile times and ambiguity for the compiler
@@ -110,6 +209,9 @@ public:
     // Initializes the sync structures
     void initialize_sync_structures();
 
+    // Initializes the per-frame linear allocators
+    void initialize_frame_allocators();
+
     // Shuts down the engine and cleans memory
     void cleanup();
 
@@ -119,6 +221,12 @@ public:
     // Draws the background
     void draw_background(VkCommandBuffer command_buffer);
 
+    // Draws the loaded scenes over the background, the draw image goes from GENERAL to COLOR_ATTACHMENT_OPTIMAL
+    void draw_geometry(VkCommandBuffer command_buffer);
+
+    // Records function into the immediate command buffer, submits it on the graphics queue and waits for it
+    void immediate_submit(std::function<void(VkCommandBuffer command_buffer)> &&function);
+
     // Runs the main program loop
     void run();
 
@@ -127,9 +235,24 @@ private:
 
     void destroy_swapchain();
 
+    // Sizes the depth pyramid and its mip count from depth_image, call again whenever the depth image is recreated.
+    // The device must be idle
+    void recreate_depth_pyramid();
+
     void initialize_pipelines();
 
     void initialize_background_pipelines();
+
+    // Records this frame's defragmentation moves at the start of the frame's command buffer
+    void defragment_memory(VkCommandBuffer command_buffer);
+
+    // Recreates an image in the move's destination memory, returns false if it has to stay where it is
+    bool move_image(VkCommandBuffer command_buffer, ImageHandle image, const VmaDefragmentationMove &move);
+
+    bool move_buffer(VkCommandBuffer command_buffer, BufferHandle buffer, const VmaDefragmentationMove &move);
+
+    // Destroys the handles moved out of by the current pass and commits it
+    void retire_defragmentation_pass();
 };
 
 #endif //INCANDESCENT_ENGINE_H
@@ -0,0 +1,524 @@
+#include <incandescent_file_reader.h>
+#include <incandescent_jobs.h>
+#include <incandescent_lz4.h>
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace {
+    // Large reads are split into calls of at most this size, neither pread nor io_uring can return more than an int
+    constexpr uint64_t MAX_READ_CALL_SIZE = 1 << 30;
+}
+
+FileHandle incan_file::open(const std::filesystem::path &file_path, bool writable) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(file_path.c_str(), writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    return file == INVALID_HANDLE_VALUE ? INVALID_FILE_HANDLE : reinterpret_cast<FileHandle>(file);
+#else
+    int file = ::open(file_path.c_str(), writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    return file < 0 ? INVALID_FILE_HANDLE : file;
+#endif
+}
+
+void incan_file::close(FileHandle file) {
+    if (file == INVALID_FILE_HANDLE) {
+        return;
+    }
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(file));
+#else
+    ::close(static_cast<int>(file));
+#endif
+}
+
+std::optional<uint64_t> incan_file::size(FileHandle file) {
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(reinterpret_cast<HANDLE>(file), &file_size)) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(file_size.QuadPart);
+#else
+    struct stat file_stat = {};
+    if (fstat(static_cast<int>(file), &file_stat) != 0) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(file_stat.st_size);
+#endif
+}
+
+bool incan_file::read_at(FileHandle file, uint64_t offset, std::span<std::byte> destination) {
+    // Reads may come back short, the rest is asked for again
+    while (!destination.empty()) {
+        size_t call_size = std::min<uint64_t>(destination.size(), MAX_READ_CALL_SIZE);
+#ifdef _WIN32
+        // A handle opened for synchronous access still reads at the offset given here
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD bytes_read = 0;
+        if (!ReadFile(reinterpret_cast<HANDLE>(file), destination.data(), static_cast<DWORD>(call_size), &bytes_read,
+                      &overlapped)) {
+            return false;
+        }
+#else
+        ssize_t bytes_read = pread(static_cast<int>(file), destination.data(), call_size, static_cast<off_t>(offset));
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read < 0) {
+            return false;
+        }
+#endif
+        // The file ends before the range does
+        if (bytes_read == 0) {
+            return false;
+        }
+        destination = destination.subspan(static_cast<size_t>(bytes_read));
+        offset += static_cast<uint64_t>(bytes_read);
+    }
+    return true;
+}
+
+bool incan_file::write_at(FileHandle file, uint64_t offset, std::span<const std::byte> source) {
+    while (!source.empty()) {
+        size_t call_size = std::min<uint64_t>(source.size(), MAX_READ_CALL_SIZE);
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD bytes_written = 0;
+        if (!WriteFile(reinterpret_cast<HANDLE>(file), source.data(), static_cast<DWORD>(call_size), &bytes_written,
+                       &overlapped)) {
+            return false;
+        }
+#else
+        ssize_t bytes_written = pwrite(static_cast<int>(file), source.data(), call_size, static_cast<off_t>(offset));
+        if (bytes_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_written <= 0) {
+            return false;
+        }
+#endif
+        source = source.subspan(static_cast<size_t>(bytes_written));
+        offset += static_cast<uint64_t>(bytes_written);
+    }
+    return true;
+}
+
+#ifdef __linux__
+// The submission and completion rings and the submission entries, all shared with the kernel
+struct IoRing {
+    int fd = -1;
+    void *submission_ring = nullptr;
+    size_t submission_ring_size = 0;
+    void *completion_ring = nullptr;
+    size_t completion_ring_size = 0;
+    io_uring_sqe *entries = nullptr;
+    uint32_t entry_count = 0;
+
+    uint32_t *submission_head;
+    uint32_t *submission_tail;
+    uint32_t submission_mask;
+    uint32_t *submission_array;
+    uint32_t *completion_head;
+    uint32_t *completion_tail;
+    uint32_t completion_mask;
+    io_uring_cqe *completions;
+
+    // Entries in the submission ring the kernel hasn't taken yet
+    uint32_t unsubmitted = 0;
+    // One per slot, read by the kernel when it starts the read
+    std::vector<iovec> buffers;
+};
+
+namespace {
+    // user_data of the no-op that wakes the completion thread up to stop
+    constexpr uint64_t WAKE_USER_DATA = UINT64_MAX;
+
+    template<typename T>
+    T *ring_field(void *ring, uint32_t offset) {
+        return reinterpret_cast<T *>(static_cast<std::byte *>(ring) + offset);
+    }
+
+    int enter_ring(const IoRing &ring, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    bool set_up_ring(IoRing &ring, uint32_t entry_count) {
+        io_uring_params params = {};
+        ring.fd = static_cast<int>(syscall(__NR_io_uring_setup, entry_count, &params));
+        if (ring.fd < 0) {
+            return false;
+        }
+
+        ring.submission_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        ring.completion_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        // Newer kernels map both rings in one go
+        bool single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mapping) {
+            ring.submission_ring_size = std::max(ring.submission_ring_size, ring.completion_ring_size);
+        }
+
+        ring.submission_ring = mmap(nullptr, ring.submission_ring_size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+        if (ring.submission_ring == MAP_FAILED) {
+            ring.submission_ring = nullptr;
+            return false;
+        }
+        if (single_mapping) {
+            ring.completion_ring = ring.submission_ring;
+        } else {
+            ring.completion_ring = mmap(nullptr, ring.completion_ring_size, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+            if (ring.completion_ring == MAP_FAILED) {
+                ring.completion_ring = nullptr;
+                return false;
+            }
+        }
+        void *entries = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+        if (entries == MAP_FAILED) {
+            return false;
+        }
+        ring.entries = static_cast<io_uring_sqe *>(entries);
+        ring.entry_count = params.sq_entries;
+
+        ring.submission_head = ring_field<uint32_t>(ring.submission_ring, params.sq_off.head);
+        ring.submission_tail = ring_field<uint32_t>(ring.submission_ring, params.sq_off.tail);
+        ring.submission_mask = *ring_field<uint32_t>(ring.submission_ring, params.sq_off.ring_mask);
+        ring.submission_array = ring_field<uint32_t>(ring.submission_ring, params.sq_off.array);
+        ring.completion_head = ring_field<uint32_t>(ring.completion_ring, params.cq_off.head);
+        ring.completion_tail = ring_field<uint32_t>(ring.completion_ring, params.cq_off.tail);
+        ring.completion_mask = *ring_field<uint32_t>(ring.completion_ring, params.cq_off.ring_mask);
+        ring.completions = ring_field<io_uring_cqe>(ring.completion_ring, params.cq_off.cqes);
+        ring.buffers.resize(ring.entry_count);
+        return true;
+    }
+
+    void tear_down_ring(IoRing &ring) {
+        if (ring.entries != nullptr) {
+            munmap(ring.entries, ring.entry_count * sizeof(io_uring_sqe));
+        }
+        if (ring.completion_ring != nullptr && ring.completion_ring != ring.submission_ring) {
+            munmap(ring.completion_ring, ring.completion_ring_size);
+        }
+        if (ring.submission_ring != nullptr) {
+            munmap(ring.submission_ring, ring.submission_ring_size);
+        }
+        if (ring.fd >= 0) {
+            ::close(ring.fd);
+        }
+        ring = {};
+    }
+
+    // Zeroed entry at the tail, nothing if the submission ring is full. The kernel only sees it after push_entry
+    io_uring_sqe *next_entry(IoRing &ring) {
+        uint32_t head = std::atomic_ref(*ring.submission_head).load(std::memory_order_acquire);
+        uint32_t tail = *ring.submission_tail;
+        if (tail - head == ring.entry_count) {
+            return nullptr;
+        }
+        uint32_t index = tail & ring.submission_mask;
+        ring.submission_array[index] = index;
+        io_uring_sqe *entry = &ring.entries[index];
+        memset(entry, 0, sizeof(*entry));
+        return entry;
+    }
+
+    // Publishes the entry next_entry returned, once it is filled in
+    void push_entry(IoRing &ring) {
+        std::atomic_ref(*ring.submission_tail).store(*ring.submission_tail + 1, std::memory_order_release);
+        ring.unsubmitted++;
+    }
+
+    void submit_entries(IoRing &ring) {
+        while (ring.unsubmitted > 0) {
+            int submitted = enter_ring(ring, ring.unsubmitted, 0, 0);
+            if (submitted < 0 && errno == EINTR) {
+                continue;
+            }
+            // The kernel is out of resources for now, what is left goes with the next submit
+            if (submitted <= 0) {
+                return;
+            }
+            ring.unsubmitted -= static_cast<uint32_t>(submitted);
+        }
+    }
+}
+#endif
+
+void AsyncFileReader::initialize(uint32_t worker_count, uint32_t queue_depth) {
+#ifdef __linux__
+    ring = new IoRing();
+    if (set_up_ring(*ring, std::max(queue_depth, 1u))) {
+        ring_slots.resize(ring->entry_count);
+        for (uint32_t slot = ring->entry_count; slot-- > 0;) {
+            free_ring_slots.push_back(slot);
+        }
+        threads.emplace_back([this]() {
+            run_ring_completions();
+        });
+        return;
+    }
+    fmt::print("io_uring isn't available, reading files on a thread pool\n");
+    tear_down_ring(*ring);
+    delete ring;
+    ring = nullptr;
+#endif
+
+    for (uint32_t i = 0; i < std::max(worker_count, 1u); i++) {
+        threads.emplace_back([this]() {
+            run_worker();
+        });
+    }
+}
+
+uint64_t AsyncFileReader::submit(std::span<const FileRead> reads) {
+    // Scratch buffers are allocated before the lock is taken
+    std::vector<PendingRead> pending_reads(reads.size());
+    for (size_t i = 0; i < reads.size(); i++) {
+        pending_reads[i].read = reads[i];
+        if (reads[i].lz4) {
+            pending_reads[i].compressed.resize(reads[i].size);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t batch = next_batch++;
+    // Reads queued on a ring that stopped working would never complete
+    if (ring_failed) {
+        batches[batch] = {0, true};
+        return batch;
+    }
+    batches[batch] = {reads.size(), false};
+    for (PendingRead &pending: pending_reads) {
+        pending.batch = batch;
+        queued_reads.push_back(std::move(pending));
+    }
+    if (ring != nullptr) {
+        fill_ring();
+    } else {
+        work_condition.notify_all();
+    }
+    return batch;
+}
+
+bool AsyncFileReader::is_complete(uint64_t batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = batches.find(batch);
+    return found == batches.end() || found->second.remaining == 0;
+}
+
+bool AsyncFileReader::wait(uint64_t batch) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto found = batches.find(batch);
+    if (found == batches.end()) {
+        return false;
+    }
+    // Batches submitted meanwhile can rehash the map, the element itself stays where it is
+    Batch &state = found->second;
+    batch_condition.wait(lock, [&]() {
+        return state.remaining == 0;
+    });
+    bool failed = state.failed;
+    batches.erase(batch);
+    return !failed;
+}
+
+void AsyncFileReader::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+#ifdef __linux__
+        // Reads still in flight wake the completion thread anyway, this covers an idle ring
+        if (ring != nullptr) {
+            io_uring_sqe *entry = next_entry(*ring);
+            if (entry != nullptr) {
+                entry->opcode = IORING_OP_NOP;
+                entry->user_data = WAKE_USER_DATA;
+                push_entry(*ring);
+                submit_entries(*ring);
+            }
+        }
+#endif
+    }
+    work_condition.notify_all();
+    // The threads drain what is left before they return
+    threads.clear();
+
+#ifdef __linux__
+    if (ring != nullptr) {
+        tear_down_ring(*ring);
+        delete ring;
+        ring = nullptr;
+    }
+#endif
+    ring_slots.clear();
+    free_ring_slots.clear();
+    queued_reads.clear();
+    batches.clear();
+    stopping = false;
+    ring_failed = false;
+}
+
+void AsyncFileReader::finish_read(PendingRead &pending, bool succeeded) {
+    // Completions all come in on the one ring thread, which splits big reads' tiles across the cores. The pool's
+    // workers already decompress side by side
+    if (succeeded && pending.read.lz4) {
+        succeeded = incan_lz4::decompress_tiles(pending.compressed,
+                                                {pending.read.destination, pending.read.decompressed_size},
+                                                ring != nullptr ? incan_util::worker_thread_count() : 1);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Batch &batch = batches[pending.batch];
+    batch.failed |= !succeeded;
+    if (--batch.remaining == 0) {
+        batch_condition.notify_all();
+    }
+}
+
+void AsyncFileReader::run_worker() {
+    while (true) {
+        PendingRead pending;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_condition.wait(lock, [&]() {
+                return stopping || !queued_reads.empty();
+            });
+            if (queued_reads.empty()) {
+                return;
+            }
+            pending = std::move(queued_reads.front());
+            queued_reads.pop_front();
+        }
+
+        bool succeeded = incan_file::read_at(pending.read.file, pending.read.offset,
+                                             {read_target(pending), pending.read.size});
+        finish_read(pending, succeeded);
+    }
+}
+
+void AsyncFileReader::fill_ring() {
+#ifdef __linux__
+    while (!queued_reads.empty() && !free_ring_slots.empty()) {
+        io_uring_sqe *entry = next_entry(*ring);
+        if (entry == nullptr) {
+            break;
+        }
+        uint32_t slot = free_ring_slots.back();
+        free_ring_slots.pop_back();
+        PendingRead &pending = ring_slots[slot].emplace(std::move(queued_reads.front()));
+        queued_reads.pop_front();
+
+        ring->buffers[slot].iov_base = read_target(pending);
+        ring->buffers[slot].iov_len = std::min(pending.read.size - pending.bytes_read, MAX_READ_CALL_SIZE);
+        entry->opcode = IORING_OP_READV;
+        entry->fd = static_cast<int>(pending.read.file);
+        entry->off = pending.read.offset + pending.bytes_read;
+        entry->addr = reinterpret_cast<uint64_t>(&ring->buffers[slot]);
+        entry->len = 1;
+        entry->user_data = slot;
+        push_entry(*ring);
+    }
+    submit_entries(*ring);
+#endif
+}
+
+void AsyncFileReader::run_ring_completions() {
+#ifdef __linux__
+    std::vector<std::pair<PendingRead, bool>> finished_reads;
+    while (true) {
+        int result = enter_ring(*ring, 0, 1, IORING_ENTER_GETEVENTS);
+        if (result < 0 && errno != EINTR) {
+            // Nothing would complete anymore, so every read queued or in flight fails and the ring takes no more
+            fmt::print("Waiting on io_uring failed with errno {}, failing its reads\n", errno);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ring_failed = true;
+                for (uint32_t slot = 0; slot < ring_slots.size(); slot++) {
+                    if (ring_slots[slot].has_value()) {
+                        finished_reads.emplace_back(std::move(ring_slots[slot].value()), false);
+                        ring_slots[slot].reset();
+                        free_ring_slots.push_back(slot);
+                    }
+                }
+                for (PendingRead &pending: queued_reads) {
+                    finished_reads.emplace_back(std::move(pending), false);
+                }
+                queued_reads.clear();
+            }
+            for (auto &[pending, succeeded]: finished_reads) {
+                finish_read(pending, succeeded);
+            }
+            return;
+        }
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint32_t head = *ring->completion_head;
+            uint32_t tail = std::atomic_ref(*ring->completion_tail).load(std::memory_order_acquire);
+            for (; head != tail; head++) {
+                const io_uring_cqe &completion = ring->completions[head & ring->completion_mask];
+                if (completion.user_data == WAKE_USER_DATA) {
+                    continue;
+                }
+
+                auto slot = static_cast<uint32_t>(completion.user_data);
+                PendingRead &pending = ring_slots[slot].value();
+                if (completion.res > 0) {
+                    pending.bytes_read += static_cast<uint64_t>(completion.res);
+                }
+                // A short read goes back in the queue for the rest, ahead of everything else
+                if (completion.res > 0 && pending.bytes_read < pending.read.size) {
+                    queued_reads.push_front(std::move(pending));
+                } else {
+                    bool succeeded = completion.res >= 0 && pending.bytes_read == pending.read.size;
+                    finished_reads.emplace_back(std::move(pending), succeeded);
+                }
+                ring_slots[slot].reset();
+                free_ring_slots.push_back(slot);
+            }
+            std::atomic_ref(*ring->completion_head).store(head, std::memory_order_release);
+
+            fill_ring();
+            done = stopping && queued_reads.empty() && free_ring_slots.size() == ring_slots.size();
+        }
+
+        // Decompression happens without the lock, so it doesn't hold up threads submitting more reads
+        for (auto &[pending, succeeded]: finished_reads) {
+            finish_read(pending, succeeded);
+        }
+        finished_reads.clear();
+        if (done) {
+            return;
+        }
+    }
+#endif
+}
@@ -0,0 +1,119 @@
+#ifndef INCANDESCENT_FILE_READER_H
+#define INCANDESCENT_FILE_READER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A file descriptor, or a HANDLE on Windows
+using FileHandle = intptr_t;
+constexpr FileHandle INVALID_FILE_HANDLE = -1;
+
+// Blocking positioned file access, safe to use on one file from many threads at once
+namespace incan_file {
+    // Read only, or read and write with the file created if it is missing
+    FileHandle open(const std::filesystem::path &file_path, bool writable);
+    void close(FileHandle file);
+
+    std::optional<uint64_t> size(FileHandle file);
+
+    // False unless all of destination was read
+    bool read_at(FileHandle file, uint64_t offset, std::span<std::byte> destination);
+    // False unless all of source was written
+    bool write_at(FileHandle file, uint64_t offset, std::span<const std::byte> source);
+}
+
+// One range of a file read into memory the caller owns, usually a mapped staging buffer
+struct FileRead {
+    FileHandle file;
+    uint64_t offset;
+    // Bytes on disk
+    uint64_t size;
+    std::byte *destination;
+    // Tiled LZ4 streams are read into a scratch buffer first and decompressed into destination, which then takes
+    // decompressed_size bytes
+    bool lz4;
+    uint64_t decompressed_size;
+};
+
+struct IoRing;
+
+/*
+ * Reads batches of file ranges in the background, so loading thousands of small pieces doesn't block a thread per
+ * read. On Linux every read goes through one io_uring: queuing a whole batch is a single system call and the reads
+ * complete on a thread of their own. Elsewhere, or when the kernel refuses io_uring (too old, or blocked by a
+ * sandbox), a small pool of threads calls pread instead. Reads land straight in their destination, compressed ones are
+ * decompressed into it on the thread that completes them.
+ */
+struct AsyncFileReader {
+    // worker_count threads for the pread fallback, queue_depth reads in flight at once with io_uring
+    void initialize(uint32_t worker_count, uint32_t queue_depth);
+
+    // Returns right away. The destinations have to stay valid until the batch is complete, and every batch has to be
+    // waited on once, that is what forgets it
+    uint64_t submit(std::span<const FileRead> reads);
+
+    bool is_complete(uint64_t batch);
+
+    // Blocks until every read of the batch is done, false if any of them failed
+    bool wait(uint64_t batch);
+
+    // Finishes everything still in flight first
+    void destroy();
+
+private:
+    struct Batch {
+        size_t remaining;
+        bool failed;
+    };
+
+    // A read queued or in flight, resumed from bytes_read after a short read
+    struct PendingRead {
+        FileRead read;
+        uint64_t batch;
+        uint64_t bytes_read;
+        std::vector<std::byte> compressed;
+    };
+
+    std::byte *read_target(PendingRead &pending) const {
+        return (pending.read.lz4 ? pending.compressed.data() : pending.read.destination) + pending.bytes_read;
+    }
+
+    // Decompresses the read if it has to be and counts it against its batch, without the mutex held
+    void finish_read(PendingRead &pending, bool succeeded);
+
+    void run_worker();
+
+    // io_uring only, with the mutex held: moves queued reads into free slots of the ring and submits them
+    void fill_ring();
+    void run_ring_completions();
+
+    std::mutex mutex;
+    std::condition_variable batch_condition;
+    std::condition_variable work_condition;
+    std::unordered_map<uint64_t, Batch> batches;
+    uint64_t next_batch = 1;
+    // Waiting for a worker, or for a free slot in the ring
+    std::deque<PendingRead> queued_reads;
+    bool stopping = false;
+
+    // Null when the thread pool does the reading. Reads in flight in the ring sit in its slots, their index is what
+    // the kernel hands back on completion
+    IoRing *ring = nullptr;
+    std::vector<std::optional<PendingRead>> ring_slots;
+    std::vector<uint32_t> free_ring_slots;
+    // Set by the completion thread when waiting on the ring fails for good, later batches fail right away
+    bool ring_failed = false;
+    std::vector<std::jthread> threads;
+};
+
+
+#endif //INCANDESCENT_FILE_READER_H
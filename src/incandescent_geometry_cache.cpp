@@ -0,0 +1,499 @@
+#include <incandescent_geometry_cache.h>
+#include <incandescent_meshlets.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <ranges>
+
+namespace {
+    constexpr uint64_t XXH_PRIME_1 = 0x9e3779b185ebca87ull;
+    constexpr uint64_t XXH_PRIME_2 = 0xc2b2ae3d27d4eb4full;
+    constexpr uint64_t XXH_PRIME_3 = 0x165667b19e3779f9ull;
+    constexpr uint64_t XXH_PRIME_4 = 0x85ebca77c2b2ae63ull;
+    constexpr uint64_t XXH_PRIME_5 = 0x27d4eb2f165667c5ull;
+
+    constexpr size_t SECTION_COUNT = static_cast<size_t>(incan_cache::SectionType::Count);
+
+    template<typename T>
+    T read_unaligned(const std::byte *bytes) {
+        T value;
+        memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    uint64_t xxh_round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * XXH_PRIME_2;
+        accumulator = std::rotl(accumulator, 31);
+        return accumulator * XXH_PRIME_1;
+    }
+
+    uint64_t xxh_merge_round(uint64_t accumulator, uint64_t value) {
+        accumulator ^= xxh_round(0, value);
+        return accumulator * XXH_PRIME_1 + XXH_PRIME_4;
+    }
+
+    uint64_t align_section_offset(uint64_t offset) {
+        return (offset + incan_cache::GEOMETRY_CACHE_ALIGNMENT - 1) / incan_cache::GEOMETRY_CACHE_ALIGNMENT *
+               incan_cache::GEOMETRY_CACHE_ALIGNMENT;
+    }
+
+    uint32_t section_element_size(incan_cache::SectionType type) {
+        switch (type) {
+            case incan_cache::SectionType::Meshes:
+                return sizeof(incan_cache::CachedMesh);
+            case incan_cache::SectionType::Surfaces:
+                return sizeof(incan_cache::CachedSurface);
+            case incan_cache::SectionType::Materials:
+                return sizeof(incan_cache::CachedMaterial);
+            case incan_cache::SectionType::Instances:
+                return sizeof(incan_cache::CachedInstance);
+            case incan_cache::SectionType::Images:
+                return sizeof(incan_cache::CachedImage);
+            case incan_cache::SectionType::Vertices:
+                return sizeof(PackedVertex);
+            case incan_cache::SectionType::Indices:
+            case incan_cache::SectionType::MeshletVertices:
+            case incan_cache::SectionType::MeshletTriangles:
+                return sizeof(uint32_t);
+            case incan_cache::SectionType::Meshlets:
+                return sizeof(Meshlet);
+            default:
+                return 1;
+        }
+    }
+
+    // A section on its way to disk, gathered from one or more byte ranges
+    struct PendingSection {
+        incan_cache::SectionType type;
+        uint64_t element_count;
+        std::vector<std::span<const std::byte>> parts;
+    };
+
+    template<typename T>
+    PendingSection table_section(incan_cache::SectionType type, const std::vector<T> &table) {
+        return {type, table.size(), {std::as_bytes(std::span(table))}};
+    }
+
+    // Copies a table out of the mapping, tables are small and this keeps every read aligned
+    template<typename T>
+    std::vector<T> read_table(std::span<const std::byte> section) {
+        std::vector<T> table(section.size() / sizeof(T));
+        memcpy(table.data(), section.data(), table.size() * sizeof(T));
+        return table;
+    }
+}
+
+uint64_t incan_cache::hash_bytes(std::span<const std::byte> bytes, uint64_t seed) {
+    const std::byte *input = bytes.data();
+    const std::byte *end = input + bytes.size();
+    uint64_t hash;
+
+    if (bytes.size() >= 32) {
+        // Four independent lanes keep the multiplies pipelined
+        uint64_t lanes[4] = {seed + XXH_PRIME_1 + XXH_PRIME_2, seed + XXH_PRIME_2, seed, seed - XXH_PRIME_1};
+        for (; end - input >= 32; input += 32) {
+            for (size_t lane = 0; lane < 4; lane++) {
+                lanes[lane] = xxh_round(lanes[lane], read_unaligned<uint64_t>(input + lane * 8));
+            }
+        }
+        hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+        for (uint64_t lane: lanes) {
+            hash = xxh_merge_round(hash, lane);
+        }
+    } else {
+        hash = seed + XXH_PRIME_5;
+    }
+    hash += bytes.size();
+
+    for (; end - input >= 8; input += 8) {
+        hash ^= xxh_round(0, read_unaligned<uint64_t>(input));
+        hash = std::rotl(hash, 27) * XXH_PRIME_1 + XXH_PRIME_4;
+    }
+    if (end - input >= 4) {
+        hash ^= read_unaligned<uint32_t>(input) * XXH_PRIME_1;
+        hash = std::rotl(hash, 23) * XXH_PRIME_2 + XXH_PRIME_3;
+        input += 4;
+    }
+    for (; input < end; input++) {
+        hash ^= static_cast<uint64_t>(*input) * XXH_PRIME_5;
+        hash = std::rotl(hash, 11) * XXH_PRIME_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::optional<uint64_t> incan_cache::hash_file(const std::filesystem::path &file_path) {
+    // Empty files can't be mapped but still have a hash
+    std::error_code size_error;
+    if (std::filesystem::file_size(file_path, size_error) == 0 && !size_error) {
+        return hash_bytes({});
+    }
+
+    MappedFile file;
+    if (!file.open(file_path)) {
+        return std::nullopt;
+    }
+    uint64_t hash = hash_bytes(file.bytes());
+    file.close();
+    return hash;
+}
+
+uint64_t incan_cache::hash_file_stamps(std::span<const std::filesystem::path> file_paths, uint64_t seed) {
+    uint64_t hash = seed;
+    for (const std::filesystem::path &file_path: file_paths) {
+        std::error_code size_error;
+        std::error_code time_error;
+        uintmax_t size = std::filesystem::file_size(file_path, size_error);
+        std::filesystem::file_time_type write_time = std::filesystem::last_write_time(file_path, time_error);
+        std::array<uint64_t, 2> stamp = {UINT64_MAX, UINT64_MAX};
+        if (!size_error && !time_error) {
+            stamp = {size, static_cast<uint64_t>(write_time.time_since_epoch().count())};
+        }
+        hash = hash_bytes(std::as_bytes(std::span(stamp)), hash);
+    }
+    return hash;
+}
+
+std::filesystem::path incan_cache::cache_file_path(const std::filesystem::path &cache_directory,
+                                                   uint64_t source_hash) {
+    return cache_directory / fmt::format("{:016x}.ingc", source_hash);
+}
+
+bool incan_cache::write_scene(const std::filesystem::path &cache_file, uint64_t source_hash,
+                              const SceneData &scene_data) {
+    /* -------- Flatten the tables -------- */
+    std::vector<CachedMesh> meshes;
+    std::vector<CachedSurface> surfaces;
+    std::string names;
+    for (const MeshAsset &mesh: scene_data.meshes) {
+        CachedMesh cached_mesh = {};
+        cached_mesh.first_surface = static_cast<uint32_t>(surfaces.size());
+        cached_mesh.surface_count = static_cast<uint32_t>(mesh.surfaces.size());
+        cached_mesh.name_offset = static_cast<uint32_t>(names.size());
+        cached_mesh.name_length = static_cast<uint32_t>(mesh.name.size());
+        Eigen::Map<Eigen::Vector3f>(cached_mesh.position_offset) = mesh.position_offset;
+        Eigen::Map<Eigen::Vector3f>(cached_mesh.position_scale) = mesh.position_scale;
+        cached_mesh.lod_count = mesh.lod_count;
+        for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+            cached_mesh.first_meshlets[lod] = mesh.lods[lod].first_meshlet;
+            cached_mesh.meshlet_counts[lod] = mesh.lods[lod].meshlet_count;
+            cached_mesh.lod_errors[lod] = mesh.lods[lod].error;
+        }
+        meshes.push_back(cached_mesh);
+        names += mesh.name;
+
+        for (const GeometrySurface &surface: mesh.surfaces) {
+            CachedSurface cached_surface = {};
+            for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+                cached_surface.first_indices[lod] = surface.lods[lod].first_index;
+                cached_surface.index_counts[lod] = surface.lods[lod].index_count;
+            }
+            cached_surface.vertex_offset = surface.vertex_offset;
+            cached_surface.vertex_count = surface.vertex_count;
+            cached_surface.material = surface.material;
+            Eigen::Map<Eigen::Vector3f>(cached_surface.center) = surface.bounds.center;
+            cached_surface.radius = surface.bounds.radius;
+            Eigen::Map<Eigen::Vector3f>(cached_surface.extents) = surface.bounds.extents;
+            surfaces.push_back(cached_surface);
+        }
+    }
+
+    std::vector<CachedMaterial> materials;
+    for (const MaterialData &material: scene_data.materials) {
+        CachedMaterial cached_material = {};
+        Eigen::Map<Eigen::Vector4f>(cached_material.base_color_factor) = material.base_color_factor;
+        cached_material.metallic_factor = material.metallic_factor;
+        cached_material.roughness_factor = material.roughness_factor;
+        cached_material.base_color_texture = material.base_color_texture;
+        cached_material.metallic_roughness_texture = material.metallic_roughness_texture;
+        cached_material.normal_texture = material.normal_texture;
+        materials.push_back(cached_material);
+    }
+
+    std::vector<CachedInstance> instances;
+    for (const MeshInstance &instance: scene_data.instances) {
+        CachedInstance cached_instance = {};
+        cached_instance.mesh = instance.mesh;
+        Eigen::Map<Eigen::Matrix4f>(cached_instance.world_transform) = instance.world_transform;
+        instances.push_back(cached_instance);
+    }
+
+    std::vector<CachedImage> images;
+    PendingSection image_data = {SectionType::ImageData, 0, {}};
+    for (const SourceImage &image: scene_data.images) {
+        CachedImage cached_image = {};
+        cached_image.offset = image_data.element_count;
+        cached_image.size = image.bytes.size();
+        cached_image.usage = image.usage;
+        images.push_back(cached_image);
+        image_data.element_count += image.bytes.size();
+        image_data.parts.push_back(image.bytes);
+    }
+
+    std::array<PendingSection, SECTION_COUNT> sections = {
+        table_section(SectionType::Meshes, meshes),
+        table_section(SectionType::Surfaces, surfaces),
+        table_section(SectionType::Materials, materials),
+        table_section(SectionType::Instances, instances),
+        PendingSection{SectionType::Names, names.size(), {std::as_bytes(std::span(names))}},
+        table_section(SectionType::Images, images),
+        image_data,
+        PendingSection{SectionType::Vertices, scene_data.vertices.size(), {std::as_bytes(scene_data.vertices)}},
+        PendingSection{SectionType::Indices, scene_data.indices.size(), {std::as_bytes(scene_data.indices)}},
+        PendingSection{SectionType::Meshlets, scene_data.meshlets.size(), {std::as_bytes(scene_data.meshlets)}},
+        PendingSection{
+            SectionType::MeshletVertices, scene_data.meshlet_vertices.size(),
+            {std::as_bytes(scene_data.meshlet_vertices)}
+        },
+        PendingSection{
+            SectionType::MeshletTriangles, scene_data.meshlet_triangles.size(),
+            {std::as_bytes(scene_data.meshlet_triangles)}
+        },
+    };
+
+    /* -------- Lay out the file -------- */
+    CacheHeader header = {};
+    header.magic = GEOMETRY_CACHE_MAGIC;
+    header.version = GEOMETRY_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.vertex_size = sizeof(PackedVertex);
+    header.section_count = static_cast<uint32_t>(SECTION_COUNT);
+
+    std::array<SectionEntry, SECTION_COUNT> directory = {};
+    uint64_t offset = sizeof(CacheHeader) + sizeof(directory);
+    for (size_t section = 0; section < SECTION_COUNT; section++) {
+        offset = align_section_offset(offset);
+        directory[section].type = sections[section].type;
+        directory[section].element_size = section_element_size(sections[section].type);
+        directory[section].offset = offset;
+        directory[section].element_count = sections[section].element_count;
+        offset += directory[section].element_size * directory[section].element_count;
+    }
+
+    /* -------- Write -------- */
+    std::error_code error;
+    std::filesystem::create_directories(cache_file.parent_path(), error);
+
+    std::filesystem::path temporary_file = cache_file;
+    temporary_file += ".tmp";
+    std::ofstream file(temporary_file, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(directory.data()), sizeof(directory));
+    uint64_t written = sizeof(CacheHeader) + sizeof(directory);
+    constexpr std::array<char, GEOMETRY_CACHE_ALIGNMENT> padding = {};
+    for (size_t section = 0; section < SECTION_COUNT; section++) {
+        file.write(padding.data(), static_cast<std::streamsize>(directory[section].offset - written));
+        written = directory[section].offset;
+        for (std::span<const std::byte> part: sections[section].parts) {
+            file.write(reinterpret_cast<const char *>(part.data()), static_cast<std::streamsize>(part.size()));
+            written += part.size();
+        }
+    }
+    file.close();
+
+    if (file.fail()) {
+        std::filesystem::remove(temporary_file, error);
+        return false;
+    }
+    std::filesystem::rename(temporary_file, cache_file, error);
+    return !error;
+}
+
+std::optional<SceneData> incan_cache::read_scene(std::span<const std::byte> cache_bytes, uint64_t source_hash) {
+    /* -------- Validate the header and directory -------- */
+    if (cache_bytes.size() < sizeof(CacheHeader) + sizeof(SectionEntry) * SECTION_COUNT) {
+        return std::nullopt;
+    }
+    CacheHeader header = read_unaligned<CacheHeader>(cache_bytes.data());
+    if (header.magic != GEOMETRY_CACHE_MAGIC || header.version != GEOMETRY_CACHE_VERSION ||
+        header.source_hash != source_hash || header.vertex_size != sizeof(PackedVertex) ||
+        header.section_count != SECTION_COUNT) {
+        return std::nullopt;
+    }
+
+    std::array<std::span<const std::byte>, SECTION_COUNT> sections;
+    for (size_t section = 0; section < SECTION_COUNT; section++) {
+        SectionEntry entry = read_unaligned<SectionEntry>(cache_bytes.data() + sizeof(CacheHeader) +
+                                                          section * sizeof(SectionEntry));
+        if (entry.type != static_cast<SectionType>(section) ||
+            entry.element_size != section_element_size(entry.type) ||
+            entry.offset % GEOMETRY_CACHE_ALIGNMENT != 0 || entry.offset > cache_bytes.size() ||
+            entry.element_count > (cache_bytes.size() - entry.offset) / entry.element_size) {
+            return std::nullopt;
+        }
+        sections[section] = cache_bytes.subspan(entry.offset, entry.element_count * entry.element_size);
+    }
+
+    auto section_bytes = [&](SectionType type) {
+        return sections[static_cast<size_t>(type)];
+    };
+
+    SceneData scene_data;
+
+    // The mapping is page aligned and every section is aligned within it, so the blobs are used in place
+    std::span<const std::byte> vertex_bytes = section_bytes(SectionType::Vertices);
+    std::span<const std::byte> index_bytes = section_bytes(SectionType::Indices);
+    scene_data.vertices = {
+        reinterpret_cast<const PackedVertex *>(vertex_bytes.data()), vertex_bytes.size() / sizeof(PackedVertex)
+    };
+    scene_data.indices = {
+        reinterpret_cast<const uint32_t *>(index_bytes.data()), index_bytes.size() / sizeof(uint32_t)
+    };
+    std::span<const std::byte> meshlet_bytes = section_bytes(SectionType::Meshlets);
+    std::span<const std::byte> meshlet_vertex_bytes = section_bytes(SectionType::MeshletVertices);
+    std::span<const std::byte> meshlet_triangle_bytes = section_bytes(SectionType::MeshletTriangles);
+    scene_data.meshlets = {
+        reinterpret_cast<const Meshlet *>(meshlet_bytes.data()), meshlet_bytes.size() / sizeof(Meshlet)
+    };
+    scene_data.meshlet_vertices = {
+        reinterpret_cast<const uint32_t *>(meshlet_vertex_bytes.data()), meshlet_vertex_bytes.size() / sizeof(uint32_t)
+    };
+    scene_data.meshlet_triangles = {
+        reinterpret_cast<const uint32_t *>(meshlet_triangle_bytes.data()),
+        meshlet_triangle_bytes.size() / sizeof(uint32_t)
+    };
+
+    /* -------- Tables and blobs, checked against each other so a damaged file can't index out of range -------- */
+    // The mesh shader writes meshlet outputs by these counts, so they are checked as well as the ranges
+    for (const Meshlet &meshlet: scene_data.meshlets) {
+        if (meshlet.vertex_count > incan_meshlet::MAX_MESHLET_VERTICES ||
+            meshlet.triangle_count > incan_meshlet::MAX_MESHLET_TRIANGLES ||
+            meshlet.vertex_offset > scene_data.meshlet_vertices.size() ||
+            meshlet.vertex_count > scene_data.meshlet_vertices.size() - meshlet.vertex_offset ||
+            meshlet.triangle_offset > scene_data.meshlet_triangles.size() ||
+            meshlet.triangle_count > scene_data.meshlet_triangles.size() - meshlet.triangle_offset) {
+            return std::nullopt;
+        }
+
+        // Meshlet vertices index the scene's vertex array, triangles pack three of the meshlet's own vertex numbers
+        std::span<const uint32_t> meshlet_vertices = scene_data.meshlet_vertices.subspan(meshlet.vertex_offset,
+                                                                                         meshlet.vertex_count);
+        std::span<const uint32_t> meshlet_triangles = scene_data.meshlet_triangles.subspan(meshlet.triangle_offset,
+                                                                                           meshlet.triangle_count);
+        bool vertices_valid = std::ranges::all_of(meshlet_vertices, [&](uint32_t vertex) {
+            return vertex < scene_data.vertices.size();
+        });
+        bool triangles_valid = std::ranges::all_of(meshlet_triangles, [&](uint32_t triangle) {
+            return (triangle & 0xff) < meshlet.vertex_count && (triangle >> 8 & 0xff) < meshlet.vertex_count &&
+                   (triangle >> 16 & 0xff) < meshlet.vertex_count && triangle >> 24 == 0;
+        });
+        if (!vertices_valid || !triangles_valid) {
+            return std::nullopt;
+        }
+    }
+
+    std::vector<CachedImage> images = read_table<CachedImage>(section_bytes(SectionType::Images));
+    std::span<const std::byte> image_data = section_bytes(SectionType::ImageData);
+    for (const CachedImage &image: images) {
+        if (image.offset > image_data.size() || image.size > image_data.size() - image.offset ||
+            image.usage > TextureUsage::Normal) {
+            return std::nullopt;
+        }
+        scene_data.images.push_back({image_data.subspan(image.offset, image.size), image.usage});
+    }
+
+    auto valid_texture = [&](uint32_t texture) {
+        return texture == NO_TEXTURE || texture < images.size();
+    };
+    for (const CachedMaterial &cached_material: read_table<CachedMaterial>(section_bytes(SectionType::Materials))) {
+        if (!valid_texture(cached_material.base_color_texture) ||
+            !valid_texture(cached_material.metallic_roughness_texture) ||
+            !valid_texture(cached_material.normal_texture)) {
+            return std::nullopt;
+        }
+        MaterialData material = {};
+        material.base_color_factor = Eigen::Map<const Eigen::Vector4f>(cached_material.base_color_factor);
+        material.metallic_factor = cached_material.metallic_factor;
+        material.roughness_factor = cached_material.roughness_factor;
+        material.base_color_texture = cached_material.base_color_texture;
+        material.metallic_roughness_texture = cached_material.metallic_roughness_texture;
+        material.normal_texture = cached_material.normal_texture;
+        scene_data.materials.push_back(material);
+    }
+
+    std::vector<CachedSurface> surfaces = read_table<CachedSurface>(section_bytes(SectionType::Surfaces));
+    std::span<const std::byte> names = section_bytes(SectionType::Names);
+    for (const CachedMesh &cached_mesh: read_table<CachedMesh>(section_bytes(SectionType::Meshes))) {
+        if (cached_mesh.first_surface > surfaces.size() ||
+            cached_mesh.surface_count > surfaces.size() - cached_mesh.first_surface ||
+            cached_mesh.name_offset > names.size() ||
+            cached_mesh.name_length > names.size() - cached_mesh.name_offset ||
+            cached_mesh.lod_count == 0 || cached_mesh.lod_count > MAX_LOD_COUNT) {
+            return std::nullopt;
+        }
+
+        MeshAsset mesh;
+        mesh.name.assign(reinterpret_cast<const char *>(names.data()) + cached_mesh.name_offset,
+                         cached_mesh.name_length);
+        mesh.position_offset = Eigen::Map<const Eigen::Vector3f>(cached_mesh.position_offset);
+        mesh.position_scale = Eigen::Map<const Eigen::Vector3f>(cached_mesh.position_scale);
+        mesh.lod_count = cached_mesh.lod_count;
+        for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+            if (cached_mesh.first_meshlets[lod] > scene_data.meshlets.size() ||
+                cached_mesh.meshlet_counts[lod] > scene_data.meshlets.size() - cached_mesh.first_meshlets[lod]) {
+                return std::nullopt;
+            }
+            mesh.lods[lod] = {cached_mesh.first_meshlets[lod], cached_mesh.meshlet_counts[lod],
+                              cached_mesh.lod_errors[lod]};
+        }
+        for (uint32_t i = 0; i < cached_mesh.surface_count; i++) {
+            const CachedSurface &cached_surface = surfaces[cached_mesh.first_surface + i];
+            bool lods_valid = std::ranges::all_of(std::views::iota(0u, MAX_LOD_COUNT), [&](uint32_t lod) {
+                return cached_surface.first_indices[lod] <= scene_data.indices.size() &&
+                       cached_surface.index_counts[lod] <= scene_data.indices.size() -
+                       cached_surface.first_indices[lod];
+            });
+            if (!lods_valid || cached_surface.vertex_offset < 0 ||
+                static_cast<size_t>(cached_surface.vertex_offset) > scene_data.vertices.size() ||
+                cached_surface.vertex_count > scene_data.vertices.size() - cached_surface.vertex_offset ||
+                cached_surface.material >= scene_data.materials.size()) {
+                return std::nullopt;
+            }
+            // Indices are relative to the surface's vertex range
+            bool indices_valid = std::ranges::all_of(std::views::iota(0u, MAX_LOD_COUNT), [&](uint32_t lod) {
+                return std::ranges::all_of(scene_data.indices.subspan(cached_surface.first_indices[lod],
+                                                                      cached_surface.index_counts[lod]),
+                                           [&](uint32_t index) { return index < cached_surface.vertex_count; });
+            });
+            if (!indices_valid) {
+                return std::nullopt;
+            }
+
+            GeometrySurface surface = {};
+            for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+                surface.lods[lod] = {cached_surface.first_indices[lod], cached_surface.index_counts[lod]};
+            }
+            surface.vertex_offset = cached_surface.vertex_offset;
+            surface.vertex_count = cached_surface.vertex_count;
+            surface.material = cached_surface.material;
+            surface.bounds.center = Eigen::Map<const Eigen::Vector3f>(cached_surface.center);
+            surface.bounds.radius = cached_surface.radius;
+            surface.bounds.extents = Eigen::Map<const Eigen::Vector3f>(cached_surface.extents);
+            mesh.surfaces.push_back(surface);
+        }
+        scene_data.meshes.push_back(std::move(mesh));
+    }
+
+    for (const CachedInstance &cached_instance: read_table<CachedInstance>(section_bytes(SectionType::Instances))) {
+        if (cached_instance.mesh >= scene_data.meshes.size()) {
+            return std::nullopt;
+        }
+        MeshInstance instance = {};
+        instance.mesh = cached_instance.mesh;
+        instance.world_transform = Eigen::Map<const Eigen::Matrix4f>(cached_instance.world_transform);
+        scene_data.instances.push_back(instance);
+    }
+
+    return scene_data;
+}
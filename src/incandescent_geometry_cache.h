@@ -0,0 +1,122 @@
+#ifndef INCANDESCENT_GEOMETRY_CACHE_H
+#define INCANDESCENT_GEOMETRY_CACHE_H
+
+#include <incandescent_loader.h>
+#include <incandescent_mapped_file.h>
+
+/*
+ * Engine-native scene container. A header and a section directory are followed by the sections themselves, each
+ * aligned to GEOMETRY_CACHE_ALIGNMENT: small fixed-size tables (meshes, surfaces with their bounds, materials,
+ * instances, images) and the raw blobs (vertices, indices and the meshlet lists exactly as they go into their GPU
+ * buffers, and the encoded image files). Reading a scene back is validating the directory and pointing spans at the
+ * mapped sections.
+ *
+ * Files are named after a content hash of the source file, so edits to the source simply miss the cache. A .gltf's
+ * external .bin and image files are folded in by size and modification time rather than read in full. OBJ material
+ * libraries and their textures aren't, editing only those keeps hitting the old cache file.
+ */
+namespace incan_cache {
+    constexpr uint32_t GEOMETRY_CACHE_MAGIC = 0x43474e49; // "INGC"
+    // Bump whenever any of the on-disk structs, PackedVertex or the order of the blobs change
+    constexpr uint32_t GEOMETRY_CACHE_VERSION = 6;
+    constexpr uint64_t GEOMETRY_CACHE_ALIGNMENT = 64;
+
+    enum class SectionType : uint32_t {
+        Meshes,
+        Surfaces,
+        Materials,
+        Instances,
+        Names,
+        Images,
+        ImageData,
+        Vertices,
+        Indices,
+        Meshlets,
+        MeshletVertices,
+        MeshletTriangles,
+        Count
+    };
+
+    struct CacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t source_hash;
+        uint32_t vertex_size;
+        uint32_t section_count;
+    };
+
+    struct SectionEntry {
+        SectionType type;
+        uint32_t element_size;
+        uint64_t offset;
+        uint64_t element_count;
+    };
+
+    // The on-disk tables are plain arrays, nothing Eigen (its alignment and padding aren't part of the format)
+    struct CachedMesh {
+        uint32_t first_surface;
+        uint32_t surface_count;
+        uint32_t name_offset;
+        uint32_t name_length;
+        float position_offset[3];
+        float position_scale[3];
+        uint32_t lod_count;
+        uint32_t first_meshlets[MAX_LOD_COUNT];
+        uint32_t meshlet_counts[MAX_LOD_COUNT];
+        float lod_errors[MAX_LOD_COUNT];
+    };
+
+    struct CachedSurface {
+        uint32_t first_indices[MAX_LOD_COUNT];
+        uint32_t index_counts[MAX_LOD_COUNT];
+        int32_t vertex_offset;
+        uint32_t vertex_count;
+        uint32_t material;
+        float center[3];
+        float radius;
+        float extents[3];
+    };
+
+    struct CachedMaterial {
+        float base_color_factor[4];
+        float metallic_factor;
+        float roughness_factor;
+        uint32_t base_color_texture;
+        uint32_t metallic_roughness_texture;
+        uint32_t normal_texture;
+    };
+
+    struct CachedInstance {
+        uint32_t mesh;
+        float world_transform[16];
+    };
+
+    // Byte range in the ImageData section
+    struct CachedImage {
+        uint64_t offset;
+        uint64_t size;
+        TextureUsage usage;
+        uint32_t padding;
+    };
+
+    // xxHash64 of the bytes
+    uint64_t hash_bytes(std::span<const std::byte> bytes, uint64_t seed = 0);
+
+    // Maps the file and hashes all of it, an empty file hashes like no bytes. Nothing if it can't be opened
+    std::optional<uint64_t> hash_file(const std::filesystem::path &file_path);
+
+    // Folds each file's size and modification time into seed, a missing file counts as a change too
+    uint64_t hash_file_stamps(std::span<const std::filesystem::path> file_paths, uint64_t seed);
+
+    std::filesystem::path cache_file_path(const std::filesystem::path &cache_directory, uint64_t source_hash);
+
+    // Writes to a temporary file and renames it into place, so a crash mid-write never leaves a truncated cache file
+    bool write_scene(const std::filesystem::path &cache_file, uint64_t source_hash, const SceneData &scene_data);
+
+    // Scene whose vertex, index, meshlet and image spans point into cache_bytes, nothing if the file is from another
+    // source, another format version or is damaged. cache_bytes has to outlive the returned scene
+    std::optional<SceneData> read_scene(std::span<const std::byte> cache_bytes, uint64_t source_hash);
+}
+
+
+#endif //INCANDESCENT_GEOMETRY_CACHE_H
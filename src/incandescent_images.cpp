@@ -6,6 +6,8 @@
 #include <volk.h>
 #include <incan_struct_init.h>
 #include <fstream>
+#include <algorithm>
+#include <bit>
 
 /*
  * TODO - This needs to be updated later to not use the all commands bit, and instead be several functions that are
@@ -43,8 +45,61 @@ void incan_util::transition_image_graphics_to_graphics(VkCommandBuffer command_b
     vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
 }
 
+void incan_util::transition_image(VkCommandBuffer command_buffer, VkImage image, VkImageLayout current_layout,
+                                  VkImageLayout new_layout, VkPipelineStageFlags2 source_stage,
+                                  VkAccessFlags2 source_access, VkPipelineStageFlags2 destination_stage,
+                                  VkAccessFlags2 destination_access, uint32_t base_mip_level,
+                                  uint32_t level_count) {
+    VkImageMemoryBarrier2 image_barrier = {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    image_barrier.pNext = nullptr;
+    image_barrier.srcStageMask = source_stage;
+    image_barrier.srcAccessMask = source_access;
+    image_barrier.dstStageMask = destination_stage;
+    image_barrier.dstAccessMask = destination_access;
+    image_barrier.oldLayout = current_layout;
+    image_barrier.newLayout = new_layout;
+    image_barrier.subresourceRange = incan_struct_init::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT,
+                                                                                base_mip_level, level_count);
+    image_barrier.image = image;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &image_barrier;
+
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+}
+
+void incan_util::transition_depth_image(VkCommandBuffer command_buffer, VkImage image, VkImageLayout current_layout,
+                                        VkImageLayout new_layout, VkPipelineStageFlags2 source_stage,
+                                        VkAccessFlags2 source_access, VkPipelineStageFlags2 destination_stage,
+                                        VkAccessFlags2 destination_access) {
+    VkImageMemoryBarrier2 image_barrier = {};
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    image_barrier.pNext = nullptr;
+    image_barrier.srcStageMask = source_stage;
+    image_barrier.srcAccessMask = source_access;
+    image_barrier.dstStageMask = destination_stage;
+    image_barrier.dstAccessMask = destination_access;
+    image_barrier.oldLayout = current_layout;
+    image_barrier.newLayout = new_layout;
+    image_barrier.subresourceRange = incan_struct_init::image_subresource_range(VK_IMAGE_ASPECT_DEPTH_BIT);
+    image_barrier.image = image;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &image_barrier;
+
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+}
+
 void incan_util::copy_image_to_image(VkCommandBuffer command_buffer, VkImage source, VkImage destination,
-                                     VkExtent2D source_extent, VkExtent2D destination_extent) {
+                                     VkExtent2D source_extent, VkExtent2D destination_extent,
+                                     uint32_t source_mip_level, uint32_t destination_mip_level) {
     // Specify region to blit (whole image for both)
     VkImageBlit2KHR blit_region = {};
     blit_region.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2_KHR;
@@ -58,11 +113,11 @@ void incan_util::copy_image_to_image(VkCommandBuffer command_buffer, VkImage sou
     blit_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     blit_region.srcSubresource.baseArrayLayer = 0;
     blit_region.srcSubresource.layerCount = 1;
-    blit_region.srcSubresource.mipLevel = 0;
+    blit_region.srcSubresource.mipLevel = source_mip_level;
     blit_region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     blit_region.dstSubresource.baseArrayLayer = 0;
     blit_region.dstSubresource.layerCount = 1;
-    blit_region.dstSubresource.mipLevel = 0;
+    blit_region.dstSubresource.mipLevel = destination_mip_level;
 
     // Specify formats and source/destination
     VkBlitImageInfo2KHR blit_image_info = {};
@@ -78,4 +133,59 @@ void incan_util::copy_image_to_image(VkCommandBuffer command_buffer, VkImage sou
 
     // Execute blit command
     vkCmdBlitImage2KHR(command_buffer, &blit_image_info);
-}
\ No newline at end of file
+}
+void incan_util::copy_image_contents(VkCommandBuffer command_buffer, VkImage source, VkImage destination,
+                                     VkExtent3D extent, uint32_t mip_levels, uint32_t source_mip,
+                                     uint32_t destination_mip) {
+    // One region per mip level, each level halves the extent
+    std::vector<VkImageCopy2KHR> copy_regions(mip_levels);
+    for (uint32_t mip = 0; mip < mip_levels; mip++) {
+        VkImageCopy2KHR &copy_region = copy_regions[mip];
+        copy_region = {};
+        copy_region.sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2_KHR;
+        copy_region.pNext = nullptr;
+        copy_region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy_region.srcSubresource.mipLevel = source_mip + mip;
+        copy_region.srcSubresource.baseArrayLayer = 0;
+        copy_region.srcSubresource.layerCount = 1;
+        copy_region.dstSubresource = copy_region.srcSubresource;
+        copy_region.dstSubresource.mipLevel = destination_mip + mip;
+        copy_region.extent.width = std::max(extent.width >> mip, 1u);
+        copy_region.extent.height = std::max(extent.height >> mip, 1u);
+        copy_region.extent.depth = std::max(extent.depth >> mip, 1u);
+    }
+
+    VkCopyImageInfo2KHR copy_image_info = {};
+    copy_image_info.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2_KHR;
+    copy_image_info.pNext = nullptr;
+    copy_image_info.srcImage = source;
+    copy_image_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    copy_image_info.dstImage = destination;
+    copy_image_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    copy_image_info.regionCount = static_cast<uint32_t>(copy_regions.size());
+    copy_image_info.pRegions = copy_regions.data();
+
+    vkCmdCopyImage2KHR(command_buffer, &copy_image_info);
+}
+
+uint32_t incan_util::mip_level_count(VkExtent3D extent) {
+    // floor(log2(largest side)) + 1
+    return std::bit_width(std::max({extent.width, extent.height, 1u}));
+}
+
+VkImageAspectFlags incan_util::image_aspect_flags(VkFormat format) {
+    // Views of the combined depth/stencil formats only see depth, stencil would need a view of its own
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
@@ -13,8 +13,35 @@ namespace incan_util {
                                                VkImageLayout current_layout,
                                                VkImageLayout new_layout);
 
+    // Barrier with explicit stages/accesses, for transitions outside the graphics to graphics case. Covers every mip
+    // level unless a range is given
+    void transition_image(VkCommandBuffer command_buffer, VkImage image, VkImageLayout current_layout,
+                          VkImageLayout new_layout, VkPipelineStageFlags2 source_stage,
+                          VkAccessFlags2 source_access, VkPipelineStageFlags2 destination_stage,
+                          VkAccessFlags2 destination_access, uint32_t base_mip_level = 0,
+                          uint32_t level_count = VK_REMAINING_MIP_LEVELS);
+
+    // transition_image for depth images, between the attachment and sampled layouts a depth pre-pass goes through
+    void transition_depth_image(VkCommandBuffer command_buffer, VkImage image, VkImageLayout current_layout,
+                                VkImageLayout new_layout, VkPipelineStageFlags2 source_stage,
+                                VkAccessFlags2 source_access, VkPipelineStageFlags2 destination_stage,
+                                VkAccessFlags2 destination_access);
+
+    // Linear blit from one mip level to another, the levels may belong to the same image
     void copy_image_to_image(VkCommandBuffer command_buffer, VkImage source, VkImage destination,
-                             VkExtent2D source_extent, VkExtent2D destination_extent);
+                             VkExtent2D source_extent, VkExtent2D destination_extent, uint32_t source_mip_level = 0,
+                             uint32_t destination_mip_level = 0);
+
+    // Levels in a full mip chain down to 1x1
+    uint32_t mip_level_count(VkExtent3D extent);
+
+    // Aspect views and barriers of a whole image of this format cover, depth for depth formats, otherwise color
+    VkImageAspectFlags image_aspect_flags(VkFormat format);
+
+    // Unfiltered copy of mip_levels mip levels between two images of the same format, starting at source_mip of the
+    // source and destination_mip of the destination. extent is the extent of the first level copied
+    void copy_image_contents(VkCommandBuffer command_buffer, VkImage source, VkImage destination, VkExtent3D extent,
+                             uint32_t mip_levels, uint32_t source_mip = 0, uint32_t destination_mip = 0);
 }
 
 
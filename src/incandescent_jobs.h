@@ -0,0 +1,39 @@
+#ifndef INCANDESCENT_JOBS_H
+#define INCANDESCENT_JOBS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace incan_util {
+    // Threads asset loading splits its work across, the calling thread counts as one of them
+    inline uint32_t worker_thread_count() {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    // Runs function(index) for every index in [0, count) across up to max_threads threads and returns once all calls
+    // are done. Workers pull the next index off a shared counter, so one huge item among many small ones doesn't
+    // stall the rest
+    template<typename Function>
+    void parallel_for(size_t count, Function &&function, size_t max_threads = worker_thread_count()) {
+        std::atomic<size_t> next_index = 0;
+        auto worker = [&]() {
+            for (size_t index = next_index++; index < count; index = next_index++) {
+                function(index);
+            }
+        };
+
+        size_t thread_count = std::min(max_threads, count);
+        std::vector<std::jthread> threads;
+        for (size_t i = 1; i < thread_count; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        // The jthreads join as they go out of scope
+    }
+}
+
+
+#endif //INCANDESCENT_JOBS_H
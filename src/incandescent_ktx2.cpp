@@ -0,0 +1,209 @@
+#include <incandescent_ktx2.h>
+
+#include <bit>
+#include <cstring>
+
+namespace {
+    constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+    };
+
+    // Identifier, header and index as they sit at the start of the file, every field at its natural alignment
+    struct Ktx2Header {
+        uint8_t identifier[12];
+        uint32_t vk_format;
+        uint32_t type_size;
+        uint32_t pixel_width;
+        uint32_t pixel_height;
+        uint32_t pixel_depth;
+        uint32_t layer_count;
+        uint32_t face_count;
+        uint32_t level_count;
+        uint32_t supercompression_scheme;
+        uint32_t dfd_byte_offset;
+        uint32_t dfd_byte_length;
+        uint32_t kvd_byte_offset;
+        uint32_t kvd_byte_length;
+        uint64_t sgd_byte_offset;
+        uint64_t sgd_byte_length;
+    };
+    static_assert(sizeof(Ktx2Header) == 80);
+
+    struct Ktx2Level {
+        uint64_t byte_offset;
+        uint64_t byte_length;
+        uint64_t uncompressed_byte_length;
+    };
+
+    // Data Format Descriptor values of the formats the cache writes. The DFD describes a block as samples of
+    // equal size, BC5 is two (red then green), the others one covering the whole block
+    struct BlockFormatDescription {
+        VkFormat format;
+        uint32_t block_size;
+        uint32_t color_model;
+        bool is_srgb;
+        uint32_t sample_count;
+    };
+
+    constexpr uint32_t KHR_DF_MODEL_BC1A = 128;
+    constexpr uint32_t KHR_DF_MODEL_BC4 = 131;
+    constexpr uint32_t KHR_DF_MODEL_BC5 = 132;
+    constexpr uint32_t KHR_DF_MODEL_BC7 = 134;
+    constexpr uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+    constexpr uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+    constexpr uint32_t KHR_DF_TRANSFER_SRGB = 2;
+
+    constexpr std::array<BlockFormatDescription, 6> BLOCK_FORMATS = {{
+        {VK_FORMAT_BC1_RGB_UNORM_BLOCK, 8, KHR_DF_MODEL_BC1A, false, 1},
+        {VK_FORMAT_BC1_RGB_SRGB_BLOCK, 8, KHR_DF_MODEL_BC1A, true, 1},
+        {VK_FORMAT_BC4_UNORM_BLOCK, 8, KHR_DF_MODEL_BC4, false, 1},
+        {VK_FORMAT_BC5_UNORM_BLOCK, 16, KHR_DF_MODEL_BC5, false, 2},
+        {VK_FORMAT_BC7_UNORM_BLOCK, 16, KHR_DF_MODEL_BC7, false, 1},
+        {VK_FORMAT_BC7_SRGB_BLOCK, 16, KHR_DF_MODEL_BC7, true, 1},
+    }};
+
+    const BlockFormatDescription *find_block_format(uint32_t format) {
+        for (const BlockFormatDescription &description: BLOCK_FORMATS) {
+            if (static_cast<uint32_t>(description.format) == format) {
+                return &description;
+            }
+        }
+        return nullptr;
+    }
+
+    uint64_t level_size(const BlockFormatDescription &description, uint32_t width, uint32_t height, uint32_t level) {
+        uint64_t blocks_x = (std::max(width >> level, 1u) + 3) / 4;
+        uint64_t blocks_y = (std::max(height >> level, 1u) + 3) / 4;
+        return blocks_x * blocks_y * description.block_size;
+    }
+
+    // Total size word followed by one Basic descriptor block
+    std::vector<uint32_t> basic_data_format_descriptor(const BlockFormatDescription &description) {
+        uint32_t descriptor_block_size = 24 + 16 * description.sample_count;
+        std::vector<uint32_t> words;
+        words.push_back(4 + descriptor_block_size);
+        words.push_back(0); // Khronos vendor, Basic descriptor type
+        words.push_back(2 | (descriptor_block_size << 16)); // Version 2
+        words.push_back(description.color_model | (KHR_DF_PRIMARIES_BT709 << 8) |
+                        ((description.is_srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16));
+        words.push_back(3 | (3 << 8)); // 4x4x1x1 texel blocks, stored as size - 1
+        words.push_back(description.block_size);
+        words.push_back(0);
+
+        uint32_t sample_bits = description.block_size * 8 / description.sample_count;
+        for (uint32_t sample = 0; sample < description.sample_count; sample++) {
+            // The channel id of a sample is its index for every model here (BC1A color, BC5 red/green, ...)
+            words.push_back((sample * sample_bits) | ((sample_bits - 1) << 16) | (sample << 24));
+            words.push_back(0);
+            words.push_back(0);
+            words.push_back(UINT32_MAX);
+        }
+        return words;
+    }
+
+    uint64_t align_up(uint64_t offset, uint64_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+}
+
+std::vector<std::byte> incan_ktx2::write_texture(VkFormat format, uint32_t width, uint32_t height,
+                                                 std::span<const std::vector<std::byte>> levels) {
+    const BlockFormatDescription *description = find_block_format(static_cast<uint32_t>(format));
+    if (description == nullptr || levels.empty()) {
+        return {};
+    }
+    for (uint32_t level = 0; level < levels.size(); level++) {
+        if (levels[level].size() != level_size(*description, width, height, level)) {
+            return {};
+        }
+    }
+
+    /* -------- Lay out the file -------- */
+    std::vector<uint32_t> descriptor = basic_data_format_descriptor(*description);
+    auto level_count = static_cast<uint32_t>(levels.size());
+
+    Ktx2Header header = {};
+    memcpy(header.identifier, KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size());
+    header.vk_format = static_cast<uint32_t>(format);
+    header.type_size = 1;
+    header.pixel_width = width;
+    header.pixel_height = height;
+    header.face_count = 1;
+    header.level_count = level_count;
+    header.dfd_byte_offset = static_cast<uint32_t>(sizeof(Ktx2Header) + sizeof(Ktx2Level) * level_count);
+    header.dfd_byte_length = static_cast<uint32_t>(descriptor.size() * sizeof(uint32_t));
+
+    // Smallest level first, each starting on a block boundary
+    std::vector<Ktx2Level> level_index(level_count);
+    uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+    for (uint32_t level = level_count; level-- > 0;) {
+        offset = align_up(offset, description->block_size);
+        level_index[level].byte_offset = offset;
+        level_index[level].byte_length = levels[level].size();
+        level_index[level].uncompressed_byte_length = levels[level].size();
+        offset += levels[level].size();
+    }
+
+    /* -------- Write -------- */
+    // Padding between the levels stays zero
+    std::vector<std::byte> file_bytes(offset);
+    memcpy(file_bytes.data(), &header, sizeof(header));
+    memcpy(file_bytes.data() + sizeof(header), level_index.data(), level_index.size() * sizeof(Ktx2Level));
+    memcpy(file_bytes.data() + header.dfd_byte_offset, descriptor.data(), header.dfd_byte_length);
+    for (uint32_t level = 0; level < level_count; level++) {
+        memcpy(file_bytes.data() + level_index[level].byte_offset, levels[level].data(), levels[level].size());
+    }
+    return file_bytes;
+}
+
+std::optional<Ktx2Texture> incan_ktx2::read_texture(std::span<const std::byte> file_bytes) {
+    std::optional<Ktx2Layout> layout = read_layout(file_bytes, file_bytes.size());
+    if (!layout.has_value()) {
+        return std::nullopt;
+    }
+
+    Ktx2Texture texture = {};
+    texture.format = layout->format;
+    texture.width = layout->width;
+    texture.height = layout->height;
+    for (auto [offset, size]: layout->level_ranges) {
+        texture.levels.push_back(file_bytes.subspan(offset, size));
+    }
+    return texture;
+}
+
+std::optional<Ktx2Layout> incan_ktx2::read_layout(std::span<const std::byte> header_bytes, uint64_t file_size) {
+    if (header_bytes.size() < sizeof(Ktx2Header)) {
+        return std::nullopt;
+    }
+    Ktx2Header header;
+    memcpy(&header, header_bytes.data(), sizeof(header));
+
+    const BlockFormatDescription *description = find_block_format(header.vk_format);
+    if (memcmp(header.identifier, KTX2_IDENTIFIER.data(), KTX2_IDENTIFIER.size()) != 0 || description == nullptr ||
+        header.type_size != 1 || header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth != 0 ||
+        header.layer_count > 1 || header.face_count != 1 || header.supercompression_scheme != 0 ||
+        header.level_count == 0 ||
+        header.level_count > std::bit_width(std::max(header.pixel_width, header.pixel_height))) {
+        return std::nullopt;
+    }
+    if (header_bytes.size() < sizeof(Ktx2Header) + sizeof(Ktx2Level) * header.level_count) {
+        return std::nullopt;
+    }
+
+    Ktx2Layout layout = {};
+    layout.format = description->format;
+    layout.width = header.pixel_width;
+    layout.height = header.pixel_height;
+    for (uint32_t level = 0; level < header.level_count; level++) {
+        Ktx2Level level_entry;
+        memcpy(&level_entry, header_bytes.data() + sizeof(Ktx2Header) + sizeof(Ktx2Level) * level,
+               sizeof(Ktx2Level));
+        if (level_entry.byte_length != level_size(*description, header.pixel_width, header.pixel_height, level) ||
+            level_entry.byte_offset > file_size || level_entry.byte_length > file_size - level_entry.byte_offset) {
+            return std::nullopt;
+        }
+        layout.level_ranges.emplace_back(level_entry.byte_offset, level_entry.byte_length);
+    }
+    return layout;
+}
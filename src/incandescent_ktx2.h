@@ -0,0 +1,44 @@
+#ifndef INCANDESCENT_KTX2_H
+#define INCANDESCENT_KTX2_H
+
+#include <incandescent_types.h>
+
+// A KTX2 texture whose levels point into the bytes it was read from
+struct Ktx2Texture {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    // Mip 0 first
+    std::vector<std::span<const std::byte>> levels;
+};
+
+// Where the levels of a KTX2 file are, from the start of the file
+struct Ktx2Layout {
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    // Mip 0 first
+    std::vector<std::pair<uint64_t, uint64_t>> level_ranges;
+};
+
+/*
+ * The part of KTX2 the texture cache needs: one 2D image (no array layers, faces or depth), every level present, no
+ * supercompression, and only the BC formats the block encoder writes. Files carry the Basic Data Format Descriptor
+ * the spec requires, so other KTX2 tools open them too. Level data is stored smallest mip first as the spec asks, the
+ * level index still lists mip 0 first.
+ */
+namespace incan_ktx2 {
+    // levels are mip 0 first, each exactly the size of its level. Returns the bytes of the file, empty for formats the
+    // cache doesn't use
+    std::vector<std::byte> write_texture(VkFormat format, uint32_t width, uint32_t height,
+                                         std::span<const std::vector<std::byte>> levels);
+
+    // Nothing if the file isn't a KTX2 the cache could have written or any level runs past the end of file_bytes
+    std::optional<Ktx2Texture> read_texture(std::span<const std::byte> file_bytes);
+
+    // Same checks from only the start of a file of file_size bytes, enough of it to hold the header and level index
+    std::optional<Ktx2Layout> read_layout(std::span<const std::byte> header_bytes, uint64_t file_size);
+}
+
+
+#endif //INCANDESCENT_KTX2_H
@@ -0,0 +1,1084 @@
+#include <incandescent_loader.h>
+#include <incandescent_geometry_cache.h>
+#include <incandescent_engine.h>
+#include <incandescent_images.h>
+#include <incandescent_jobs.h>
+#include <incandescent_mesh_optimizer.h>
+#include <incandescent_meshlets.h>
+#include <incandescent_simplifier.h>
+#include <incandescent_upload.h>
+#include <volk.h>
+
+#include <fastgltf/core.hpp>
+#include <fastgltf/tools.hpp>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+void LoadedScene::destroy(ResourceManager &resources) {
+    for (ImageHandle texture: textures) {
+        if (resources.images.contains(texture)) {
+            resources.destroy_image(texture);
+        }
+    }
+    for (const ResidentMesh &resident_mesh: resident_meshes) {
+        if (resources.buffers.contains(resident_mesh.buffer)) {
+            resources.destroy_buffer(resident_mesh.buffer);
+        }
+    }
+    for (BufferHandle buffer: {instance_buffer, draw_instance_buffer, work_item_buffer, cull_counter_buffer,
+                               visibility_buffer, culled_index_buffer, draw_command_buffer}) {
+        if (resources.buffers.contains(buffer)) {
+            resources.destroy_buffer(buffer);
+        }
+    }
+    cache_mapping.close();
+    texture_archive.close();
+    *this = {};
+}
+
+namespace {
+    // Where one primitive's data goes in the scene arrays, worked out up front so workers never share a range
+    struct PrimitiveRange {
+        const fastgltf::Primitive *primitive;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+
+    // Empty if the file can't be read
+    std::vector<std::byte> read_file_bytes(const std::filesystem::path &file_path) {
+        std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            return {};
+        }
+        std::vector<std::byte> bytes(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!file) {
+            return {};
+        }
+        return bytes;
+    }
+
+    // Used by surfaces whose file gives them no material
+    MaterialData default_material() {
+        MaterialData material = {};
+        material.base_color_factor = Eigen::Vector4f::Ones();
+        material.metallic_factor = 1.0f;
+        material.roughness_factor = 1.0f;
+        material.base_color_texture = NO_TEXTURE;
+        material.metallic_roughness_texture = NO_TEXTURE;
+        material.normal_texture = NO_TEXTURE;
+        return material;
+    }
+
+    std::span<const std::byte> buffer_bytes(const fastgltf::DataSource &data_source) {
+        return std::visit(fastgltf::visitor{
+                              [](const auto &) -> std::span<const std::byte> {
+                                  return {};
+                              },
+                              [](const fastgltf::sources::Array &array) -> std::span<const std::byte> {
+                                  return {array.bytes.data(), array.bytes.size_bytes()};
+                              },
+                              [](const fastgltf::sources::Vector &vector) -> std::span<const std::byte> {
+                                  return {vector.bytes.data(), vector.bytes.size()};
+                              },
+                              [](const fastgltf::sources::ByteView &byte_view) -> std::span<const std::byte> {
+                                  return {byte_view.bytes.data(), byte_view.bytes.size()};
+                              },
+                          }, data_source);
+    }
+
+    // The image's file bytes, copied out of the asset or read from disk, still encoded
+    std::vector<std::byte> encoded_image_bytes(const fastgltf::Asset &asset, const fastgltf::Image &image,
+                                               const std::filesystem::path &directory) {
+        std::vector<std::byte> bytes;
+        auto copy_bytes = [&](std::span<const std::byte> source) {
+            bytes.assign(source.begin(), source.end());
+        };
+
+        std::visit(fastgltf::visitor{
+                       [](const auto &) {
+                       },
+                       [&](const fastgltf::sources::URI &file_path) {
+                           if (file_path.fileByteOffset == 0 && file_path.uri.isLocalPath()) {
+                               bytes = read_file_bytes(directory / file_path.uri.fspath());
+                           }
+                       },
+                       [&](const fastgltf::sources::Array &array) {
+                           copy_bytes({array.bytes.data(), array.bytes.size_bytes()});
+                       },
+                       [&](const fastgltf::sources::Vector &vector) {
+                           copy_bytes({vector.bytes.data(), vector.bytes.size()});
+                       },
+                       [&](const fastgltf::sources::BufferView &view) {
+                           const fastgltf::BufferView &buffer_view = asset.bufferViews[view.bufferViewIndex];
+                           std::span<const std::byte> data = buffer_bytes(asset.buffers[buffer_view.bufferIndex].data);
+                           if (buffer_view.byteOffset + buffer_view.byteLength <= data.size()) {
+                               copy_bytes(data.subspan(buffer_view.byteOffset, buffer_view.byteLength));
+                           }
+                       },
+                   }, image.data);
+
+        return bytes;
+    }
+
+    // Local files a .gltf reads besides itself (external buffers and images), empty if it doesn't parse
+    std::vector<std::filesystem::path> gltf_external_files(const std::filesystem::path &file_path) {
+        auto gltf_file = fastgltf::GltfDataBuffer::FromPath(file_path);
+        if (gltf_file.error() != fastgltf::Error::None) {
+            return {};
+        }
+        // Only the JSON is parsed, buffers are left as URIs
+        fastgltf::Parser parser;
+        auto parsed_asset = parser.loadGltf(gltf_file.get(), file_path.parent_path(),
+                                            fastgltf::Options::DontRequireValidAssetMember);
+        if (parsed_asset.error() != fastgltf::Error::None) {
+            return {};
+        }
+
+        std::vector<std::filesystem::path> files;
+        auto add_file = [&](const fastgltf::DataSource &source) {
+            if (const auto *uri = std::get_if<fastgltf::sources::URI>(&source); uri && uri->uri.isLocalPath()) {
+                files.push_back(file_path.parent_path() / uri->uri.fspath());
+            }
+        };
+        for (const fastgltf::Buffer &buffer: parsed_asset->buffers) {
+            add_file(buffer.data);
+        }
+        for (const fastgltf::Image &image: parsed_asset->images) {
+            add_file(image.data);
+        }
+        return files;
+    }
+
+    // Every primitive owns its own vertex and index range, so workers write straight into the scene's storage
+    void decode_primitive(const fastgltf::Asset &asset, const PrimitiveRange &range, Vertex *vertices,
+                          uint32_t *indices) {
+        const fastgltf::Primitive &primitive = *range.primitive;
+
+        std::span<Vertex> primitive_vertices(vertices, range.vertex_count);
+        for (Vertex &vertex: primitive_vertices) {
+            vertex.position = Eigen::Vector3f::Zero();
+            vertex.uv_x = 0.0f;
+            vertex.normal = Eigen::Vector3f::UnitZ();
+            vertex.uv_y = 0.0f;
+            vertex.color = Eigen::Vector4f::Ones();
+        }
+
+        const fastgltf::Accessor &position_accessor = asset.accessors[primitive.findAttribute("POSITION")->
+            accessorIndex];
+        fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
+            asset, position_accessor, [&](fastgltf::math::fvec3 position, size_t index) {
+                primitive_vertices[index].position = {position.x(), position.y(), position.z()};
+            });
+
+        auto normals = primitive.findAttribute("NORMAL");
+        if (normals != primitive.attributes.end()) {
+            fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec3>(
+                asset, asset.accessors[normals->accessorIndex], [&](fastgltf::math::fvec3 normal, size_t index) {
+                    primitive_vertices[index].normal = {normal.x(), normal.y(), normal.z()};
+                });
+        }
+
+        auto uvs = primitive.findAttribute("TEXCOORD_0");
+        if (uvs != primitive.attributes.end()) {
+            fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec2>(
+                asset, asset.accessors[uvs->accessorIndex], [&](fastgltf::math::fvec2 uv, size_t index) {
+                    primitive_vertices[index].uv_x = uv.x();
+                    primitive_vertices[index].uv_y = uv.y();
+                });
+        }
+
+        auto colors = primitive.findAttribute("COLOR_0");
+        if (colors != primitive.attributes.end()) {
+            fastgltf::iterateAccessorWithIndex<fastgltf::math::fvec4>(
+                asset, asset.accessors[colors->accessorIndex], [&](fastgltf::math::fvec4 color, size_t index) {
+                    primitive_vertices[index].color = {color.x(), color.y(), color.z(), color.w()};
+                });
+        }
+
+        if (primitive.indicesAccessor.has_value()) {
+            fastgltf::copyFromAccessor<uint32_t>(asset, asset.accessors[primitive.indicesAccessor.value()], indices);
+
+            // Triangles reaching past the primitive's vertices collapse onto its first vertex and draw nothing
+            for (uint32_t i = 0; i < range.index_count; i += 3) {
+                uint32_t *triangle = indices + i;
+                uint32_t *triangle_end = indices + std::min(i + 3, range.index_count);
+                if (std::any_of(triangle, triangle_end, [&](uint32_t index) { return index >= range.vertex_count; })) {
+                    std::fill(triangle, triangle_end, 0u);
+                }
+            }
+        } else {
+            // Non-indexed primitives still go through the index buffer so every surface draws the same way
+            for (uint32_t i = 0; i < range.index_count; i++) {
+                indices[i] = i;
+            }
+        }
+    }
+
+    // Bounds over the vertices a surface actually indexes, a surface may share its vertex range with others
+    Eigen::AlignedBox3f surface_box(const GeometrySurface &surface, std::span<const Vertex> vertices,
+                                    std::span<const uint32_t> indices) {
+        Eigen::AlignedBox3f box;
+        for (uint32_t i = 0; i < surface.lods[0].index_count; i++) {
+            uint32_t vertex = surface.vertex_offset + indices[surface.lods[0].first_index + i];
+            if (vertex < vertices.size()) {
+                box.extend(vertices[vertex].position);
+            }
+        }
+        if (box.isEmpty()) {
+            box.extend(Eigen::Vector3f::Zero());
+        }
+        return box;
+    }
+
+    // The slice of every scene array a mesh's buffer holds and where each goes in the buffer
+    ResidentMesh lay_out_mesh_buffer(const MeshAsset &mesh, std::span<const Meshlet> meshlets) {
+        constexpr VkDeviceSize SECTION_ALIGNMENT = 16;
+
+        ResidentMesh resident_mesh = {};
+        resident_mesh.first_elements.fill(UINT32_MAX);
+        std::array<uint32_t, MESH_SECTION_COUNT> end_elements = {};
+        auto extend = [&](MeshSection section, uint32_t first, uint32_t count) {
+            auto index = static_cast<size_t>(section);
+            resident_mesh.first_elements[index] = std::min(resident_mesh.first_elements[index], first);
+            end_elements[index] = std::max(end_elements[index], first + count);
+        };
+
+        for (const GeometrySurface &surface: mesh.surfaces) {
+            extend(MeshSection::Vertices, static_cast<uint32_t>(surface.vertex_offset), surface.vertex_count);
+            for (const SurfaceLod &lod: surface.lods) {
+                extend(MeshSection::Indices, lod.first_index, lod.index_count);
+            }
+        }
+        // Levels follow each other, so the last one ends the mesh's meshlets
+        const MeshLod &last_lod = mesh.lods[mesh.lod_count - 1];
+        uint32_t end_meshlet = last_lod.first_meshlet + last_lod.meshlet_count;
+        for (uint32_t meshlet = mesh.lods[0].first_meshlet; meshlet < end_meshlet; meshlet++) {
+            extend(MeshSection::Meshlets, meshlet, 1);
+            extend(MeshSection::MeshletVertices, meshlets[meshlet].vertex_offset, meshlets[meshlet].vertex_count);
+            extend(MeshSection::MeshletTriangles, meshlets[meshlet].triangle_offset,
+                   meshlets[meshlet].triangle_count);
+        }
+
+        for (size_t section = 0; section < MESH_SECTION_COUNT; section++) {
+            resident_mesh.first_elements[section] = std::min(resident_mesh.first_elements[section],
+                                                             end_elements[section]);
+            resident_mesh.element_counts[section] = end_elements[section] - resident_mesh.first_elements[section];
+            resident_mesh.section_offsets[section] = resident_mesh.size;
+            resident_mesh.size += resident_mesh.element_counts[section] * MESH_SECTION_ELEMENT_SIZES[section];
+            resident_mesh.size = (resident_mesh.size + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        }
+        return resident_mesh;
+    }
+
+    // Largest error a level of detail may have, relative to the half diagonal of its mesh's box
+    constexpr float LOD_MAX_RELATIVE_ERROR = 0.05f;
+    // A simplified surface with more than this share of the level before's indices isn't worth a level of its own
+    constexpr float LOD_MIN_REDUCTION = 0.9f;
+
+    /*
+     * Last import step: optimizes every vertex range, computes the bounds, simplifies the surfaces into a chain of
+     * levels of detail, splits every level into meshlets and packs the vertices into the scene's storage. A mesh's
+     * vertex ranges are its own, so each mesh is a job. Surfaces sharing a range (an OBJ mesh's materials) are next
+     * to each other and so are their indices, each surface's triangles are reordered on their own and the vertices
+     * once for all of them.
+     */
+    void optimize_and_pack_meshes(SceneData &scene_data, std::span<Vertex> vertices) {
+        scene_data.vertex_storage.resize(vertices.size());
+        // Built per mesh and joined in mesh order afterwards, so a mesh's meshlets stay contiguous
+        std::vector<incan_meshlet::MeshletLists> mesh_meshlets(scene_data.meshes.size());
+        // Simplified indices go after the imported ones, also joined in mesh order. Until then the surfaces' simplified
+        // ranges point into these and an empty range stands for the level before's
+        std::vector<std::vector<uint32_t>> mesh_lod_indices(scene_data.meshes.size());
+        incan_util::parallel_for(scene_data.meshes.size(), [&](size_t mesh_index) {
+            std::vector<GeometrySurface> &surfaces = scene_data.meshes[mesh_index].surfaces;
+            for (size_t first = 0; first < surfaces.size();) {
+                size_t last = first + 1;
+                while (last < surfaces.size() && surfaces[last].vertex_offset == surfaces[first].vertex_offset &&
+                       surfaces[last].vertex_count == surfaces[first].vertex_count) {
+                    last++;
+                }
+
+                std::span<Vertex> range_vertices = vertices.subspan(surfaces[first].vertex_offset,
+                                                                    surfaces[first].vertex_count);
+                std::span<uint32_t> range_indices(scene_data.index_storage.data() + surfaces[first].lods[0].first_index,
+                                                  surfaces[last - 1].lods[0].first_index +
+                                                  surfaces[last - 1].lods[0].index_count -
+                                                  surfaces[first].lods[0].first_index);
+                // A broken file can index past its vertices, that range keeps its order rather than crash the passes
+                bool indices_valid = std::ranges::all_of(range_indices, [&](uint32_t index) {
+                    return index < range_vertices.size();
+                });
+                if (indices_valid) {
+                    for (size_t surface = first; surface < last; surface++) {
+                        std::span<uint32_t> surface_indices(
+                            scene_data.index_storage.data() + surfaces[surface].lods[0].first_index,
+                            surfaces[surface].lods[0].index_count);
+                        incan_mesh::optimize_vertex_cache(surface_indices,
+                                                          static_cast<uint32_t>(range_vertices.size()));
+                        incan_mesh::optimize_overdraw(surface_indices, range_vertices);
+                    }
+                    incan_mesh::optimize_vertex_fetch(range_vertices, range_indices);
+                }
+                first = last;
+            }
+
+            Eigen::AlignedBox3f mesh_box;
+            for (GeometrySurface &surface: surfaces) {
+                Eigen::AlignedBox3f box = surface_box(surface, vertices, scene_data.index_storage);
+                surface.bounds.center = box.center();
+                surface.bounds.extents = box.sizes() * 0.5f;
+                surface.bounds.radius = surface.bounds.extents.norm();
+                mesh_box.extend(box);
+            }
+            if (mesh_box.isEmpty()) {
+                mesh_box.extend(Eigen::Vector3f::Zero());
+            }
+
+            MeshAsset &mesh = scene_data.meshes[mesh_index];
+            mesh.position_offset = mesh_box.center();
+            mesh.position_scale = mesh_box.sizes() * 0.5f;
+
+            /* -------- Levels of detail -------- */
+            std::vector<uint32_t> &lod_indices = mesh_lod_indices[mesh_index];
+            auto surface_lod_indices = [&](const GeometrySurface &surface, uint32_t lod) -> std::span<uint32_t> {
+                while (lod > 0 && surface.lods[lod].index_count == 0) {
+                    lod--;
+                }
+                uint32_t *indices = lod == 0 ? scene_data.index_storage.data() : lod_indices.data();
+                return {indices + surface.lods[lod].first_index, surface.lods[lod].index_count};
+            };
+
+            // Every level is simplified from the full detail triangles, so errors don't pile up level on level
+            float max_error = LOD_MAX_RELATIVE_ERROR * mesh.position_scale.norm();
+            mesh.lod_count = 1;
+            mesh.lods[0].error = 0.0f;
+            for (uint32_t lod = 1; lod < MAX_LOD_COUNT; lod++) {
+                float lod_error = mesh.lods[lod - 1].error;
+                bool reduced = false;
+                for (GeometrySurface &surface: surfaces) {
+                    surface.lods[lod] = {};
+                    std::span<const uint32_t> full_indices = surface_lod_indices(surface, 0);
+                    size_t previous_index_count = surface_lod_indices(surface, lod - 1).size();
+
+                    float error = 0.0f;
+                    std::vector<uint32_t> simplified = incan_simplify::simplify(
+                        full_indices, vertices.subspan(surface.vertex_offset, surface.vertex_count),
+                        (full_indices.size() / 3 >> lod) * 3, max_error, error);
+                    if (simplified.empty() ||
+                        static_cast<float>(simplified.size()) > LOD_MIN_REDUCTION * previous_index_count) {
+                        continue;
+                    }
+
+                    incan_mesh::optimize_vertex_cache(simplified, surface.vertex_count);
+                    surface.lods[lod] = {static_cast<uint32_t>(lod_indices.size()),
+                                         static_cast<uint32_t>(simplified.size())};
+                    lod_indices.insert(lod_indices.end(), simplified.begin(), simplified.end());
+                    lod_error = std::max(lod_error, error);
+                    reduced = true;
+                }
+                if (!reduced) {
+                    break;
+                }
+                mesh.lods[lod].error = lod_error;
+                mesh.lod_count = lod + 1;
+            }
+
+            // Half a quantization step on every axis
+            float position_error = QUANTIZE_POSITIONS ? 0.5f * mesh.position_scale.norm() / 32767.0f : 0.0f;
+            // Each level gets meshlets of its own, also for the surfaces that repeat a range, so a level is one run
+            incan_meshlet::MeshletLists &meshlets = mesh_meshlets[mesh_index];
+            for (uint32_t lod = 0; lod < mesh.lod_count; lod++) {
+                mesh.lods[lod].first_meshlet = static_cast<uint32_t>(meshlets.meshlets.size());
+                for (const GeometrySurface &surface: surfaces) {
+                    incan_meshlet::build_meshlets(surface_lod_indices(surface, lod),
+                                                  vertices.subspan(surface.vertex_offset, surface.vertex_count),
+                                                  surface.vertex_offset, position_error, meshlets);
+                }
+                mesh.lods[lod].meshlet_count = static_cast<uint32_t>(meshlets.meshlets.size()) -
+                                               mesh.lods[lod].first_meshlet;
+            }
+
+            // Ranges shared by several surfaces are packed again for each, to the same result
+            for (const GeometrySurface &surface: surfaces) {
+                for (uint32_t i = 0; i < surface.vertex_count; i++) {
+                    uint32_t vertex = surface.vertex_offset + i;
+                    scene_data.vertex_storage[vertex] = incan_mesh::pack_vertex(vertices[vertex],
+                                                                                mesh.position_offset,
+                                                                                mesh.position_scale);
+                }
+            }
+        });
+
+        // Each mesh's simplified indices go right after its imported ones, so all of a mesh's indices are one range
+        // and its buffer can be streamed in as a slice of every scene array
+        incan_meshlet::MeshletLists scene_meshlets;
+        size_t index_count = scene_data.index_storage.size();
+        for (const std::vector<uint32_t> &lod_indices: mesh_lod_indices) {
+            index_count += lod_indices.size();
+        }
+        std::vector<uint32_t> index_storage;
+        index_storage.reserve(index_count);
+        for (size_t mesh_index = 0; mesh_index < scene_data.meshes.size(); mesh_index++) {
+            MeshAsset &mesh = scene_data.meshes[mesh_index];
+            uint32_t first_meshlet = incan_meshlet::append_meshlets(scene_meshlets, mesh_meshlets[mesh_index]);
+
+            // The importers lay a mesh's surfaces out one after the other
+            uint32_t first_imported_index = UINT32_MAX;
+            uint32_t end_imported_index = 0;
+            for (const GeometrySurface &surface: mesh.surfaces) {
+                first_imported_index = std::min(first_imported_index, surface.lods[0].first_index);
+                end_imported_index = std::max(end_imported_index,
+                                              surface.lods[0].first_index + surface.lods[0].index_count);
+            }
+            first_imported_index = std::min(first_imported_index, end_imported_index);
+            auto first_mesh_index = static_cast<uint32_t>(index_storage.size());
+            index_storage.insert(index_storage.end(), scene_data.index_storage.begin() + first_imported_index,
+                                 scene_data.index_storage.begin() + end_imported_index);
+            auto first_lod_index = static_cast<uint32_t>(index_storage.size());
+            index_storage.insert(index_storage.end(), mesh_lod_indices[mesh_index].begin(),
+                                 mesh_lod_indices[mesh_index].end());
+
+            for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+                if (lod < mesh.lod_count) {
+                    mesh.lods[lod].first_meshlet += first_meshlet;
+                } else {
+                    mesh.lods[lod] = mesh.lods[lod - 1];
+                }
+            }
+            for (GeometrySurface &surface: mesh.surfaces) {
+                surface.lods[0].first_index += first_mesh_index - first_imported_index;
+                for (uint32_t lod = 1; lod < MAX_LOD_COUNT; lod++) {
+                    if (lod >= mesh.lod_count || surface.lods[lod].index_count == 0) {
+                        surface.lods[lod] = surface.lods[lod - 1];
+                    } else {
+                        surface.lods[lod].first_index += first_lod_index;
+                    }
+                }
+            }
+        }
+        scene_data.index_storage = std::move(index_storage);
+        scene_data.meshlet_storage = std::move(scene_meshlets.meshlets);
+        scene_data.meshlet_vertex_storage = std::move(scene_meshlets.vertices);
+        scene_data.meshlet_triangle_storage = std::move(scene_meshlets.triangles);
+
+        scene_data.vertices = scene_data.vertex_storage;
+        scene_data.indices = scene_data.index_storage;
+        scene_data.meshlets = scene_data.meshlet_storage;
+        scene_data.meshlet_vertices = scene_data.meshlet_vertex_storage;
+        scene_data.meshlet_triangles = scene_data.meshlet_triangle_storage;
+    }
+
+    // Open addressing with linear probing, keyed on an OBJ (position, normal, uv) index triple. The table is sized for
+    // the worst case (every face corner unique) at half load up front, so it never grows or rehashes
+    class VertexDeduplicationMap {
+    public:
+        explicit VertexDeduplicationMap(size_t max_keys) {
+            size_t capacity = std::bit_ceil(std::max<size_t>(max_keys * 2, 16));
+            slots.resize(capacity);
+            mask = capacity - 1;
+        }
+
+        // Returns the vertex already stored for key, or stores new_vertex and returns it
+        uint32_t find_or_insert(const tinyobj::index_t &key, uint32_t new_vertex) {
+            for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+                Slot &entry = slots[slot];
+                if (entry.vertex == EMPTY_SLOT) {
+                    entry = {key.vertex_index, key.normal_index, key.texcoord_index, new_vertex};
+                    return new_vertex;
+                }
+                if (entry.position == key.vertex_index && entry.normal == key.normal_index &&
+                    entry.uv == key.texcoord_index) {
+                    return entry.vertex;
+                }
+            }
+        }
+
+    private:
+        static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+        // 16 bytes, four slots to a cache line
+        struct Slot {
+            int32_t position;
+            int32_t normal;
+            int32_t uv;
+            uint32_t vertex = EMPTY_SLOT;
+        };
+
+        static size_t hash(const tinyobj::index_t &key) {
+            // Each index gets its own odd multiplier, then the murmur3 finalizer spreads the bits
+            uint64_t value = static_cast<uint32_t>(key.vertex_index) * 0x9e3779b97f4a7c15ull;
+            value ^= static_cast<uint32_t>(key.normal_index) * 0xc2b2ae3d27d4eb4full;
+            value ^= static_cast<uint32_t>(key.texcoord_index) * 0x165667b19e3779f9ull;
+            value ^= value >> 33;
+            value *= 0xff51afd7ed558ccdull;
+            value ^= value >> 33;
+            return static_cast<size_t>(value);
+        }
+
+        std::vector<Slot> slots;
+        size_t mask;
+    };
+
+    // One OBJ object/group as an indexed mesh, surface ranges are relative to the mesh until it is placed
+    struct ObjMeshData {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<GeometrySurface> surfaces;
+    };
+
+    // Faces are grouped by material so each material is one surface, vertices are deduplicated on their index triple
+    ObjMeshData build_obj_mesh(const tinyobj::attrib_t &attrib, const tinyobj::mesh_t &mesh,
+                               uint32_t default_material_index) {
+        ObjMeshData mesh_data;
+
+        // Triangulated on load, anything that still isn't a triangle is skipped
+        std::vector<uint32_t> triangle_faces;
+        std::vector<size_t> face_offsets(mesh.num_face_vertices.size());
+        size_t face_offset = 0;
+        for (size_t face = 0; face < mesh.num_face_vertices.size(); face++) {
+            face_offsets[face] = face_offset;
+            if (mesh.num_face_vertices[face] == 3) {
+                triangle_faces.push_back(static_cast<uint32_t>(face));
+            }
+            face_offset += mesh.num_face_vertices[face];
+        }
+
+        auto face_material = [&](uint32_t face) {
+            int material_id = mesh.material_ids.empty() ? -1 : mesh.material_ids[face];
+            return material_id < 0 ? default_material_index : static_cast<uint32_t>(material_id);
+        };
+        std::ranges::stable_sort(triangle_faces, {}, face_material);
+
+        VertexDeduplicationMap vertex_map(triangle_faces.size() * 3);
+        mesh_data.indices.reserve(triangle_faces.size() * 3);
+
+        bool has_colors = attrib.colors.size() == attrib.vertices.size();
+        for (uint32_t face: triangle_faces) {
+            uint32_t material = face_material(face);
+            if (mesh_data.surfaces.empty() || mesh_data.surfaces.back().material != material) {
+                GeometrySurface surface = {};
+                surface.lods[0].first_index = static_cast<uint32_t>(mesh_data.indices.size());
+                surface.material = material;
+                mesh_data.surfaces.push_back(surface);
+            }
+
+            for (size_t corner = 0; corner < 3; corner++) {
+                const tinyobj::index_t &key = mesh.indices[face_offsets[face] + corner];
+                uint32_t next_vertex = static_cast<uint32_t>(mesh_data.vertices.size());
+                uint32_t vertex_index = vertex_map.find_or_insert(key, next_vertex);
+                mesh_data.indices.push_back(vertex_index);
+
+                if (vertex_index != next_vertex) {
+                    continue;
+                }
+
+                size_t position = 3 * static_cast<size_t>(key.vertex_index);
+                Vertex vertex = {};
+                vertex.position = {attrib.vertices[position], attrib.vertices[position + 1],
+                                   attrib.vertices[position + 2]};
+                vertex.normal = Eigen::Vector3f::UnitZ();
+                if (key.normal_index >= 0) {
+                    size_t normal = 3 * static_cast<size_t>(key.normal_index);
+                    vertex.normal = {attrib.normals[normal], attrib.normals[normal + 1], attrib.normals[normal + 2]};
+                }
+                // OBJ puts the uv origin at the bottom left, Vulkan samples from the top left
+                if (key.texcoord_index >= 0) {
+                    size_t uv = 2 * static_cast<size_t>(key.texcoord_index);
+                    vertex.uv_x = attrib.texcoords[uv];
+                    vertex.uv_y = 1.0f - attrib.texcoords[uv + 1];
+                }
+                vertex.color = Eigen::Vector4f::Ones();
+                if (has_colors) {
+                    vertex.color = {attrib.colors[position], attrib.colors[position + 1], attrib.colors[position + 2],
+                                    1.0f};
+                }
+                mesh_data.vertices.push_back(vertex);
+            }
+        }
+
+        for (size_t i = 0; i < mesh_data.surfaces.size(); i++) {
+            GeometrySurface &surface = mesh_data.surfaces[i];
+            uint32_t end_index = i + 1 < mesh_data.surfaces.size()
+                                     ? mesh_data.surfaces[i + 1].lods[0].first_index
+                                     : static_cast<uint32_t>(mesh_data.indices.size());
+            surface.lods[0].index_count = end_index - surface.lods[0].first_index;
+            surface.vertex_count = static_cast<uint32_t>(mesh_data.vertices.size());
+        }
+
+        return mesh_data;
+    }
+
+    uint32_t texture_slot(const fastgltf::Asset &asset, const fastgltf::Optional<fastgltf::TextureInfo> &info) {
+        if (!info.has_value() || !asset.textures[info->textureIndex].imageIndex.has_value()) {
+            return NO_TEXTURE;
+        }
+        return static_cast<uint32_t>(asset.textures[info->textureIndex].imageIndex.value());
+    }
+}
+
+std::optional<SceneData> incan_loader::import_gltf(const std::filesystem::path &file_path) {
+    /* -------- Parse -------- */
+    // The file is memory mapped so the JSON/GLB chunks are parsed in place instead of being read into a copy first
+#if FASTGLTF_HAS_MEMORY_MAPPED_FILE
+    auto gltf_file = fastgltf::MappedGltfFile::FromPath(file_path);
+#else
+    auto gltf_file = fastgltf::GltfDataBuffer::FromPath(file_path);
+#endif
+    if (gltf_file.error() != fastgltf::Error::None) {
+        fmt::print("Failed to open {}: {}\n", file_path.string(), fastgltf::getErrorMessage(gltf_file.error()));
+        return std::nullopt;
+    }
+
+    fastgltf::Parser parser;
+    constexpr fastgltf::Options gltf_options = fastgltf::Options::LoadExternalBuffers |
+                                               fastgltf::Options::DontRequireValidAssetMember;
+    auto parsed_asset = parser.loadGltf(gltf_file.get(), file_path.parent_path(), gltf_options);
+    if (parsed_asset.error() != fastgltf::Error::None) {
+        fmt::print("Failed to parse {}: {}\n", file_path.string(), fastgltf::getErrorMessage(parsed_asset.error()));
+        return std::nullopt;
+    }
+    const fastgltf::Asset &asset = parsed_asset.get();
+
+    SceneData scene_data;
+
+    /* -------- Lay out the scene arrays -------- */
+    std::vector<PrimitiveRange> primitive_ranges;
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    scene_data.meshes.reserve(asset.meshes.size());
+    for (const fastgltf::Mesh &mesh: asset.meshes) {
+        MeshAsset mesh_asset;
+        mesh_asset.name = mesh.name;
+
+        for (const fastgltf::Primitive &primitive: mesh.primitives) {
+            auto positions = primitive.findAttribute("POSITION");
+            if (primitive.type != fastgltf::PrimitiveType::Triangles || positions == primitive.attributes.end()) {
+                continue;
+            }
+
+            // Every attribute is written per POSITION vertex, a mismatched count would write past the primitive's range
+            size_t position_count = asset.accessors[positions->accessorIndex].count;
+            auto attribute_matches = [&](std::string_view name) {
+                auto attribute = primitive.findAttribute(name);
+                return attribute == primitive.attributes.end() ||
+                       asset.accessors[attribute->accessorIndex].count == position_count;
+            };
+            if (position_count == 0 || !attribute_matches("NORMAL") || !attribute_matches("TEXCOORD_0") ||
+                !attribute_matches("COLOR_0")) {
+                fmt::print("Skipping a primitive of {} with mismatched attribute counts\n", mesh.name);
+                continue;
+            }
+
+            PrimitiveRange range = {};
+            range.primitive = &primitive;
+            range.first_vertex = vertex_count;
+            range.vertex_count = static_cast<uint32_t>(position_count);
+            range.first_index = index_count;
+            range.index_count = primitive.indicesAccessor.has_value()
+                                    ? static_cast<uint32_t>(asset.accessors[primitive.indicesAccessor.value()].count)
+                                    : range.vertex_count;
+            primitive_ranges.push_back(range);
+
+            GeometrySurface surface = {};
+            surface.lods[0] = {range.first_index, range.index_count};
+            surface.vertex_offset = static_cast<int32_t>(range.first_vertex);
+            surface.vertex_count = range.vertex_count;
+            // Primitives without a material use the one appended after the file's own
+            surface.material = primitive.materialIndex.has_value() &&
+                               primitive.materialIndex.value() < asset.materials.size()
+                                   ? static_cast<uint32_t>(primitive.materialIndex.value())
+                                   : static_cast<uint32_t>(asset.materials.size());
+            mesh_asset.surfaces.push_back(surface);
+
+            vertex_count += range.vertex_count;
+            index_count += range.index_count;
+        }
+
+        scene_data.meshes.push_back(std::move(mesh_asset));
+    }
+
+    /* -------- Materials -------- */
+    // Color textures are sampled as sRGB, everything else (normals, metallic/roughness) is linear data
+    std::vector<TextureUsage> image_usages(asset.images.size(), TextureUsage::Data);
+    for (const fastgltf::Material &material: asset.materials) {
+        MaterialData material_data = {};
+        material_data.base_color_factor = {
+            material.pbrData.baseColorFactor.x(), material.pbrData.baseColorFactor.y(),
+            material.pbrData.baseColorFactor.z(), material.pbrData.baseColorFactor.w()
+        };
+        material_data.metallic_factor = material.pbrData.metallicFactor;
+        material_data.roughness_factor = material.pbrData.roughnessFactor;
+        material_data.base_color_texture = texture_slot(asset, material.pbrData.baseColorTexture);
+        material_data.metallic_roughness_texture = texture_slot(asset, material.pbrData.metallicRoughnessTexture);
+        material_data.normal_texture = NO_TEXTURE;
+        if (material.normalTexture.has_value() &&
+            asset.textures[material.normalTexture->textureIndex].imageIndex.has_value()) {
+            material_data.normal_texture = static_cast<uint32_t>(
+                asset.textures[material.normalTexture->textureIndex].imageIndex.value());
+        }
+
+        if (material_data.base_color_texture != NO_TEXTURE) {
+            image_usages[material_data.base_color_texture] = TextureUsage::Color;
+        }
+        uint32_t emissive_texture = texture_slot(asset, material.emissiveTexture);
+        if (emissive_texture != NO_TEXTURE) {
+            image_usages[emissive_texture] = TextureUsage::Color;
+        }
+        if (material_data.normal_texture != NO_TEXTURE) {
+            image_usages[material_data.normal_texture] = TextureUsage::Normal;
+        }
+
+        scene_data.materials.push_back(material_data);
+    }
+    // Surfaces without a material point past the file's materials, at the default
+    scene_data.materials.push_back(default_material());
+
+    /* -------- Decode geometry, gather image files -------- */
+    // Images stay encoded here, they are decoded at upload time whether the scene came from here or from the cache
+    std::vector<Vertex> vertices(vertex_count);
+    scene_data.index_storage.resize(index_count);
+    scene_data.image_storage.resize(asset.images.size());
+    incan_util::parallel_for(primitive_ranges.size() + asset.images.size(), [&](size_t job) {
+        if (job < primitive_ranges.size()) {
+            const PrimitiveRange &range = primitive_ranges[job];
+            decode_primitive(asset, range, vertices.data() + range.first_vertex,
+                             scene_data.index_storage.data() + range.first_index);
+        } else {
+            size_t image_index = job - primitive_ranges.size();
+            scene_data.image_storage[image_index] = encoded_image_bytes(asset, asset.images[image_index],
+                                                                        file_path.parent_path());
+        }
+    });
+
+    for (size_t image_index = 0; image_index < asset.images.size(); image_index++) {
+        scene_data.images.push_back({scene_data.image_storage[image_index], image_usages[image_index]});
+    }
+    optimize_and_pack_meshes(scene_data, vertices);
+
+    /* -------- Flatten the node hierarchy -------- */
+    size_t scene_index = asset.defaultScene.has_value() ? asset.defaultScene.value() : 0;
+    if (scene_index < asset.scenes.size()) {
+        fastgltf::iterateSceneNodes(asset, scene_index, fastgltf::math::fmat4x4(),
+                                    [&](const fastgltf::Node &node, const fastgltf::math::fmat4x4 &matrix) {
+                                        if (!node.meshIndex.has_value()) {
+                                            return;
+                                        }
+                                        MeshInstance instance = {};
+                                        instance.mesh = static_cast<uint32_t>(node.meshIndex.value());
+                                        instance.world_transform = Eigen::Map<const Eigen::Matrix4f>(
+                                            matrix.data());
+                                        scene_data.instances.push_back(instance);
+                                    });
+    }
+
+    return scene_data;
+}
+
+std::optional<SceneData> incan_loader::import_obj(const std::filesystem::path &file_path) {
+    /* -------- Parse -------- */
+    // tinyobjloader reads the stream a line at a time, a large stream buffer keeps that from turning into small reads
+    std::vector<char> stream_buffer(1024 * 1024);
+    std::ifstream file_stream;
+    file_stream.rdbuf()->pubsetbuf(stream_buffer.data(), static_cast<std::streamsize>(stream_buffer.size()));
+    file_stream.open(file_path, std::ios::binary);
+    if (!file_stream.is_open()) {
+        fmt::print("Failed to open {}\n", file_path.string());
+        return std::nullopt;
+    }
+
+    std::filesystem::path directory = file_path.parent_path();
+    tinyobj::MaterialFileReader material_reader(directory.string());
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> obj_materials;
+    std::string warnings;
+    std::string errors;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &obj_materials, &warnings, &errors, &file_stream, &material_reader)) {
+        fmt::print("Failed to parse {}: {}\n", file_path.string(), errors);
+        return std::nullopt;
+    }
+    if (!warnings.empty()) {
+        fmt::print("{}: {}\n", file_path.string(), warnings);
+    }
+
+    SceneData scene_data;
+
+    /* -------- Materials -------- */
+    // Materials share textures by file name, each file is read once
+    std::vector<std::filesystem::path> image_paths;
+    std::vector<TextureUsage> image_usages;
+    std::unordered_map<std::string, uint32_t> image_indices;
+    auto texture_slot = [&](const std::string &texture_name, TextureUsage usage) {
+        if (texture_name.empty()) {
+            return NO_TEXTURE;
+        }
+        auto [image, inserted] = image_indices.try_emplace(texture_name, static_cast<uint32_t>(image_paths.size()));
+        if (inserted) {
+            image_paths.push_back(directory / texture_name);
+            image_usages.push_back(usage);
+        }
+        return image->second;
+    };
+
+    for (const tinyobj::material_t &obj_material: obj_materials) {
+        MaterialData material_data = default_material();
+        material_data.base_color_factor = {
+            obj_material.diffuse[0], obj_material.diffuse[1], obj_material.diffuse[2], obj_material.dissolve
+        };
+        material_data.metallic_factor = obj_material.metallic;
+        material_data.roughness_factor = obj_material.roughness;
+        material_data.base_color_texture = texture_slot(obj_material.diffuse_texname, TextureUsage::Color);
+        material_data.normal_texture = texture_slot(!obj_material.normal_texname.empty()
+                                                        ? obj_material.normal_texname
+                                                        : obj_material.bump_texname, TextureUsage::Normal);
+        scene_data.materials.push_back(material_data);
+    }
+    // Faces without a material (usemtl missing or unknown) use the one after the file's own
+    uint32_t default_material_index = static_cast<uint32_t>(scene_data.materials.size());
+    scene_data.materials.push_back(default_material());
+
+    /* -------- Deduplicate and read image files, one object/group per job -------- */
+    std::vector<ObjMeshData> mesh_data(shapes.size());
+    scene_data.image_storage.resize(image_paths.size());
+    incan_util::parallel_for(shapes.size() + image_paths.size(), [&](size_t job) {
+        if (job < shapes.size()) {
+            mesh_data[job] = build_obj_mesh(attrib, shapes[job].mesh, default_material_index);
+        } else {
+            scene_data.image_storage[job - shapes.size()] = read_file_bytes(image_paths[job - shapes.size()]);
+        }
+    });
+
+    /* -------- Place the meshes in the scene arrays -------- */
+    std::vector<uint32_t> first_vertices(mesh_data.size());
+    std::vector<uint32_t> first_indices(mesh_data.size());
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    for (size_t mesh_index = 0; mesh_index < mesh_data.size(); mesh_index++) {
+        first_vertices[mesh_index] = vertex_count;
+        first_indices[mesh_index] = index_count;
+
+        MeshAsset mesh_asset;
+        mesh_asset.name = shapes[mesh_index].name;
+        for (GeometrySurface surface: mesh_data[mesh_index].surfaces) {
+            surface.lods[0].first_index += index_count;
+            surface.vertex_offset = static_cast<int32_t>(vertex_count);
+            mesh_asset.surfaces.push_back(surface);
+        }
+
+        vertex_count += static_cast<uint32_t>(mesh_data[mesh_index].vertices.size());
+        index_count += static_cast<uint32_t>(mesh_data[mesh_index].indices.size());
+        scene_data.meshes.push_back(std::move(mesh_asset));
+
+        // OBJ has no hierarchy, every object sits at the origin
+        MeshInstance instance = {};
+        instance.mesh = static_cast<uint32_t>(mesh_index);
+        instance.world_transform = Eigen::Matrix4f::Identity();
+        scene_data.instances.push_back(instance);
+    }
+
+    std::vector<Vertex> vertices(vertex_count);
+    scene_data.index_storage.resize(index_count);
+    incan_util::parallel_for(mesh_data.size(), [&](size_t mesh_index) {
+        const ObjMeshData &mesh = mesh_data[mesh_index];
+        std::ranges::copy(mesh.vertices, vertices.begin() + first_vertices[mesh_index]);
+        std::ranges::copy(mesh.indices, scene_data.index_storage.begin() + first_indices[mesh_index]);
+    });
+
+    for (size_t image_index = 0; image_index < image_paths.size(); image_index++) {
+        scene_data.images.push_back({scene_data.image_storage[image_index], image_usages[image_index]});
+    }
+    optimize_and_pack_meshes(scene_data, vertices);
+
+    return scene_data;
+}
+
+LoadedScene incan_loader::upload_scene(IncandescentEngine &engine, SceneData scene_data,
+                                      const std::filesystem::path &file_path) {
+    ResourceManager &resources = engine.resources;
+
+    LoadedScene scene;
+    scene.vertex_count = static_cast<uint32_t>(scene_data.vertices.size());
+    scene.index_count = static_cast<uint32_t>(scene_data.indices.size());
+    scene.meshlet_count = static_cast<uint32_t>(scene_data.meshlets.size());
+
+    /* -------- Geometry -------- */
+    // Only laid out here, the ResidencyManager uploads a mesh once one of its instances is worth drawing
+    scene.resident_meshes.reserve(scene_data.meshes.size());
+    for (const MeshAsset &mesh: scene_data.meshes) {
+        scene.resident_meshes.push_back(lay_out_mesh_buffer(mesh, scene_data.meshlets));
+    }
+
+    /* -------- Culling -------- */
+    // The instances go up once, everything else is written on the GPU every frame. Transfer source lets the
+    // defragmenter move them
+    VkBufferUsageFlags transfer_usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    VkBufferUsageFlags storage_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                                       transfer_usage;
+    const MeshletRenderer &meshlet_renderer = engine.meshlet_renderer;
+    VkDeviceSize instance_count = std::max<VkDeviceSize>(scene_data.instances.size(), 1);
+
+    // Without mesh shaders the culling pass writes the surviving triangles out for an indexed draw, the worst case
+    // being every triangle of every instance. Each instance gets the range of its full detail level
+    std::vector<MeshletSceneInstance> scene_instances;
+    scene_instances.reserve(scene_data.instances.size());
+    VkDeviceSize culled_index_count = 0;
+    VkDeviceSize work_item_count = 0;
+    for (const MeshInstance &instance: scene_data.instances) {
+        const MeshAsset &mesh = scene_data.meshes[instance.mesh];
+        scene_instances.push_back(incan_meshlet::scene_instance(instance, static_cast<uint32_t>(culled_index_count)));
+        for (const GeometrySurface &surface: mesh.surfaces) {
+            culled_index_count += surface.lods[0].index_count;
+        }
+        // Room for whichever level of detail the instance picks
+        uint32_t max_meshlet_count = 0;
+        for (uint32_t lod = 0; lod < mesh.lod_count; lod++) {
+            max_meshlet_count = std::max(max_meshlet_count, mesh.lods[lod].meshlet_count);
+        }
+        work_item_count += (max_meshlet_count + meshlet_renderer.meshlets_per_work_item - 1) /
+                           meshlet_renderer.meshlets_per_work_item;
+    }
+
+    scene.instance_buffer = resources.create_buffer(instance_count * sizeof(MeshletSceneInstance), storage_usage,
+                                                    VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0,
+                                                    AllocationCategory::Buffer);
+    scene.draw_instance_buffer = resources.create_buffer(instance_count * sizeof(MeshletDrawInstance), storage_usage,
+                                                         VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0,
+                                                         AllocationCategory::Buffer);
+    // The early and late culling passes each append to their own region, an instance is drawn by one of them at most
+    scene.work_item_buffer = resources.create_buffer(
+        CULL_REGION_COUNT * std::max<VkDeviceSize>(work_item_count, 1) * 2 * sizeof(uint32_t), storage_usage,
+        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0, AllocationCategory::Buffer);
+    scene.cull_counter_buffer = resources.create_buffer(CULL_REGION_COUNT * CULL_COUNTER_REGION_SIZE,
+                                                        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | storage_usage,
+                                                        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0,
+                                                        AllocationCategory::Buffer);
+    scene.visibility_buffer = resources.create_buffer(instance_count * sizeof(uint32_t), storage_usage,
+                                                      VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0,
+                                                      AllocationCategory::Buffer);
+    if (!meshlet_renderer.mesh_shaders_enabled) {
+        scene.culled_index_buffer = resources.create_buffer(
+            std::max<VkDeviceSize>(culled_index_count, 1) * sizeof(uint32_t),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | transfer_usage,
+            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0, AllocationCategory::Buffer);
+        scene.draw_command_buffer = resources.create_buffer(
+            CULL_REGION_COUNT * DRAW_BUCKET_COUNT * instance_count * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | storage_usage, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0,
+            AllocationCategory::Buffer);
+    }
+
+    if (!scene_instances.empty()) {
+        VkDeviceSize instance_bytes = scene_instances.size() * sizeof(MeshletSceneInstance);
+        VkDeviceSize visibility_bytes = scene_instances.size() * sizeof(uint32_t);
+        UploadBatch upload_batch;
+        upload_batch.initialize(engine.allocator, engine.memory_telemetry);
+        VkDeviceSize staging_offset = upload_batch.reserve(instance_bytes);
+        VkDeviceSize visibility_offset = upload_batch.reserve(visibility_bytes);
+        upload_batch.allocate_staging();
+        std::memcpy(upload_batch.staging_data(staging_offset), scene_instances.data(), instance_bytes);
+        upload_batch.copy_to_buffer(staging_offset, resources.buffers.hot(scene.instance_buffer).buffer, 0,
+                                    instance_bytes);
+        // Nothing starts out visible, the first frame finds everything in the late pass
+        std::memset(upload_batch.staging_data(visibility_offset), 0, visibility_bytes);
+        upload_batch.copy_to_buffer(visibility_offset, resources.buffers.hot(scene.visibility_buffer).buffer, 0,
+                                    visibility_bytes);
+        engine.immediate_submit([&](VkCommandBuffer command_buffer) {
+            upload_batch.record(command_buffer);
+        });
+        upload_batch.destroy();
+    }
+
+    /* -------- Textures -------- */
+    // Every mip is uploaded, the ResidencyManager drops the finer ones of textures it can read them back for
+    std::vector<std::optional<ArchiveEntry>> mip_sources;
+    scene.textures = engine.texture_streamer.stream(engine, scene_data.images, file_path, scene.texture_archive,
+                                                    mip_sources);
+    scene.resident_textures.resize(scene.textures.size());
+    for (size_t texture = 0; texture < scene.textures.size(); texture++) {
+        if (!resources.images.contains(scene.textures[texture])) {
+            continue;
+        }
+        const ImageColdData &image = resources.images.cold(scene.textures[texture]);
+        ResidentTexture &resident_texture = scene.resident_textures[texture];
+        resident_texture.mip_source = mip_sources[texture];
+        resident_texture.format = image.image_format;
+        resident_texture.extent = image.image_extent;
+        resident_texture.mip_count = image.mip_levels;
+    }
+
+    // The encoded images aren't needed anymore, the geometry is until the scene goes away
+    scene_data.images = {};
+    scene_data.image_storage = {};
+    scene.meshes = std::move(scene_data.meshes);
+    scene.materials = std::move(scene_data.materials);
+    scene.instances = std::move(scene_data.instances);
+    scene.scene_data = std::move(scene_data);
+
+    return scene;
+}
+
+std::optional<LoadedScene> incan_loader::load_scene(IncandescentEngine &engine,
+                                                    const std::filesystem::path &file_path) {
+    auto load_start = std::chrono::steady_clock::now();
+
+    std::optional<uint64_t> source_hash = incan_cache::hash_file(file_path);
+    if (!source_hash.has_value()) {
+        fmt::print("Failed to open {}\n", file_path.string());
+        return std::nullopt;
+    }
+    if (file_path.extension() != ".obj") {
+        source_hash = incan_cache::hash_file_stamps(gltf_external_files(file_path), source_hash.value());
+    }
+    std::filesystem::path cache_file = incan_cache::cache_file_path(engine.geometry_cache_directory,
+                                                                    source_hash.value());
+
+    auto print_loaded = [&](const LoadedScene &scene, const char *source) {
+        auto load_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                               load_start);
+        fmt::print("Loaded {} ({}): {} meshes, {} vertices, {} indices, {} meshlets, {} textures in {} ms\n",
+                   file_path.string(), source, scene.meshes.size(), scene.vertex_count, scene.index_count,
+                   scene.meshlet_count, scene.textures.size(), load_time.count());
+    };
+
+    /* -------- Geometry cache -------- */
+    // Nothing is parsed on a hit. The mapping stays open as long as the scene, meshes are streamed in from its pages
+    MappedFile cache_mapping;
+    if (cache_mapping.open(cache_file)) {
+        std::optional<SceneData> cached_scene = incan_cache::read_scene(cache_mapping.bytes(), source_hash.value());
+        if (cached_scene.has_value()) {
+            LoadedScene scene = upload_scene(engine, std::move(cached_scene.value()), file_path);
+            scene.cache_mapping = std::move(cache_mapping);
+            print_loaded(scene, "geometry cache");
+            return scene;
+        }
+        cache_mapping.close();
+        fmt::print("Geometry cache {} is unreadable, importing {} again\n", cache_file.string(), file_path.string());
+    }
+
+    /* -------- Import -------- */
+    std::optional<SceneData> scene_data = file_path.extension() == ".obj"
+                                              ? import_obj(file_path)
+                                              : import_gltf(file_path);
+    if (!scene_data.has_value()) {
+        return std::nullopt;
+    }
+
+    if (!incan_cache::write_scene(cache_file, source_hash.value(), scene_data.value())) {
+        fmt::print("Failed to write geometry cache {}\n", cache_file.string());
+    }
+
+    LoadedScene scene = upload_scene(engine, std::move(scene_data.value()), file_path);
+    print_loaded(scene, "imported");
+    return scene;
+}
@@ -0,0 +1,299 @@
+#ifndef INCANDESCENT_LOADER_H
+#define INCANDESCENT_LOADER_H
+
+#include <incandescent_types.h>
+#include <incandescent_resources.h>
+#include <incandescent_archive.h>
+#include <incandescent_mapped_file.h>
+#include <filesystem>
+#include <span>
+
+class IncandescentEngine;
+
+// Full precision vertex the importers build meshes with, it is optimized and packed before it reaches the GPU
+struct Vertex {
+    Eigen::Vector3f position;
+    float uv_x;
+    Eigen::Vector3f normal;
+    float uv_y;
+    Eigen::Vector4f color;
+};
+
+// Positions as 16-bit offsets inside their mesh's bounding box instead of floats. Error is at most half a step of
+// MeshAsset::position_scale / 32767 per axis, shaders have to be built with the same setting
+constexpr bool QUANTIZE_POSITIONS = true;
+
+/*
+ * Interleaved vertex of the scene's vertex array, 20 bytes with quantized positions and 24 without (48 as floats).
+ * Shaders decode it as:
+ *   position: float (QUANTIZE_POSITIONS off) or snorm16, position = mesh.position_offset + mesh.position_scale * p
+ *   normal: snorm16 octahedral (x, y), z = 1 - |x| - |y|, then x and y fold back over the diagonals where z < 0
+ *   uv: half floats
+ *   color: unorm8 RGBA
+ */
+struct PackedVertex {
+    std::conditional_t<QUANTIZE_POSITIONS, std::array<int16_t, 4>, std::array<float, 3>> position;
+    std::array<int16_t, 2> normal;
+    std::array<uint16_t, 2> uv;
+    std::array<uint8_t, 4> color;
+};
+
+static_assert(sizeof(PackedVertex) == (QUANTIZE_POSITIONS ? 20 : 24), "Vertex layout has to match the shaders");
+
+constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+
+// Axis aligned box in mesh space plus the sphere around it
+struct Bounds {
+    Eigen::Vector3f center;
+    float radius;
+    Eigen::Vector3f extents;
+};
+
+/*
+ * Cluster of at most 64 vertices and 124 triangles of one surface, culled on the GPU as a whole. Bounds are in mesh
+ * space, before the instance transform. The cone test is meshoptimizer's: every triangle of the meshlet faces away
+ * from a camera at p if dot(normalize(cone_apex - p), cone_axis) >= cone_cutoff, a cutoff above 1 never culls.
+ */
+struct Meshlet {
+    std::array<float, 3> center;
+    float radius;
+    std::array<float, 3> cone_apex;
+    float cone_cutoff;
+    std::array<float, 3> cone_axis;
+    // First entry in the meshlet vertex list, whose entries index the scene's vertex array
+    uint32_t vertex_offset;
+    // First entry in the meshlet triangle list, whose entries are three 8-bit meshlet vertex numbers (bits 0-23)
+    uint32_t triangle_offset;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+    uint32_t padding;
+};
+
+static_assert(sizeof(Meshlet) == 64, "Meshlet layout has to match the shaders");
+
+// Levels of detail a mesh can have, the full detail triangles plus simplified ones at 1/2, 1/4, 1/8 and 1/16 of them
+constexpr uint32_t MAX_LOD_COUNT = 5;
+
+// One level of detail's indices in the scene's index array
+struct SurfaceLod {
+    uint32_t first_index;
+    uint32_t index_count;
+};
+
+// One draw's worth of indices in the scene's index array
+struct GeometrySurface {
+    // lods[0] is the triangles the file has, a surface that couldn't be simplified further repeats its last range.
+    // Entries past the mesh's lod_count repeat the last one too
+    std::array<SurfaceLod, MAX_LOD_COUNT> lods;
+    // Indices are local to the surface, this is where its vertices start in the scene's vertex array. Every level of
+    // detail indexes the same vertices
+    int32_t vertex_offset;
+    uint32_t vertex_count;
+    uint32_t material;
+    Bounds bounds;
+};
+
+// One level of detail of a whole mesh
+struct MeshLod {
+    // Its surfaces' triangles split into meshlets, contiguous in surface order
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    // Furthest the simplified surface is from the full detail one, in mesh space. 0 for the first level
+    float error;
+};
+
+struct MeshAsset {
+    std::string name;
+    std::vector<GeometrySurface> surfaces;
+    // Dequantizes the mesh's positions (offset + scale * p), the center and half size of the box around its vertices
+    Eigen::Vector3f position_offset;
+    Eigen::Vector3f position_scale;
+    // Levels of detail from the most detailed, each coarser than the one before. Entries past lod_count repeat the
+    // last one
+    uint32_t lod_count = 1;
+    std::array<MeshLod, MAX_LOD_COUNT> lods = {};
+};
+
+// Texture slots index LoadedScene::textures, NO_TEXTURE if the material has none
+struct MaterialData {
+    Eigen::Vector4f base_color_factor;
+    float metallic_factor;
+    float roughness_factor;
+    uint32_t base_color_texture;
+    uint32_t metallic_roughness_texture;
+    // Block compressed normal maps (BC5) only keep X and Y, shaders rebuild Z from them
+    uint32_t normal_texture;
+};
+
+struct MeshInstance {
+    uint32_t mesh;
+    Eigen::Matrix4f world_transform;
+};
+
+// What an image holds, which decides the format it is uploaded in. Color is sRGB, data and normals are linear
+enum class TextureUsage : uint32_t {
+    Color,
+    Data,
+    Normal
+};
+
+// An image still in its file format (PNG, JPEG, ...), decoded at upload time
+struct SourceImage {
+    std::span<const std::byte> bytes;
+    TextureUsage usage;
+};
+
+/*
+ * A scene on the CPU, what the importers produce and what the geometry cache stores. The large blobs are spans so a
+ * scene read from the cache points straight into the mapped file, an imported scene points them at its own storage
+ * vectors (their buffers move with them, so the spans survive the SceneData being moved).
+ */
+struct SceneData {
+    std::vector<MeshAsset> meshes;
+    std::vector<MaterialData> materials;
+    std::vector<MeshInstance> instances;
+
+    std::span<const PackedVertex> vertices;
+    std::span<const uint32_t> indices;
+    std::span<const Meshlet> meshlets;
+    std::span<const uint32_t> meshlet_vertices;
+    std::span<const uint32_t> meshlet_triangles;
+    std::vector<SourceImage> images;
+
+    std::vector<PackedVertex> vertex_storage;
+    std::vector<uint32_t> index_storage;
+    std::vector<Meshlet> meshlet_storage;
+    std::vector<uint32_t> meshlet_vertex_storage;
+    std::vector<uint32_t> meshlet_triangle_storage;
+    std::vector<std::vector<std::byte>> image_storage;
+};
+
+// The scene-wide arrays a mesh's buffer holds a slice of, in the order they are laid out in it
+enum class MeshSection : uint32_t {
+    Vertices,
+    Indices,
+    Meshlets,
+    MeshletVertices,
+    MeshletTriangles,
+    Count
+};
+
+constexpr size_t MESH_SECTION_COUNT = static_cast<size_t>(MeshSection::Count);
+constexpr std::array<VkDeviceSize, MESH_SECTION_COUNT> MESH_SECTION_ELEMENT_SIZES = {
+    sizeof(PackedVertex), sizeof(uint32_t), sizeof(Meshlet), sizeof(uint32_t), sizeof(uint32_t)
+};
+
+/*
+ * A mesh's geometry on the GPU, streamed in and out by the ResidencyManager. One buffer holds the mesh's slice of each
+ * of the scene's arrays, the importers keep every mesh's elements contiguous. Meshlets keep their scene-wide vertex
+ * and triangle numbers, shaders read each section through an address biased back by the section's first element.
+ */
+struct ResidentMesh {
+    std::array<uint32_t, MESH_SECTION_COUNT> first_elements;
+    std::array<uint32_t, MESH_SECTION_COUNT> element_counts;
+    // Each section starts 16 byte aligned
+    std::array<VkDeviceSize, MESH_SECTION_COUNT> section_offsets;
+    VkDeviceSize size;
+    // Invalid while the mesh isn't resident
+    BufferHandle buffer;
+    // Largest priority of the mesh's instances in the last finished sweep, and when a sweep last wanted it
+    float priority = 0.0f;
+    uint64_t last_used_frame = 0;
+    // Gathered by the sweep in progress
+    float sweep_priority = 0.0f;
+
+    // Where element 0 of the scene-wide array would be, only elements in the mesh's slice may be read through it
+    VkDeviceAddress section_address(const ResourceManager &resources, MeshSection section) const {
+        auto index = static_cast<size_t>(section);
+        // Unsigned wraparound is intended, shaders add the element offset back before reading
+        return resources.buffers.hot(buffer).device_address + section_offsets[index] -
+               first_elements[index] * MESH_SECTION_ELEMENT_SIZES[index];
+    }
+};
+
+/*
+ * A texture's mips on the GPU. The image only holds mips resident_mip and coarser of the full chain, its own mip 0 is
+ * the chain's resident_mip. The ResidencyManager rebuilds it whenever resident_mip changes.
+ */
+struct ResidentTexture {
+    // KTX2 in the scene's texture archive the finer mips are read back from, nothing if there is none and every mip
+    // stays resident
+    std::optional<ArchiveEntry> mip_source;
+    VkFormat format;
+    // Of the full chain
+    VkExtent3D extent;
+    uint32_t mip_count;
+    uint32_t resident_mip = 0;
+    // Finer than resident_mip while mips are being read back for it
+    uint32_t streaming_mip = 0;
+    // Finest mip any instance using the texture wanted in the last finished sweep
+    uint32_t wanted_mip = 0;
+    float priority = 0.0f;
+    uint64_t last_used_frame = 0;
+    // Gathered by the sweep in progress
+    float sweep_priority = 0.0f;
+    uint32_t sweep_mip = UINT32_MAX;
+};
+
+/*
+ * Everything a scene file turns into. The geometry stays on the CPU in scene_data and only the meshes the
+ * ResidencyManager picks have a buffer on the GPU. Every texture is on the GPU, but only with the mips it picks.
+ */
+struct LoadedScene {
+    std::vector<MeshAsset> meshes;
+    std::vector<MaterialData> materials;
+    // One per source image, invalid handles for images that failed to decode
+    std::vector<ImageHandle> textures;
+    // Flattened node hierarchy of the default scene
+    std::vector<MeshInstance> instances;
+
+    // One per mesh and one per texture
+    std::vector<ResidentMesh> resident_meshes;
+    std::vector<ResidentTexture> resident_textures;
+    // Source of the meshes' geometry, a scene read from the geometry cache points into cache_mapping
+    SceneData scene_data;
+    MappedFile cache_mapping;
+    // Holds the block compressed textures' KTX2s, open for as long as the scene so their mips can be read back
+    Archive texture_archive;
+
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    uint32_t meshlet_count = 0;
+    // What the MeshletRenderer culls with: every instance's transform, uploaded once, and what culling them writes
+    // every frame (their DrawInstances, the meshlet work items and the counters the indirect calls read, one region
+    // of each per culling pass, and whether each instance was visible for the next frame's occlusion culling)
+    BufferHandle instance_buffer;
+    BufferHandle draw_instance_buffer;
+    BufferHandle work_item_buffer;
+    BufferHandle cull_counter_buffer;
+    BufferHandle visibility_buffer;
+    // Only without mesh shaders: the triangles that survive culling, each instance gets a range big enough for all
+    // of its mesh, and the VkDrawIndexedIndirectCommands drawing them, per pass DRAW_BUCKET_COUNT buckets of one per
+    // instance
+    BufferHandle culled_index_buffer;
+    BufferHandle draw_command_buffer;
+
+    void destroy(ResourceManager &resources);
+};
+
+namespace incan_loader {
+    // Parses a .gltf/.glb from a memory mapped file and decodes its geometry on worker threads. Images are kept
+    // encoded. Returns nothing if the file can't be parsed. Both importers finish by optimizing every surface's
+    // triangle and vertex order, splitting the surfaces into meshlets and packing the vertices
+    std::optional<SceneData> import_gltf(const std::filesystem::path &file_path);
+
+    // Streams a Wavefront .obj, each object/group is turned into an indexed mesh on its own worker thread with
+    // vertices deduplicated on their (position, normal, uv) triple
+    std::optional<SceneData> import_obj(const std::filesystem::path &file_path);
+
+    // Streams the textures in through the engine's TextureStreamer and lays out every mesh's buffer, which the
+    // ResidencyManager uploads once the mesh is wanted. The scene keeps scene_data to upload them from
+    LoadedScene upload_scene(IncandescentEngine &engine, SceneData scene_data, const std::filesystem::path &file_path);
+
+    // Loads from the geometry cache when it holds this exact file, otherwise imports it (picking the importer from
+    // the extension) and writes the cache for next time
+    std::optional<LoadedScene> load_scene(IncandescentEngine &engine, const std::filesystem::path &file_path);
+}
+
+
+#endif //INCANDESCENT_LOADER_H
@@ -0,0 +1,287 @@
+#include <incandescent_lz4.h>
+#include <incandescent_jobs.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define INCANDESCENT_LZ4_SSE2
+#endif
+
+namespace {
+    constexpr size_t MIN_MATCH = 4;
+    // The format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end
+    constexpr size_t LAST_LITERALS = 5;
+    constexpr size_t MATCH_FIND_LIMIT = 12;
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr uint32_t HASH_BITS = 16;
+    // Every this many misses in a row the search steps one byte further
+    constexpr uint32_t SKIP_STRENGTH = 6;
+
+    // The decoder's fast path copies in steps of this many bytes, overshooting by up to one step less a byte
+    constexpr size_t WIDE_COPY_SIZE = 16;
+
+    uint32_t read_u32(const std::byte *bytes) {
+        uint32_t value;
+        memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash_sequence(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // SSE2 is part of x86-64, elsewhere the 16 byte memcpy becomes whatever vector move the target has
+    void copy_16(std::byte *destination, const std::byte *source) {
+#ifdef INCANDESCENT_LZ4_SSE2
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(source)));
+#else
+        memcpy(destination, source, WIDE_COPY_SIZE);
+#endif
+    }
+
+    void wide_copy(std::byte *destination, const std::byte *source, size_t count) {
+        for (size_t copied = 0; copied < count; copied += WIDE_COPY_SIZE) {
+            copy_16(destination + copied, source + copied);
+        }
+    }
+
+    void write_u32(std::byte *bytes, uint32_t value) {
+        memcpy(bytes, &value, sizeof(value));
+    }
+
+    // Offsets in the table are multiples of 4, so their low two bits hold the padding after the tile
+    std::pair<size_t, size_t> tile_range(std::span<const std::byte> source, size_t tile) {
+        uint32_t entry = read_u32(source.data() + tile * sizeof(uint32_t));
+        uint32_t next_entry = read_u32(source.data() + (tile + 1) * sizeof(uint32_t));
+        return {entry & ~3u, (next_entry & ~3u) - (entry & 3u)};
+    }
+
+    // Lengths past the 15 a token holds go on in bytes of 255 and a final smaller byte
+    void write_length(std::vector<std::byte> &block, size_t length) {
+        for (; length >= 255; length -= 255) {
+            block.push_back(std::byte{255});
+        }
+        block.push_back(static_cast<std::byte>(length));
+    }
+
+    // match_length 0 writes the last sequence, which is only literals
+    void write_sequence(std::vector<std::byte> &block, std::span<const std::byte> literals, size_t match_length,
+                        size_t offset) {
+        size_t literal_token = std::min<size_t>(literals.size(), 15);
+        size_t match_token = match_length > 0 ? std::min<size_t>(match_length - MIN_MATCH, 15) : 0;
+        block.push_back(static_cast<std::byte>((literal_token << 4) | match_token));
+        if (literal_token == 15) {
+            write_length(block, literals.size() - 15);
+        }
+        block.insert(block.end(), literals.begin(), literals.end());
+        if (match_length == 0) {
+            return;
+        }
+
+        block.push_back(static_cast<std::byte>(offset & 0xff));
+        block.push_back(static_cast<std::byte>(offset >> 8));
+        if (match_token == 15) {
+            write_length(block, match_length - MIN_MATCH - 15);
+        }
+    }
+}
+
+size_t incan_lz4::compress_bound(size_t source_size) {
+    return source_size + source_size / 255 + 16;
+}
+
+std::vector<std::byte> incan_lz4::compress(std::span<const std::byte> source) {
+    std::vector<std::byte> block;
+    block.reserve(compress_bound(source.size()));
+    if (source.size() <= MATCH_FIND_LIMIT) {
+        write_sequence(block, source, 0, 0);
+        return block;
+    }
+
+    // Positions are stored plus one, so zero means empty
+    std::vector<uint32_t> hash_table(size_t{1} << HASH_BITS, 0);
+    const std::byte *bytes = source.data();
+    size_t match_start_limit = source.size() - MATCH_FIND_LIMIT;
+    size_t match_end_limit = source.size() - LAST_LITERALS;
+
+    size_t anchor = 0;
+    size_t position = 0;
+    uint32_t misses = 0;
+    while (position < match_start_limit) {
+        uint32_t sequence = read_u32(bytes + position);
+        uint32_t &slot = hash_table[hash_sequence(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position + 1);
+        if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read_u32(bytes + candidate - 1) != sequence) {
+            position += 1 + (misses++ >> SKIP_STRENGTH);
+            continue;
+        }
+        candidate--;
+        misses = 0;
+
+        // The match may reach back into the literals before it
+        while (position > anchor && candidate > 0 && bytes[position - 1] == bytes[candidate - 1]) {
+            position--;
+            candidate--;
+        }
+        size_t match_length = MIN_MATCH;
+        while (position + match_length < match_end_limit &&
+               bytes[position + match_length] == bytes[candidate + match_length]) {
+            match_length++;
+        }
+
+        write_sequence(block, source.subspan(anchor, position - anchor), match_length, position - candidate);
+        position += match_length;
+        anchor = position;
+    }
+
+    write_sequence(block, source.subspan(anchor), 0, 0);
+    return block;
+}
+
+bool incan_lz4::decompress(std::span<const std::byte> source, std::span<std::byte> destination) {
+    size_t read = 0;
+    size_t written = 0;
+    auto read_length = [&](size_t &length) {
+        uint8_t byte;
+        do {
+            if (read == source.size()) {
+                return false;
+            }
+            byte = static_cast<uint8_t>(source[read++]);
+            length += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (read < source.size()) {
+        auto token = static_cast<uint8_t>(source[read++]);
+
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(literal_count)) {
+            return false;
+        }
+        if (literal_count > source.size() - read || literal_count > destination.size() - written) {
+            return false;
+        }
+        // Whatever the overshoot writes past the literals is written again by what comes after them
+        if (source.size() - read >= literal_count + WIDE_COPY_SIZE &&
+            destination.size() - written >= literal_count + WIDE_COPY_SIZE) {
+            wide_copy(destination.data() + written, source.data() + read, literal_count);
+        } else {
+            std::copy_n(source.data() + read, literal_count, destination.data() + written);
+        }
+        read += literal_count;
+        written += literal_count;
+
+        // Only the last sequence ends without a match
+        if (read == source.size()) {
+            return written == destination.size();
+        }
+
+        if (source.size() - read < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(source[read]) | (static_cast<size_t>(source[read + 1]) << 8);
+        read += 2;
+        size_t match_length = (token & 15) + MIN_MATCH;
+        if ((token & 15) == 15 && !read_length(match_length)) {
+            return false;
+        }
+        if (offset == 0 || offset > written || match_length > destination.size() - written) {
+            return false;
+        }
+
+        // Matches closer than their length repeat the bytes they are still writing, so those go one at a time. Wide
+        // copies only need every step to read bytes already written
+        std::byte *match = destination.data() + written;
+        if (offset >= WIDE_COPY_SIZE && destination.size() - written >= match_length + WIDE_COPY_SIZE) {
+            wide_copy(match, match - offset, match_length);
+        } else if (offset >= match_length) {
+            memcpy(match, match - offset, match_length);
+        } else {
+            for (size_t i = 0; i < match_length; i++) {
+                match[i] = match[i - offset];
+            }
+        }
+        written += match_length;
+    }
+    return false;
+}
+
+size_t incan_lz4::tile_count(size_t decompressed_size) {
+    return (decompressed_size + LZ4_TILE_SIZE - 1) / LZ4_TILE_SIZE;
+}
+
+std::vector<std::byte> incan_lz4::compress_tiles(std::span<const std::byte> source) {
+    size_t count = tile_count(source.size());
+    std::vector<std::byte> stream((count + 1) * sizeof(uint32_t));
+    for (size_t tile = 0; tile < count; tile++) {
+        size_t tile_start = tile * LZ4_TILE_SIZE;
+        std::span<const std::byte> tile_bytes = source.subspan(tile_start,
+                                                               std::min(LZ4_TILE_SIZE, source.size() - tile_start));
+        size_t stored_start = stream.size();
+        std::vector<std::byte> block = compress(tile_bytes);
+        if (block.size() < tile_bytes.size()) {
+            stream.insert(stream.end(), block.begin(), block.end());
+        } else {
+            stream.insert(stream.end(), tile_bytes.begin(), tile_bytes.end());
+        }
+        size_t padding = (sizeof(uint32_t) - stream.size() % sizeof(uint32_t)) % sizeof(uint32_t);
+        stream.resize(stream.size() + padding);
+        write_u32(stream.data() + tile * sizeof(uint32_t), static_cast<uint32_t>(stored_start | padding));
+    }
+    write_u32(stream.data() + count * sizeof(uint32_t), static_cast<uint32_t>(stream.size()));
+    return stream;
+}
+
+bool incan_lz4::tiles_valid(std::span<const std::byte> source, size_t decompressed_size) {
+    size_t count = tile_count(decompressed_size);
+    size_t table_size = (count + 1) * sizeof(uint32_t);
+    if (source.size() < table_size || (read_u32(source.data()) & ~3u) != table_size ||
+        read_u32(source.data() + count * sizeof(uint32_t)) != source.size()) {
+        return false;
+    }
+    for (size_t tile = 0; tile < count; tile++) {
+        uint32_t entry = read_u32(source.data() + tile * sizeof(uint32_t));
+        uint32_t next_start = read_u32(source.data() + (tile + 1) * sizeof(uint32_t)) & ~3u;
+        size_t tile_size = std::min(LZ4_TILE_SIZE, decompressed_size - tile * LZ4_TILE_SIZE);
+        if (next_start < (entry & ~3u) + (entry & 3u) || next_start > source.size() ||
+            next_start - (entry & ~3u) - (entry & 3u) > tile_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool incan_lz4::decompress_tile(std::span<const std::byte> source, size_t tile, std::span<std::byte> destination) {
+    auto [start, end] = tile_range(source, tile);
+    std::span<const std::byte> block = source.subspan(start, end - start);
+    if (block.size() == destination.size()) {
+        std::ranges::copy(block, destination.begin());
+        return true;
+    }
+    return decompress(block, destination);
+}
+
+bool incan_lz4::decompress_tiles(std::span<const std::byte> source, std::span<std::byte> destination,
+                                 size_t max_threads) {
+    if (!tiles_valid(source, destination.size())) {
+        return false;
+    }
+    std::atomic<bool> failed = false;
+    incan_util::parallel_for(tile_count(destination.size()), [&](size_t tile) {
+        size_t tile_start = tile * LZ4_TILE_SIZE;
+        std::span<std::byte> tile_destination = destination.subspan(
+            tile_start, std::min(LZ4_TILE_SIZE, destination.size() - tile_start));
+        if (!decompress_tile(source, tile, tile_destination)) {
+            failed = true;
+        }
+    }, max_threads);
+    return !failed;
+}
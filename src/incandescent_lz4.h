@@ -0,0 +1,47 @@
+#ifndef INCANDESCENT_LZ4_H
+#define INCANDESCENT_LZ4_H
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Decompressed bytes per tile of a tiled stream, what a GPU workgroup expands in its shared memory
+constexpr size_t LZ4_TILE_SIZE = 16 * 1024;
+
+/*
+ * LZ4 block format (no frame, no checksums), compatible with the reference decoder. The compressor does a greedy
+ * search over a single hash table, so it is fast rather than tight. It speeds up through data that doesn't match, so
+ * already compressed data costs little to try. The decoder copies 16 bytes at a time wherever it has room to.
+ *
+ * Tiled streams cut the data into LZ4_TILE_SIZE tiles compressed as blocks of their own, so every tile can be
+ * expanded at once, on threads here or by workgroups of lz4_decompress.comp. A stream starts with a table of
+ * tile_count + 1 uint32 offsets from its start, one per tile and one for the end, and every tile starts on a 4 byte
+ * boundary. Tiles that don't get smaller are stored as they are, a tile whose stored size is its decompressed size
+ * is one of those.
+ */
+namespace incan_lz4 {
+    // Largest block compress() returns for source_size bytes
+    size_t compress_bound(size_t source_size);
+
+    std::vector<std::byte> compress(std::span<const std::byte> source);
+
+    // destination has to be exactly the decompressed size. False if the block is malformed or doesn't fill it
+    bool decompress(std::span<const std::byte> source, std::span<std::byte> destination);
+
+    size_t tile_count(size_t decompressed_size);
+
+    std::vector<std::byte> compress_tiles(std::span<const std::byte> source);
+
+    // Checks the offset table of a stream that decompresses to decompressed_size bytes, not the tiles themselves
+    bool tiles_valid(std::span<const std::byte> source, size_t decompressed_size);
+
+    // Expands one tile of a stream tiles_valid accepted, destination takes exactly that tile's bytes
+    bool decompress_tile(std::span<const std::byte> source, size_t tile, std::span<std::byte> destination);
+
+    // destination has to be exactly the decompressed size, the tiles are split across up to max_threads threads
+    bool decompress_tiles(std::span<const std::byte> source, std::span<std::byte> destination,
+                          size_t max_threads = 1);
+}
+
+
+#endif //INCANDESCENT_LZ4_H
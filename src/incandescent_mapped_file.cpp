@@ -0,0 +1,106 @@
+#include <incandescent_mapped_file.h>
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+#ifdef _WIN32
+        file_handle = std::exchange(other.file_handle, nullptr);
+        mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::filesystem::path &file_path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void *view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr) {
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    file_handle = file;
+    mapping_handle = mapping;
+    data = static_cast<const std::byte *>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int file = ::open(file_path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat file_stat = {};
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    void *view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps its own reference to the file
+    ::close(file);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    // Everything mapped here is read front to back in full, so have the kernel start reading ahead right away
+    posix_madvise(view, static_cast<size_t>(file_stat.st_size), POSIX_MADV_WILLNEED);
+    data = static_cast<const std::byte *>(view);
+    size = static_cast<size_t>(file_stat.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (data == nullptr) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping_handle);
+    CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    munmap(const_cast<std::byte *>(data), size);
+#endif
+
+    data = nullptr;
+    size = 0;
+}
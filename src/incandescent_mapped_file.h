@@ -0,0 +1,38 @@
+#ifndef INCANDESCENT_MAPPED_FILE_H
+#define INCANDESCENT_MAPPED_FILE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+
+/*
+ * Read-only memory mapping of a whole file. The pages are only read from disk as they are touched, so the loader can
+ * copy straight out of them without a read() into a buffer first. Move-only, a copy would unmap the pages twice.
+ * Empty files can't be mapped, open fails for them.
+ */
+struct MappedFile {
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    ~MappedFile();
+
+    bool open(const std::filesystem::path &file_path);
+    void close();
+
+    std::span<const std::byte> bytes() const {
+        return {data, size};
+    }
+
+private:
+    const std::byte *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
+
+
+#endif //INCANDESCENT_MAPPED_FILE_H
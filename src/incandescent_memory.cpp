@@ -0,0 +1,229 @@
+#include <incandescent_memory.h>
+#include <fstream>
+
+const char *allocation_category_name(AllocationCategory category) {
+    switch (category) {
+        case AllocationCategory::RenderTarget:
+            return "render_target";
+        case AllocationCategory::Buffer:
+            return "buffer";
+        case AllocationCategory::Texture:
+            return "texture";
+        case AllocationCategory::Staging:
+            return "staging";
+        default:
+            return "unknown";
+    }
+}
+
+void MemoryTelemetry::initialize(VmaAllocator vma_allocator, bool use_memory_budget) {
+    allocator = vma_allocator;
+    memory_budget_enabled = use_memory_budget;
+
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(allocator, &memory_properties);
+    heap_budgets.resize(memory_properties->memoryHeapCount);
+
+    update(0);
+}
+
+void MemoryTelemetry::track(VmaAllocation allocation, AllocationCategory category) {
+    if (allocation == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // Shows up in vmaBuildStatsString and in the validation layers' memory reports
+    vmaSetAllocationName(allocator, allocation, allocation_category_name(category));
+
+    VmaAllocationInfo allocation_info;
+    vmaGetAllocationInfo(allocator, allocation, &allocation_info);
+
+    std::lock_guard lock(tracking_mutex);
+    tracked_allocations[allocation] = {category, allocation_info.size};
+
+    AllocationCategoryTotals &totals = category_totals[static_cast<size_t>(category)];
+    totals.bytes += allocation_info.size;
+    totals.allocation_count++;
+}
+
+void MemoryTelemetry::untrack(VmaAllocation allocation) {
+    std::lock_guard lock(tracking_mutex);
+    auto tracked = tracked_allocations.find(allocation);
+    if (tracked == tracked_allocations.end()) {
+        return;
+    }
+
+    AllocationCategoryTotals &totals = category_totals[static_cast<size_t>(tracked->second.category)];
+    totals.bytes -= tracked->second.size;
+    totals.allocation_count--;
+
+    tracked_allocations.erase(tracked);
+}
+
+void MemoryTelemetry::update(uint32_t frame_index) {
+    // Lets VMA attribute budget queries to the frame, it only re-fetches the budget from the driver every few frames
+    last_frame_index = frame_index;
+    vmaSetCurrentFrameIndex(allocator, frame_index);
+    vmaGetHeapBudgets(allocator, heap_budgets.data());
+}
+
+bool MemoryTelemetry::write_json_snapshot(const char *file_path) {
+    std::ofstream snapshot_file(file_path);
+    if (!snapshot_file.is_open()) {
+        return false;
+    }
+
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(allocator, &memory_properties);
+
+    VmaTotalStatistics total_statistics;
+    vmaCalculateStatistics(allocator, &total_statistics);
+
+    snapshot_file << "{\n";
+    snapshot_file << fmt::format("  \"frame\": {},\n", last_frame_index);
+    snapshot_file << fmt::format("  \"memory_budget_extension\": {},\n", memory_budget_enabled);
+
+    // Per-heap usage and budget
+    snapshot_file << "  \"heaps\": [\n";
+    for (uint32_t i = 0; i < heap_budgets.size(); i++) {
+        const VmaBudget &budget = heap_budgets[i];
+        const VkMemoryHeap &heap = memory_properties->memoryHeaps[i];
+        snapshot_file << fmt::format(
+            "    {{\"index\": {}, \"device_local\": {}, \"size\": {}, \"budget\": {}, \"usage\": {}, "
+            "\"block_count\": {}, \"block_bytes\": {}, \"allocation_count\": {}, \"allocation_bytes\": {}}}{}\n",
+            i, (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0, heap.size, budget.budget, budget.usage,
+            budget.statistics.blockCount, budget.statistics.blockBytes, budget.statistics.allocationCount,
+            budget.statistics.allocationBytes, i + 1 < heap_budgets.size() ? "," : "");
+    }
+    snapshot_file << "  ],\n";
+
+    // Per-category totals
+    snapshot_file << "  \"categories\": {\n";
+    {
+        std::lock_guard lock(tracking_mutex);
+        for (size_t i = 0; i < ALLOCATION_CATEGORY_COUNT; i++) {
+            snapshot_file << fmt::format("    \"{}\": {{\"bytes\": {}, \"allocation_count\": {}}}{}\n",
+                                         allocation_category_name(static_cast<AllocationCategory>(i)),
+                                         category_totals[i].bytes, category_totals[i].allocation_count,
+                                         i + 1 < ALLOCATION_CATEGORY_COUNT ? "," : "");
+        }
+    }
+    snapshot_file << "  },\n";
+
+    snapshot_file << fmt::format(
+        "  \"total\": {{\"block_count\": {}, \"block_bytes\": {}, \"allocation_count\": {}, "
+        "\"allocation_bytes\": {}, \"unused_range_count\": {}}},\n",
+        total_statistics.total.statistics.blockCount, total_statistics.total.statistics.blockBytes,
+        total_statistics.total.statistics.allocationCount, total_statistics.total.statistics.allocationBytes,
+        total_statistics.total.unusedRangeCount);
+
+    // VMA's own dump is already JSON, so it is embedded as-is
+    char *vma_stats_string = nullptr;
+    vmaBuildStatsString(allocator, &vma_stats_string, VK_TRUE);
+    snapshot_file << "  \"vma\": " << vma_stats_string << "\n";
+    vmaFreeStatsString(allocator, vma_stats_string);
+
+    snapshot_file << "}\n";
+    snapshot_file.close();
+
+    return true;
+}
+
+void MemoryDefragmenter::initialize(VmaAllocator vma_allocator, VkDeviceSize bytes_per_pass, uint32_t moves_per_pass) {
+    allocator = vma_allocator;
+    max_bytes_per_pass = bytes_per_pass;
+    max_moves_per_pass = moves_per_pass;
+}
+
+bool MemoryDefragmenter::is_fragmented(float max_unused_fraction) const {
+    VmaTotalStatistics total_statistics;
+    vmaCalculateStatistics(allocator, &total_statistics);
+
+    // Only device local memory counts, staging and readback churn in host visible blocks isn't worth a run. On
+    // unified memory every device local type is host visible as well, then those are all there is to count
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(allocator, &memory_properties);
+    auto device_only = [&](uint32_t type) {
+        VkMemoryPropertyFlags flags = memory_properties->memoryTypes[type].propertyFlags;
+        return (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0 && (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) == 0;
+    };
+    bool has_device_only = false;
+    for (uint32_t type = 0; type < memory_properties->memoryTypeCount; type++) {
+        has_device_only |= device_only(type);
+    }
+
+    VkDeviceSize block_bytes = 0;
+    VkDeviceSize allocation_bytes = 0;
+    for (uint32_t type = 0; type < memory_properties->memoryTypeCount; type++) {
+        VkMemoryPropertyFlags flags = memory_properties->memoryTypes[type].propertyFlags;
+        if (has_device_only ? device_only(type) : (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0) {
+            block_bytes += total_statistics.memoryType[type].statistics.blockBytes;
+            allocation_bytes += total_statistics.memoryType[type].statistics.allocationBytes;
+        }
+    }
+    if (block_bytes == 0) {
+        return false;
+    }
+
+    VkDeviceSize unused_bytes = block_bytes - allocation_bytes;
+    return static_cast<float>(unused_bytes) > static_cast<float>(block_bytes) * max_unused_fraction;
+}
+
+void MemoryDefragmenter::begin() {
+    if (is_running()) {
+        return;
+    }
+
+    // Fast algorithm, the per pass budget is what keeps the frame cost down, not the quality of the packing
+    VmaDefragmentationInfo defragmentation_info = {};
+    defragmentation_info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT;
+    defragmentation_info.pool = VK_NULL_HANDLE;
+    defragmentation_info.maxBytesPerPass = max_bytes_per_pass;
+    defragmentation_info.maxAllocationsPerPass = max_moves_per_pass;
+
+    VK_CHECK(vmaBeginDefragmentation(allocator, &defragmentation_info, &context));
+}
+
+std::span<VmaDefragmentationMove> MemoryDefragmenter::begin_pass(uint64_t frame_number) {
+    pass_info = {};
+    VkResult result = vmaBeginDefragmentationPass(allocator, context, &pass_info);
+
+    // VK_SUCCESS means there is nothing left to move, VK_INCOMPLETE hands out the moves of this pass
+    if (result == VK_SUCCESS) {
+        end_run();
+        return {};
+    }
+    if (result != VK_INCOMPLETE) {
+        VK_CHECK(result);
+    }
+
+    pass_active = true;
+    pass_frame = frame_number;
+
+    return {pass_info.pMoves, pass_info.moveCount};
+}
+
+void MemoryDefragmenter::end_pass() {
+    VkResult result = vmaEndDefragmentationPass(allocator, context, &pass_info);
+    pass_active = false;
+    pass_info = {};
+
+    if (result == VK_SUCCESS) {
+        end_run();
+    }
+}
+
+void MemoryDefragmenter::destroy() {
+    if (is_running()) {
+        end_run();
+    }
+}
+
+void MemoryDefragmenter::end_run() {
+    vmaEndDefragmentation(allocator, context, &last_run_stats);
+    context = VK_NULL_HANDLE;
+
+    fmt::print("Defragmentation moved {} allocations ({} bytes), released {} blocks ({} bytes)\n",
+               last_run_stats.allocationsMoved, last_run_stats.bytesMoved, last_run_stats.deviceMemoryBlocksFreed,
+               last_run_stats.bytesFreed);
+}
@@ -0,0 +1,111 @@
+#ifndef INCANDESCENT_MEMORY_H
+#define INCANDESCENT_MEMORY_H
+
+#include <incandescent_types.h>
+#include <mutex>
+#include <unordered_map>
+
+// Categories used to tag every VMA allocation the engine makes
+enum class AllocationCategory : uint32_t {
+    RenderTarget,
+    Buffer,
+    Texture,
+    Staging,
+    Count
+};
+
+constexpr size_t ALLOCATION_CATEGORY_COUNT = static_cast<size_t>(AllocationCategory::Count);
+
+const char *allocation_category_name(AllocationCategory category);
+
+struct AllocationCategoryTotals {
+    VkDeviceSize bytes = 0;
+    uint32_t allocation_count = 0;
+};
+
+/*
+ * Tracks VRAM use through VMA. Heap usage/budget is refreshed once per frame with vmaGetHeapBudgets (backed by
+ * VK_EXT_memory_budget when the device has it), category totals are kept up to date on every track/untrack.
+ */
+struct MemoryTelemetry {
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    bool memory_budget_enabled = false;
+
+    // One entry per memory heap, refreshed by update()
+    std::vector<VmaBudget> heap_budgets;
+    std::array<AllocationCategoryTotals, ALLOCATION_CATEGORY_COUNT> category_totals = {};
+
+    void initialize(VmaAllocator vma_allocator, bool use_memory_budget);
+
+    // Names the allocation after its category and adds it to the category totals
+    void track(VmaAllocation allocation, AllocationCategory category);
+
+    // Must be called before the allocation is freed
+    void untrack(VmaAllocation allocation);
+
+    // Advances VMA's frame index and refreshes the heap budgets, call once per frame
+    void update(uint32_t frame_index);
+
+    // Writes heap budgets, category totals and the full vmaBuildStatsString output as one JSON document
+    bool write_json_snapshot(const char *file_path);
+
+private:
+    struct TrackedAllocation {
+        AllocationCategory category;
+        VkDeviceSize size;
+    };
+
+    // Allocations can be made from loader threads, so tracking is guarded
+    std::mutex tracking_mutex;
+    std::unordered_map<VmaAllocation, TrackedAllocation> tracked_allocations;
+    uint32_t last_frame_index = 0;
+};
+
+/*
+ * Incremental VMA defragmentation. A run is started with begin(), then one pass is handed out at a time, each capped
+ * at max_bytes_per_pass/max_moves_per_pass. The caller recreates every moved resource in the destination memory and
+ * records the copies, and only ends the pass once the frame holding those copies has retired. The engine only has a
+ * graphics queue, so the copies go at the start of the frame's command buffer, the per pass caps are what bound their
+ * cost.
+ */
+struct MemoryDefragmenter {
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    VmaDefragmentationContext context = VK_NULL_HANDLE;
+    VmaDefragmentationPassMoveInfo pass_info = {};
+    bool pass_active = false;
+    uint64_t pass_frame = 0;
+
+    // Per pass budget, picked up the next time a run begins
+    VkDeviceSize max_bytes_per_pass = 0;
+    uint32_t max_moves_per_pass = 0;
+
+    // Totals of the last finished run
+    VmaDefragmentationStats last_run_stats = {};
+
+    void initialize(VmaAllocator vma_allocator, VkDeviceSize bytes_per_pass, uint32_t moves_per_pass);
+
+    bool is_running() const {
+        return context != VK_NULL_HANDLE;
+    }
+
+    // True if more than max_unused_fraction of the allocated device local (not host visible) blocks is free space
+    bool is_fragmented(float max_unused_fraction) const;
+
+    void begin();
+
+    // Starts the next pass, the moves stay valid until end_pass. Empty (and the run is over) once VMA has nothing
+    // left to move
+    std::span<VmaDefragmentationMove> begin_pass(uint64_t frame_number);
+
+    // Commits the moves of the current pass, ends the run when VMA reports it is done
+    void end_pass();
+
+    // Ends an unfinished run, any active pass must already have been ended
+    void destroy();
+
+private:
+    void end_run();
+};
+
+
+#endif //INCANDESCENT_MEMORY_H
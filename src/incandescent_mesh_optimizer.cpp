@@ -0,0 +1,371 @@
+#include <incandescent_mesh_optimizer.h>
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace {
+    // Forsyth's scoring: the three most recent vertices get a flat score so the next triangle doesn't just reuse the
+    // last edge, older ones decay with their cache position, and vertices with few triangles left get a boost so they
+    // are finished off instead of leaving stragglers for later
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+    constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+
+    float vertex_score(int32_t cache_position, uint32_t remaining_triangles) {
+        if (remaining_triangles == 0) {
+            return -1.0f;
+        }
+
+        float score = 0.0f;
+        if (cache_position >= 0) {
+            if (cache_position < 3) {
+                score = LAST_TRIANGLE_SCORE;
+            } else {
+                float decay = 1.0f - static_cast<float>(cache_position - 3) /
+                                     static_cast<float>(incan_mesh::VERTEX_CACHE_SIZE - 3);
+                score = std::pow(decay, CACHE_DECAY_POWER);
+            }
+        }
+        return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangles), -VALENCE_BOOST_POWER);
+    }
+
+    // FIFO cache tracked with timestamps: a vertex is still cached if fewer than cache_size misses happened since it
+    // was loaded. Flushing is just skipping the clock ahead
+    struct FifoCache {
+        FifoCache(size_t vertex_count, uint32_t size) : timestamps(vertex_count, 0), cache_size(size),
+                                                        timestamp(size + 1) {
+        }
+
+        uint32_t add_triangle(const uint32_t *triangle) {
+            uint32_t misses = 0;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = triangle[corner];
+                if (timestamp - timestamps[vertex] > cache_size) {
+                    timestamps[vertex] = timestamp++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        void flush() {
+            timestamp += cache_size + 1;
+        }
+
+        std::vector<uint32_t> timestamps;
+        uint32_t cache_size;
+        uint32_t timestamp;
+    };
+
+    Eigen::Vector2f octahedral_encode(const Eigen::Vector3f &normal) {
+        float length = normal.cwiseAbs().sum();
+        if (length < FLT_MIN) {
+            return Eigen::Vector2f::Zero();
+        }
+        Eigen::Vector3f projected = normal / length;
+        auto sign = [](float value) {
+            return value >= 0.0f ? 1.0f : -1.0f;
+        };
+        // The lower half folds over the diagonals onto the corners of the square
+        if (projected.z() < 0.0f) {
+            return {(1.0f - std::abs(projected.y())) * sign(projected.x()),
+                    (1.0f - std::abs(projected.x())) * sign(projected.y())};
+        }
+        return projected.head<2>();
+    }
+
+    int16_t quantize_snorm16(float value) {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    uint8_t quantize_unorm8(float value) {
+        return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    uint16_t half_bits(float value) {
+        Eigen::half half_value(value);
+        uint16_t bits;
+        memcpy(&bits, &half_value, sizeof(bits));
+        return bits;
+    }
+}
+
+void incan_mesh::optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertex_count) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count < 2) {
+        return;
+    }
+
+    /* -------- Triangles around each vertex -------- */
+    std::vector<uint32_t> remaining_triangles(vertex_count, 0);
+    for (size_t i = 0; i < triangle_count * 3; i++) {
+        remaining_triangles[indices[i]]++;
+    }
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (uint32_t vertex = 0; vertex < vertex_count; vertex++) {
+        adjacency_offsets[vertex + 1] = adjacency_offsets[vertex] + remaining_triangles[vertex];
+    }
+    std::vector<uint32_t> adjacency(triangle_count * 3);
+    std::vector<uint32_t> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (size_t i = 0; i < triangle_count * 3; i++) {
+        adjacency[adjacency_fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int32_t> cache_positions(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (uint32_t vertex = 0; vertex < vertex_count; vertex++) {
+        vertex_scores[vertex] = vertex_score(-1, remaining_triangles[vertex]);
+    }
+    auto score_triangle = [&](uint32_t triangle) {
+        return vertex_scores[indices[triangle * 3]] + vertex_scores[indices[triangle * 3 + 1]] +
+               vertex_scores[indices[triangle * 3 + 2]];
+    };
+    std::vector<float> triangle_scores(triangle_count);
+    for (uint32_t triangle = 0; triangle < triangle_count; triangle++) {
+        triangle_scores[triangle] = score_triangle(triangle);
+    }
+
+    /* -------- Emit the best scoring triangle around the cache, one at a time -------- */
+    std::vector<uint32_t> ordered_indices;
+    ordered_indices.reserve(triangle_count * 3);
+    std::vector<bool> emitted(triangle_count, false);
+    std::array<uint32_t, VERTEX_CACHE_SIZE + 3> cache;
+    std::array<uint32_t, VERTEX_CACHE_SIZE + 3> next_cache;
+    uint32_t cache_count = 0;
+    size_t input_cursor = 0;
+
+    auto best = std::ranges::max_element(triangle_scores);
+    uint32_t best_triangle = static_cast<uint32_t>(best - triangle_scores.begin());
+    while (ordered_indices.size() < triangle_count * 3) {
+        // Nothing left around the cache, carry on with the first triangle left in input order
+        if (best_triangle == NO_TRIANGLE) {
+            while (emitted[input_cursor]) {
+                input_cursor++;
+            }
+            best_triangle = static_cast<uint32_t>(input_cursor);
+        }
+
+        const uint32_t *triangle = &indices[best_triangle * 3];
+        emitted[best_triangle] = true;
+        ordered_indices.insert(ordered_indices.end(), triangle, triangle + 3);
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            uint32_t vertex = triangle[corner];
+            uint32_t *first = &adjacency[adjacency_offsets[vertex]];
+            uint32_t *last = first + remaining_triangles[vertex];
+            *std::find(first, last, best_triangle) = *(last - 1);
+            remaining_triangles[vertex]--;
+        }
+
+        // The triangle's vertices go to the front, everything else moves back and falls off past VERTEX_CACHE_SIZE
+        uint32_t next_count = 0;
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            if (std::find(next_cache.begin(), next_cache.begin() + next_count, triangle[corner]) ==
+                next_cache.begin() + next_count) {
+                next_cache[next_count++] = triangle[corner];
+            }
+        }
+        for (uint32_t i = 0; i < cache_count; i++) {
+            if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2]) {
+                next_cache[next_count++] = cache[i];
+            }
+        }
+
+        for (uint32_t i = 0; i < next_count; i++) {
+            uint32_t vertex = next_cache[i];
+            cache_positions[vertex] = i < VERTEX_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+            vertex_scores[vertex] = vertex_score(cache_positions[vertex], remaining_triangles[vertex]);
+        }
+
+        // Only triangles touching a vertex whose score changed can have a new score
+        best_triangle = NO_TRIANGLE;
+        float best_score = -FLT_MAX;
+        for (uint32_t i = 0; i < next_count; i++) {
+            uint32_t vertex = next_cache[i];
+            for (uint32_t j = 0; j < remaining_triangles[vertex]; j++) {
+                uint32_t adjacent_triangle = adjacency[adjacency_offsets[vertex] + j];
+                triangle_scores[adjacent_triangle] = score_triangle(adjacent_triangle);
+                if (triangle_scores[adjacent_triangle] > best_score) {
+                    best_score = triangle_scores[adjacent_triangle];
+                    best_triangle = adjacent_triangle;
+                }
+            }
+        }
+
+        cache_count = std::min(next_count, VERTEX_CACHE_SIZE);
+        std::copy_n(next_cache.begin(), cache_count, cache.begin());
+    }
+
+    std::ranges::copy(ordered_indices, indices.begin());
+}
+
+void incan_mesh::optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count < 2) {
+        return;
+    }
+
+    /* -------- Hard boundaries, where the cache order misses on all three vertices anyway -------- */
+    FifoCache cache(vertices.size(), OVERDRAW_CACHE_SIZE);
+    std::vector<size_t> hard_boundaries;
+    for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+        if (cache.add_triangle(&indices[triangle * 3]) == 3 || triangle == 0) {
+            hard_boundaries.push_back(triangle);
+        }
+    }
+
+    /* -------- Soft boundaries, wherever a cluster is already within threshold of its hard cluster -------- */
+    std::vector<size_t> cluster_starts;
+    for (size_t hard_cluster = 0; hard_cluster < hard_boundaries.size(); hard_cluster++) {
+        size_t start = hard_boundaries[hard_cluster];
+        size_t end = hard_cluster + 1 < hard_boundaries.size() ? hard_boundaries[hard_cluster + 1] : triangle_count;
+
+        cache.flush();
+        uint32_t cluster_misses = 0;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            cluster_misses += cache.add_triangle(&indices[triangle * 3]);
+        }
+        float cluster_threshold = threshold * static_cast<float>(cluster_misses) / static_cast<float>(end - start);
+
+        size_t first_cluster = cluster_starts.size();
+        cluster_starts.push_back(start);
+        cache.flush();
+        uint32_t running_misses = 0;
+        uint32_t running_triangles = 0;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            running_misses += cache.add_triangle(&indices[triangle * 3]);
+            running_triangles++;
+            if (static_cast<float>(running_misses) / static_cast<float>(running_triangles) <= cluster_threshold) {
+                cluster_starts.push_back(triangle + 1);
+                cache.flush();
+                running_misses = 0;
+                running_triangles = 0;
+            }
+        }
+        // The tail after the last split is whatever was left over and usually small, it joins the cluster before it
+        if (cluster_starts.size() > first_cluster + 1) {
+            cluster_starts.pop_back();
+        }
+    }
+
+    /* -------- Sort the clusters, the ones facing away from the middle of the surface first -------- */
+    auto triangle_position = [&](size_t triangle, uint32_t corner) {
+        return vertices[indices[triangle * 3 + corner]].position;
+    };
+
+    Eigen::Vector3f surface_centroid = Eigen::Vector3f::Zero();
+    float surface_area = 0.0f;
+    for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+        Eigen::Vector3f a = triangle_position(triangle, 0);
+        Eigen::Vector3f b = triangle_position(triangle, 1);
+        Eigen::Vector3f c = triangle_position(triangle, 2);
+        float area = (b - a).cross(c - a).norm();
+        surface_centroid += (a + b + c) / 3.0f * area;
+        surface_area += area;
+    }
+    if (surface_area > 0.0f) {
+        surface_centroid /= surface_area;
+    }
+
+    std::vector<float> cluster_keys(cluster_starts.size(), 0.0f);
+    for (size_t cluster = 0; cluster < cluster_starts.size(); cluster++) {
+        size_t end = cluster + 1 < cluster_starts.size() ? cluster_starts[cluster + 1] : triangle_count;
+        Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+        Eigen::Vector3f normal = Eigen::Vector3f::Zero();
+        float area = 0.0f;
+        for (size_t triangle = cluster_starts[cluster]; triangle < end; triangle++) {
+            Eigen::Vector3f a = triangle_position(triangle, 0);
+            Eigen::Vector3f b = triangle_position(triangle, 1);
+            Eigen::Vector3f c = triangle_position(triangle, 2);
+            // Unnormalized, so bigger triangles count for more in both sums
+            Eigen::Vector3f face_normal = (b - a).cross(c - a);
+            float face_area = face_normal.norm();
+            centroid += (a + b + c) / 3.0f * face_area;
+            normal += face_normal;
+            area += face_area;
+        }
+        if (area > 0.0f && normal.norm() > 0.0f) {
+            cluster_keys[cluster] = (centroid / area - surface_centroid).dot(normal.normalized());
+        }
+    }
+
+    std::vector<size_t> cluster_order(cluster_starts.size());
+    std::iota(cluster_order.begin(), cluster_order.end(), 0);
+    std::ranges::stable_sort(cluster_order, std::ranges::greater(), [&](size_t cluster) {
+        return cluster_keys[cluster];
+    });
+
+    std::vector<uint32_t> ordered_indices;
+    ordered_indices.reserve(triangle_count * 3);
+    for (size_t cluster: cluster_order) {
+        size_t end = cluster + 1 < cluster_starts.size() ? cluster_starts[cluster + 1] : triangle_count;
+        ordered_indices.insert(ordered_indices.end(), indices.begin() + cluster_starts[cluster] * 3,
+                               indices.begin() + end * 3);
+    }
+    std::ranges::copy(ordered_indices, indices.begin());
+}
+
+void incan_mesh::optimize_vertex_fetch(std::span<Vertex> vertices, std::span<uint32_t> indices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    uint32_t next_vertex = 0;
+    for (uint32_t &index: indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = next_vertex++;
+        }
+        index = remap[index];
+    }
+    for (uint32_t &new_vertex: remap) {
+        if (new_vertex == UINT32_MAX) {
+            new_vertex = next_vertex++;
+        }
+    }
+
+    std::vector<Vertex> reordered(vertices.size());
+    for (size_t vertex = 0; vertex < vertices.size(); vertex++) {
+        reordered[remap[vertex]] = vertices[vertex];
+    }
+    std::ranges::copy(reordered, vertices.begin());
+}
+
+float incan_mesh::average_cache_miss_ratio(std::span<const uint32_t> indices, uint32_t vertex_count,
+                                           uint32_t cache_size) {
+    size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0) {
+        return 0.0f;
+    }
+
+    FifoCache cache(vertex_count, cache_size);
+    size_t misses = 0;
+    for (size_t triangle = 0; triangle < triangle_count; triangle++) {
+        misses += cache.add_triangle(&indices[triangle * 3]);
+    }
+    return static_cast<float>(misses) / static_cast<float>(triangle_count);
+}
+
+PackedVertex incan_mesh::pack_vertex(const Vertex &vertex, const Eigen::Vector3f &position_offset,
+                                     const Eigen::Vector3f &position_scale) {
+    PackedVertex packed = {};
+    if constexpr (QUANTIZE_POSITIONS) {
+        for (int axis = 0; axis < 3; axis++) {
+            // A flat axis has every vertex on the offset, any scale decodes it
+            float scale = position_scale[axis] > 0.0f ? position_scale[axis] : 1.0f;
+            packed.position[axis] = quantize_snorm16((vertex.position[axis] - position_offset[axis]) / scale);
+        }
+    } else {
+        for (int axis = 0; axis < 3; axis++) {
+            packed.position[axis] = vertex.position[axis];
+        }
+    }
+
+    Eigen::Vector2f normal = octahedral_encode(vertex.normal);
+    packed.normal = {quantize_snorm16(normal.x()), quantize_snorm16(normal.y())};
+    packed.uv = {half_bits(vertex.uv_x), half_bits(vertex.uv_y)};
+    packed.color = {
+        quantize_unorm8(vertex.color.x()), quantize_unorm8(vertex.color.y()), quantize_unorm8(vertex.color.z()),
+        quantize_unorm8(vertex.color.w())
+    };
+    return packed;
+}
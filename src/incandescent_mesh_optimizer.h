@@ -0,0 +1,39 @@
+#ifndef INCANDESCENT_MESH_OPTIMIZER_H
+#define INCANDESCENT_MESH_OPTIMIZER_H
+
+#include <incandescent_loader.h>
+
+/*
+ * Import-time triangle and vertex ordering. The passes are meant to run in order on each surface:
+ *   1. optimize_vertex_cache: Forsyth's greedy triangle order, so the post-transform cache catches most repeats
+ *   2. optimize_overdraw: cuts that order into clusters where the cache restarts anyway and sorts the clusters
+ *      outward-facing first (Sander, Nehab and Barczak), so most views draw occluders before what they hide
+ *   3. optimize_vertex_fetch: renumbers vertices in first use order, so vertex fetch walks memory front to back
+ * Indices are local to the span of vertices passed in.
+ */
+namespace incan_mesh {
+    // Sizes the passes model, a bit smaller than what current GPUs reuse so the order holds up across vendors
+    constexpr uint32_t VERTEX_CACHE_SIZE = 32;
+    constexpr uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+    void optimize_vertex_cache(std::span<uint32_t> indices, uint32_t vertex_count);
+
+    // threshold is how much worse than the cache-optimal order (in misses per triangle) a cluster may get, bigger
+    // values allow more, smaller clusters and so better sorting
+    void optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex> vertices, float threshold = 1.05f);
+
+    // Reorders vertices and rewrites indices to match. Vertices no index refers to keep their order after the rest
+    void optimize_vertex_fetch(std::span<Vertex> vertices, std::span<uint32_t> indices);
+
+    // Misses per triangle of a FIFO cache of cache_size vertices, 0.5 is about the best a regular grid can do and 3
+    // the worst
+    float average_cache_miss_ratio(std::span<const uint32_t> indices, uint32_t vertex_count,
+                                   uint32_t cache_size = OVERDRAW_CACHE_SIZE);
+
+    // position_offset and position_scale are the mesh's, only used with QUANTIZE_POSITIONS
+    PackedVertex pack_vertex(const Vertex &vertex, const Eigen::Vector3f &position_offset,
+                             const Eigen::Vector3f &position_scale);
+}
+
+
+#endif //INCANDESCENT_MESH_OPTIMIZER_H
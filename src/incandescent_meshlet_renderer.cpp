@@ -0,0 +1,617 @@
+#include <incandescent_meshlet_renderer.h>
+#include <incandescent_images.h>
+#include <incandescent_pipelines.h>
+#include <incan_struct_init.h>
+#include <volk.h>
+
+namespace {
+    // Instances each instance_cull.comp workgroup tests
+    constexpr uint32_t INSTANCE_CULL_WORKGROUP_SIZE = 64;
+    // The smallest maxComputeWorkGroupCount and maxTaskWorkGroupCount a device can have in each dimension
+    constexpr uint32_t MAX_WORKGROUPS_PER_DIMENSION = 65535;
+    constexpr VkShaderStageFlags MESH_PUSH_CONSTANT_STAGES = VK_SHADER_STAGE_TASK_BIT_EXT |
+                                                             VK_SHADER_STAGE_MESH_BIT_EXT;
+    constexpr VkShaderStageFlags VERTEX_PUSH_CONSTANT_STAGES = VK_SHADER_STAGE_VERTEX_BIT;
+
+    static_assert(sizeof(MeshletViewData) == 176, "MeshletViewData has to match ViewData in the shaders");
+    static_assert(sizeof(MeshletDrawInstance) == 144, "MeshletDrawInstance has to match DrawInstance in the shaders");
+    static_assert(sizeof(MeshletSceneInstance) == 80, "MeshletSceneInstance has to match SceneInstance in the shaders");
+    static_assert(sizeof(MeshletMeshData) == 144, "MeshletMeshData has to match MeshData in the shaders");
+    static_assert(sizeof(MeshletCullCounters) == 32, "MeshletCullCounters has to match the shaders' counter words");
+    static_assert(sizeof(MeshletCullCounters) <= CULL_COUNTER_REGION_SIZE);
+
+    void memory_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags2 src_stage_mask,
+                        VkAccessFlags2 src_access_mask, VkPipelineStageFlags2 dst_stage_mask,
+                        VkAccessFlags2 dst_access_mask) {
+        VkMemoryBarrier2 barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+        barrier.pNext = nullptr;
+        barrier.srcStageMask = src_stage_mask;
+        barrier.srcAccessMask = src_access_mask;
+        barrier.dstStageMask = dst_stage_mask;
+        barrier.dstAccessMask = dst_access_mask;
+
+        VkDependencyInfo dependency_info = {};
+        dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependency_info.pNext = nullptr;
+        dependency_info.memoryBarrierCount = 1;
+        dependency_info.pMemoryBarriers = &barrier;
+
+        vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+    }
+
+    // Nothing if the shader can't be loaded
+    std::optional<PipelineHandle> create_compute_pipeline(VkDevice device, ResourceManager &resources,
+                                                          const char *file_path, VkPipelineLayout layout) {
+        VkShaderModule shader_module = VK_NULL_HANDLE;
+        if (!incan_util::load_shader_module(file_path, device, &shader_module)) {
+            fmt::print("Error when building shader {}\n", file_path);
+            return std::nullopt;
+        }
+
+        VkPipelineShaderStageCreateInfo shader_stage_create_info = {};
+        shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shader_stage_create_info.pNext = nullptr;
+        shader_stage_create_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        shader_stage_create_info.module = shader_module;
+        shader_stage_create_info.pName = "main";
+
+        VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+        compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        compute_pipeline_create_info.pNext = nullptr;
+        compute_pipeline_create_info.layout = layout;
+        compute_pipeline_create_info.stage = shader_stage_create_info;
+
+        VkPipeline compute_pipeline;
+        VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr,
+            &compute_pipeline));
+        vkDestroyShaderModule(device, shader_module, nullptr);
+        return resources.add_pipeline(compute_pipeline, layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+    }
+
+    // Rows of at most MAX_WORKGROUPS_PER_DIMENSION, the shaders number the workgroups row by row
+    VkExtent2D workgroup_grid(uint32_t workgroup_count) {
+        return {std::min(workgroup_count, MAX_WORKGROUPS_PER_DIMENSION),
+                (workgroup_count + MAX_WORKGROUPS_PER_DIMENSION - 1) / MAX_WORKGROUPS_PER_DIMENSION};
+    }
+
+    // Which of a scene's counters, work items and draw commands a pass uses, the single pass shares the early one's
+    uint32_t cull_region(CullPass pass) {
+        return pass == CullPass::Late ? 1 : 0;
+    }
+}
+
+void MeshletRenderer::initialize(VkDevice vulkan_device, DescriptorLayoutCache &layout_cache,
+                                 GraphicsPipelineCache &pipeline_cache, ResourceManager &resource_manager,
+                                 MipGenerator &generator, bool device_supports_mesh_shaders,
+                                 bool device_supports_int64,
+                                 bool device_supports_multi_draw_indirect, bool device_supports_draw_indirect_count,
+                                 VkFormat color_format, VkFormat depth_format) {
+    device = vulkan_device;
+    resources = &resource_manager;
+    mip_generator = &generator;
+
+    // Every shader here loads 64-bit buffer addresses out of its push constants
+    if (!device_supports_int64) {
+        fmt::print("Device has no 64-bit shader integers, meshes won't be drawn\n");
+        return;
+    }
+
+    /* -------- Instance culling -------- */
+    // The counters are the only thing written with atomics, so the only thing that can't go through an address. The
+    // late pass tests against the depth pyramid
+    DescriptorLayoutBuilder descriptor_layout_builder;
+    descriptor_layout_builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_layout_builder.add_binding(1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    instance_cull_descriptor_set_layout = descriptor_layout_builder.build(layout_cache, device,
+                                                                          VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkPushConstantRange instance_cull_push_constant_range = {};
+    instance_cull_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    instance_cull_push_constant_range.offset = 0;
+    instance_cull_push_constant_range.size = sizeof(InstanceCullPushConstants);
+
+    std::optional<PipelineHandle> instance_cull = create_compute_pipeline(
+        device, *resources, "shaders/instance_cull.comp.spv",
+        layout_cache.get_pipeline_layout(device, {&instance_cull_descriptor_set_layout, 1},
+                                         {&instance_cull_push_constant_range, 1}));
+    if (!instance_cull.has_value()) {
+        return;
+    }
+    instance_cull_pipeline = instance_cull.value();
+
+    // Opaque triangles into one color and one depth attachment. There is no vertex input, the shaders pull their own
+    // vertices
+    PipelineBuilder pipeline_builder;
+    pipeline_builder.add_color_attachment_format(color_format);
+    pipeline_builder.set_depth_format(depth_format);
+    // Reversed depth, 1 at the near plane and 0 at infinity
+    pipeline_builder.enable_depth_test(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+
+    /* -------- Mesh shader path -------- */
+    if (device_supports_mesh_shaders) {
+        VkPushConstantRange push_constant_range = {};
+        push_constant_range.stageFlags = MESH_PUSH_CONSTANT_STAGES;
+        push_constant_range.offset = 0;
+        push_constant_range.size = sizeof(MeshletPushConstants);
+
+        // The task shader tests meshlets against the depth pyramid
+        descriptor_layout_builder.clear();
+        descriptor_layout_builder.add_binding(0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+        mesh_descriptor_set_layout = descriptor_layout_builder.build(layout_cache, device,
+                                                                     VK_SHADER_STAGE_TASK_BIT_EXT);
+
+        // No culling, the mesh shader backface tests with the instance's mirroring known
+        PipelineBuilder mesh_pipeline_builder = pipeline_builder;
+        mesh_pipeline_builder.add_shader_stage(VK_SHADER_STAGE_TASK_BIT_EXT, "shaders/meshlet.task.spv");
+        mesh_pipeline_builder.add_shader_stage(VK_SHADER_STAGE_MESH_BIT_EXT, "shaders/meshlet.mesh.spv");
+        mesh_pipeline_builder.add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/meshlet.frag.spv");
+        mesh_pipeline_builder.set_layout(layout_cache.get_pipeline_layout(device, {&mesh_descriptor_set_layout, 1},
+                                                                          {&push_constant_range, 1}));
+
+        std::optional<PipelineHandle> pipeline = mesh_pipeline_builder.build(pipeline_cache);
+        if (pipeline.has_value()) {
+            mesh_pipeline = pipeline.value();
+            mesh_shaders_enabled = true;
+            meshlets_per_work_item = TASK_WORKGROUP_SIZE;
+            enabled = true;
+            return;
+        }
+        fmt::print("Falling back to culling meshlets in compute\n");
+    }
+
+    /* -------- Compute culling path -------- */
+    // Each draw finds its instance through firstInstance, and a bucket is drawn in one call
+    if (!device_supports_multi_draw_indirect) {
+        fmt::print("Device can't draw indirect with several draws or a first instance, meshes won't be drawn\n");
+        return;
+    }
+    draw_indirect_count_enabled = device_supports_draw_indirect_count;
+
+    VkPushConstantRange vertex_push_constant_range = {};
+    vertex_push_constant_range.stageFlags = VERTEX_PUSH_CONSTANT_STAGES;
+    vertex_push_constant_range.offset = 0;
+    vertex_push_constant_range.size = sizeof(MeshletPushConstants);
+
+    pipeline_builder.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, "shaders/meshlet.vert.spv");
+    pipeline_builder.add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, "shaders/meshlet.frag.spv");
+    pipeline_builder.set_layout(layout_cache.get_pipeline_layout(device, {}, {&vertex_push_constant_range, 1}));
+
+    // The triangles left are already backface tested, culling here only follows the bucket's winding
+    constexpr std::array<VkFrontFace, DRAW_BUCKET_COUNT> bucket_front_faces = {
+        VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FRONT_FACE_CLOCKWISE
+    };
+    for (uint32_t bucket = 0; bucket < DRAW_BUCKET_COUNT; bucket++) {
+        pipeline_builder.set_cull_mode(VK_CULL_MODE_BACK_BIT, bucket_front_faces[bucket]);
+        std::optional<PipelineHandle> graphics_pipeline = pipeline_builder.build(pipeline_cache);
+        if (!graphics_pipeline.has_value()) {
+            return;
+        }
+        bucket_pipelines[bucket] = graphics_pipeline.value();
+    }
+
+    // Culled indices and draw commands, counted up with atomics, and the depth pyramid
+    descriptor_layout_builder.clear();
+    descriptor_layout_builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_layout_builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_layout_builder.add_binding(2, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    cull_descriptor_set_layout = descriptor_layout_builder.build(layout_cache, device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkPushConstantRange cull_push_constant_range = {};
+    cull_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    cull_push_constant_range.offset = 0;
+    cull_push_constant_range.size = sizeof(MeshletPushConstants);
+
+    std::optional<PipelineHandle> cull = create_compute_pipeline(
+        device, *resources, "shaders/meshlet_cull.comp.spv",
+        layout_cache.get_pipeline_layout(device, {&cull_descriptor_set_layout, 1}, {&cull_push_constant_range, 1}));
+    if (!cull.has_value()) {
+        return;
+    }
+    cull_pipeline = cull.value();
+    enabled = true;
+}
+
+void MeshletRenderer::draw(VkCommandBuffer command_buffer, std::span<const LoadedScene> scenes,
+                           const Camera &camera, VkExtent2D extent, ImageHandle color_image, ImageHandle depth_image,
+                           ImageHandle depth_pyramid, FrameLinearAllocator &linear_allocator,
+                           DescriptorAllocator &descriptor_allocator) {
+    float aspect_ratio = static_cast<float>(extent.width) / static_cast<float>(std::max(extent.height, 1u));
+
+    MeshletViewData view_data = {};
+    view_data.view_projection = camera.projection_matrix(aspect_ratio) * camera.view_matrix();
+    view_data.frustum_planes = camera.frustum_planes(aspect_ratio);
+    view_data.camera_position << camera.position, 1.0f;
+    view_data.viewport_size = {extent.width, extent.height};
+    view_data.depth_pyramid_mip_count = resources->images.cold(depth_pyramid).mip_levels;
+
+    // The shaders load it as float4s, so it goes in at 16 bytes whatever the allocator's own alignment is
+    std::optional<LinearAllocation> view_allocation = linear_allocator.allocate(sizeof(MeshletViewData), 16);
+    if (!enabled || !view_allocation) {
+        return;
+    }
+    std::memcpy(view_allocation->mapped, &view_data, sizeof(MeshletViewData));
+
+    float pixels_per_unit = static_cast<float>(extent.height) / (2.0f * std::tan(camera.vertical_fov * 0.5f));
+
+    // Scenes without a mesh table this frame are skipped
+    std::vector<std::optional<InstanceCullPushConstants>> scene_push_constants(scenes.size());
+    for (size_t i = 0; i < scenes.size(); i++) {
+        const LoadedScene &scene = scenes[i];
+        if (scene.instances.empty() || scene.meshlet_count == 0) {
+            continue;
+        }
+
+        std::optional<VkDeviceAddress> meshes = write_meshes(scene, linear_allocator);
+        if (!meshes) {
+            continue;
+        }
+
+        InstanceCullPushConstants push_constants = {};
+        push_constants.view = view_allocation->device_address;
+        push_constants.scene_instances = resources->buffers.hot(scene.instance_buffer).device_address;
+        push_constants.meshes = *meshes;
+        push_constants.draw_instances = resources->buffers.hot(scene.draw_instance_buffer).device_address;
+        push_constants.work_items = resources->buffers.hot(scene.work_item_buffer).device_address;
+        push_constants.draw_commands = mesh_shaders_enabled
+                                           ? 0
+                                           : resources->buffers.hot(scene.draw_command_buffer).device_address;
+        push_constants.visibility = resources->buffers.hot(scene.visibility_buffer).device_address;
+        push_constants.instance_count = static_cast<uint32_t>(scene.instances.size());
+        push_constants.meshlets_per_work_item = meshlets_per_work_item;
+        push_constants.lod_scale = pixels_per_unit / LOD_PIXEL_ERROR;
+        push_constants.near_plane = camera.near_plane;
+        scene_push_constants[i] = push_constants;
+    }
+
+    // Whatever last frame left in the pyramid is dropped, every pass binds it but only the late pass reads it
+    VkPipelineStageFlags2 read_stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT |
+                                        (mesh_shaders_enabled ? VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT : 0);
+    incan_util::transition_image(command_buffer, resources->images.hot(depth_pyramid).image,
+                                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, read_stages,
+                                 VK_ACCESS_2_NONE, read_stages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+
+    RenderTargets targets = {color_image, depth_image, depth_pyramid, extent};
+    if (!mip_generator->can_generate_pyramid(extent, depth_pyramid)) {
+        record_pass(command_buffer, CullPass::All, scenes, scene_push_constants, targets, descriptor_allocator);
+        return;
+    }
+
+    record_pass(command_buffer, CullPass::Early, scenes, scene_push_constants, targets, descriptor_allocator);
+
+    /* -------- Depth pyramid -------- */
+    // Built from the depth of what was visible last frame, the late pass's draws load both attachments back
+    VkImage depth = resources->images.hot(depth_image).image;
+    VkPipelineStageFlags2 depth_stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+                                         VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    incan_util::transition_depth_image(command_buffer, depth, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, depth_stages,
+                                       VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    // Reversed depth, the minimum is the farthest
+    mip_generator->generate_pyramid(command_buffer, resources->images.hot(depth_image).image_view,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, extent, depth_pyramid,
+                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, descriptor_allocator, MipReduction::Min);
+    incan_util::transition_depth_image(command_buffer, depth, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                       VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE, depth_stages,
+                                       VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                       VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+    memory_barrier(command_buffer, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                   VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                   VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT);
+
+    record_pass(command_buffer, CullPass::Late, scenes, scene_push_constants, targets, descriptor_allocator);
+}
+
+void MeshletRenderer::record_pass(VkCommandBuffer command_buffer, CullPass pass, std::span<const LoadedScene> scenes,
+                                  std::span<const std::optional<InstanceCullPushConstants>> scene_push_constants,
+                                  const RenderTargets &targets, DescriptorAllocator &descriptor_allocator) {
+    uint32_t region = cull_region(pass);
+    VkDeviceSize counter_offset = region * CULL_COUNTER_REGION_SIZE;
+    VkImageView depth_pyramid_view = resources->images.hot(targets.depth_pyramid).image_view;
+
+    // The pass's region of each scene's work items and counters
+    auto instance_cull_push_constants = [&](size_t scene) {
+        InstanceCullPushConstants push_constants = *scene_push_constants[scene];
+        push_constants.work_items += region * (resources->buffers.cold(scenes[scene].work_item_buffer).size /
+                                               CULL_REGION_COUNT);
+        push_constants.pass = pass;
+        return push_constants;
+    };
+    auto meshlet_push_constants = [&](size_t scene) {
+        MeshletPushConstants push_constants = {};
+        push_constants.view = scene_push_constants[scene]->view;
+        push_constants.instances = scene_push_constants[scene]->draw_instances;
+        push_constants.work_items = instance_cull_push_constants(scene).work_items;
+        push_constants.counters = resources->buffers.hot(scenes[scene].cull_counter_buffer).device_address +
+                                  counter_offset;
+        push_constants.occlusion_culling = pass == CullPass::Late;
+        return push_constants;
+    };
+    // Each region has a bucket of draw commands per pipeline, with room for every instance
+    auto draw_command_region_size = [&](const LoadedScene &scene) {
+        return DRAW_BUCKET_COUNT * scene.instances.size() * sizeof(VkDrawIndexedIndirectCommand);
+    };
+
+    /* -------- Instance culling -------- */
+    // Last frame's draws have to be done with the region before it is cleared and written again, and the late pass's
+    // visibility has to land before the next early pass reads it
+    VkPipelineStageFlags2 draw_stages = mesh_shaders_enabled
+                                            ? VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT |
+                                              VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT
+                                            : VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT |
+                                              VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+    memory_barrier(command_buffer,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | draw_stages,
+                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+    for (size_t i = 0; i < scenes.size(); i++) {
+        if (!scene_push_constants[i]) {
+            continue;
+        }
+        vkCmdFillBuffer(command_buffer, resources->buffers.hot(scenes[i].cull_counter_buffer).buffer, counter_offset,
+                        CULL_COUNTER_REGION_SIZE, 0);
+        // Commands past a bucket's count are drawn too when the count can't be read on the GPU, they have to be empty
+        if (!mesh_shaders_enabled) {
+            VkDeviceSize region_size = draw_command_region_size(scenes[i]);
+            vkCmdFillBuffer(command_buffer, resources->buffers.hot(scenes[i].draw_command_buffer).buffer,
+                            region * region_size, region_size, 0);
+        }
+    }
+    memory_barrier(command_buffer, VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    for (size_t i = 0; i < scenes.size(); i++) {
+        if (scene_push_constants[i]) {
+            cull_instances(command_buffer, scenes[i], instance_cull_push_constants(i), depth_pyramid_view,
+                           descriptor_allocator);
+        }
+    }
+    memory_barrier(command_buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | draw_stages,
+                   VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    /* -------- Meshlet culling -------- */
+    if (!mesh_shaders_enabled) {
+        for (size_t i = 0; i < scenes.size(); i++) {
+            if (scene_push_constants[i]) {
+                cull_triangles(command_buffer, scenes[i], pass, meshlet_push_constants(i), depth_pyramid_view,
+                               descriptor_allocator);
+            }
+        }
+        memory_barrier(command_buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                       VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT |
+                       VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                       VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT |
+                       VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+    }
+
+    /* -------- Draw -------- */
+    VkRenderingAttachmentInfo color_attachment = {};
+    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    color_attachment.pNext = nullptr;
+    color_attachment.imageView = resources->images.hot(targets.color_image).image_view;
+    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+    // Cleared to the far end of the reversed range, the late pass draws over what the early pass left
+    VkRenderingAttachmentInfo depth_attachment = {};
+    depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depth_attachment.pNext = nullptr;
+    depth_attachment.imageView = resources->images.hot(targets.depth_image).image_view;
+    depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depth_attachment.loadOp = pass == CullPass::Late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depth_attachment.clearValue.depthStencil = {0.0f, 0};
+
+    VkRenderingInfo rendering_info = {};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.pNext = nullptr;
+    rendering_info.renderArea = {{0, 0}, targets.extent};
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachments = &color_attachment;
+    rendering_info.pDepthAttachment = &depth_attachment;
+
+    vkCmdBeginRenderingKHR(command_buffer, &rendering_info);
+
+    VkViewport viewport = {};
+    viewport.width = static_cast<float>(targets.extent.width);
+    viewport.height = static_cast<float>(targets.extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {{0, 0}, targets.extent};
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    if (mesh_shaders_enabled) {
+        VkDescriptorSet descriptor_set = descriptor_allocator.allocate(device, mesh_descriptor_set_layout);
+        if (descriptor_set == VK_NULL_HANDLE) {
+            vkCmdEndRenderingKHR(command_buffer);
+            return;
+        }
+
+        DescriptorWriter descriptor_writer;
+        descriptor_writer.write_image(0, depth_pyramid_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                      VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+        descriptor_writer.update_set(device, descriptor_set);
+
+        // The counters start with the task workgroup counts instance_cull.comp worked out
+        const PipelineHotData &mesh = resources->pipelines.hot(mesh_pipeline);
+        vkCmdBindPipeline(command_buffer, mesh.bind_point, mesh.pipeline);
+        vkCmdBindDescriptorSets(command_buffer, mesh.bind_point, mesh.layout, 0, 1, &descriptor_set, 0, nullptr);
+        for (size_t i = 0; i < scenes.size(); i++) {
+            if (!scene_push_constants[i]) {
+                continue;
+            }
+            MeshletPushConstants push_constants = meshlet_push_constants(i);
+            vkCmdPushConstants(command_buffer, mesh.layout, MESH_PUSH_CONSTANT_STAGES, 0,
+                               sizeof(MeshletPushConstants), &push_constants);
+            vkCmdDrawMeshTasksIndirectEXT(command_buffer, resources->buffers.hot(scenes[i].cull_counter_buffer).buffer,
+                                          counter_offset + offsetof(MeshletCullCounters, workgroup_counts), 1,
+                                          sizeof(VkDrawMeshTasksIndirectCommandEXT));
+        }
+    } else {
+        // Bucket by bucket so each pipeline is bound once, every scene's commands for it are drawn in one call
+        for (uint32_t bucket = 0; bucket < DRAW_BUCKET_COUNT; bucket++) {
+            const PipelineHotData &graphics = resources->pipelines.hot(bucket_pipelines[bucket]);
+            vkCmdBindPipeline(command_buffer, graphics.bind_point, graphics.pipeline);
+
+            for (size_t i = 0; i < scenes.size(); i++) {
+                if (!scene_push_constants[i]) {
+                    continue;
+                }
+                const LoadedScene &scene = scenes[i];
+                MeshletPushConstants push_constants = meshlet_push_constants(i);
+                vkCmdPushConstants(command_buffer, graphics.layout, VERTEX_PUSH_CONSTANT_STAGES, 0,
+                                   sizeof(MeshletPushConstants), &push_constants);
+                vkCmdBindIndexBuffer(command_buffer, resources->buffers.hot(scene.culled_index_buffer).buffer, 0,
+                                     VK_INDEX_TYPE_UINT32);
+
+                auto instance_count = static_cast<uint32_t>(scene.instances.size());
+                VkBuffer draw_commands = resources->buffers.hot(scene.draw_command_buffer).buffer;
+                VkDeviceSize bucket_offset = region * draw_command_region_size(scene) +
+                                             bucket * instance_count * sizeof(VkDrawIndexedIndirectCommand);
+                if (draw_indirect_count_enabled) {
+                    vkCmdDrawIndexedIndirectCount(command_buffer, draw_commands, bucket_offset,
+                                                  resources->buffers.hot(scene.cull_counter_buffer).buffer,
+                                                  counter_offset + offsetof(MeshletCullCounters, draw_counts) +
+                                                  bucket * sizeof(uint32_t), instance_count,
+                                                  sizeof(VkDrawIndexedIndirectCommand));
+                } else {
+                    vkCmdDrawIndexedIndirect(command_buffer, draw_commands, bucket_offset, instance_count,
+                                             sizeof(VkDrawIndexedIndirectCommand));
+                }
+            }
+        }
+    }
+
+    vkCmdEndRenderingKHR(command_buffer);
+}
+
+void MeshletRenderer::destroy() {
+    // Layouts belong to the layout cache and the graphics pipelines to the pipeline cache
+    for (PipelineHandle pipeline: {instance_cull_pipeline, cull_pipeline}) {
+        if (resources && resources->pipelines.contains(pipeline)) {
+            resources->destroy_pipeline(pipeline);
+        }
+    }
+}
+
+std::optional<VkDeviceAddress> MeshletRenderer::write_meshes(const LoadedScene &scene,
+                                                             FrameLinearAllocator &linear_allocator) {
+    std::optional<LinearAllocation> allocation = linear_allocator.allocate(
+        scene.meshes.size() * sizeof(MeshletMeshData), 16);
+    if (!allocation) {
+        return std::nullopt;
+    }
+
+    for (size_t i = 0; i < scene.meshes.size(); i++) {
+        const MeshAsset &mesh = scene.meshes[i];
+
+        MeshletMeshData mesh_data = {};
+        mesh_data.position_offset = mesh.position_offset;
+        mesh_data.lod_count = mesh.lod_count;
+        mesh_data.position_scale = mesh.position_scale;
+        for (uint32_t lod = 0; lod < MAX_LOD_COUNT; lod++) {
+            mesh_data.lods[lod] = {mesh.lods[lod].first_meshlet, mesh.lods[lod].meshlet_count, mesh.lods[lod].error, 0};
+        }
+
+        // Instances of meshes the ResidencyManager hasn't streamed in are culled with the ones out of view
+        const ResidentMesh &resident_mesh = scene.resident_meshes[i];
+        if (resources->buffers.contains(resident_mesh.buffer)) {
+            mesh_data.vertices = resident_mesh.section_address(*resources, MeshSection::Vertices);
+            mesh_data.meshlets = resident_mesh.section_address(*resources, MeshSection::Meshlets);
+            mesh_data.meshlet_vertices = resident_mesh.section_address(*resources, MeshSection::MeshletVertices);
+            mesh_data.meshlet_triangles = resident_mesh.section_address(*resources, MeshSection::MeshletTriangles);
+        }
+
+        std::memcpy(static_cast<std::byte *>(allocation->mapped) + i * sizeof(MeshletMeshData), &mesh_data,
+                    sizeof(MeshletMeshData));
+    }
+    return allocation->device_address;
+}
+
+void MeshletRenderer::cull_instances(VkCommandBuffer command_buffer, const LoadedScene &scene,
+                                     InstanceCullPushConstants push_constants, VkImageView depth_pyramid_view,
+                                     DescriptorAllocator &descriptor_allocator) {
+    VkDescriptorSet descriptor_set = descriptor_allocator.allocate(device, instance_cull_descriptor_set_layout);
+    if (descriptor_set == VK_NULL_HANDLE) {
+        return;
+    }
+
+    // Only the pass's region of the counters
+    DescriptorWriter descriptor_writer;
+    descriptor_writer.write_buffer(0, resources->buffers.hot(scene.cull_counter_buffer).buffer,
+                                   sizeof(MeshletCullCounters), cull_region(push_constants.pass) *
+                                   CULL_COUNTER_REGION_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_writer.write_image(1, depth_pyramid_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                  VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    descriptor_writer.update_set(device, descriptor_set);
+
+    const PipelineHotData &instance_cull = resources->pipelines.hot(instance_cull_pipeline);
+    vkCmdBindPipeline(command_buffer, instance_cull.bind_point, instance_cull.pipeline);
+    vkCmdBindDescriptorSets(command_buffer, instance_cull.bind_point, instance_cull.layout, 0, 1, &descriptor_set, 0,
+                            nullptr);
+    vkCmdPushConstants(command_buffer, instance_cull.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(InstanceCullPushConstants), &push_constants);
+
+    // One thread per instance
+    VkExtent2D grid = workgroup_grid((push_constants.instance_count + INSTANCE_CULL_WORKGROUP_SIZE - 1) /
+                                     INSTANCE_CULL_WORKGROUP_SIZE);
+    vkCmdDispatch(command_buffer, grid.width, grid.height, 1);
+}
+
+void MeshletRenderer::cull_triangles(VkCommandBuffer command_buffer, const LoadedScene &scene, CullPass pass,
+                                     MeshletPushConstants push_constants, VkImageView depth_pyramid_view,
+                                     DescriptorAllocator &descriptor_allocator) {
+    VkDescriptorSet descriptor_set = descriptor_allocator.allocate(device, cull_descriptor_set_layout);
+    if (descriptor_set == VK_NULL_HANDLE) {
+        return;
+    }
+
+    DescriptorWriter descriptor_writer;
+    descriptor_writer.write_buffer(0, resources->buffers.hot(scene.culled_index_buffer).buffer, VK_WHOLE_SIZE, 0,
+                                   VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_writer.write_buffer(1, resources->buffers.hot(scene.draw_command_buffer).buffer, VK_WHOLE_SIZE, 0,
+                                   VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_writer.write_image(2, depth_pyramid_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                  VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    descriptor_writer.update_set(device, descriptor_set);
+
+    const PipelineHotData &cull = resources->pipelines.hot(cull_pipeline);
+    vkCmdBindPipeline(command_buffer, cull.bind_point, cull.pipeline);
+    vkCmdBindDescriptorSets(command_buffer, cull.bind_point, cull.layout, 0, 1, &descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, cull.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletPushConstants),
+                       &push_constants);
+
+    // One workgroup per meshlet, as many as instance_cull.comp found
+    vkCmdDispatchIndirect(command_buffer, resources->buffers.hot(scene.cull_counter_buffer).buffer,
+                          cull_region(pass) * CULL_COUNTER_REGION_SIZE +
+                          offsetof(MeshletCullCounters, workgroup_counts));
+}
+
+MeshletSceneInstance incan_meshlet::scene_instance(const MeshInstance &instance, uint32_t first_culled_index) {
+    // Cone tests only hold if the transform turns normals the same way it turns directions, which uniform scale and
+    // no mirroring guarantee
+    Eigen::Matrix3f linear = instance.world_transform.topLeftCorner<3, 3>();
+    Eigen::Vector3f axis_scales = linear.colwise().norm();
+
+    MeshletSceneInstance scene_instance = {};
+    scene_instance.world_transform = instance.world_transform;
+    scene_instance.mesh = instance.mesh;
+    scene_instance.max_scale = axis_scales.maxCoeff();
+    scene_instance.first_culled_index = first_culled_index;
+    if (linear.determinant() < 0.0f) {
+        scene_instance.flags |= INSTANCE_MIRRORED;
+    } else if (scene_instance.max_scale - axis_scales.minCoeff() <= 1e-3f * scene_instance.max_scale) {
+        scene_instance.flags |= INSTANCE_CONE_CULLING;
+    }
+    return scene_instance;
+}
@@ -0,0 +1,240 @@
+#ifndef INCANDESCENT_MESHLET_RENDERER_H
+#define INCANDESCENT_MESHLET_RENDERER_H
+
+#include <incandescent_types.h>
+#include <incandescent_buffers.h>
+#include <incandescent_camera.h>
+#include <incandescent_descriptors.h>
+#include <incandescent_loader.h>
+#include <incandescent_mipmaps.h>
+#include <incandescent_pipelines.h>
+#include <incandescent_resources.h>
+
+// Must match ViewData in meshlet_common.hlsl
+struct MeshletViewData {
+    Eigen::Matrix4f view_projection;
+    std::array<Eigen::Vector4f, 5> frustum_planes;
+    Eigen::Vector4f camera_position;
+    // Pixels drawn to, the depth pyramid's mip 0 is half of it
+    std::array<uint32_t, 2> viewport_size;
+    uint32_t depth_pyramid_mip_count;
+    uint32_t padding;
+};
+
+// Set on instances whose transform keeps the normal cone valid (uniform scale, no mirroring)
+constexpr uint32_t INSTANCE_CONE_CULLING = 1;
+// Set on mirrored instances, whose triangles wind the other way round on screen
+constexpr uint32_t INSTANCE_MIRRORED = 2;
+
+// Largest simplification error, projected to the screen, an instance's level of detail may have
+constexpr float LOD_PIXEL_ERROR = 1.0f;
+
+// Indexed draws are sorted by the pipeline they need: instances facing the usual way round, and mirrored ones whose
+// front faces are clockwise
+constexpr uint32_t DRAW_BUCKET_COUNT = 2;
+
+// Meshlets each meshlet.task workgroup tests
+constexpr uint32_t TASK_WORKGROUP_SIZE = 32;
+
+// Must match the PASS_ defines in instance_cull.comp
+enum class CullPass : uint32_t {
+    // Instances visible last frame, frustum tested only, whose depth the pyramid is built from
+    Early,
+    // Every instance against the frustum and the pyramid, draws the ones the early pass didn't and writes visibility
+    Late,
+    // Frustum culling alone, when there is no pyramid to test against
+    All
+};
+
+// The early and late passes each have their own counters, work items and draw commands, the late pass the second ones
+constexpr uint32_t CULL_REGION_COUNT = 2;
+// Counter regions are bound at their own offset, 256 is the largest minStorageBufferOffsetAlignment there is
+constexpr VkDeviceSize CULL_COUNTER_REGION_SIZE = 256;
+
+// Must match SceneInstance in instance_cull.comp. One per MeshInstance, uploaded with the scene
+struct MeshletSceneInstance {
+    Eigen::Matrix4f world_transform;
+    uint32_t mesh;
+    uint32_t flags;
+    // Largest scale of world_transform's axes
+    float max_scale;
+    // Start of the instance's range in the culled index buffer, only used without mesh shaders
+    uint32_t first_culled_index;
+};
+
+// Must match MeshLod in instance_cull.comp
+struct MeshletLodData {
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    float error;
+    uint32_t padding;
+};
+
+// Must match MeshData in instance_cull.comp. One per MeshAsset, written every frame since meshes come and go
+struct MeshletMeshData {
+    Eigen::Vector3f position_offset;
+    uint32_t lod_count;
+    Eigen::Vector3f position_scale;
+    uint32_t padding;
+    std::array<MeshletLodData, MAX_LOD_COUNT> lods;
+    // The mesh's own buffer, see ResidentMesh::section_address. All 0 while the mesh isn't resident
+    VkDeviceAddress vertices;
+    VkDeviceAddress meshlets;
+    VkDeviceAddress meshlet_vertices;
+    VkDeviceAddress meshlet_triangles;
+};
+
+// Must match DrawInstance in meshlet_common.hlsl. instance_cull.comp writes one per visible MeshInstance every frame
+struct MeshletDrawInstance {
+    Eigen::Matrix4f world_transform;
+    // xyz dequantize the mesh's positions, w of position_offset is the largest scale of world_transform's axes
+    Eigen::Vector4f position_offset;
+    Eigen::Vector4f position_scale;
+    // Meshlets of the level of detail the instance draws this frame
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    // The instance's VkDrawIndexedIndirectCommand, only used without mesh shaders
+    uint32_t draw_command;
+    uint32_t flags;
+    VkDeviceAddress vertices;
+    VkDeviceAddress meshlets;
+    VkDeviceAddress meshlet_vertices;
+    VkDeviceAddress meshlet_triangles;
+};
+
+// Must match the counter words in meshlet_common.hlsl. Zeroed every frame, then counted up by instance_cull.comp
+struct MeshletCullCounters {
+    // Workgroups of the meshlet pass, read as a VkDispatchIndirectCommand or VkDrawMeshTasksIndirectCommandEXT.
+    // Rows of at most 65535, one workgroup per work item
+    std::array<uint32_t, 3> workgroup_counts;
+    uint32_t work_item_count;
+    // Draw commands in each bucket
+    std::array<uint32_t, DRAW_BUCKET_COUNT> draw_counts;
+    std::array<uint32_t, 2> padding;
+};
+
+// Must match PushConstants in meshlet_common.hlsl, everything the meshlet shaders read comes through these addresses
+// and the ones in the instance
+struct MeshletPushConstants {
+    VkDeviceAddress view;
+    VkDeviceAddress instances;
+    // What the meshlet pass runs over, {instance, first meshlet} pairs appended by instance_cull.comp
+    VkDeviceAddress work_items;
+    VkDeviceAddress counters;
+    // Set in the late pass, meshlets are tested against the depth pyramid too
+    uint32_t occlusion_culling;
+    uint32_t padding;
+};
+
+// Must match InstanceCullPushConstants in instance_cull.comp
+struct InstanceCullPushConstants {
+    VkDeviceAddress view;
+    VkDeviceAddress scene_instances;
+    VkDeviceAddress meshes;
+    VkDeviceAddress draw_instances;
+    VkDeviceAddress work_items;
+    // The bucketed draw commands of both regions, 0 with mesh shaders where nothing is drawn indexed
+    VkDeviceAddress draw_commands;
+    // One word per instance, whether the late pass found it visible
+    VkDeviceAddress visibility;
+    uint32_t instance_count;
+    uint32_t meshlets_per_work_item;
+    // Pixels per unit at a distance of one over LOD_PIXEL_ERROR, an error times it over the distance is at most 1
+    float lod_scale;
+    float near_plane;
+    CullPass pass;
+    uint32_t padding;
+};
+
+/*
+ * Draws loaded scenes meshlet by meshlet with the CPU recording the same few commands whatever the instance count.
+ * instance_cull.comp tests every instance's bounding sphere against the view frustum and picks its level of detail,
+ * the coarsest whose simplification error projects to less than LOD_PIXEL_ERROR pixels, then hands the meshlets of
+ * the ones left to one of two paths:
+ *   - VK_EXT_mesh_shader: a meshlet.task workgroup tests 32 meshlets and launches one meshlet.mesh workgroup for each
+ *     meshlet that is left, one indirect draw per scene
+ *   - otherwise meshlet_cull.comp tests each meshlet, backface tests the triangles of the meshlets that pass and
+ *     compacts the rest into the scene's culled index buffer. Each visible instance has a VkDrawIndexedIndirectCommand
+ *     in the bucket of the pipeline it needs, every bucket is drawn with one vkCmdDrawIndexedIndirectCount per scene
+ *     (without draw indirect count, the whole bucket with the unused commands left empty)
+ * Only instances whose mesh the ResidencyManager has streamed in are drawn, each reads its mesh's own buffer.
+ *
+ * Occlusion culling takes two passes over the same depth buffer. The early pass draws the instances that were visible
+ * last frame, and the MipGenerator reduces the depth it leaves to a min pyramid (Hi-Z, the farthest depth under each
+ * texel). The late pass tests every instance's bounding sphere against the pyramid, remembers which ones passed for
+ * next frame's early pass and draws those the early pass didn't, with their meshlets tested against the pyramid too.
+ * Without the single pass downsampler there is no pyramid and everything is drawn in one frustum culled pass.
+ *
+ * Everything is read through buffer device addresses, only the depth pyramid and what is written with atomics
+ * (counters, culled indices and index counts) are bound as descriptor sets. Those sets come from the descriptor
+ * allocator passed in, so on the descriptor buffer backend the frame's descriptor buffer has to be bound again
+ * afterwards.
+ */
+struct MeshletRenderer {
+    PipelineHandle mesh_pipeline;
+    PipelineHandle instance_cull_pipeline;
+    PipelineHandle cull_pipeline;
+    std::array<PipelineHandle, DRAW_BUCKET_COUNT> bucket_pipelines;
+    VkDescriptorSetLayout instance_cull_descriptor_set_layout;
+    VkDescriptorSetLayout mesh_descriptor_set_layout;
+    VkDescriptorSetLayout cull_descriptor_set_layout;
+    // Picked at initialize, scenes need to know them when they are uploaded
+    bool mesh_shaders_enabled = false;
+    uint32_t meshlets_per_work_item = 1;
+    // False if the shaders couldn't be loaded or the device can't run them, nothing is drawn then
+    bool enabled = false;
+
+    void initialize(VkDevice vulkan_device, DescriptorLayoutCache &layout_cache, GraphicsPipelineCache &pipeline_cache,
+                    ResourceManager &resource_manager, MipGenerator &generator,
+                    bool device_supports_mesh_shaders, bool device_supports_int64,
+                    bool device_supports_multi_draw_indirect, bool device_supports_draw_indirect_count,
+                    VkFormat color_format, VkFormat depth_format);
+
+    // Draws every instance of the scenes over color_image, which has to be in COLOR_ATTACHMENT_OPTIMAL. depth_image
+    // has to be in DEPTH_ATTACHMENT_OPTIMAL, is cleared and has to be sampled for occlusion culling. depth_pyramid is
+    // an R32 image half the size of extent with a full mip chain, its contents are rebuilt every frame and it is left
+    // in SHADER_READ_ONLY_OPTIMAL. Per-frame data comes from linear_allocator
+    void draw(VkCommandBuffer command_buffer, std::span<const LoadedScene> scenes, const Camera &camera,
+              VkExtent2D extent, ImageHandle color_image, ImageHandle depth_image, ImageHandle depth_pyramid,
+              FrameLinearAllocator &linear_allocator, DescriptorAllocator &descriptor_allocator);
+
+    void destroy();
+
+private:
+    struct RenderTargets {
+        ImageHandle color_image;
+        ImageHandle depth_image;
+        ImageHandle depth_pyramid;
+        VkExtent2D extent;
+    };
+
+    // Culls the scenes in one pass and draws what is left, into depth cleared first unless this is the late pass
+    void record_pass(VkCommandBuffer command_buffer, CullPass pass, std::span<const LoadedScene> scenes,
+                     std::span<const std::optional<InstanceCullPushConstants>> scene_push_constants,
+                     const RenderTargets &targets, DescriptorAllocator &descriptor_allocator);
+
+    // Every mesh's levels of detail and buffer addresses in this frame's linear allocator, nothing if the frame is
+    // out of space
+    std::optional<VkDeviceAddress> write_meshes(const LoadedScene &scene, FrameLinearAllocator &linear_allocator);
+
+    void cull_instances(VkCommandBuffer command_buffer, const LoadedScene &scene,
+                        InstanceCullPushConstants push_constants, VkImageView depth_pyramid_view,
+                        DescriptorAllocator &descriptor_allocator);
+
+    void cull_triangles(VkCommandBuffer command_buffer, const LoadedScene &scene, CullPass pass,
+                        MeshletPushConstants push_constants, VkImageView depth_pyramid_view,
+                        DescriptorAllocator &descriptor_allocator);
+
+    VkDevice device = VK_NULL_HANDLE;
+    ResourceManager *resources = nullptr;
+    MipGenerator *mip_generator = nullptr;
+    bool draw_indirect_count_enabled = false;
+};
+
+namespace incan_meshlet {
+    // What the instance culling pass needs of an instance, with its flags worked out from the transform
+    MeshletSceneInstance scene_instance(const MeshInstance &instance, uint32_t first_culled_index);
+}
+
+
+#endif //INCANDESCENT_MESHLET_RENDERER_H
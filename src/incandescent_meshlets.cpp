@@ -0,0 +1,153 @@
+#include <incandescent_meshlets.h>
+
+#include <cfloat>
+
+namespace {
+    constexpr uint8_t UNUSED_VERTEX = 0xFF;
+
+    // Normals this close to perpendicular to the average make the cone too wide to ever cull
+    constexpr float MIN_CONE_DOT = 0.1f;
+    constexpr float NEVER_CULL_CUTOFF = 2.0f;
+
+    std::array<uint32_t, 3> unpack_triangle(uint32_t triangle) {
+        return {triangle & 0xFF, (triangle >> 8) & 0xFF, (triangle >> 16) & 0xFF};
+    }
+
+    // Sphere around the meshlet's box and its normal cone, the apex is pushed back along the axis until it is behind
+    // every triangle so the cone test holds for cameras close to the meshlet as well
+    void compute_bounds(Meshlet &meshlet, const incan_meshlet::MeshletLists &lists, std::span<const Vertex> vertices,
+                        uint32_t vertex_offset, float position_error) {
+        auto position = [&](uint32_t meshlet_vertex) -> const Eigen::Vector3f & {
+            return vertices[lists.vertices[meshlet.vertex_offset + meshlet_vertex] - vertex_offset].position;
+        };
+
+        Eigen::AlignedBox3f box;
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+            box.extend(position(i));
+        }
+        Eigen::Vector3f center = box.center();
+        float radius = 0.0f;
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+            radius = std::max(radius, (position(i) - center).norm());
+        }
+
+        // Unit normals, so every triangle gets the same say in the axis whatever its size
+        std::array<Eigen::Vector3f, incan_meshlet::MAX_MESHLET_TRIANGLES> normals;
+        std::array<uint32_t, incan_meshlet::MAX_MESHLET_TRIANGLES> first_corners;
+        uint32_t normal_count = 0;
+        Eigen::Vector3f normal_sum = Eigen::Vector3f::Zero();
+        for (uint32_t i = 0; i < meshlet.triangle_count; i++) {
+            std::array<uint32_t, 3> corners = unpack_triangle(lists.triangles[meshlet.triangle_offset + i]);
+            Eigen::Vector3f normal = (position(corners[1]) - position(corners[0])).cross(
+                position(corners[2]) - position(corners[0]));
+            float area = normal.norm();
+            if (area < FLT_MIN) {
+                continue;
+            }
+            normals[normal_count] = normal / area;
+            first_corners[normal_count] = corners[0];
+            normal_sum += normals[normal_count];
+            normal_count++;
+        }
+
+        Eigen::Map<Eigen::Vector3f>(meshlet.center.data()) = center;
+        meshlet.radius = radius + position_error;
+        Eigen::Map<Eigen::Vector3f>(meshlet.cone_apex.data()) = center;
+        meshlet.cone_axis = {0.0f, 0.0f, 1.0f};
+        meshlet.cone_cutoff = NEVER_CULL_CUTOFF;
+
+        float axis_length = normal_sum.norm();
+        if (normal_count == 0 || axis_length < FLT_MIN) {
+            return;
+        }
+        Eigen::Vector3f axis = normal_sum / axis_length;
+        Eigen::Map<Eigen::Vector3f>(meshlet.cone_axis.data()) = axis;
+
+        float min_dot = 1.0f;
+        for (uint32_t i = 0; i < normal_count; i++) {
+            min_dot = std::min(min_dot, normals[i].dot(axis));
+        }
+        if (min_dot <= MIN_CONE_DOT) {
+            return;
+        }
+
+        // Furthest point back along the axis that is still on the negative side of every triangle's plane
+        float apex_distance = 0.0f;
+        for (uint32_t i = 0; i < normal_count; i++) {
+            float plane_distance = (center - position(first_corners[i])).dot(normals[i]);
+            apex_distance = std::max(apex_distance, plane_distance / normals[i].dot(axis));
+        }
+        Eigen::Map<Eigen::Vector3f>(meshlet.cone_apex.data()) = center - axis * apex_distance;
+        // The normals spread up to acos(min_dot) around the axis, the cameras that see none of the triangles are in
+        // the cone turned inside out, which is the sine of that angle
+        meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    }
+}
+
+void incan_meshlet::build_meshlets(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+                                   uint32_t vertex_offset, float position_error, MeshletLists &output) {
+    // Each vertex's number in the meshlet being built
+    std::vector<uint8_t> meshlet_vertex(vertices.size(), UNUSED_VERTEX);
+
+    Meshlet meshlet = {};
+    meshlet.vertex_offset = static_cast<uint32_t>(output.vertices.size());
+    meshlet.triangle_offset = static_cast<uint32_t>(output.triangles.size());
+
+    auto finish_meshlet = [&] {
+        if (meshlet.triangle_count == 0) {
+            return;
+        }
+        compute_bounds(meshlet, output, vertices, vertex_offset, position_error);
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++) {
+            meshlet_vertex[output.vertices[meshlet.vertex_offset + i] - vertex_offset] = UNUSED_VERTEX;
+        }
+        output.meshlets.push_back(meshlet);
+
+        meshlet = {};
+        meshlet.vertex_offset = static_cast<uint32_t>(output.vertices.size());
+        meshlet.triangle_offset = static_cast<uint32_t>(output.triangles.size());
+    };
+
+    for (size_t triangle = 0; triangle + 3 <= indices.size(); triangle += 3) {
+        uint32_t a = indices[triangle];
+        uint32_t b = indices[triangle + 1];
+        uint32_t c = indices[triangle + 2];
+        if (a >= vertices.size() || b >= vertices.size() || c >= vertices.size()) {
+            continue;
+        }
+
+        // Degenerate triangles can name a vertex twice, it still only takes one slot
+        uint32_t new_vertices = (meshlet_vertex[a] == UNUSED_VERTEX) +
+                                (meshlet_vertex[b] == UNUSED_VERTEX && b != a) +
+                                (meshlet_vertex[c] == UNUSED_VERTEX && c != a && c != b);
+        if (meshlet.vertex_count + new_vertices > MAX_MESHLET_VERTICES ||
+            meshlet.triangle_count == MAX_MESHLET_TRIANGLES) {
+            finish_meshlet();
+        }
+
+        for (uint32_t vertex: {a, b, c}) {
+            if (meshlet_vertex[vertex] == UNUSED_VERTEX) {
+                meshlet_vertex[vertex] = static_cast<uint8_t>(meshlet.vertex_count++);
+                output.vertices.push_back(vertex_offset + vertex);
+            }
+        }
+        output.triangles.push_back(meshlet_vertex[a] | (meshlet_vertex[b] << 8) | (meshlet_vertex[c] << 16));
+        meshlet.triangle_count++;
+    }
+    finish_meshlet();
+}
+
+uint32_t incan_meshlet::append_meshlets(MeshletLists &destination, const MeshletLists &source) {
+    auto first_meshlet = static_cast<uint32_t>(destination.meshlets.size());
+    auto vertex_base = static_cast<uint32_t>(destination.vertices.size());
+    auto triangle_base = static_cast<uint32_t>(destination.triangles.size());
+
+    for (Meshlet meshlet: source.meshlets) {
+        meshlet.vertex_offset += vertex_base;
+        meshlet.triangle_offset += triangle_base;
+        destination.meshlets.push_back(meshlet);
+    }
+    destination.vertices.insert(destination.vertices.end(), source.vertices.begin(), source.vertices.end());
+    destination.triangles.insert(destination.triangles.end(), source.triangles.begin(), source.triangles.end());
+    return first_meshlet;
+}
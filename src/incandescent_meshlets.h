@@ -0,0 +1,36 @@
+#ifndef INCANDESCENT_MESHLETS_H
+#define INCANDESCENT_MESHLETS_H
+
+#include <incandescent_loader.h>
+
+/*
+ * Import-time meshlet building. Triangles are taken in the order they already have and a meshlet is closed as soon as
+ * the next triangle would overflow it, so every meshlet is a run of consecutive triangles. Run it after the mesh
+ * optimizer, whose cache order keeps neighbouring triangles together and so gives tight meshlets that share few
+ * vertices with each other.
+ */
+namespace incan_meshlet {
+    // What meshlet.mesh is compiled for, inside the output limits VK_EXT_mesh_shader guarantees on every device
+    constexpr uint32_t MAX_MESHLET_VERTICES = 64;
+    constexpr uint32_t MAX_MESHLET_TRIANGLES = 124;
+
+    // Meshlets plus the vertex and triangle lists they point into
+    struct MeshletLists {
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> vertices;
+        std::vector<uint32_t> triangles;
+    };
+
+    // Appends the meshlets of one surface. indices are local to vertices, vertex_offset is added to every meshlet
+    // vertex so they index the scene's vertex array. Triangles with an index past vertices are left out.
+    // position_error pads the bounding spheres by how far the GPU's (quantized) positions can be from vertices
+    void build_meshlets(std::span<const uint32_t> indices, std::span<const Vertex> vertices, uint32_t vertex_offset,
+                        float position_error, MeshletLists &output);
+
+    // Appends source to destination, moving its offsets to where its lists now start. Returns the index the first
+    // meshlet of source got
+    uint32_t append_meshlets(MeshletLists &destination, const MeshletLists &source);
+}
+
+
+#endif //INCANDESCENT_MESHLETS_H
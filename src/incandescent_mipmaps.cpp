@@ -0,0 +1,310 @@
+#include <incandescent_mipmaps.h>
+#include <incandescent_images.h>
+#include <incandescent_pipelines.h>
+#include <incan_struct_init.h>
+#include <volk.h>
+
+// Each workgroup reduces a 64x64 tile, the last one reduces the 64x64 mip 6 results
+constexpr uint32_t TILE_SIZE = 64;
+constexpr uint32_t MID_MIP_SIZE = 64;
+
+void MipGenerator::initialize(VkDevice vulkan_device, VkPhysicalDevice gpu, DescriptorLayoutCache &layout_cache,
+                              ResourceManager &resource_manager, bool device_supports_single_pass) {
+    device = vulkan_device;
+    physical_device = gpu;
+    resources = &resource_manager;
+    single_pass_supported = device_supports_single_pass;
+
+    if (!single_pass_supported) {
+        return;
+    }
+
+    DescriptorLayoutBuilder descriptor_layout_builder;
+    descriptor_layout_builder.add_binding(0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    descriptor_layout_builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_SINGLE_PASS_MIP_LEVELS);
+    descriptor_layout_builder.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_layout_builder.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_set_layout = descriptor_layout_builder.build(layout_cache, device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(MipDownsamplePushConstants);
+
+    VkPipelineLayout pipeline_layout = layout_cache.get_pipeline_layout(device, {&descriptor_set_layout, 1},
+                                                                        {&push_constant_range, 1});
+
+    VkShaderModule downsample_shader;
+    if (!incan_util::load_shader_module("shaders/mip_downsample.comp.spv", device, &downsample_shader)) {
+        fmt::print("Error when building mip downsample shader, falling back to blits\n");
+        single_pass_supported = false;
+        return;
+    }
+
+    VkPipelineShaderStageCreateInfo shader_stage_create_info = {};
+    shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shader_stage_create_info.pNext = nullptr;
+    shader_stage_create_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shader_stage_create_info.module = downsample_shader;
+    shader_stage_create_info.pName = "main";
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+    compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    compute_pipeline_create_info.pNext = nullptr;
+    compute_pipeline_create_info.layout = pipeline_layout;
+    compute_pipeline_create_info.stage = shader_stage_create_info;
+
+    VkPipeline compute_pipeline;
+    VK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr,
+        &compute_pipeline));
+    pipeline = resources->add_pipeline(compute_pipeline, pipeline_layout, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+    vkDestroyShaderModule(device, downsample_shader, nullptr);
+
+    // Transfer usage lets the defragmenter move them
+    VkBufferUsageFlags buffer_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                            VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    workgroup_counter = resources->create_buffer(sizeof(uint32_t), buffer_usage_flags,
+                                                 VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0, AllocationCategory::Buffer);
+    mid_mip = resources->create_buffer(MID_MIP_SIZE * MID_MIP_SIZE * 4 * sizeof(float), buffer_usage_flags,
+                                       VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0, AllocationCategory::Buffer);
+}
+
+bool MipGenerator::generate(VkCommandBuffer command_buffer, ImageHandle image, VkImageLayout current_layout,
+                            VkImageLayout final_layout, DescriptorAllocator &descriptor_allocator,
+                            MipReduction reduction) {
+    if (resources->images.cold(image).mip_levels <= 1) {
+        return true;
+    }
+
+    if (can_use_single_pass(image)) {
+        generate_single_pass(command_buffer, image, current_layout, final_layout, descriptor_allocator, reduction);
+        return true;
+    }
+
+    // Blits can only filter linearly, so min/max pyramids need the compute path
+    if (reduction == MipReduction::Average && can_use_blit_chain(image)) {
+        generate_blit_chain(command_buffer, image, current_layout, final_layout);
+        return true;
+    }
+
+    return false;
+}
+
+void MipGenerator::destroy() {
+    if (!single_pass_supported) {
+        return;
+    }
+
+    // The set layout and pipeline layout belong to the layout cache
+    resources->destroy_pipeline(pipeline);
+    resources->destroy_buffer(workgroup_counter);
+    resources->destroy_buffer(mid_mip);
+}
+
+bool MipGenerator::can_use_single_pass(ImageHandle image) const {
+    const ImageColdData &image_info = resources->images.cold(image);
+    if ((image_info.usage_flags & VK_IMAGE_USAGE_SAMPLED_BIT) == 0) {
+        return false;
+    }
+    return can_downsample({image_info.image_extent.width, image_info.image_extent.height}, image_info.mip_levels - 1,
+                          image);
+}
+
+bool MipGenerator::can_generate_pyramid(VkExtent2D source_extent, ImageHandle pyramid) const {
+    return can_downsample(source_extent, resources->images.cold(pyramid).mip_levels, pyramid);
+}
+
+bool MipGenerator::can_downsample(VkExtent2D source_extent, uint32_t mip_count, ImageHandle destination) const {
+    if (!single_pass_supported) {
+        return false;
+    }
+
+    const ImageColdData &image_info = resources->images.cold(destination);
+    if ((image_info.usage_flags & VK_IMAGE_USAGE_STORAGE_BIT) == 0) {
+        return false;
+    }
+
+    // Mip 6 has to fit in the 64x64 buffer the last workgroup reads from
+    uint32_t tiles_x = (source_extent.width + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t tiles_y = (source_extent.height + TILE_SIZE - 1) / TILE_SIZE;
+    if (mip_count > MAX_SINGLE_PASS_MIP_LEVELS || tiles_x > MID_MIP_SIZE || tiles_y > MID_MIP_SIZE) {
+        return false;
+    }
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, image_info.image_format, &format_properties);
+    return format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+}
+
+void MipGenerator::generate_single_pass(VkCommandBuffer command_buffer, ImageHandle image,
+                                        VkImageLayout current_layout, VkImageLayout final_layout,
+                                        DescriptorAllocator &descriptor_allocator, MipReduction reduction) {
+    const ImageHotData &image_data = resources->images.hot(image);
+    const ImageColdData &image_info = resources->images.cold(image);
+    std::span<const VkImageView> mip_views = resources->get_mip_views(image);
+
+    // Mip 0 is read through a sampled view, the rest are written as storage images
+    incan_util::transition_image(command_buffer, image_data.image, current_layout,
+                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                 VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                 VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, 0, 1);
+    incan_util::transition_image(command_buffer, image_data.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                 VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+                                 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, 1);
+
+    record_downsample(command_buffer, mip_views[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      {image_info.image_extent.width, image_info.image_extent.height}, mip_views.subspan(1),
+                      descriptor_allocator, reduction);
+
+    incan_util::transition_image(command_buffer, image_data.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 final_layout, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE,
+                                 VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                 VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, 0, 1);
+    incan_util::transition_image(command_buffer, image_data.image, VK_IMAGE_LAYOUT_GENERAL, final_layout,
+                                 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                 VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                 VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, 1);
+}
+
+void MipGenerator::generate_pyramid(VkCommandBuffer command_buffer, VkImageView source_view,
+                                    VkImageLayout source_layout, VkExtent2D source_extent, ImageHandle pyramid,
+                                    VkImageLayout final_layout, DescriptorAllocator &descriptor_allocator,
+                                    MipReduction reduction) {
+    VkImage pyramid_image = resources->images.hot(pyramid).image;
+
+    // Every level is written, whatever was read from it before has to be done first
+    incan_util::transition_image(command_buffer, pyramid_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                                 VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_NONE,
+                                 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    record_downsample(command_buffer, source_view, source_layout, source_extent, resources->get_mip_views(pyramid),
+                      descriptor_allocator, reduction);
+
+    incan_util::transition_image(command_buffer, pyramid_image, VK_IMAGE_LAYOUT_GENERAL, final_layout,
+                                 VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                                 VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                 VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+}
+
+void MipGenerator::record_downsample(VkCommandBuffer command_buffer, VkImageView source_view,
+                                     VkImageLayout source_layout, VkExtent2D source_extent,
+                                     std::span<const VkImageView> destination_views,
+                                     DescriptorAllocator &descriptor_allocator, MipReduction reduction) {
+    VkBuffer counter_buffer = resources->buffers.hot(workgroup_counter).buffer;
+    VkBuffer mid_mip_buffer = resources->buffers.hot(mid_mip).buffer;
+
+    // Every submit on the queue shares the counter and mid mip buffers. Barriers also order the commands of earlier
+    // submits on the same queue, so the counter is zeroed on every use once the last dispatch to touch it is done
+    VkMemoryBarrier2 memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    memory_barrier.pNext = nullptr;
+    memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    memory_barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &memory_barrier;
+
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+    vkCmdFillBuffer(command_buffer, counter_buffer, 0, sizeof(uint32_t), 0);
+
+    // The dispatch reads the counter as zero
+    memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+    memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+
+    // Unused array slots still need a valid view, the shader never writes past mip_count
+    auto mip_count = static_cast<uint32_t>(destination_views.size());
+    VkDescriptorSet descriptor_set = descriptor_allocator.allocate(device, descriptor_set_layout);
+    // The mips are left as they were, the layout transitions around this still happen
+    if (descriptor_set == VK_NULL_HANDLE) {
+        return;
+    }
+
+    DescriptorWriter descriptor_writer;
+    descriptor_writer.write_image(0, source_view, VK_NULL_HANDLE, source_layout, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    for (uint32_t i = 0; i < MAX_SINGLE_PASS_MIP_LEVELS; i++) {
+        descriptor_writer.write_image(1, destination_views[std::min(i, mip_count - 1)], VK_NULL_HANDLE,
+                                      VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, i);
+    }
+    descriptor_writer.write_buffer(2, counter_buffer, sizeof(uint32_t), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_writer.write_buffer(3, mid_mip_buffer, VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    descriptor_writer.update_set(device, descriptor_set);
+
+    uint32_t tiles_x = (source_extent.width + TILE_SIZE - 1) / TILE_SIZE;
+    uint32_t tiles_y = (source_extent.height + TILE_SIZE - 1) / TILE_SIZE;
+
+    MipDownsamplePushConstants push_constants = {};
+    push_constants.source_width = source_extent.width;
+    push_constants.source_height = source_extent.height;
+    push_constants.mip_count = mip_count;
+    push_constants.workgroup_count = tiles_x * tiles_y;
+    push_constants.reduction = static_cast<uint32_t>(reduction);
+
+    const PipelineHotData &downsample = resources->pipelines.hot(pipeline);
+    vkCmdBindPipeline(command_buffer, downsample.bind_point, downsample.pipeline);
+    vkCmdBindDescriptorSets(command_buffer, downsample.bind_point, downsample.layout, 0, 1, &descriptor_set, 0,
+                            nullptr);
+    vkCmdPushConstants(command_buffer, downsample.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(MipDownsamplePushConstants), &push_constants);
+    vkCmdDispatch(command_buffer, tiles_x, tiles_y, 1);
+}
+
+bool MipGenerator::can_use_blit_chain(ImageHandle image) const {
+    const ImageColdData &image_info = resources->images.cold(image);
+
+    VkImageUsageFlags required_usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if ((image_info.usage_flags & required_usage) != required_usage) {
+        return false;
+    }
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, image_info.image_format, &format_properties);
+    VkFormatFeatureFlags required_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                             VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (format_properties.optimalTilingFeatures & required_features) == required_features;
+}
+
+void MipGenerator::generate_blit_chain(VkCommandBuffer command_buffer, ImageHandle image,
+                                       VkImageLayout current_layout, VkImageLayout final_layout) {
+    const ImageHotData &image_data = resources->images.hot(image);
+    const ImageColdData &image_info = resources->images.cold(image);
+
+    // Every level below mip 0 is overwritten, so its old contents can go
+    incan_util::transition_image(command_buffer, image_data.image, current_layout,
+                                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                 VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_BLIT_BIT,
+                                 VK_ACCESS_2_TRANSFER_READ_BIT, 0, 1);
+    incan_util::transition_image(command_buffer, image_data.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE,
+                                 VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, 1);
+
+    VkExtent2D source_extent = {image_info.image_extent.width, image_info.image_extent.height};
+    for (uint32_t mip = 1; mip < image_info.mip_levels; mip++) {
+        VkExtent2D destination_extent = {std::max(source_extent.width / 2, 1u),
+                                         std::max(source_extent.height / 2, 1u)};
+
+        incan_util::copy_image_to_image(command_buffer, image_data.image, image_data.image, source_extent,
+                                        destination_extent, mip - 1, mip);
+
+        // The level just written is the source of the next blit
+        incan_util::transition_image(command_buffer, image_data.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_BLIT_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_BLIT_BIT,
+                                     VK_ACCESS_2_TRANSFER_READ_BIT, mip, 1);
+        source_extent = destination_extent;
+    }
+
+    incan_util::transition_image(command_buffer, image_data.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                 final_layout, VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                 VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                 VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+}
@@ -0,0 +1,91 @@
+#ifndef INCANDESCENT_MIPMAPS_H
+#define INCANDESCENT_MIPMAPS_H
+
+#include <incandescent_types.h>
+#include <incandescent_descriptors.h>
+#include <incandescent_resources.h>
+
+// How four texels of one level become one texel of the next, min/max are for depth pyramids (Hi-Z)
+enum class MipReduction : uint32_t {
+    Average = 0,
+    Min = 1,
+    Max = 2
+};
+
+// Levels below mip 0 the single pass shader can write, a 4096x4096 image
+constexpr uint32_t MAX_SINGLE_PASS_MIP_LEVELS = 12;
+
+// Must match MipPushConstants in mip_downsample.comp
+struct MipDownsamplePushConstants {
+    uint32_t source_width;
+    uint32_t source_height;
+    uint32_t mip_count;
+    uint32_t workgroup_count;
+    uint32_t reduction;
+};
+
+/*
+ * Builds the mip chain of an image from mip 0. The fast path is one compute dispatch of the single pass downsampler
+ * (mip_downsample.comp), the fallback is a chain of linear blits with a barrier per level, used for formats that
+ * can't be storage images (sRGB), images over 4096 texels and devices without subgroup shuffles. The single pass
+ * shader can also reduce one image into another, which is how depth pyramids are built from depth buffers that
+ * can't be storage images themselves. Every dispatch shares one counter and mid mip buffer, so the command buffers it
+ * records into have to go to the same queue.
+ */
+struct MipGenerator {
+    VkDescriptorSetLayout descriptor_set_layout;
+    PipelineHandle pipeline;
+    BufferHandle workgroup_counter;
+    BufferHandle mid_mip;
+    bool single_pass_supported = false;
+
+    void initialize(VkDevice vulkan_device, VkPhysicalDevice gpu, DescriptorLayoutCache &layout_cache,
+                    ResourceManager &resource_manager, bool device_supports_single_pass);
+
+    // Fills every level below mip 0. The whole image is expected in current_layout and is left in final_layout.
+    // Sets come from descriptor_allocator, so on the descriptor buffer backend the frame's descriptor buffer has to
+    // be bound again afterwards. Returns false if neither path can handle the image (min/max without compute)
+    bool generate(VkCommandBuffer command_buffer, ImageHandle image, VkImageLayout current_layout,
+                  VkImageLayout final_layout, DescriptorAllocator &descriptor_allocator,
+                  MipReduction reduction = MipReduction::Average);
+
+    // Whether generate_pyramid can reduce a source this big into pyramid
+    bool can_generate_pyramid(VkExtent2D source_extent, ImageHandle pyramid) const;
+
+    // Reduces another image's mip 0, read through source_view in source_layout, into every level of pyramid, whose
+    // mip 0 is half the source's size. The caller orders the source's writes before this, pyramid's old contents are
+    // dropped and it is left in final_layout
+    void generate_pyramid(VkCommandBuffer command_buffer, VkImageView source_view, VkImageLayout source_layout,
+                          VkExtent2D source_extent, ImageHandle pyramid, VkImageLayout final_layout,
+                          DescriptorAllocator &descriptor_allocator, MipReduction reduction);
+
+    void destroy();
+
+private:
+    bool can_use_single_pass(ImageHandle image) const;
+
+    // source_extent is mip 0 of the source, destination gets mip_count levels reduced from it
+    bool can_downsample(VkExtent2D source_extent, uint32_t mip_count, ImageHandle destination) const;
+
+    // One dispatch writing destination_views[i] with level i + 1 of the source, which has to be readable already and
+    // the views in GENERAL
+    void record_downsample(VkCommandBuffer command_buffer, VkImageView source_view, VkImageLayout source_layout,
+                           VkExtent2D source_extent, std::span<const VkImageView> destination_views,
+                           DescriptorAllocator &descriptor_allocator, MipReduction reduction);
+
+    void generate_single_pass(VkCommandBuffer command_buffer, ImageHandle image, VkImageLayout current_layout,
+                              VkImageLayout final_layout, DescriptorAllocator &descriptor_allocator,
+                              MipReduction reduction);
+
+    bool can_use_blit_chain(ImageHandle image) const;
+
+    void generate_blit_chain(VkCommandBuffer command_buffer, ImageHandle image, VkImageLayout current_layout,
+                             VkImageLayout final_layout);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+    ResourceManager *resources = nullptr;
+};
+
+
+#endif //INCANDESCENT_MIPMAPS_H
@@ -5,6 +5,7 @@
 #include "incandescent_pipelines.h"
 #include <fstream>
 #include <incan_struct_init.h>
+#include <cstring>
 
 bool incan_util::load_shader_module(const char *file_path, VkDevice device, VkShaderModule *out_shader_module) {
     // Open file with cursor at the end
@@ -46,4 +47,311 @@ bool incan_util::load_shader_module(const char *file_path, VkDevice device, VkSh
     return true;
 }
 
+namespace {
+    // Vulkan's vertex input and blend structs are all 32-bit fields with no padding, so they compare and hash as
+    // arrays of words
+    template<typename T>
+    bool words_equal(std::span<const T> a, std::span<const T> b) {
+        static_assert(sizeof(T) % sizeof(uint32_t) == 0);
+        return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size_bytes()) == 0);
+    }
+
+    template<typename T>
+    void hash_words(size_t &seed, std::span<const T> values) {
+        static_assert(sizeof(T) % sizeof(uint32_t) == 0);
+        const auto *bytes = reinterpret_cast<const std::byte *>(values.data());
+        for (size_t offset = 0; offset < values.size_bytes(); offset += sizeof(uint32_t)) {
+            uint32_t word;
+            std::memcpy(&word, bytes + offset, sizeof(uint32_t));
+            incan_util::hash_combine(seed, word);
+        }
+    }
+
+    VkPipeline create_graphics_pipeline(VkDevice device, const GraphicsPipelineState &state,
+                                        std::span<const VkShaderModule> shader_modules) {
+        std::vector<VkPipelineShaderStageCreateInfo> stages(state.shader_stages.size());
+        for (size_t i = 0; i < stages.size(); i++) {
+            stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stages[i].pNext = nullptr;
+            stages[i].stage = state.shader_stages[i].stage;
+            stages[i].module = shader_modules[i];
+            stages[i].pName = "main";
+        }
+
+        VkPipelineRenderingCreateInfo rendering_create_info = {};
+        rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+        rendering_create_info.pNext = nullptr;
+        rendering_create_info.colorAttachmentCount = static_cast<uint32_t>(state.color_attachment_formats.size());
+        rendering_create_info.pColorAttachmentFormats = state.color_attachment_formats.data();
+        rendering_create_info.depthAttachmentFormat = state.depth_attachment_format;
+
+        // Ignored by mesh shading pipelines
+        VkPipelineVertexInputStateCreateInfo vertex_input_state = {};
+        vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertex_input_state.pNext = nullptr;
+        vertex_input_state.vertexBindingDescriptionCount = static_cast<uint32_t>(state.vertex_bindings.size());
+        vertex_input_state.pVertexBindingDescriptions = state.vertex_bindings.data();
+        vertex_input_state.vertexAttributeDescriptionCount = static_cast<uint32_t>(state.vertex_attributes.size());
+        vertex_input_state.pVertexAttributeDescriptions = state.vertex_attributes.data();
+
+        VkPipelineInputAssemblyStateCreateInfo input_assembly_state = {};
+        input_assembly_state.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        input_assembly_state.pNext = nullptr;
+        input_assembly_state.topology = state.topology;
+
+        VkPipelineViewportStateCreateInfo viewport_state = {};
+        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewport_state.pNext = nullptr;
+        viewport_state.viewportCount = 1;
+        viewport_state.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterization_state = {};
+        rasterization_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterization_state.pNext = nullptr;
+        rasterization_state.polygonMode = state.polygon_mode;
+        rasterization_state.cullMode = state.cull_mode;
+        rasterization_state.frontFace = state.front_face;
+        rasterization_state.lineWidth = 1.0f;
+
+        VkPipelineMultisampleStateCreateInfo multisample_state = {};
+        multisample_state.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisample_state.pNext = nullptr;
+        multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisample_state.minSampleShading = 1.0f;
+
+        VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {};
+        depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depth_stencil_state.pNext = nullptr;
+        depth_stencil_state.depthTestEnable = state.depth_test ? VK_TRUE : VK_FALSE;
+        depth_stencil_state.depthWriteEnable = state.depth_write ? VK_TRUE : VK_FALSE;
+        depth_stencil_state.depthCompareOp = state.depth_compare_op;
+        depth_stencil_state.minDepthBounds = 0.0f;
+        depth_stencil_state.maxDepthBounds = 1.0f;
+
+        std::vector<VkPipelineColorBlendAttachmentState> blend_attachments(state.color_attachment_formats.size(),
+                                                                           state.blend_attachment);
+        VkPipelineColorBlendStateCreateInfo color_blend_state = {};
+        color_blend_state.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        color_blend_state.pNext = nullptr;
+        color_blend_state.attachmentCount = static_cast<uint32_t>(blend_attachments.size());
+        color_blend_state.pAttachments = blend_attachments.data();
+
+        std::array<VkDynamicState, 2> dynamic_states = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+        VkPipelineDynamicStateCreateInfo dynamic_state = {};
+        dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state.pNext = nullptr;
+        dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+        dynamic_state.pDynamicStates = dynamic_states.data();
+
+        VkGraphicsPipelineCreateInfo pipeline_create_info = {};
+        pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipeline_create_info.pNext = &rendering_create_info;
+        pipeline_create_info.flags = state.flags;
+        pipeline_create_info.stageCount = static_cast<uint32_t>(stages.size());
+        pipeline_create_info.pStages = stages.data();
+        pipeline_create_info.pVertexInputState = &vertex_input_state;
+        pipeline_create_info.pInputAssemblyState = &input_assembly_state;
+        pipeline_create_info.pViewportState = &viewport_state;
+        pipeline_create_info.pRasterizationState = &rasterization_state;
+        pipeline_create_info.pMultisampleState = &multisample_state;
+        pipeline_create_info.pDepthStencilState = &depth_stencil_state;
+        pipeline_create_info.pColorBlendState = &color_blend_state;
+        pipeline_create_info.pDynamicState = &dynamic_state;
+        pipeline_create_info.layout = state.layout;
+
+        VkPipeline pipeline;
+        VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline));
+        return pipeline;
+    }
+}
+
+bool GraphicsPipelineState::operator==(const GraphicsPipelineState &other) const {
+    return shader_stages == other.shader_stages &&
+           words_equal<VkVertexInputBindingDescription>(vertex_bindings, other.vertex_bindings) &&
+           words_equal<VkVertexInputAttributeDescription>(vertex_attributes, other.vertex_attributes) &&
+           topology == other.topology && polygon_mode == other.polygon_mode && cull_mode == other.cull_mode &&
+           front_face == other.front_face && depth_test == other.depth_test && depth_write == other.depth_write &&
+           depth_compare_op == other.depth_compare_op &&
+           words_equal<VkPipelineColorBlendAttachmentState>({&blend_attachment, 1}, {&other.blend_attachment, 1}) &&
+           color_attachment_formats == other.color_attachment_formats &&
+           depth_attachment_format == other.depth_attachment_format && flags == other.flags && layout == other.layout;
+}
+
+size_t GraphicsPipelineStateHash::operator()(const GraphicsPipelineState &state) const {
+    size_t seed = std::hash<VkPipelineLayout>{}(state.layout);
+    for (const PipelineShaderStage &shader_stage: state.shader_stages) {
+        incan_util::hash_combine(seed, shader_stage.stage);
+        incan_util::hash_combine(seed, std::hash<std::string>{}(shader_stage.file_path));
+    }
+    hash_words<VkVertexInputBindingDescription>(seed, state.vertex_bindings);
+    hash_words<VkVertexInputAttributeDescription>(seed, state.vertex_attributes);
+    incan_util::hash_combine(seed, state.topology);
+    incan_util::hash_combine(seed, state.polygon_mode);
+    incan_util::hash_combine(seed, state.cull_mode);
+    incan_util::hash_combine(seed, state.front_face);
+    incan_util::hash_combine(seed, state.depth_test);
+    incan_util::hash_combine(seed, state.depth_write);
+    incan_util::hash_combine(seed, state.depth_compare_op);
+    hash_words<VkPipelineColorBlendAttachmentState>(seed, {&state.blend_attachment, 1});
+    for (VkFormat format: state.color_attachment_formats) {
+        incan_util::hash_combine(seed, format);
+    }
+    incan_util::hash_combine(seed, state.depth_attachment_format);
+    incan_util::hash_combine(seed, state.flags);
+    return seed;
+}
+
+void GraphicsPipelineCache::initialize(VkDevice vulkan_device, ResourceManager &resource_manager) {
+    device = vulkan_device;
+    resources = &resource_manager;
+}
+
+std::optional<PipelineHandle> GraphicsPipelineCache::get_pipeline(const GraphicsPipelineState &state) {
+    std::promise<std::optional<PipelineHandle>> promise;
+    {
+        std::unique_lock lock(cache_mutex);
+        auto cached = pipelines.find(state);
+        if (cached != pipelines.end()) {
+            // May still be compiling on another thread, so it is waited on outside the lock
+            std::shared_future<std::optional<PipelineHandle>> pipeline = cached->second;
+            lock.unlock();
+            return pipeline.get();
+        }
+        pipelines.emplace(state, promise.get_future().share());
+    }
 
+    std::vector<VkShaderModule> shader_modules;
+    for (const PipelineShaderStage &shader_stage: state.shader_stages) {
+        VkShaderModule shader_module;
+        if (!incan_util::load_shader_module(shader_stage.file_path.c_str(), device, &shader_module)) {
+            fmt::print("Error when building shader {}\n", shader_stage.file_path);
+            break;
+        }
+        shader_modules.push_back(shader_module);
+    }
+
+    std::optional<PipelineHandle> handle;
+    if (shader_modules.size() == state.shader_stages.size()) {
+        VkPipeline pipeline = create_graphics_pipeline(device, state, shader_modules);
+        // The ResourceManager isn't thread safe, the cache's lock is what keeps its own calls apart
+        std::lock_guard lock(cache_mutex);
+        handle = resources->add_pipeline(pipeline, state.layout, VK_PIPELINE_BIND_POINT_GRAPHICS);
+    }
+    for (VkShaderModule shader_module: shader_modules) {
+        vkDestroyShaderModule(device, shader_module, nullptr);
+    }
+
+    promise.set_value(handle);
+    return handle;
+}
+
+void GraphicsPipelineCache::destroy() {
+    // Compiles still running take the lock to register their pipeline, so they are waited on without it
+    decltype(pipelines) compiled_pipelines;
+    {
+        std::lock_guard lock(cache_mutex);
+        compiled_pipelines = std::move(pipelines);
+        pipelines.clear();
+    }
+    for (auto &[state, pipeline]: compiled_pipelines) {
+        std::optional<PipelineHandle> handle = pipeline.get();
+        if (handle.has_value()) {
+            resources->destroy_pipeline(handle.value());
+        }
+    }
+}
+
+void PipelineBuilder::add_shader_stage(VkShaderStageFlagBits stage, const char *file_path) {
+    state.shader_stages.push_back({stage, file_path});
+}
+
+void PipelineBuilder::add_vertex_binding(uint32_t binding, uint32_t stride, VkVertexInputRate input_rate) {
+    VkVertexInputBindingDescription vertex_binding = {};
+    vertex_binding.binding = binding;
+    vertex_binding.stride = stride;
+    vertex_binding.inputRate = input_rate;
+    state.vertex_bindings.push_back(vertex_binding);
+}
+
+void PipelineBuilder::add_vertex_attribute(uint32_t location, uint32_t binding, VkFormat format, uint32_t offset) {
+    VkVertexInputAttributeDescription vertex_attribute = {};
+    vertex_attribute.location = location;
+    vertex_attribute.binding = binding;
+    vertex_attribute.format = format;
+    vertex_attribute.offset = offset;
+    state.vertex_attributes.push_back(vertex_attribute);
+}
+
+void PipelineBuilder::set_input_topology(VkPrimitiveTopology topology) {
+    state.topology = topology;
+}
+
+void PipelineBuilder::set_polygon_mode(VkPolygonMode polygon_mode) {
+    state.polygon_mode = polygon_mode;
+}
+
+void PipelineBuilder::set_cull_mode(VkCullModeFlags cull_mode, VkFrontFace front_face) {
+    state.cull_mode = cull_mode;
+    state.front_face = front_face;
+}
+
+void PipelineBuilder::enable_depth_test(bool depth_write, VkCompareOp compare_op) {
+    state.depth_test = true;
+    state.depth_write = depth_write;
+    state.depth_compare_op = compare_op;
+}
+
+void PipelineBuilder::disable_depth_test() {
+    state.depth_test = false;
+    state.depth_write = false;
+    state.depth_compare_op = VK_COMPARE_OP_ALWAYS;
+}
+
+void PipelineBuilder::enable_blending_additive() {
+    state.blend_attachment.blendEnable = VK_TRUE;
+    state.blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    state.blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    state.blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    state.blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    state.blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    state.blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+}
+
+void PipelineBuilder::enable_blending_alpha_blend() {
+    state.blend_attachment.blendEnable = VK_TRUE;
+    state.blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    state.blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    state.blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+    state.blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    state.blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    state.blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+}
+
+void PipelineBuilder::disable_blending() {
+    // Back to the defaults, so pipelines that never blended and ones that stopped share a key
+    state.blend_attachment = GraphicsPipelineState{}.blend_attachment;
+}
+
+void PipelineBuilder::add_color_attachment_format(VkFormat format) {
+    state.color_attachment_formats.push_back(format);
+}
+
+void PipelineBuilder::set_depth_format(VkFormat format) {
+    state.depth_attachment_format = format;
+}
+
+void PipelineBuilder::set_flags(VkPipelineCreateFlags flags) {
+    state.flags = flags;
+}
+
+void PipelineBuilder::set_layout(VkPipelineLayout layout) {
+    state.layout = layout;
+}
+
+void PipelineBuilder::clear() {
+    state = {};
+}
+
+std::optional<PipelineHandle> PipelineBuilder::build(GraphicsPipelineCache &pipeline_cache) const {
+    return pipeline_cache.get_pipeline(state);
+}
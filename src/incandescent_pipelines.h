@@ -8,15 +8,127 @@
 #include "incandescent_pipelines.h"
 #include <fstream>
 #include <incan_struct_init.h>
+#include <incandescent_types.h>
+#include <incandescent_resources.h>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace incan_util {
     bool load_shader_module(const char *file_path, VkDevice device, VkShaderModule *out_shader_module);
 }
 
-class incandescent_pipelines {
+// Shaders are named by their SPIR-V file rather than a module, a destroyed module's handle can come back for
+// different code and would hit the wrong pipeline
+struct PipelineShaderStage {
+    VkShaderStageFlagBits stage;
+    std::string file_path;
 
+    bool operator==(const PipelineShaderStage &other) const = default;
 };
 
+/*
+ * Everything a graphics pipeline is built from, and the key it is cached under. Pipelines always render with dynamic
+ * rendering into the attachment formats given here, with one sample and a dynamic viewport and scissor.
+ */
+struct GraphicsPipelineState {
+    std::vector<PipelineShaderStage> shader_stages;
+    std::vector<VkVertexInputBindingDescription> vertex_bindings;
+    std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_NONE;
+    VkFrontFace front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    bool depth_test = false;
+    bool depth_write = false;
+    VkCompareOp depth_compare_op = VK_COMPARE_OP_ALWAYS;
+    // Applied to every color attachment
+    VkPipelineColorBlendAttachmentState blend_attachment = {
+        VK_FALSE, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE,
+        VK_BLEND_FACTOR_ZERO, VK_BLEND_OP_ADD,
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    };
+    std::vector<VkFormat> color_attachment_formats;
+    VkFormat depth_attachment_format = VK_FORMAT_UNDEFINED;
+    VkPipelineCreateFlags flags = 0;
+    // Owned by the DescriptorLayoutCache, so equal layouts are the same handle
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+
+    bool operator==(const GraphicsPipelineState &other) const;
+};
+
+struct GraphicsPipelineStateHash {
+    size_t operator()(const GraphicsPipelineState &state) const;
+};
+
+/*
+ * Returns the pipeline already built for an identical GraphicsPipelineState instead of compiling another one, so
+ * passes asking for the same state share one VkPipeline and draws between them don't change the bound pipeline.
+ * Safe to call from any thread: compiles happen outside the lock, several different pipelines can compile at once,
+ * and a caller asking for a pipeline that is still compiling waits for it instead of compiling it again.
+ * The ResourceManager holds the pipelines, the cache owns the handles it returns and callers must not destroy them.
+ */
+struct GraphicsPipelineCache {
+    void initialize(VkDevice vulkan_device, ResourceManager &resource_manager);
+
+    // Nothing if a shader couldn't be loaded, which is cached like a pipeline
+    std::optional<PipelineHandle> get_pipeline(const GraphicsPipelineState &state);
+
+    // Destroys every cached pipeline, before the ResourceManager is destroyed
+    void destroy();
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    ResourceManager *resources = nullptr;
+
+    std::mutex cache_mutex;
+    std::unordered_map<GraphicsPipelineState, std::shared_future<std::optional<PipelineHandle>>,
+        GraphicsPipelineStateHash> pipelines;
+};
+
+// Fills in a GraphicsPipelineState, what isn't set keeps the defaults: filled triangle lists, no culling, no depth
+// test and no blending
+struct PipelineBuilder {
+    GraphicsPipelineState state;
+
+    void add_shader_stage(VkShaderStageFlagBits stage, const char *file_path);
+
+    void add_vertex_binding(uint32_t binding, uint32_t stride,
+                            VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX);
+
+    void add_vertex_attribute(uint32_t location, uint32_t binding, VkFormat format, uint32_t offset);
+
+    void set_input_topology(VkPrimitiveTopology topology);
+
+    void set_polygon_mode(VkPolygonMode polygon_mode);
+
+    void set_cull_mode(VkCullModeFlags cull_mode, VkFrontFace front_face);
+
+    void enable_depth_test(bool depth_write, VkCompareOp compare_op);
+
+    void disable_depth_test();
+
+    // Source color times its alpha, added to the destination
+    void enable_blending_additive();
+
+    // Source over destination by the source's alpha
+    void enable_blending_alpha_blend();
+
+    void disable_blending();
+
+    void add_color_attachment_format(VkFormat format);
+
+    void set_depth_format(VkFormat format);
+
+    void set_flags(VkPipelineCreateFlags flags);
+
+    void set_layout(VkPipelineLayout layout);
+
+    void clear();
+
+    std::optional<PipelineHandle> build(GraphicsPipelineCache &pipeline_cache) const;
+};
 
 
 #endif //INCANDESCENT_PIPELINES_H
@@ -0,0 +1,568 @@
+#include <incandescent_residency.h>
+#include <incandescent_engine.h>
+#include <incandescent_decompression.h>
+#include <incandescent_images.h>
+#include <incandescent_ktx2.h>
+#include <volk.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    // Instances outside the view count for this share of their size on screen
+    constexpr float OFFSCREEN_PRIORITY_SCALE = 0.25f;
+    // Instances smaller than this on screen don't ask for their assets
+    constexpr float MIN_PRIORITY_PIXELS = 1.0f;
+    // Mips no larger than this on either side are never evicted, they are what a texture falls back to
+    constexpr uint32_t MIP_TAIL_EXTENT = 64;
+    // Instances scored per update, scenes with more take several frames to refresh their assets' priorities
+    constexpr size_t PRIORITY_INSTANCES_PER_FRAME = 4096;
+
+    // One asset waiting to be streamed in or one that could be evicted
+    struct AssetEntry {
+        size_t scene;
+        size_t index;
+        bool texture;
+        float priority;
+        uint64_t last_used_frame;
+        // Eviction only: the coarsest mip evicting a texture may leave it with
+        uint32_t coarsest_mip;
+    };
+
+    // Block extent and bytes per block of the formats textures come in, uncompressed formats are 1x1 blocks
+    std::pair<uint32_t, VkDeviceSize> format_block(VkFormat format) {
+        switch (format) {
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+                return {4, 8};
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+                return {4, 16};
+            case VK_FORMAT_R16G16B16A16_SFLOAT:
+                return {1, 8};
+            default:
+                return {1, 4};
+        }
+    }
+
+    VkExtent3D mip_extent(VkExtent3D extent, uint32_t mip) {
+        return {std::max(extent.width >> mip, 1u), std::max(extent.height >> mip, 1u), 1};
+    }
+
+    // Tightly packed size of one mip, what it costs on the GPU give or take the driver's padding
+    VkDeviceSize mip_bytes(const ResidentTexture &texture, uint32_t mip) {
+        auto [block_extent, block_bytes] = format_block(texture.format);
+        VkExtent3D extent = mip_extent(texture.extent, mip);
+        return static_cast<VkDeviceSize>((extent.width + block_extent - 1) / block_extent) *
+               ((extent.height + block_extent - 1) / block_extent) * block_bytes;
+    }
+
+    // Bytes of first_mip and every coarser mip
+    VkDeviceSize texture_bytes(const ResidentTexture &texture, uint32_t first_mip) {
+        VkDeviceSize bytes = 0;
+        for (uint32_t mip = first_mip; mip < texture.mip_count; mip++) {
+            bytes += mip_bytes(texture, mip);
+        }
+        return bytes;
+    }
+
+    // Coarsest resident_mip the texture may have, textures without a mip source keep all of them
+    uint32_t tail_mip(const ResidentTexture &texture) {
+        if (!texture.mip_source.has_value()) {
+            return 0;
+        }
+        uint32_t mip = 0;
+        while (mip + 1 < texture.mip_count &&
+               std::max(texture.extent.width, texture.extent.height) >> mip > MIP_TAIL_EXTENT) {
+            mip++;
+        }
+        return mip;
+    }
+
+    std::span<const std::byte> scene_array(const SceneData &scene_data, MeshSection section) {
+        switch (section) {
+            case MeshSection::Vertices:
+                return std::as_bytes(scene_data.vertices);
+            case MeshSection::Indices:
+                return std::as_bytes(scene_data.indices);
+            case MeshSection::Meshlets:
+                return std::as_bytes(scene_data.meshlets);
+            case MeshSection::MeshletVertices:
+                return std::as_bytes(scene_data.meshlet_vertices);
+            case MeshSection::MeshletTriangles:
+                return std::as_bytes(scene_data.meshlet_triangles);
+            default:
+                return {};
+        }
+    }
+
+    // A texture whose image is rebuilt this frame, copying the mips both images have from source_mip's image
+    struct TextureRebuild {
+        size_t scene;
+        size_t texture;
+        uint32_t target_mip;
+        uint32_t source_mip;
+        ImageHandle image;
+    };
+
+    // A texture read back from the archive has to be exactly the one its image was created from
+    bool mips_match(const Ktx2Layout &layout, const ResidentTexture &resident_texture) {
+        return layout.format == resident_texture.format && layout.level_ranges.size() == resident_texture.mip_count &&
+               layout.width == resident_texture.extent.width && layout.height == resident_texture.extent.height;
+    }
+}
+
+void ResidencyManager::initialize(VmaAllocator vma_allocator, MemoryTelemetry &telemetry,
+                                  ResourceManager &resource_manager, AsyncFileReader &reader,
+                                  const GpuDecompressor &decompressor, float budget_fraction,
+                                  VkDeviceSize upload_bytes_per_frame) {
+    allocator = vma_allocator;
+    memory_telemetry = &telemetry;
+    resources = &resource_manager;
+    file_reader = &reader;
+    gpu_decompressor = &decompressor;
+    heap_budget_fraction = budget_fraction;
+    upload_limit = upload_bytes_per_frame;
+}
+
+void ResidencyManager::update(VkCommandBuffer command_buffer, std::span<LoadedScene> scenes, const Camera &camera,
+                              VkExtent2D extent, uint64_t frame_number, bool release_retired) {
+    if (release_retired) {
+        release_retired_resources(frame_number);
+    }
+
+    RetiredResources retiring = {};
+    retiring.frame = frame_number;
+    // Images rebuilt this frame, for finished read backs and for textures that lose mips
+    std::vector<TextureRebuild> rebuilds;
+    auto begin_rebuild = [&](size_t scene_index, size_t texture, uint32_t target_mip) -> TextureRebuild & {
+        ResidentTexture &resident_texture = scenes[scene_index].resident_textures[texture];
+        TextureRebuild &rebuild = rebuilds.emplace_back();
+        rebuild.scene = scene_index;
+        rebuild.texture = texture;
+        rebuild.target_mip = target_mip;
+        rebuild.source_mip = resident_texture.resident_mip;
+        rebuild.image = resources->create_image(resident_texture.format,
+                                                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                                mip_extent(resident_texture.extent, target_mip),
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, AllocationCategory::Texture,
+                                                resident_texture.mip_count - target_mip);
+        resident_texture.resident_mip = target_mip;
+        resident_texture.streaming_mip = target_mip;
+        return rebuild;
+    };
+
+    /* -------- Finish read backs -------- */
+    // The levels are copied from where the reads put them in the staging buffer, or from where the GPU expands them
+    for (auto readback = readbacks.begin(); readback != readbacks.end();) {
+        if (!file_reader->is_complete(readback->read_batch)) {
+            readback++;
+            continue;
+        }
+
+        ResidentTexture &resident_texture = scenes[readback->scene].resident_textures[readback->texture];
+        UploadBatch &upload_batch = readback->upload_batch;
+        const StagedEntry &staged_entry = readback->staged_entry;
+        std::optional<Ktx2Layout> layout;
+        if (file_reader->wait(readback->read_batch)) {
+            layout = incan_ktx2::read_layout(
+                incan_decompression::entry_header(staged_entry, *resident_texture.mip_source, upload_batch),
+                resident_texture.mip_source->size);
+        }
+        resident_texture.streaming_mip = resident_texture.resident_mip;
+
+        // A texture whose entry can't be read or has changed keeps the mips it has from now on
+        if (!layout.has_value() || !mips_match(*layout, resident_texture)) {
+            fmt::print("Failed to read the mips of texture {} back from its archive\n", readback->texture);
+            resident_texture.mip_source.reset();
+            upload_batch.destroy();
+        } else {
+            TextureRebuild &rebuild = begin_rebuild(readback->scene, readback->texture, readback->target_mip);
+            VkImage image = resources->images.hot(rebuild.image).image;
+            for (uint32_t mip = rebuild.target_mip; mip < rebuild.source_mip; mip++) {
+                upload_batch.copy_to_image(staged_entry.offset + layout->level_ranges[mip].first, image,
+                                           mip_extent(resident_texture.extent, mip), mip - rebuild.target_mip,
+                                           staged_entry.source);
+            }
+            retiring.upload_batches.push_back(std::move(upload_batch));
+        }
+        readback = readbacks.erase(readback);
+    }
+
+    /* -------- Priorities -------- */
+    float aspect_ratio = static_cast<float>(extent.width) / static_cast<float>(std::max(extent.height, 1u));
+    std::array<Eigen::Vector4f, 5> frustum_planes = camera.frustum_planes(aspect_ratio);
+    float pixels_per_unit = static_cast<float>(extent.height) / (2.0f * std::tan(camera.vertical_fov * 0.5f));
+
+    // Priorities are gathered over a sweep through every scene's instances, a slice of them per frame, so the cost of
+    // a frame doesn't grow with the instance count. The scenes may change mid sweep, which only skews that one sweep
+    size_t instance_count = 0;
+    for (const LoadedScene &scene: scenes) {
+        instance_count += scene.instances.size();
+    }
+    size_t slice_begin = std::min(next_instance, instance_count);
+    size_t slice_end = std::min(slice_begin + PRIORITY_INSTANCES_PER_FRAME, instance_count);
+
+    size_t scene_begin = 0;
+    for (LoadedScene &scene: scenes) {
+        size_t scene_end = scene_begin + scene.instances.size();
+        size_t first = std::clamp(slice_begin, scene_begin, scene_end) - scene_begin;
+        size_t end = std::clamp(slice_end, scene_begin, scene_end) - scene_begin;
+        scene_begin = scene_end;
+
+        for (size_t instance_index = first; instance_index < end; instance_index++) {
+            const MeshInstance &instance = scene.instances[instance_index];
+            const MeshAsset &mesh = scene.meshes[instance.mesh];
+            Eigen::Vector3f center = (instance.world_transform * mesh.position_offset.homogeneous()).head<3>();
+            float max_scale = instance.world_transform.topLeftCorner<3, 3>().colwise().norm().maxCoeff();
+            float radius = mesh.position_scale.norm() * max_scale;
+            float distance = std::max((center - camera.position).norm() - radius, camera.near_plane);
+            float pixels = radius / distance * pixels_per_unit;
+            bool in_view = std::ranges::all_of(frustum_planes, [&](const Eigen::Vector4f &plane) {
+                return plane.head<3>().dot(center) + plane.w() >= -radius;
+            });
+            float priority = in_view ? pixels : pixels * OFFSCREEN_PRIORITY_SCALE;
+            if (priority < MIN_PRIORITY_PIXELS) {
+                continue;
+            }
+
+            ResidentMesh &resident_mesh = scene.resident_meshes[instance.mesh];
+            resident_mesh.sweep_priority = std::max(resident_mesh.sweep_priority, priority);
+
+            // Taken as if each texture covered the instance once, its diameter on screen needs that many texels
+            for (const GeometrySurface &surface: mesh.surfaces) {
+                if (surface.material >= scene.materials.size()) {
+                    continue;
+                }
+                const MaterialData &material = scene.materials[surface.material];
+                for (uint32_t texture: {material.base_color_texture, material.metallic_roughness_texture,
+                                        material.normal_texture}) {
+                    if (texture >= scene.resident_textures.size() || scene.resident_textures[texture].mip_count == 0) {
+                        continue;
+                    }
+                    ResidentTexture &resident_texture = scene.resident_textures[texture];
+                    resident_texture.sweep_priority = std::max(resident_texture.sweep_priority, priority);
+
+                    float texels = static_cast<float>(std::max(resident_texture.extent.width,
+                                                               resident_texture.extent.height));
+                    float mip = std::floor(std::log2(std::max(texels / (2.0f * pixels), 1.0f)));
+                    resident_texture.sweep_mip = std::min(resident_texture.sweep_mip, static_cast<uint32_t>(mip));
+                }
+            }
+        }
+    }
+    next_instance = slice_end;
+
+    // Once every instance has been scored the sweep replaces the priorities and the next one starts over
+    if (next_instance == instance_count) {
+        for (LoadedScene &scene: scenes) {
+            for (ResidentMesh &resident_mesh: scene.resident_meshes) {
+                resident_mesh.priority = resident_mesh.sweep_priority;
+                if (resident_mesh.priority > 0.0f) {
+                    resident_mesh.last_used_frame = frame_number;
+                }
+                resident_mesh.sweep_priority = 0.0f;
+            }
+            for (ResidentTexture &resident_texture: scene.resident_textures) {
+                resident_texture.priority = resident_texture.sweep_priority;
+                resident_texture.wanted_mip = std::min(tail_mip(resident_texture), resident_texture.sweep_mip);
+                if (resident_texture.priority > 0.0f) {
+                    resident_texture.last_used_frame = frame_number;
+                }
+                resident_texture.sweep_priority = 0.0f;
+                resident_texture.sweep_mip = UINT32_MAX;
+            }
+        }
+        next_instance = 0;
+        priority_frame = frame_number;
+    }
+
+    /* -------- Requests and eviction candidates -------- */
+    VkDeviceSize resident_bytes = 0;
+    std::vector<AssetEntry> requests;
+    std::vector<AssetEntry> candidates;
+    // Mips each texture ends the frame with, its image is only rebuilt once every decision is made
+    std::vector<std::vector<uint32_t>> target_mips(scenes.size());
+    for (size_t scene_index = 0; scene_index < scenes.size(); scene_index++) {
+        LoadedScene &scene = scenes[scene_index];
+        for (size_t mesh = 0; mesh < scene.resident_meshes.size(); mesh++) {
+            const ResidentMesh &resident_mesh = scene.resident_meshes[mesh];
+            AssetEntry entry = {scene_index, mesh, false, resident_mesh.priority, resident_mesh.last_used_frame, 0};
+            if (resources->buffers.contains(resident_mesh.buffer)) {
+                resident_bytes += resident_mesh.size;
+                candidates.push_back(entry);
+            } else if (resident_mesh.priority > 0.0f && resident_mesh.size > 0) {
+                requests.push_back(entry);
+            }
+        }
+
+        target_mips[scene_index].resize(scene.resident_textures.size());
+        for (size_t texture = 0; texture < scene.resident_textures.size(); texture++) {
+            const ResidentTexture &resident_texture = scene.resident_textures[texture];
+            target_mips[scene_index][texture] = resident_texture.resident_mip;
+            if (resident_texture.mip_count == 0) {
+                continue;
+            }
+            // Mips still being read back already count, and the texture is left alone until they are in
+            resident_bytes += texture_bytes(resident_texture, std::min(resident_texture.streaming_mip,
+                                                                       resident_texture.resident_mip));
+            if (resident_texture.streaming_mip < resident_texture.resident_mip) {
+                continue;
+            }
+
+            AssetEntry entry = {scene_index, texture, true, resident_texture.priority,
+                                resident_texture.last_used_frame, tail_mip(resident_texture)};
+            if (resident_texture.wanted_mip < resident_texture.resident_mip && resident_texture.priority > 0.0f) {
+                requests.push_back(entry);
+            }
+            // Mips finer than any instance wants are the first to go
+            if (resident_texture.resident_mip < resident_texture.wanted_mip) {
+                candidates.push_back({scene_index, texture, true, 0.0f, 0, resident_texture.wanted_mip});
+            }
+            if (resident_texture.resident_mip < entry.coarsest_mip) {
+                candidates.push_back(entry);
+            }
+        }
+    }
+    std::ranges::sort(requests, std::ranges::greater(), &AssetEntry::priority);
+    std::ranges::sort(candidates, [](const AssetEntry &a, const AssetEntry &b) {
+        return a.last_used_frame != b.last_used_frame ? a.last_used_frame < b.last_used_frame
+                                                      : a.priority < b.priority;
+    });
+
+    /* -------- Evict and pick what streams in -------- */
+    VkDeviceSize budget_bytes = budget(resident_bytes);
+    size_t next_candidate = 0;
+
+    // Evicts until needed_bytes more fit the budget, only what is stale or has less than priority
+    auto make_room = [&](VkDeviceSize needed_bytes, float priority, const AssetEntry *request) {
+        while (resident_bytes + needed_bytes > budget_bytes) {
+            if (next_candidate == candidates.size()) {
+                return false;
+            }
+            const AssetEntry &candidate = candidates[next_candidate];
+            if (candidate.last_used_frame == priority_frame && candidate.priority >= priority) {
+                return false;
+            }
+            bool same_asset = request != nullptr && request->scene == candidate.scene &&
+                              request->index == candidate.index && request->texture == candidate.texture;
+
+            LoadedScene &scene = scenes[candidate.scene];
+            if (candidate.texture) {
+                const ResidentTexture &resident_texture = scene.resident_textures[candidate.index];
+                uint32_t &target_mip = target_mips[candidate.scene][candidate.index];
+                // Textures streaming in from this frame on are left alone
+                if (same_asset || target_mip >= candidate.coarsest_mip || target_mip < resident_texture.resident_mip) {
+                    next_candidate++;
+                    continue;
+                }
+                resident_bytes -= mip_bytes(resident_texture, target_mip);
+                target_mip++;
+            } else {
+                ResidentMesh &resident_mesh = scene.resident_meshes[candidate.index];
+                retiring.buffers.push_back(resident_mesh.buffer);
+                resident_mesh.buffer = {};
+                resident_bytes -= resident_mesh.size;
+                next_candidate++;
+            }
+        }
+        return true;
+    };
+
+    std::vector<AssetEntry> mesh_uploads;
+    VkDeviceSize upload_bytes = 0;
+    for (const AssetEntry &request: requests) {
+        LoadedScene &scene = scenes[request.scene];
+        VkDeviceSize request_bytes;
+        if (request.texture) {
+            const ResidentTexture &resident_texture = scene.resident_textures[request.index];
+            // Evicted from while making room for an earlier request
+            if (target_mips[request.scene][request.index] != resident_texture.resident_mip) {
+                continue;
+            }
+            request_bytes = texture_bytes(resident_texture, resident_texture.wanted_mip) -
+                            texture_bytes(resident_texture, resident_texture.resident_mip);
+        } else {
+            request_bytes = scene.resident_meshes[request.index].size;
+        }
+
+        // The rest waits for the next frames, but one asset always goes through however large it is
+        if (upload_bytes > 0 && upload_bytes + request_bytes > upload_limit) {
+            break;
+        }
+        if (!make_room(request_bytes, request.priority, &request)) {
+            continue;
+        }
+        resident_bytes += request_bytes;
+        upload_bytes += request_bytes;
+
+        if (request.texture) {
+            target_mips[request.scene][request.index] = scene.resident_textures[request.index].wanted_mip;
+        } else {
+            mesh_uploads.push_back(request);
+        }
+    }
+    // The budget can also shrink under what is already resident
+    make_room(0, std::numeric_limits<float>::max(), nullptr);
+
+    /* -------- Stage meshes, start read backs -------- */
+    UploadBatch upload_batch;
+    upload_batch.initialize(allocator, *memory_telemetry);
+
+    // Shaders read meshes through buffer device addresses, transfer source lets the defragmenter move them
+    std::vector<VkDeviceSize> mesh_staging_offsets;
+    for (const AssetEntry &upload: mesh_uploads) {
+        ResidentMesh &resident_mesh = scenes[upload.scene].resident_meshes[upload.index];
+        resident_mesh.buffer = resources->create_buffer(resident_mesh.size,
+                                                        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                                        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+                                                        VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                                                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                                        VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE, 0,
+                                                        AllocationCategory::Buffer);
+        mesh_staging_offsets.push_back(upload_batch.reserve(resident_mesh.size));
+        upload_batch.copy_to_buffer(mesh_staging_offsets.back(), resources->buffers.hot(resident_mesh.buffer).buffer,
+                                    0, resident_mesh.size);
+    }
+    if (upload_batch.staged_bytes() > 0) {
+        upload_batch.allocate_staging();
+        for (size_t i = 0; i < mesh_uploads.size(); i++) {
+            const LoadedScene &scene = scenes[mesh_uploads[i].scene];
+            const ResidentMesh &resident_mesh = scene.resident_meshes[mesh_uploads[i].index];
+            std::byte *staging = upload_batch.staging_data(mesh_staging_offsets[i]);
+            for (size_t section = 0; section < MESH_SECTION_COUNT; section++) {
+                std::span<const std::byte> source = scene_array(scene.scene_data, static_cast<MeshSection>(section));
+                VkDeviceSize element_size = MESH_SECTION_ELEMENT_SIZES[section];
+                memcpy(staging + resident_mesh.section_offsets[section],
+                       source.data() + resident_mesh.first_elements[section] * element_size,
+                       resident_mesh.element_counts[section] * element_size);
+            }
+        }
+        retiring.upload_batches.push_back(std::move(upload_batch));
+    } else {
+        upload_batch.destroy();
+    }
+
+    // Finer mips are read from the texture's KTX2 straight into a staging buffer of its own (still compressed when
+    // the GPU decompresses), its image is rebuilt in the first update after the read completes. Each texture is a
+    // batch of its own, so a failed read only costs it
+    for (size_t scene_index = 0; scene_index < scenes.size(); scene_index++) {
+        for (size_t texture = 0; texture < target_mips[scene_index].size(); texture++) {
+            ResidentTexture &resident_texture = scenes[scene_index].resident_textures[texture];
+            uint32_t target_mip = target_mips[scene_index][texture];
+            if (target_mip > resident_texture.resident_mip) {
+                begin_rebuild(scene_index, texture, target_mip);
+                continue;
+            }
+            if (target_mip == resident_texture.resident_mip) {
+                continue;
+            }
+
+            Readback &readback = readbacks.emplace_back();
+            readback.scene = scene_index;
+            readback.texture = texture;
+            readback.target_mip = target_mip;
+            readback.upload_batch.initialize(allocator, *memory_telemetry);
+            readback.staged_entry = incan_decompression::stage_entry(*gpu_decompressor,
+                                                                     scenes[scene_index].texture_archive,
+                                                                     *resident_texture.mip_source,
+                                                                     readback.upload_batch);
+            readback.read_batch = file_reader->submit({&readback.staged_entry.read, 1});
+            resident_texture.streaming_mip = target_mip;
+        }
+    }
+
+    /* -------- Record -------- */
+    // Images that only lose mips get no upload, so the batches don't move them out of UNDEFINED
+    for (const TextureRebuild &rebuild: rebuilds) {
+        incan_util::transition_image(command_buffer, resources->images.hot(rebuild.image).image,
+                                     VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COPY_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    }
+    for (UploadBatch &recorded_batch: retiring.upload_batches) {
+        recorded_batch.record(command_buffer);
+    }
+
+    // The mips both images have are copied over on the GPU, then the new image takes over the texture's handle
+    for (const TextureRebuild &rebuild: rebuilds) {
+        LoadedScene &scene = scenes[rebuild.scene];
+        const ResidentTexture &resident_texture = scene.resident_textures[rebuild.texture];
+        ImageHandle texture = scene.textures[rebuild.texture];
+        VkImage old_image = resources->images.hot(texture).image;
+        VkImage new_image = resources->images.hot(rebuild.image).image;
+
+        uint32_t first_kept_mip = std::max(rebuild.target_mip, rebuild.source_mip);
+        incan_util::transition_image(command_buffer, old_image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                     VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                     VK_ACCESS_2_NONE, VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        incan_util::copy_image_contents(command_buffer, old_image, new_image,
+                                        mip_extent(resident_texture.extent, first_kept_mip),
+                                        resident_texture.mip_count - first_kept_mip,
+                                        first_kept_mip - rebuild.source_mip, first_kept_mip - rebuild.target_mip);
+        incan_util::transition_image(command_buffer, new_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COPY_BIT,
+                                     VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                     VK_ACCESS_2_MEMORY_READ_BIT);
+
+        resources->swap_images(texture, rebuild.image);
+        retiring.images.push_back(rebuild.image);
+    }
+
+    if (!retiring.buffers.empty() || !retiring.images.empty() || !retiring.upload_batches.empty()) {
+        retired_resources.push_back(std::move(retiring));
+    }
+}
+
+void ResidencyManager::destroy() {
+    for (Readback &readback: readbacks) {
+        file_reader->wait(readback.read_batch);
+        readback.upload_batch.destroy();
+    }
+    readbacks.clear();
+    release_retired_resources(std::numeric_limits<uint64_t>::max() - FRAME_OVERLAP);
+}
+
+VkDeviceSize ResidencyManager::budget(VkDeviceSize resident_bytes) const {
+    const VkPhysicalDeviceMemoryProperties *memory_properties;
+    vmaGetMemoryProperties(allocator, &memory_properties);
+
+    VkDeviceSize heap_budget = 0;
+    VkDeviceSize heap_usage = 0;
+    for (uint32_t heap = 0; heap < memory_properties->memoryHeapCount; heap++) {
+        if (heap < memory_telemetry->heap_budgets.size() &&
+            (memory_properties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            heap_budget += memory_telemetry->heap_budgets[heap].budget;
+            heap_usage += memory_telemetry->heap_budgets[heap].usage;
+        }
+    }
+
+    // Whatever else is in the heaps stays there, so the share is cut short if the heaps would go over their budget
+    VkDeviceSize other_usage = heap_usage - std::min(heap_usage, resident_bytes);
+    auto share = static_cast<VkDeviceSize>(heap_budget_fraction * static_cast<float>(heap_budget));
+    return std::min(share, heap_budget - std::min(heap_budget, other_usage));
+}
+
+void ResidencyManager::release_retired_resources(uint64_t frame_number) {
+    while (!retired_resources.empty() && retired_resources.front().frame + FRAME_OVERLAP <= frame_number) {
+        RetiredResources &retired = retired_resources.front();
+        for (BufferHandle buffer: retired.buffers) {
+            if (resources->buffers.contains(buffer)) {
+                resources->destroy_buffer(buffer);
+            }
+        }
+        for (ImageHandle image: retired.images) {
+            if (resources->images.contains(image)) {
+                resources->destroy_image(image);
+            }
+        }
+        for (UploadBatch &upload_batch: retired.upload_batches) {
+            upload_batch.destroy();
+        }
+        retired_resources.pop_front();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef INCANDESCENT_RESIDENCY_H
+#define INCANDESCENT_RESIDENCY_H
+
+#include <incandescent_types.h>
+#include <incandescent_camera.h>
+#include <incandescent_decompression.h>
+#include <incandescent_file_reader.h>
+#include <incandescent_loader.h>
+#include <incandescent_memory.h>
+#include <incandescent_resources.h>
+#include <incandescent_upload.h>
+#include <deque>
+
+/*
+ * Keeps the loaded scenes' meshes and texture mips on the GPU within a share of the device local heaps' budget.
+ * Each instance gets a priority, its projected radius in pixels (scaled down outside the view, so what is just behind
+ * the camera isn't dropped first), and its mesh and its materials' textures take the largest priority of their
+ * instances. Instances are scored a fixed slice per frame, so with many of them the priorities trail the camera by a
+ * few frames:
+ *   - meshes are streamed in whole from the scene's CPU copy, each into a buffer of its own
+ *   - textures keep the mips their instances' size on screen calls for plus a small tail that is never evicted. The
+ *     finer mips are read back from the texture's entry in the scene's texture archive without blocking, once the
+ *     read completes the image is rebuilt with that many mips and swapped in under the same handle. Dropping mips
+ *     rebuilds it right away. Textures without an archive entry keep every mip
+ * Once the budget is full the least recently wanted assets are evicted first, then the lowest priority ones, but
+ * never to make room for something with a lower priority. Everything is recorded into the frame's command buffer and
+ * what is evicted or replaced, along with its staging memory, is destroyed once that frame has retired, so nothing
+ * waits on the device.
+ */
+struct ResidencyManager {
+    void initialize(VmaAllocator vma_allocator, MemoryTelemetry &telemetry, ResourceManager &resource_manager,
+                    AsyncFileReader &reader, const GpuDecompressor &decompressor, float budget_fraction,
+                    VkDeviceSize upload_bytes_per_frame);
+
+    // Records this frame's uploads and image rebuilds into command_buffer, which has to run before anything draws
+    // the scenes. With release_retired false (a defragmentation pass is active) nothing retired is destroyed yet
+    void update(VkCommandBuffer command_buffer, std::span<LoadedScene> scenes, const Camera &camera,
+                VkExtent2D extent, uint64_t frame_number, bool release_retired);
+
+    // Only once the device is idle, waits on the read backs still in flight
+    void destroy();
+
+private:
+    // What one frame evicted or replaced and the staging memory of its uploads
+    struct RetiredResources {
+        uint64_t frame;
+        std::vector<BufferHandle> buffers;
+        std::vector<ImageHandle> images;
+        std::vector<UploadBatch> upload_batches;
+    };
+
+    // A texture's mips on their way from its archive entry into a staging buffer of their own
+    struct Readback {
+        size_t scene;
+        size_t texture;
+        uint32_t target_mip;
+        uint64_t read_batch;
+        UploadBatch upload_batch;
+        StagedEntry staged_entry;
+    };
+
+    // Bytes the resident assets may take this frame
+    VkDeviceSize budget(VkDeviceSize resident_bytes) const;
+
+    void release_retired_resources(uint64_t frame_number);
+
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    MemoryTelemetry *memory_telemetry = nullptr;
+    ResourceManager *resources = nullptr;
+    AsyncFileReader *file_reader = nullptr;
+    const GpuDecompressor *gpu_decompressor = nullptr;
+    float heap_budget_fraction = 0.0f;
+    VkDeviceSize upload_limit = 0;
+    std::deque<RetiredResources> retired_resources;
+    std::vector<Readback> readbacks;
+    // Where the current priority sweep continues over the scenes' instances, in scene order
+    size_t next_instance = 0;
+    // When the last sweep finished, assets its instances wanted have this as last_used_frame
+    uint64_t priority_frame = 0;
+};
+
+
+#endif //INCANDESCENT_RESIDENCY_H
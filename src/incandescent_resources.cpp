@@ -0,0 +1,185 @@
+#include <incandescent_resources.h>
+#include <incan_struct_init.h>
+#include <volk.h>
+
+void ResourceManager::initialize(VkDevice vulkan_device, VmaAllocator vma_allocator, MemoryTelemetry &telemetry) {
+    device = vulkan_device;
+    allocator = vma_allocator;
+    memory_telemetry = &telemetry;
+}
+
+ImageHandle ResourceManager::create_image(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent,
+                                          VkImageLayout resting_layout, AllocationCategory category,
+                                          uint32_t mip_levels) {
+    ImageHotData hot_entry = {};
+    hot_entry.bindless_storage_index = NO_BINDLESS_INDEX;
+
+    ImageColdData cold_entry = {};
+    cold_entry.image_extent = extent;
+    cold_entry.image_format = format;
+    cold_entry.mip_levels = mip_levels;
+    cold_entry.usage_flags = usage_flags;
+    cold_entry.resting_layout = resting_layout;
+
+    VkImageCreateInfo image_create_info = incan_struct_init::image_create_info(format, usage_flags, extent,
+                                                                               mip_levels);
+
+    VmaAllocationCreateInfo image_allocation_create_info = {};
+    image_allocation_create_info.usage = VMA_MEMORY_USAGE_GPU_ONLY; // Tells VMA to put image into VRAM
+    image_allocation_create_info.requiredFlags = static_cast<VkMemoryPropertyFlags>(
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT); // This guarantees fastest memory access
+
+    // Allocate and create the image
+    VK_CHECK(vmaCreateImage(allocator, &image_create_info, &image_allocation_create_info, &hot_entry.image,
+        &cold_entry.allocation, nullptr));
+    memory_telemetry->track(cold_entry.allocation, category);
+
+    VkImageViewCreateInfo image_view_create_info = incan_struct_init::image_view_create_info(
+        format, hot_entry.image, incan_util::image_aspect_flags(format), 0, mip_levels);
+    VK_CHECK(vkCreateImageView(device, &image_view_create_info, nullptr, &hot_entry.image_view));
+
+    ImageHandle handle = images.insert(hot_entry, cold_entry);
+    image_allocations[cold_entry.allocation] = handle;
+
+    return handle;
+}
+
+std::span<const VkImageView> ResourceManager::get_mip_views(ImageHandle handle) {
+    const ImageHotData &hot_entry = images.hot(handle);
+    const ImageColdData &cold_entry = images.cold(handle);
+
+    std::vector<VkImageView> &views = mip_views[hot_entry.image];
+    if (views.empty()) {
+        views.resize(cold_entry.mip_levels);
+        for (uint32_t mip = 0; mip < cold_entry.mip_levels; mip++) {
+            VkImageViewCreateInfo image_view_create_info = incan_struct_init::image_view_create_info(
+                cold_entry.image_format, hot_entry.image, incan_util::image_aspect_flags(cold_entry.image_format), mip,
+                1);
+            VK_CHECK(vkCreateImageView(device, &image_view_create_info, nullptr, &views[mip]));
+        }
+    }
+
+    return views;
+}
+
+void ResourceManager::release_mip_views(VkImage image) {
+    auto views = mip_views.find(image);
+    if (views == mip_views.end()) {
+        return;
+    }
+
+    for (VkImageView view: views->second) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    mip_views.erase(views);
+}
+
+void ResourceManager::destroy_image(ImageHandle handle) {
+    const ImageHotData &hot_entry = images.hot(handle);
+    const ImageColdData &cold_entry = images.cold(handle);
+
+    release_mip_views(hot_entry.image);
+    vkDestroyImageView(device, hot_entry.image_view, nullptr);
+    memory_telemetry->untrack(cold_entry.allocation);
+    image_allocations.erase(cold_entry.allocation);
+    vmaDestroyImage(allocator, hot_entry.image, cold_entry.allocation);
+
+    images.remove(handle);
+}
+
+void ResourceManager::swap_images(ImageHandle first, ImageHandle second) {
+    std::swap(images.hot(first), images.hot(second));
+    std::swap(images.cold(first), images.cold(second));
+    image_allocations[images.cold(first).allocation] = first;
+    image_allocations[images.cold(second).allocation] = second;
+}
+
+BufferHandle ResourceManager::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage_flags,
+                                            VmaMemoryUsage memory_usage, VmaAllocationCreateFlags allocation_flags,
+                                            AllocationCategory category) {
+    AllocatedBuffer new_buffer = incan_util::create_buffer(allocator, size, usage_flags, memory_usage,
+                                                           allocation_flags);
+    memory_telemetry->track(new_buffer.allocation, category);
+
+    BufferHotData hot_entry = {};
+    hot_entry.buffer = new_buffer.buffer;
+    if (usage_flags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+        hot_entry.device_address = incan_util::get_buffer_device_address(device, new_buffer.buffer);
+    }
+
+    BufferColdData cold_entry = {};
+    cold_entry.allocation = new_buffer.allocation;
+    cold_entry.allocation_info = new_buffer.allocation_info;
+    cold_entry.size = new_buffer.size;
+    cold_entry.usage_flags = new_buffer.usage_flags;
+
+    BufferHandle handle = buffers.insert(hot_entry, cold_entry);
+    buffer_allocations[cold_entry.allocation] = handle;
+
+    return handle;
+}
+
+void ResourceManager::destroy_buffer(BufferHandle handle) {
+    const BufferHotData &hot_entry = buffers.hot(handle);
+    const BufferColdData &cold_entry = buffers.cold(handle);
+
+    memory_telemetry->untrack(cold_entry.allocation);
+    buffer_allocations.erase(cold_entry.allocation);
+    vmaDestroyBuffer(allocator, hot_entry.buffer, cold_entry.allocation);
+
+    buffers.remove(handle);
+}
+
+PipelineHandle ResourceManager::add_pipeline(VkPipeline pipeline, VkPipelineLayout layout,
+                                             VkPipelineBindPoint bind_point) {
+    PipelineHotData hot_entry = {};
+    hot_entry.pipeline = pipeline;
+    hot_entry.layout = layout;
+    hot_entry.bind_point = bind_point;
+
+    return pipelines.insert(hot_entry, {});
+}
+
+void ResourceManager::destroy_pipeline(PipelineHandle handle) {
+    vkDestroyPipeline(device, pipelines.hot(handle).pipeline, nullptr);
+    pipelines.remove(handle);
+}
+
+SamplerHandle ResourceManager::create_sampler(const VkSamplerCreateInfo &sampler_create_info) {
+    SamplerHotData hot_entry = {};
+    VK_CHECK(vkCreateSampler(device, &sampler_create_info, nullptr, &hot_entry.sampler));
+
+    return samplers.insert(hot_entry, {});
+}
+
+void ResourceManager::destroy_sampler(SamplerHandle handle) {
+    vkDestroySampler(device, samplers.hot(handle).sampler, nullptr);
+    samplers.remove(handle);
+}
+
+void ResourceManager::destroy() {
+    // Handles are collected first, destroying while walking the pool would change it under the walk
+    std::vector<ImageHandle> image_handles;
+    images.for_each([&](ImageHandle handle) { image_handles.push_back(handle); });
+    for (ImageHandle handle: image_handles) {
+        destroy_image(handle);
+    }
+
+    std::vector<BufferHandle> buffer_handles;
+    buffers.for_each([&](BufferHandle handle) { buffer_handles.push_back(handle); });
+    for (BufferHandle handle: buffer_handles) {
+        destroy_buffer(handle);
+    }
+
+    std::vector<PipelineHandle> pipeline_handles;
+    pipelines.for_each([&](PipelineHandle handle) { pipeline_handles.push_back(handle); });
+    for (PipelineHandle handle: pipeline_handles) {
+        destroy_pipeline(handle);
+    }
+
+    std::vector<SamplerHandle> sampler_handles;
+    samplers.for_each([&](SamplerHandle handle) { sampler_handles.push_back(handle); });
+    for (SamplerHandle handle: sampler_handles) {
+        destroy_sampler(handle);
+    }
+}
@@ -0,0 +1,276 @@
+#ifndef INCANDESCENT_RESOURCES_H
+#define INCANDESCENT_RESOURCES_H
+
+#include <incandescent_types.h>
+#include <incandescent_memory.h>
+#include <incandescent_buffers.h>
+#include <cassert>
+#include <memory>
+#include <unordered_map>
+
+/*
+ * 32-bit generational handle, the low bits index into a pool and the high bits hold the generation of that slot.
+ * Releasing a slot bumps its generation, so handles kept past a destroy are caught instead of aliasing whatever
+ * reuses the slot. A value of 0 is the null handle.
+ */
+template<typename Tag>
+struct ResourceHandle {
+    static constexpr uint32_t INDEX_BITS = 20;
+    static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+    static constexpr uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+    uint32_t value = 0;
+
+    static ResourceHandle make(uint32_t index, uint32_t generation) {
+        return {(generation << INDEX_BITS) | index};
+    }
+
+    uint32_t index() const {
+        return value & INDEX_MASK;
+    }
+
+    uint32_t generation() const {
+        return value >> INDEX_BITS;
+    }
+
+    bool is_valid() const {
+        return value != 0;
+    }
+
+    bool operator==(const ResourceHandle &other) const {
+        return value == other.value;
+    }
+
+    bool operator!=(const ResourceHandle &other) const {
+        return value != other.value;
+    }
+};
+
+using ImageHandle = ResourceHandle<struct ImageTag>;
+using BufferHandle = ResourceHandle<struct BufferTag>;
+using PipelineHandle = ResourceHandle<struct PipelineTag>;
+using SamplerHandle = ResourceHandle<struct SamplerTag>;
+
+/*
+ * Pool of resources addressed by generational handles. Data is split in two arrays, hot data is what gets read while
+ * recording commands and cold data is only touched on create/destroy/move, so command recording walks tightly packed
+ * arrays. Lookups are O(1), stale handles abort in debug builds. Entries are stored in fixed size chunks that never
+ * move, so references returned by hot() and cold() stay valid across inserts until their own handle is removed.
+ */
+template<typename HandleType, typename HotData, typename ColdData>
+struct ResourcePool {
+    HandleType insert(const HotData &hot_entry, const ColdData &cold_entry) {
+        uint32_t index;
+        if (!free_indices.empty()) {
+            index = free_indices.back();
+            free_indices.pop_back();
+        } else {
+            index = static_cast<uint32_t>(generations.size());
+            assert(index <= HandleType::INDEX_MASK);
+            if (index % CHUNK_SIZE == 0) {
+                hot_chunks.push_back(std::make_unique<HotData[]>(CHUNK_SIZE));
+                cold_chunks.push_back(std::make_unique<ColdData[]>(CHUNK_SIZE));
+            }
+            // Generations start at 1 so no live handle is ever 0
+            generations.push_back(1);
+        }
+        hot_entry_at(index) = hot_entry;
+        cold_entry_at(index) = cold_entry;
+        alive_count++;
+
+        return HandleType::make(index, generations[index]);
+    }
+
+    void remove(HandleType handle) {
+        uint32_t index = slot(handle);
+        hot_entry_at(index) = {};
+        cold_entry_at(index) = {};
+
+        // Skip generation 0 when wrapping so the slot never produces the null handle
+        generations[index] = (generations[index] + 1) & HandleType::GENERATION_MASK;
+        if (generations[index] == 0) {
+            generations[index] = 1;
+        }
+        free_indices.push_back(index);
+        alive_count--;
+    }
+
+    bool contains(HandleType handle) const {
+        return handle.is_valid() && handle.index() < generations.size() &&
+               generations[handle.index()] == handle.generation();
+    }
+
+    HotData &hot(HandleType handle) {
+        return hot_entry_at(slot(handle));
+    }
+
+    const HotData &hot(HandleType handle) const {
+        uint32_t index = slot(handle);
+        return hot_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    ColdData &cold(HandleType handle) {
+        return cold_entry_at(slot(handle));
+    }
+
+    const ColdData &cold(HandleType handle) const {
+        uint32_t index = slot(handle);
+        return cold_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    // Number of live entries
+    size_t size() const {
+        return alive_count;
+    }
+
+    // Calls function(handle) for every live entry
+    template<typename Function>
+    void for_each(Function function) const {
+        std::vector<bool> is_free(generations.size(), false);
+        for (uint32_t index: free_indices) {
+            is_free[index] = true;
+        }
+        for (uint32_t index = 0; index < generations.size(); index++) {
+            if (!is_free[index]) {
+                function(HandleType::make(index, generations[index]));
+            }
+        }
+    }
+
+private:
+    // Enough entries per chunk that walking hot data stays mostly contiguous
+    static constexpr uint32_t CHUNK_SIZE = 256;
+
+    uint32_t slot(HandleType handle) const {
+        assert(contains(handle) && "Stale or null resource handle");
+        return handle.index();
+    }
+
+    HotData &hot_entry_at(uint32_t index) {
+        return hot_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    ColdData &cold_entry_at(uint32_t index) {
+        return cold_chunks[index / CHUNK_SIZE][index % CHUNK_SIZE];
+    }
+
+    std::vector<std::unique_ptr<HotData[]>> hot_chunks;
+    std::vector<std::unique_ptr<ColdData[]>> cold_chunks;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> free_indices;
+    size_t alive_count = 0;
+};
+
+constexpr uint32_t NO_BINDLESS_INDEX = UINT32_MAX;
+
+// Read while recording commands
+struct ImageHotData {
+    VkImage image;
+    VkImageView image_view;
+    // Slot in the bindless heap's storage image array, NO_BINDLESS_INDEX if the image isn't registered
+    uint32_t bindless_storage_index;
+};
+
+// Only needed to create, move or destroy the image
+struct ImageColdData {
+    VmaAllocation allocation;
+    VkExtent3D image_extent;
+    VkFormat image_format;
+    uint32_t mip_levels;
+    VkImageUsageFlags usage_flags;
+    // Layout the image is left in between frames, UNDEFINED if its contents are rebuilt every frame and are not
+    // worth copying on a move
+    VkImageLayout resting_layout;
+};
+
+struct BufferHotData {
+    VkBuffer buffer;
+    VkDeviceAddress device_address;
+};
+
+struct BufferColdData {
+    VmaAllocation allocation;
+    VmaAllocationInfo allocation_info;
+    VkDeviceSize size;
+    VkBufferUsageFlags usage_flags;
+};
+
+struct PipelineHotData {
+    VkPipeline pipeline;
+    VkPipelineLayout layout; // Owned by the DescriptorLayoutCache
+    VkPipelineBindPoint bind_point;
+};
+
+struct SamplerHotData {
+    VkSampler sampler;
+};
+
+// For pools with nothing worth keeping out of the hot array
+struct NoColdData {
+};
+
+using ImagePool = ResourcePool<ImageHandle, ImageHotData, ImageColdData>;
+using BufferPool = ResourcePool<BufferHandle, BufferHotData, BufferColdData>;
+using PipelinePool = ResourcePool<PipelineHandle, PipelineHotData, NoColdData>;
+using SamplerPool = ResourcePool<SamplerHandle, SamplerHotData, NoColdData>;
+
+/*
+ * Owns every long-lived image, buffer, pipeline and sampler. The rest of the engine only keeps handles, so a resource
+ * can be recreated in place (defragmentation moves, reloads) without anyone holding a dangling Vulkan handle.
+ */
+struct ResourceManager {
+    ImagePool images;
+    BufferPool buffers;
+    PipelinePool pipelines;
+    SamplerPool samplers;
+
+    // Lets the defragmenter find the resource behind a VMA allocation
+    std::unordered_map<VmaAllocation, ImageHandle> image_allocations;
+    std::unordered_map<VmaAllocation, BufferHandle> buffer_allocations;
+
+    void initialize(VkDevice vulkan_device, VmaAllocator vma_allocator, MemoryTelemetry &telemetry);
+
+    // Device local 2D image with a view over all of it
+    ImageHandle create_image(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent,
+                             VkImageLayout resting_layout, AllocationCategory category, uint32_t mip_levels = 1);
+
+    // One single-level view per mip, created on first use and kept until the image is destroyed
+    std::span<const VkImageView> get_mip_views(ImageHandle handle);
+
+    // Drops the mip views of a VkImage that is going away, used for images left behind by defragmentation moves
+    void release_mip_views(VkImage image);
+
+    void destroy_image(ImageHandle handle);
+
+    // Trades the images behind two handles, so an image rebuilt under a new handle can take the place of one the rest
+    // of the engine refers to, and the old image is destroyed later through the new handle
+    void swap_images(ImageHandle first, ImageHandle second);
+
+    BufferHandle create_buffer(VkDeviceSize size, VkBufferUsageFlags usage_flags, VmaMemoryUsage memory_usage,
+                               VmaAllocationCreateFlags allocation_flags, AllocationCategory category);
+
+    void destroy_buffer(BufferHandle handle);
+
+    // Takes ownership of an already built pipeline
+    PipelineHandle add_pipeline(VkPipeline pipeline, VkPipelineLayout layout, VkPipelineBindPoint bind_point);
+
+    void destroy_pipeline(PipelineHandle handle);
+
+    SamplerHandle create_sampler(const VkSamplerCreateInfo &sampler_create_info);
+
+    void destroy_sampler(SamplerHandle handle);
+
+    // Destroys whatever is still alive
+    void destroy();
+
+private:
+    VkDevice device = VK_NULL_HANDLE;
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    MemoryTelemetry *memory_telemetry = nullptr;
+
+    // Keyed by VkImage rather than handle, so a moved image gets a fresh set of views
+    std::unordered_map<VkImage, std::vector<VkImageView>> mip_views;
+};
+
+
+#endif //INCANDESCENT_RESOURCES_H
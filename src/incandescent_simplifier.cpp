@@ -0,0 +1,334 @@
+#include <incandescent_simplifier.h>
+
+#include <bit>
+#include <unordered_map>
+
+namespace {
+    constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+    // A collapse may turn a remaining triangle by up to about 78 degrees (the cosine between its old and new normal),
+    // further than that and the surface starts to fold over
+    constexpr double MIN_NORMAL_DOT = 0.2;
+
+    // Sum of squared distances to planes, weighted by the area of the triangles the planes came from
+    struct Quadric {
+        Eigen::Matrix3d a = Eigen::Matrix3d::Zero();
+        Eigen::Vector3d b = Eigen::Vector3d::Zero();
+        double c = 0.0;
+        double weight = 0.0;
+
+        // The plane dot(normal, p) + distance = 0, normal has to be unit length
+        void add_plane(const Eigen::Vector3d &normal, double distance, double area) {
+            a += area * normal * normal.transpose();
+            b += area * distance * normal;
+            c += area * distance * distance;
+            weight += area;
+        }
+
+        Quadric &operator+=(const Quadric &other) {
+            a += other.a;
+            b += other.b;
+            c += other.c;
+            weight += other.weight;
+            return *this;
+        }
+
+        // Mean squared distance from position to the planes, so errors of big and small regions compare
+        double error(const Eigen::Vector3d &position) const {
+            if (weight <= 0.0) {
+                return 0.0;
+            }
+            return std::max(0.0, (position.dot(a * position) + 2.0 * b.dot(position) + c) / weight);
+        }
+    };
+
+    struct Collapse {
+        // Positions, from is merged onto to
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    struct PositionKey {
+        std::array<uint32_t, 3> bits;
+
+        bool operator==(const PositionKey &) const = default;
+    };
+
+    struct PositionKeyHash {
+        size_t operator()(const PositionKey &key) const {
+            uint64_t hash = key.bits[0];
+            hash = hash * 0x9E3779B97F4A7C15ull ^ key.bits[1];
+            hash = hash * 0x9E3779B97F4A7C15ull ^ key.bits[2];
+            return static_cast<size_t>(hash ^ (hash >> 29));
+        }
+    };
+
+    // Numbers the distinct positions, vertices at the same position get the same number. position_vertices gets
+    // one vertex of each
+    std::vector<uint32_t> weld_positions(std::span<const Vertex> vertices, std::vector<uint32_t> &position_vertices) {
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> positions;
+        positions.reserve(vertices.size());
+
+        std::vector<uint32_t> vertex_positions(vertices.size());
+        for (uint32_t vertex = 0; vertex < vertices.size(); vertex++) {
+            // Adding zero turns -0 into +0, the two compare equal but their bits don't
+            const Eigen::Vector3f &position = vertices[vertex].position;
+            PositionKey key = {{std::bit_cast<uint32_t>(position.x() + 0.0f),
+                                std::bit_cast<uint32_t>(position.y() + 0.0f),
+                                std::bit_cast<uint32_t>(position.z() + 0.0f)}};
+            auto [entry, inserted] = positions.try_emplace(key, static_cast<uint32_t>(position_vertices.size()));
+            if (inserted) {
+                position_vertices.push_back(vertex);
+            }
+            vertex_positions[vertex] = entry->second;
+        }
+        return vertex_positions;
+    }
+
+    uint64_t edge_key(uint32_t a, uint32_t b) {
+        return static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b);
+    }
+}
+
+std::vector<uint32_t> incan_simplify::simplify(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+                                               size_t target_index_count, float max_error, float &result_error) {
+    result_error = 0.0f;
+
+    /* -------- Weld -------- */
+    std::vector<uint32_t> position_vertices;
+    std::vector<uint32_t> vertex_positions = weld_positions(vertices, position_vertices);
+    size_t position_count = position_vertices.size();
+
+    std::vector<Eigen::Vector3d> positions(position_count);
+    for (size_t position = 0; position < position_count; position++) {
+        positions[position] = vertices[position_vertices[position]].position.cast<double>();
+    }
+
+    // Triangles that are already degenerate once welded are dropped, a broken index drops its triangle
+    std::vector<std::array<uint32_t, 3>> triangles;
+    triangles.reserve(indices.size() / 3);
+    for (size_t i = 0; i + 3 <= indices.size(); i += 3) {
+        std::array<uint32_t, 3> triangle = {indices[i], indices[i + 1], indices[i + 2]};
+        if (triangle[0] >= vertices.size() || triangle[1] >= vertices.size() || triangle[2] >= vertices.size()) {
+            continue;
+        }
+        uint32_t a = vertex_positions[triangle[0]];
+        uint32_t b = vertex_positions[triangle[1]];
+        uint32_t c = vertex_positions[triangle[2]];
+        if (a != b && b != c && c != a) {
+            triangles.push_back(triangle);
+        }
+    }
+
+    // Attribute seams: a position more than one of the triangles' vertices sits at
+    std::vector<uint32_t> position_first_vertex(position_count, NO_VERTEX);
+    std::vector<uint8_t> seams(position_count, 0);
+    for (const std::array<uint32_t, 3> &triangle: triangles) {
+        for (uint32_t vertex: triangle) {
+            uint32_t &first_vertex = position_first_vertex[vertex_positions[vertex]];
+            if (first_vertex == NO_VERTEX) {
+                first_vertex = vertex;
+            } else if (first_vertex != vertex) {
+                seams[vertex_positions[vertex]] = 1;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(position_count);
+    for (const std::array<uint32_t, 3> &triangle: triangles) {
+        const Eigen::Vector3d &p0 = positions[vertex_positions[triangle[0]]];
+        Eigen::Vector3d normal = (positions[vertex_positions[triangle[1]]] - p0).cross(
+            positions[vertex_positions[triangle[2]]] - p0);
+        double length = normal.norm();
+        if (length <= 0.0) {
+            continue;
+        }
+        normal /= length;
+        for (uint32_t vertex: triangle) {
+            quadrics[vertex_positions[vertex]].add_plane(normal, -normal.dot(p0), 0.5 * length);
+        }
+    }
+
+    size_t target_triangle_count = target_index_count / 3;
+    double max_cost = static_cast<double>(max_error) * max_error;
+    double largest_cost = 0.0;
+
+    std::vector<uint32_t> adjacency_offsets(position_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<uint8_t> locked(position_count);
+    std::vector<uint8_t> touched(position_count);
+    std::unordered_map<uint64_t, uint32_t> edge_counts;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> from_neighbours;
+    std::vector<uint32_t> to_neighbours;
+
+    while (triangles.size() > target_triangle_count) {
+        /* -------- Adjacency and borders of what is left -------- */
+        std::ranges::fill(adjacency_offsets, 0);
+        for (const std::array<uint32_t, 3> &triangle: triangles) {
+            for (uint32_t vertex: triangle) {
+                adjacency_offsets[vertex_positions[vertex] + 1]++;
+            }
+        }
+        for (size_t position = 0; position < position_count; position++) {
+            adjacency_offsets[position + 1] += adjacency_offsets[position];
+        }
+        adjacency.resize(triangles.size() * 3);
+        std::vector<uint32_t> cursors(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+        for (uint32_t triangle = 0; triangle < triangles.size(); triangle++) {
+            for (uint32_t vertex: triangles[triangle]) {
+                adjacency[cursors[vertex_positions[vertex]]++] = triangle;
+            }
+        }
+        auto position_triangles = [&](uint32_t position) {
+            return std::span<const uint32_t>(adjacency.data() + adjacency_offsets[position],
+                                             adjacency_offsets[position + 1] - adjacency_offsets[position]);
+        };
+
+        // Edges with one triangle are open borders, with more than two non-manifold
+        edge_counts.clear();
+        for (const std::array<uint32_t, 3> &triangle: triangles) {
+            for (size_t corner = 0; corner < 3; corner++) {
+                edge_counts[edge_key(vertex_positions[triangle[corner]],
+                                     vertex_positions[triangle[(corner + 1) % 3]])]++;
+            }
+        }
+        locked = seams;
+        for (auto [key, count]: edge_counts) {
+            if (count != 2) {
+                locked[key >> 32] = 1;
+                locked[key & 0xFFFFFFFF] = 1;
+            }
+        }
+
+        /* -------- Candidates -------- */
+        // Every interior edge is one directed edge in each of its two triangles, so each direction comes up once
+        collapses.clear();
+        for (const std::array<uint32_t, 3> &triangle: triangles) {
+            for (size_t corner = 0; corner < 3; corner++) {
+                uint32_t from = vertex_positions[triangle[corner]];
+                uint32_t to = vertex_positions[triangle[(corner + 1) % 3]];
+                if (locked[from]) {
+                    continue;
+                }
+                Quadric quadric = quadrics[from];
+                quadric += quadrics[to];
+                double cost = quadric.error(positions[to]);
+                if (cost <= max_cost) {
+                    collapses.push_back({from, to, cost});
+                }
+            }
+        }
+        std::ranges::sort(collapses, {}, &Collapse::cost);
+
+        /* -------- Collapse -------- */
+        std::ranges::fill(touched, 0);
+        size_t triangle_count = triangles.size();
+        bool collapsed = false;
+        for (const Collapse &collapse: collapses) {
+            if (triangle_count <= target_triangle_count) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            // Two neighbours in common, the far corners of the edge's two triangles. More and the collapse would
+            // pinch the surface into a non-manifold edge
+            from_neighbours.clear();
+            to_neighbours.clear();
+            for (uint32_t triangle: position_triangles(collapse.from)) {
+                for (uint32_t vertex: triangles[triangle]) {
+                    from_neighbours.push_back(vertex_positions[vertex]);
+                }
+            }
+            for (uint32_t triangle: position_triangles(collapse.to)) {
+                for (uint32_t vertex: triangles[triangle]) {
+                    to_neighbours.push_back(vertex_positions[vertex]);
+                }
+            }
+            std::ranges::sort(from_neighbours);
+            from_neighbours.erase(std::ranges::unique(from_neighbours).begin(), from_neighbours.end());
+            std::ranges::sort(to_neighbours);
+            to_neighbours.erase(std::ranges::unique(to_neighbours).begin(), to_neighbours.end());
+            size_t shared_neighbours = 0;
+            for (uint32_t position: from_neighbours) {
+                shared_neighbours += position != collapse.from && position != collapse.to &&
+                                     std::ranges::binary_search(to_neighbours, position);
+            }
+            if (shared_neighbours != 2) {
+                continue;
+            }
+
+            // The triangles on the edge disappear, the rest of from's fan must not flip or fold
+            uint32_t to_vertex = NO_VERTEX;
+            uint32_t removed_triangles = 0;
+            bool folds = false;
+            for (uint32_t triangle: position_triangles(collapse.from)) {
+                std::array<Eigen::Vector3d, 3> corners;
+                std::array<Eigen::Vector3d, 3> moved_corners;
+                bool on_edge = false;
+                for (size_t corner = 0; corner < 3; corner++) {
+                    uint32_t position = vertex_positions[triangles[triangle][corner]];
+                    if (position == collapse.to) {
+                        // The vertex of to on from's side of any seam through to, from itself is never on one
+                        to_vertex = triangles[triangle][corner];
+                        on_edge = true;
+                    }
+                    corners[corner] = positions[position];
+                    moved_corners[corner] = position == collapse.from ? positions[collapse.to] : corners[corner];
+                }
+                if (on_edge) {
+                    removed_triangles++;
+                    continue;
+                }
+
+                Eigen::Vector3d normal = (corners[1] - corners[0]).cross(corners[2] - corners[0]);
+                Eigen::Vector3d moved_normal = (moved_corners[1] - moved_corners[0]).cross(
+                    moved_corners[2] - moved_corners[0]);
+                if (moved_normal.dot(normal) <= MIN_NORMAL_DOT * moved_normal.norm() * normal.norm() ||
+                    moved_normal.squaredNorm() <= 0.0) {
+                    folds = true;
+                    break;
+                }
+            }
+            if (folds || to_vertex == NO_VERTEX) {
+                continue;
+            }
+
+            for (uint32_t triangle: position_triangles(collapse.from)) {
+                for (uint32_t &vertex: triangles[triangle]) {
+                    touched[vertex_positions[vertex]] = 1;
+                    if (vertex_positions[vertex] == collapse.from) {
+                        vertex = to_vertex;
+                    }
+                }
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+            largest_cost = std::max(largest_cost, collapse.cost);
+            triangle_count -= removed_triangles;
+            collapsed = true;
+        }
+
+        // The triangles that were on a collapsed edge now name one position twice
+        std::erase_if(triangles, [&](const std::array<uint32_t, 3> &triangle) {
+            uint32_t a = vertex_positions[triangle[0]];
+            uint32_t b = vertex_positions[triangle[1]];
+            uint32_t c = vertex_positions[triangle[2]];
+            return a == b || b == c || c == a;
+        });
+        if (!collapsed) {
+            break;
+        }
+    }
+
+    result_error = static_cast<float>(std::sqrt(largest_cost));
+
+    std::vector<uint32_t> result;
+    result.reserve(triangles.size() * 3);
+    for (const std::array<uint32_t, 3> &triangle: triangles) {
+        result.insert(result.end(), triangle.begin(), triangle.end());
+    }
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef INCANDESCENT_SIMPLIFIER_H
+#define INCANDESCENT_SIMPLIFIER_H
+
+#include <incandescent_loader.h>
+
+/*
+ * Import-time mesh simplification for the LOD chain, edge collapses ordered by quadric error (Garland and Heckbert).
+ * Only half-edge collapses are made, a vertex is merged onto one of its neighbours and never moved, so every LOD
+ * indexes the vertices of the full detail mesh and shares the vertex buffer with it. Vertices that have to stay
+ * where they are never collapse:
+ *   - open borders and non-manifold edges, so the outline and the seams between surfaces don't open up
+ *   - attribute seams (one position, several vertices), so uv and normal discontinuities stay sharp
+ * Collapses are made in passes, cheapest first, and a collapse keeps the vertices around it out of the rest of its
+ * pass, so costs never go stale within a pass.
+ */
+namespace incan_simplify {
+    // Indices of the triangles simplified down to about target_index_count indices (fewer if a border or a seam
+    // stops it), never with an error above max_error. Errors are distances in mesh space. indices are local to
+    // vertices and so is the result, result_error is the largest error of the collapses that were made
+    std::vector<uint32_t> simplify(std::span<const uint32_t> indices, std::span<const Vertex> vertices,
+                                   size_t target_index_count, float max_error, float &result_error);
+}
+
+
+#endif //INCANDESCENT_SIMPLIFIER_H
@@ -0,0 +1,462 @@
+#include <incandescent_texture_streamer.h>
+#include <incandescent_engine.h>
+#include <incandescent_images.h>
+#include <incandescent_jobs.h>
+#include <incandescent_block_compression.h>
+#include <incandescent_decompression.h>
+#include <incandescent_geometry_cache.h>
+#include <incandescent_ktx2.h>
+#include <incan_struct_init.h>
+#include <volk.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+#include <mutex>
+#include <semaphore>
+
+void TextureStreamer::initialize(VkDevice vulkan_device, VkQueue queue, uint32_t queue_family_index,
+                                 uint32_t max_in_flight, bool block_compression) {
+    device = vulkan_device;
+    upload_queue = queue;
+    textures_in_flight = std::max(max_in_flight, 1u);
+    compress_textures = block_compression;
+
+    VkCommandPoolCreateInfo command_pool_create_info = {};
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.pNext = nullptr;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    command_pool_create_info.queueFamilyIndex = queue_family_index;
+    VK_CHECK(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool));
+
+    std::vector<VkCommandBuffer> command_buffers(textures_in_flight);
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
+    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.pNext = nullptr;
+    command_buffer_allocate_info.commandPool = command_pool;
+    command_buffer_allocate_info.commandBufferCount = textures_in_flight;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    VK_CHECK(vkAllocateCommandBuffers(device, &command_buffer_allocate_info, command_buffers.data()));
+
+    // Unsignaled, a slot's fence is waited on and reset when the slot is retired
+    VkFenceCreateInfo fence_create_info = incan_struct_init::fence_create_info();
+    upload_slots.resize(textures_in_flight);
+    for (uint32_t i = 0; i < textures_in_flight; i++) {
+        upload_slots[i].command_buffer = command_buffers[i];
+        VK_CHECK(vkCreateFence(device, &fence_create_info, nullptr, &upload_slots[i].fence));
+    }
+
+    // Sized for the mip generator's set, one per texture in flight
+    std::vector<DescriptorAllocator::PoolSizeRatio> pool_size_ratios = {
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_SINGLE_PASS_MIP_LEVELS},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+    };
+    descriptor_allocator.initialize_pools(device, textures_in_flight, pool_size_ratios);
+}
+
+namespace {
+    // Part of every texture cache id, bump it whenever the encoder or the mip filter change their output
+    constexpr uint64_t TEXTURE_ENCODER_VERSION = 1;
+
+    // How one image gets to the GPU, worked out from its header before any decoding starts
+    struct TexturePlan {
+        bool valid;
+        bool is_hdr;
+        bool compressed;
+        BlockFormat block_format;
+        VkFormat format;
+        VkExtent3D extent;
+        // Id of the texture in the scene's texture archive, a hash of the image file and its usage
+        uint64_t cache_id;
+        // The texture's KTX2 in the archive, found while planning or appended once encoded. Its mips can be read back
+        // from there later
+        std::optional<ArchiveEntry> cache_entry;
+    };
+
+    // stb_image decodes HDR to 32-bit floats, half floats are plenty for color and every device can filter them
+    void write_half_texels(std::byte *destination, const float *texels, size_t value_count) {
+        for (size_t i = 0; i < value_count; i++) {
+            Eigen::half value(texels[i]);
+            memcpy(destination + i * sizeof(Eigen::half), &value, sizeof(Eigen::half));
+        }
+    }
+
+    // BC1 has no usable alpha and BC5 only two channels, BC7 is the catch-all for everything else
+    BlockFormat block_format_for(TextureUsage usage, int channels) {
+        if (usage == TextureUsage::Normal) {
+            return BlockFormat::BC5;
+        }
+        // stb_image counts grey + alpha as 2 channels and RGBA as 4
+        bool has_alpha = channels == 2 || channels == 4;
+        return usage == TextureUsage::Color && !has_alpha ? BlockFormat::BC1 : BlockFormat::BC7;
+    }
+
+    // A cached texture is only used if it is exactly what the image would be encoded to now
+    bool cache_file_matches(const Ktx2Layout &layout, const TexturePlan &plan) {
+        return layout.format == plan.format && layout.width == plan.extent.width &&
+               layout.height == plan.extent.height &&
+               layout.level_ranges.size() == incan_util::mip_level_count(plan.extent);
+    }
+
+    // Decodes to RGBA8, builds the mip chain and block compresses every level, nothing if the image can't be decoded
+    std::vector<std::vector<std::byte>> encode_texture(const SourceImage &image, const TexturePlan &plan,
+                                                       size_t max_threads) {
+        auto *bytes = reinterpret_cast<const stbi_uc *>(image.bytes.data());
+        int width, height, channels;
+        stbi_uc *texels = stbi_load_from_memory(bytes, static_cast<int>(image.bytes.size()), &width, &height,
+                                                &channels, 4);
+        if (texels == nullptr) {
+            return {};
+        }
+        std::vector<std::vector<uint8_t>> mips = incan_bc::build_mip_chain(
+            texels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), image.usage == TextureUsage::Color);
+        stbi_image_free(texels);
+
+        std::vector<std::vector<std::byte>> levels(mips.size());
+        for (uint32_t level = 0; level < mips.size(); level++) {
+            uint32_t level_width = std::max(static_cast<uint32_t>(width) >> level, 1u);
+            uint32_t level_height = std::max(static_cast<uint32_t>(height) >> level, 1u);
+            levels[level].resize(incan_bc::level_size(plan.block_format, level_width, level_height));
+            incan_bc::encode_level(plan.block_format, mips[level].data(), level_width, level_height,
+                                   levels[level].data(), max_threads);
+        }
+        return levels;
+    }
+
+    // Copies a whole mip chain (mip 0 first) into the batch's staging buffer and queues one copy per level
+    void stage_levels(UploadBatch &upload_batch, std::span<const std::span<const std::byte>> levels, VkImage image,
+                      VkExtent3D extent) {
+        std::vector<VkDeviceSize> staging_offsets;
+        for (std::span<const std::byte> level: levels) {
+            staging_offsets.push_back(upload_batch.reserve(level.size()));
+        }
+        upload_batch.allocate_staging();
+
+        for (uint32_t level = 0; level < levels.size(); level++) {
+            memcpy(upload_batch.staging_data(staging_offsets[level]), levels[level].data(), levels[level].size());
+            VkExtent3D level_extent = {std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u), 1};
+            upload_batch.copy_to_image(staging_offsets[level], image, level_extent, level);
+        }
+    }
+
+    // Reads the cached KTX2 straight into the batch's staging buffer and queues a copy per level from where each one
+    // lands, in the staging buffer or once the GPU has decompressed it. False if it can't be read or isn't what the
+    // image would be encoded to now
+    bool stage_cached_texture(AsyncFileReader &file_reader, const GpuDecompressor &decompressor,
+                              const Archive &texture_archive, const ArchiveEntry &entry, const TexturePlan &plan,
+                              UploadBatch &upload_batch, VkImage image) {
+        StagedEntry staged_entry = incan_decompression::stage_entry(decompressor, texture_archive, entry,
+                                                                    upload_batch);
+        if (!file_reader.wait(file_reader.submit({&staged_entry.read, 1}))) {
+            return false;
+        }
+        std::optional<Ktx2Layout> layout = incan_ktx2::read_layout(
+            incan_decompression::entry_header(staged_entry, entry, upload_batch), entry.size);
+        if (!layout.has_value() || !cache_file_matches(*layout, plan)) {
+            return false;
+        }
+
+        // KTX2 starts every level on a multiple of its block size, which is all a copy out of a buffer asks for
+        for (uint32_t level = 0; level < layout->level_ranges.size(); level++) {
+            VkExtent3D level_extent = {std::max(plan.extent.width >> level, 1u),
+                                       std::max(plan.extent.height >> level, 1u), 1};
+            upload_batch.copy_to_image(staged_entry.offset + layout->level_ranges[level].first, image, level_extent,
+                                       level, staged_entry.source);
+        }
+        return true;
+    }
+}
+
+std::vector<ImageHandle> TextureStreamer::stream(IncandescentEngine &engine, std::span<const SourceImage> images,
+                                                 const std::filesystem::path &file_path, Archive &texture_archive,
+                                                 std::vector<std::optional<ArchiveEntry>> &mip_sources) {
+    ResourceManager &resources = engine.resources;
+    std::vector<ImageHandle> textures(images.size());
+
+    // Block compressed textures are cached in one archive next to the scene file, nothing is cached without it
+    bool texture_cache_open = false;
+    if (compress_textures) {
+        std::filesystem::path cache_path = file_path.parent_path() / fmt::format("{}-textures.archive",
+                                                                                 file_path.stem().string());
+        texture_cache_open = texture_archive.open(cache_path, true);
+        if (!texture_cache_open) {
+            fmt::print("Failed to open texture cache {}\n", cache_path.string());
+        }
+    }
+
+    /* -------- Plan every image from its header -------- */
+    // stb_image reads the size without decoding and cached textures are only looked up, so this is quick
+    std::vector<TexturePlan> plans(images.size());
+    incan_util::parallel_for(images.size(), [&](size_t image_index) {
+        const SourceImage &image = images[image_index];
+        TexturePlan &plan = plans[image_index];
+        auto *bytes = reinterpret_cast<const stbi_uc *>(image.bytes.data());
+        int byte_count = static_cast<int>(image.bytes.size());
+        int width, height, channels;
+        if (image.bytes.empty() || !stbi_info_from_memory(bytes, byte_count, &width, &height, &channels)) {
+            return;
+        }
+
+        plan.valid = true;
+        plan.is_hdr = stbi_is_hdr_from_memory(bytes, byte_count);
+        plan.extent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+        plan.compressed = compress_textures && !plan.is_hdr;
+        if (!plan.compressed) {
+            plan.format = image.usage == TextureUsage::Color ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+            if (plan.is_hdr) {
+                plan.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+            }
+            return;
+        }
+
+        plan.block_format = block_format_for(image.usage, channels);
+        plan.format = incan_bc::vulkan_format(plan.block_format, image.usage == TextureUsage::Color);
+        plan.cache_id = incan_cache::hash_bytes(image.bytes, (TEXTURE_ENCODER_VERSION << 8) |
+                                                             static_cast<uint64_t>(image.usage));
+        const ArchiveEntry *cache_entry = texture_archive.find(plan.cache_id);
+        if (cache_entry != nullptr) {
+            plan.cache_entry = *cache_entry;
+        }
+    });
+
+    /* -------- Create the images -------- */
+    // Every image exists before the first worker starts
+    std::vector<size_t> pending_images;
+    for (size_t image_index = 0; image_index < images.size(); image_index++) {
+        const TexturePlan &plan = plans[image_index];
+        if (!plan.valid) {
+            fmt::print("Failed to decode image {} of {}\n", image_index, file_path.string());
+            continue;
+        }
+
+        // Storage lets linear textures take the single pass mip path, sRGB and block compressed formats can't be
+        // storage images (and the latter come with their mips anyway)
+        VkImageUsageFlags usage_flags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        if (!plan.compressed && plan.format != VK_FORMAT_R8G8B8A8_SRGB) {
+            usage_flags |= VK_IMAGE_USAGE_STORAGE_BIT;
+        }
+
+        textures[image_index] = resources.create_image(plan.format, usage_flags, plan.extent,
+                                                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                       AllocationCategory::Texture,
+                                                       incan_util::mip_level_count(plan.extent));
+        pending_images.push_back(image_index);
+    }
+
+    // Workers only get plain Vulkan handles, the resource pools stay on this thread
+    std::vector<VkImage> destination_images(images.size(), VK_NULL_HANDLE);
+    for (size_t image_index: pending_images) {
+        destination_images[image_index] = resources.images.hot(textures[image_index]).image;
+    }
+
+    size_t decode_thread_count = std::min<size_t>(incan_util::worker_thread_count(), textures_in_flight);
+    // With fewer textures than workers the spare threads go to encoding, so one big texture still uses them all
+    size_t busy_decode_threads = std::max<size_t>(std::min(decode_thread_count, pending_images.size()), 1);
+    size_t encode_thread_count = std::max<size_t>(incan_util::worker_thread_count() / busy_decode_threads, 1);
+
+    /* -------- Decode on the workers -------- */
+    std::counting_semaphore<> free_slots(textures_in_flight);
+    std::mutex decoded_mutex;
+    std::condition_variable decoded_condition;
+    std::deque<DecodedTexture> decoded_textures;
+    std::mutex archive_mutex;
+
+    auto decode_texture = [&](size_t job) {
+        size_t image_index = pending_images[job];
+        TexturePlan &plan = plans[image_index];
+        free_slots.acquire();
+
+        // VMA and the memory telemetry are both safe to call from here
+        DecodedTexture decoded_texture = {};
+        decoded_texture.image_index = image_index;
+        UploadBatch &upload_batch = decoded_texture.upload_batch;
+        upload_batch.initialize(engine.allocator, engine.memory_telemetry);
+
+        bool cache_staged = plan.cache_entry.has_value() &&
+                            stage_cached_texture(engine.file_reader, engine.gpu_decompressor, texture_archive,
+                                                 *plan.cache_entry, plan, upload_batch,
+                                                 destination_images[image_index]);
+        // A cached texture that turned out unusable is encoded again and replaced
+        if (plan.cache_entry.has_value() && !cache_staged) {
+            upload_batch.destroy();
+            upload_batch.initialize(engine.allocator, engine.memory_telemetry);
+            plan.cache_entry.reset();
+        }
+
+        if (cache_staged) {
+            decoded_texture.decoded = true;
+            decoded_texture.mips_uploaded = true;
+        } else if (plan.compressed) {
+            std::vector<std::vector<std::byte>> levels = encode_texture(images[image_index], plan,
+                                                                        encode_thread_count);
+            decoded_texture.decoded = !levels.empty();
+            if (decoded_texture.decoded) {
+                // A texture that can't be cached is still uploaded, it is just encoded again next time
+                std::vector<std::byte> file_bytes = incan_ktx2::write_texture(plan.format, plan.extent.width,
+                                                                              plan.extent.height, levels);
+                if (texture_cache_open && !file_bytes.empty()) {
+                    PackedEntry packed_entry = incan_archive::pack_entry(file_bytes);
+                    std::lock_guard<std::mutex> lock(archive_mutex);
+                    plan.cache_entry = texture_archive.append(plan.cache_id, packed_entry);
+                }
+                if (texture_cache_open && !plan.cache_entry.has_value()) {
+                    fmt::print("Failed to cache image {} of {}\n", image_index, file_path.string());
+                }
+                std::vector<std::span<const std::byte>> level_bytes(levels.begin(), levels.end());
+                stage_levels(upload_batch, level_bytes, destination_images[image_index], plan.extent);
+                decoded_texture.mips_uploaded = true;
+            }
+        } else {
+            const SourceImage &image = images[image_index];
+            auto *bytes = reinterpret_cast<const stbi_uc *>(image.bytes.data());
+            int byte_count = static_cast<int>(image.bytes.size());
+            int width, height, channels;
+            void *texels = plan.is_hdr
+                               ? static_cast<void *>(stbi_loadf_from_memory(bytes, byte_count, &width, &height,
+                                                                            &channels, 4))
+                               : static_cast<void *>(stbi_load_from_memory(bytes, byte_count, &width, &height,
+                                                                           &channels, 4));
+
+            decoded_texture.decoded = texels != nullptr;
+            if (texels != nullptr) {
+                size_t value_count = static_cast<size_t>(width) * height * 4;
+                VkDeviceSize texel_bytes = value_count * (plan.is_hdr ? sizeof(Eigen::half) : 1);
+
+                VkDeviceSize staging_offset = upload_batch.reserve(texel_bytes);
+                upload_batch.allocate_staging();
+                if (plan.is_hdr) {
+                    write_half_texels(upload_batch.staging_data(staging_offset), static_cast<const float *>(texels),
+                                      value_count);
+                } else {
+                    memcpy(upload_batch.staging_data(staging_offset), texels, texel_bytes);
+                }
+                stbi_image_free(texels);
+
+                VkExtent3D extent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+                upload_batch.copy_to_image(staging_offset, destination_images[image_index], extent);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(decoded_mutex);
+            decoded_textures.push_back(std::move(decoded_texture));
+        }
+        decoded_condition.notify_one();
+    };
+
+    std::jthread decode_thread([&]() {
+        incan_util::parallel_for(pending_images.size(), decode_texture, decode_thread_count);
+    });
+
+    /* -------- Submit uploads as the textures come in -------- */
+    // Slots are used round robin, so the oldest submit is always the next one to finish
+    size_t oldest_slot = 0;
+    size_t slots_in_flight = 0;
+    auto retire_oldest_slot = [&]() {
+        UploadSlot &slot = upload_slots[oldest_slot];
+        VK_CHECK(vkWaitForFences(device, 1, &slot.fence, true, UINT64_MAX));
+        VK_CHECK(vkResetFences(device, 1, &slot.fence));
+        slot.upload_batch.destroy();
+        oldest_slot = (oldest_slot + 1) % textures_in_flight;
+        slots_in_flight--;
+        free_slots.release();
+    };
+
+    for (size_t received = 0; received < pending_images.size(); received++) {
+        std::unique_lock<std::mutex> lock(decoded_mutex);
+        // Retiring finished uploads is what lets the workers start new decodes, so it is done while waiting
+        while (decoded_textures.empty()) {
+            if (slots_in_flight == 0) {
+                decoded_condition.wait(lock, [&]() {
+                    return !decoded_textures.empty();
+                });
+            } else {
+                lock.unlock();
+                retire_oldest_slot();
+                lock.lock();
+            }
+        }
+        DecodedTexture decoded_texture = std::move(decoded_textures.front());
+        decoded_textures.pop_front();
+        lock.unlock();
+
+        ImageHandle texture = textures[decoded_texture.image_index];
+        if (!decoded_texture.decoded) {
+            fmt::print("Failed to decode image {} of {}\n", decoded_texture.image_index, file_path.string());
+            resources.destroy_image(texture);
+            textures[decoded_texture.image_index] = {};
+            free_slots.release();
+            continue;
+        }
+
+        // Every slot in flight and this texture each hold one of the textures_in_flight tokens, so a slot is free
+        UploadSlot &slot = upload_slots[(oldest_slot + slots_in_flight) % textures_in_flight];
+        slot.upload_batch = std::move(decoded_texture.upload_batch);
+
+        VK_CHECK(vkResetCommandBuffer(slot.command_buffer, 0));
+        VkCommandBufferBeginInfo command_buffer_begin_info =
+                incan_struct_init::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        VK_CHECK(vkBeginCommandBuffer(slot.command_buffer, &command_buffer_begin_info));
+
+        slot.upload_batch.record(slot.command_buffer);
+        // Block compressed textures arrive with their mips, the rest have them built here
+        bool mips_generated = !decoded_texture.mips_uploaded &&
+                              engine.mip_generator.generate(slot.command_buffer, texture,
+                                                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                            descriptor_allocator);
+        // Uploaded mip chains only need their layout changed, and sampling mip 0 alone still beats leaving a texture
+        // the generator can't handle unusable
+        if (!mips_generated) {
+            incan_util::transition_image(slot.command_buffer, resources.images.hot(texture).image,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                         VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                         VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT);
+        }
+
+        VK_CHECK(vkEndCommandBuffer(slot.command_buffer));
+
+        VkCommandBufferSubmitInfo command_buffer_submit_info =
+                incan_struct_init::command_buffer_submit_info(slot.command_buffer);
+        VkSubmitInfo2 submit_info = incan_struct_init::submit_info(&command_buffer_submit_info, nullptr, nullptr);
+        VK_CHECK(vkQueueSubmit2KHR(upload_queue, 1, &submit_info, slot.fence));
+        slots_in_flight++;
+    }
+
+    while (slots_in_flight > 0) {
+        retire_oldest_slot();
+    }
+    // No submit references the mip sets anymore
+    descriptor_allocator.clear_pools(device);
+
+    // The workers are done with the archive, what they appended only counts once the TOC names it
+    if (texture_cache_open && !texture_archive.commit()) {
+        fmt::print("Failed to write texture cache for {}\n", file_path.string());
+        texture_archive.close();
+        texture_cache_open = false;
+    }
+    mip_sources.assign(images.size(), std::nullopt);
+    for (size_t image_index: pending_images) {
+        if (texture_cache_open && resources.images.contains(textures[image_index])) {
+            mip_sources[image_index] = plans[image_index].cache_entry;
+        }
+    }
+
+    return textures;
+}
+
+void TextureStreamer::destroy() {
+    for (UploadSlot &slot: upload_slots) {
+        vkDestroyFence(device, slot.fence, nullptr);
+    }
+    upload_slots.clear();
+    descriptor_allocator.destroy_pools(device);
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    command_pool = VK_NULL_HANDLE;
+}
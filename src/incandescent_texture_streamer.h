@@ -0,0 +1,68 @@
+#ifndef INCANDESCENT_TEXTURE_STREAMER_H
+#define INCANDESCENT_TEXTURE_STREAMER_H
+
+#include <incandescent_types.h>
+#include <incandescent_archive.h>
+#include <incandescent_upload.h>
+#include <incandescent_loader.h>
+#include <incandescent_descriptors.h>
+
+class IncandescentEngine;
+
+/*
+ * Decodes textures with stb_image on worker threads while the thread that called stream() records and submits their
+ * uploads, so decoding one texture overlaps with copying and mipping the ones before it. A texture holds one of
+ * textures_in_flight slots from the moment a worker starts decoding it until the fence of its upload signals, which
+ * caps decode and staging memory no matter how many textures a scene has. Workers copy what stb_image decoded into the
+ * texture's mapped staging buffer, converting HDR texels to half on the way, and block compressed textures are copied
+ * there level by level once encoded.
+ *
+ * When the device has BC, LDR textures are block compressed on the workers with their whole mip chain and appended
+ * as a KTX2 to the scene's texture archive next to the scene file, under a hash of the image file and its usage.
+ * Later loads find it there and read it through the AsyncFileReader straight into the staging buffer, then upload its
+ * mips from where they landed, skipping decode, mipping and encode altogether. With the GpuDecompressor enabled the
+ * entry is read still compressed and expanded on the GPU as part of the upload.
+ */
+struct TextureStreamer {
+    void initialize(VkDevice vulkan_device, VkQueue queue, uint32_t queue_family_index, uint32_t max_in_flight,
+                    bool block_compression);
+
+    // Returns one handle per image, invalid for images that couldn't be decoded. HDR images become RGBA16F. LDR images
+    // become BC1 (opaque color), BC7 (color with alpha, data) or BC5 (normals) when compressing, otherwise RGBA8
+    // (sRGB for color). Returns once every upload has finished. texture_archive is left open when compressing, and
+    // mip_sources gets the entry in it each image's mips can be read back from, nothing for images that have none
+    std::vector<ImageHandle> stream(IncandescentEngine &engine, std::span<const SourceImage> images,
+                                    const std::filesystem::path &file_path, Archive &texture_archive,
+                                    std::vector<std::optional<ArchiveEntry>> &mip_sources);
+
+    void destroy();
+
+private:
+    // A texture between its worker finishing the decode and its upload being submitted
+    struct DecodedTexture {
+        size_t image_index;
+        bool decoded;
+        // Block compressed textures come with every mip, the rest only with mip 0
+        bool mips_uploaded;
+        UploadBatch upload_batch;
+    };
+
+    // Command buffer and fence of one submitted upload, the staging memory is freed when it is retired
+    struct UploadSlot {
+        VkCommandBuffer command_buffer;
+        VkFence fence;
+        UploadBatch upload_batch;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue upload_queue = VK_NULL_HANDLE;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    // Mip generation sets, cleared once every slot of a stream() has retired
+    DescriptorAllocator descriptor_allocator;
+    uint32_t textures_in_flight = 0;
+    bool compress_textures = false;
+    std::vector<UploadSlot> upload_slots;
+};
+
+
+#endif //INCANDESCENT_TEXTURE_STREAMER_H
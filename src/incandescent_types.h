@@ -29,6 +29,13 @@
 #include <fmt/core.h>
 #include <Eigen/Dense>
 
+namespace incan_util {
+    // Mixes value into seed, same constants as boost::hash_combine
+    inline void hash_combine(size_t &seed, size_t value) {
+        seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+    }
+}
+
 #define VK_CHECK(x)                                                     \
     do {                                                                \
         VkResult err = x;                                               \
@@ -0,0 +1,199 @@
+#include <incandescent_upload.h>
+#include <incandescent_decompression.h>
+#include <incan_struct_init.h>
+#include <volk.h>
+#include <algorithm>
+
+void UploadBatch::initialize(VmaAllocator vma_allocator, MemoryTelemetry &telemetry) {
+    allocator = vma_allocator;
+    memory_telemetry = &telemetry;
+}
+
+VkDeviceSize UploadBatch::reserve(VkDeviceSize size, VkDeviceSize alignment) {
+    VkDeviceSize offset = (reserved_size + alignment - 1) / alignment * alignment;
+    reserved_size = offset + size;
+    return offset;
+}
+
+void UploadBatch::allocate_staging() {
+    // Sequential write + mapped, the loader writes straight into it and never reads back. The decompression shader
+    // reads its streams through a buffer address
+    VkBufferUsageFlags usage_flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    if (!decompressions.empty()) {
+        usage_flags |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    }
+    staging_buffer = incan_util::create_buffer(allocator, std::max<VkDeviceSize>(reserved_size, 1), usage_flags,
+                                               VMA_MEMORY_USAGE_AUTO,
+                                               VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                               VMA_ALLOCATION_CREATE_MAPPED_BIT);
+    memory_telemetry->track(staging_buffer.allocation, AllocationCategory::Staging);
+
+    // Lives as long as the staging buffer, so it is counted as staging too
+    if (!decompressions.empty()) {
+        decompression_buffer = incan_util::create_buffer(allocator, decompressed_size,
+                                                         VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                                         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                         VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
+        memory_telemetry->track(decompression_buffer.allocation, AllocationCategory::Staging);
+    }
+}
+
+std::byte *UploadBatch::staging_data(VkDeviceSize offset) const {
+    return static_cast<std::byte *>(staging_buffer.allocation_info.pMappedData) + offset;
+}
+
+void UploadBatch::copy_to_buffer(VkDeviceSize staging_offset, VkBuffer destination, VkDeviceSize destination_offset,
+                                 VkDeviceSize size) {
+    BufferUpload upload = {};
+    upload.destination = destination;
+    upload.region.srcOffset = staging_offset;
+    upload.region.dstOffset = destination_offset;
+    upload.region.size = size;
+    buffer_uploads.push_back(upload);
+}
+
+void UploadBatch::copy_to_image(VkDeviceSize offset, VkImage destination, VkExtent3D extent, uint32_t mip_level,
+                                UploadSource source) {
+    ImageUpload upload = {};
+    upload.destination = destination;
+    upload.source = source;
+    upload.region.bufferOffset = offset;
+    upload.region.bufferRowLength = 0; // Tightly packed
+    upload.region.bufferImageHeight = 0;
+    upload.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    upload.region.imageSubresource.mipLevel = mip_level;
+    upload.region.imageSubresource.baseArrayLayer = 0;
+    upload.region.imageSubresource.layerCount = 1;
+    upload.region.imageExtent = extent;
+    image_uploads.push_back(upload);
+}
+
+VkDeviceSize UploadBatch::decompress(const GpuDecompressor &decompressor, VkDeviceSize staging_offset,
+                                     VkDeviceSize size) {
+    // Aligned for any block size an image copy out of it asks for, and the shader writes whole words
+    VkDeviceSize offset = (decompressed_size + 15) / 16 * 16;
+    decompressed_size = offset + (size + 3) / 4 * 4;
+    decompressions.push_back({&decompressor, staging_offset, offset, size});
+    return offset;
+}
+
+void UploadBatch::record(VkCommandBuffer command_buffer) {
+    // No-op on host-coherent memory
+    VK_CHECK(vmaFlushAllocation(allocator, staging_buffer.allocation, 0, VK_WHOLE_SIZE));
+
+    if (!decompressions.empty()) {
+        VmaAllocatorInfo allocator_info;
+        vmaGetAllocatorInfo(allocator, &allocator_info);
+        VkDeviceAddress staging_address = incan_util::get_buffer_device_address(allocator_info.device,
+                                                                                staging_buffer.buffer);
+        VkDeviceAddress decompressed_address = incan_util::get_buffer_device_address(allocator_info.device,
+                                                                                     decompression_buffer.buffer);
+        for (const Decompression &decompression: decompressions) {
+            decompression.decompressor->record(command_buffer, staging_address + decompression.staging_offset,
+                                               decompressed_address + decompression.decompressed_offset,
+                                               decompression.size);
+        }
+    }
+
+    // One transition barrier for every image instead of one call per image. Each barrier covers every mip, so an
+    // image with several levels uploaded still gets only one
+    std::vector<VkImageMemoryBarrier2> image_barriers;
+    image_barriers.reserve(image_uploads.size());
+    for (const ImageUpload &upload: image_uploads) {
+        if (std::ranges::find(image_barriers, upload.destination, &VkImageMemoryBarrier2::image) !=
+            image_barriers.end()) {
+            continue;
+        }
+        VkImageMemoryBarrier2 image_barrier = {};
+        image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        image_barrier.pNext = nullptr;
+        image_barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        image_barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        image_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        image_barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        image_barrier.subresourceRange = incan_struct_init::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+        image_barrier.image = upload.destination;
+        image_barriers.push_back(image_barrier);
+    }
+
+    // The copies out of the decompressed bytes wait on the shader that writes them
+    VkMemoryBarrier2 decompression_barrier = {};
+    decompression_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    decompression_barrier.pNext = nullptr;
+    decompression_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    decompression_barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    decompression_barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    decompression_barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+    VkDependencyInfo dependency_info = {};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.pNext = nullptr;
+    dependency_info.memoryBarrierCount = decompressions.empty() ? 0 : 1;
+    dependency_info.pMemoryBarriers = &decompression_barrier;
+    dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size());
+    dependency_info.pImageMemoryBarriers = image_barriers.data();
+
+    if (!image_barriers.empty() || !decompressions.empty()) {
+        vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+    }
+
+    // Regions going to the same buffer are handed over in one copy command
+    std::ranges::stable_sort(buffer_uploads, {}, [](const BufferUpload &upload) {
+        return upload.destination;
+    });
+    std::vector<VkBufferCopy> regions;
+    for (size_t first = 0; first < buffer_uploads.size();) {
+        size_t last = first;
+        regions.clear();
+        while (last < buffer_uploads.size() && buffer_uploads[last].destination == buffer_uploads[first].destination) {
+            regions.push_back(buffer_uploads[last].region);
+            last++;
+        }
+        vkCmdCopyBuffer(command_buffer, staging_buffer.buffer, buffer_uploads[first].destination,
+                        static_cast<uint32_t>(regions.size()), regions.data());
+        first = last;
+    }
+
+    for (const ImageUpload &upload: image_uploads) {
+        VkBuffer source_buffer = upload.source == UploadSource::Decompressed ? decompression_buffer.buffer
+                                                                             : staging_buffer.buffer;
+        vkCmdCopyBufferToImage(command_buffer, source_buffer, upload.destination,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &upload.region);
+    }
+
+    // Buffers are done after this, images are handed to the caller still being written by the copies
+    VkMemoryBarrier2 memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    memory_barrier.pNext = nullptr;
+    memory_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+    memory_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    memory_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+
+    dependency_info.imageMemoryBarrierCount = 0;
+    dependency_info.pImageMemoryBarriers = nullptr;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &memory_barrier;
+
+    vkCmdPipelineBarrier2KHR(command_buffer, &dependency_info);
+}
+
+void UploadBatch::destroy() {
+    if (staging_buffer.buffer != VK_NULL_HANDLE) {
+        memory_telemetry->untrack(staging_buffer.allocation);
+        incan_util::destroy_buffer(allocator, staging_buffer);
+    }
+    if (decompression_buffer.buffer != VK_NULL_HANDLE) {
+        memory_telemetry->untrack(decompression_buffer.allocation);
+        incan_util::destroy_buffer(allocator, decompression_buffer);
+    }
+    staging_buffer = {};
+    decompression_buffer = {};
+    reserved_size = 0;
+    decompressed_size = 0;
+    buffer_uploads.clear();
+    image_uploads.clear();
+    decompressions.clear();
+}
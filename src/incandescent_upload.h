@@ -0,0 +1,93 @@
+#ifndef INCANDESCENT_UPLOAD_H
+#define INCANDESCENT_UPLOAD_H
+
+#include <incandescent_types.h>
+#include <incandescent_memory.h>
+#include <incandescent_buffers.h>
+
+struct GpuDecompressor;
+
+// Where an image upload copies from
+enum class UploadSource {
+    Staging,
+    Decompressed // The batch's device local buffer the GPU decompresses into
+};
+
+/*
+ * Puts many buffer and image uploads behind one staging buffer. Space is reserved up front, the staging buffer is
+ * created once for the total, and record() issues every copy into a single command buffer, so a whole scene costs one
+ * staging allocation and one submit instead of one per resource. The staging memory can be filled from any thread as
+ * long as the ranges don't overlap, reserve() and the copy_to_* calls belong to one thread.
+ *
+ * Tiled LZ4 streams can be staged as they are and expanded on the GPU into a device local buffer of the batch's own,
+ * which images are then filled from like from the staging buffer.
+ */
+struct UploadBatch {
+    void initialize(VmaAllocator vma_allocator, MemoryTelemetry &telemetry);
+
+    // Returns the offset of the reserved range in the staging buffer
+    VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+    // Creates and maps a staging buffer big enough for everything reserved so far
+    void allocate_staging();
+
+    // Write pointer into the staging buffer, only valid after allocate_staging
+    std::byte *staging_data(VkDeviceSize offset) const;
+
+    void copy_to_buffer(VkDeviceSize staging_offset, VkBuffer destination, VkDeviceSize destination_offset,
+                        VkDeviceSize size);
+
+    // Fills one mip of a 2D color image from tightly packed texels (or blocks), extent is the size of that mip. offset
+    // is into the staging buffer, or into the decompressed bytes with UploadSource::Decompressed
+    void copy_to_image(VkDeviceSize offset, VkImage destination, VkExtent3D extent, uint32_t mip_level = 0,
+                       UploadSource source = UploadSource::Staging);
+
+    // Before allocate_staging: queues the expansion of the tiled LZ4 stream at staging_offset (4 byte aligned) into
+    // size bytes, returns where they start among the decompressed bytes. Runs first thing in record()
+    VkDeviceSize decompress(const GpuDecompressor &decompressor, VkDeviceSize staging_offset, VkDeviceSize size);
+
+    // Records every copy. Buffers are visible to all later commands, images are left in TRANSFER_DST_OPTIMAL so the
+    // caller can build their mips before moving them to their resting layout
+    void record(VkCommandBuffer command_buffer);
+
+    // Only once the submit holding the copies has finished
+    void destroy();
+
+    VkDeviceSize staged_bytes() const {
+        return reserved_size;
+    }
+
+private:
+    struct BufferUpload {
+        VkBuffer destination;
+        VkBufferCopy region;
+    };
+
+    struct ImageUpload {
+        VkImage destination;
+        VkBufferImageCopy region;
+        UploadSource source;
+    };
+
+    struct Decompression {
+        const GpuDecompressor *decompressor;
+        VkDeviceSize staging_offset;
+        VkDeviceSize decompressed_offset;
+        VkDeviceSize size;
+    };
+
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    MemoryTelemetry *memory_telemetry = nullptr;
+    AllocatedBuffer staging_buffer = {};
+    VkDeviceSize reserved_size = 0;
+    // Only created when something is decompressed on the GPU
+    AllocatedBuffer decompression_buffer = {};
+    VkDeviceSize decompressed_size = 0;
+
+    std::vector<BufferUpload> buffer_uploads;
+    std::vector<ImageUpload> image_uploads;
+    std::vector<Decompression> decompressions;
+};
+
+
+#endif //INCANDESCENT_UPLOAD_H
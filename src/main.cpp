@@ -1,8 +1,13 @@
 #include "incandescent_engine.h"
 
-int main() {
+int main(int argc, char *argv[]) {
     IncandescentEngine engine;
 
+    // Optional glTF/GLB/OBJ file to load at startup
+    if (argc > 1) {
+        engine.scene_path = argv[1];
+    }
+
     engine.initialize();
     engine.run();
     engine.cleanup();